@@ -132,6 +132,29 @@ public:
     /// Should rendering progress be written to standard output whilst
     /// rendering?
     const bool reportProgress;
+    /// Should the integrators skip sampling light sources directly?
+    const bool disableNextEventEstimation;
+    /// Should bounce directions be chosen uniformly, rather than in
+    /// proportion to the cosine of their angle to the surface normal?
+    const bool uniformHemisphereSampling;
+    /// Should the 'wavefront' integrator sort bounce rays by origin and
+    /// direction before tracing them?
+    const bool sortBounceRays;
+    /// Should shading go through the virtual tc::ShadeAPI and tc::Shader
+    /// interfaces, even for the built in scene?
+    const bool genericShading;
+    /// Should the 'stratified' integrator interpolate irradiance between
+    /// nearby diffuse points? With more than one thread the image can differ
+    /// slightly from run to run, use '--threadCount 1' to repeat a render
+    /// exactly.
+    const bool irradianceCache;
+    /// The largest error allowed by the irradiance cache.
+    const float irradianceCacheError;
+    /// The largest radius of an irradiance cache record, in scene units.
+    const float irradianceCacheRadius;
+    /// How far the 'ambientOcclusion' integrator looks for occluders, in
+    /// scene units.
+    const float ambientOcclusionDistance;
     const size_t qualityLevel;
     /// The number of samples to use when computing the final colour value of a
     /// pixel. When supersampling, the values are averaged to produce a good
@@ -153,12 +176,54 @@ public:
     const char* outputFilename;
     /// The filename of the scenee file to read from..
     const char* inputFilename;
+    /// If this is set, the input file is converted to a binary scene file
+    /// with this filename, instead of being rendered. Files ending in '.tbs'
+    /// are read as binary scene files.
+    const char* convertTo;
+    /// The name of the sample generator to use. One of 'random', 'halton' or
+    /// 'sobol'.
+    const char* sampler;
+    /// The name of the light transport algorithm to use. One of 'stratified',
+    /// 'path', 'wavefront', or one of the previews 'ambientOcclusion' or
+    /// 'direct'.
+    const char* integrator;
+    /// The ray depth at which the 'path' integrator starts to terminate paths
+    /// with Russian roulette.
+    const size_t russianRouletteDepth;
+    /// The memory in megabytes that the meshes of a binary scene file may
+    /// take while rendering. Meshes are loaded when a ray first reaches them,
+    /// and the least recently used are freed to stay within it. If this is
+    /// 0, every mesh is loaded up front.
+    const size_t memoryBudget;
+    /// The centre of the sphere of white light that lights the scene. By
+    /// default it surrounds the scene, like a sky.
+    const float lightX;
+    const float lightY;
+    const float lightZ;
+    /// The radius of the light sphere. A small sphere inside the scene lights
+    /// it like a bulb.
+    const float lightRadius;
+    /// The brightness of the light sphere.
+    const float lightIntensity;
 
     /// \brief Initialises the 'Args' class bry parsing argvh.
     inline Args(const int argc, const char* argv[])
         : runUnitTests(hasFlag("--runUnitTests", argc, argv)),
           render(hasFlag("--render", argc, argv)),
           reportProgress(hasFlag("--reportProgress", argc, argv)),
+          disableNextEventEstimation(
+              hasFlag("--disableNextEventEstimation", argc, argv)),
+          uniformHemisphereSampling(
+              hasFlag("--uniformHemisphereSampling", argc, argv)),
+          sortBounceRays(hasFlag("--sortBounceRays", argc, argv)),
+          genericShading(hasFlag("--genericShading", argc, argv)),
+          irradianceCache(hasFlag("--irradianceCache", argc, argv)),
+          irradianceCacheError(
+              getArgFloat("--irradianceCacheError", 0.3f, argc, argv)),
+          irradianceCacheRadius(
+              getArgFloat("--irradianceCacheRadius", 1.0f, argc, argv)),
+          ambientOcclusionDistance(
+              getArgFloat("--ambientOcclusionDistance", 1.0f, argc, argv)),
           qualityLevel(getArg("--qualityLevel", 1, argc, argv)),
           samplesPerPixel(getArg("--samplesPerPixel", 1, argc, argv)),
           maxRayDepth(getArg("--maxRayDepth", 2, argc, argv)),
@@ -168,7 +233,18 @@ public:
           width(getArg("--width", 256, argc, argv)),
           height(getArg("--height", 256, argc, argv)),
           outputFilename(getArg("--outputFilename", "out.png", argc, argv)),
-          inputFilename(getArg("--inputFilename", "in.lsd", argc, argv))
+          inputFilename(getArg("--inputFilename", "in.lsd", argc, argv)),
+          convertTo(getArg("--convertTo", "", argc, argv)),
+          sampler(getArg("--sampler", "sobol", argc, argv)),
+          integrator(getArg("--integrator", "stratified", argc, argv)),
+          russianRouletteDepth(
+              getArg("--russianRouletteDepth", (size_t)3, argc, argv)),
+          memoryBudget(getArg("--memoryBudget", (size_t)0, argc, argv)),
+          lightX(getArgFloat("--lightX", 0.0f, argc, argv)),
+          lightY(getArgFloat("--lightY", 0.0f, argc, argv)),
+          lightZ(getArgFloat("--lightZ", 0.0f, argc, argv)),
+          lightRadius(getArgFloat("--lightRadius", 20.0f, argc, argv)),
+          lightIntensity(getArgFloat("--lightIntensity", 40.0f, argc, argv))
     {
     }
 };
@@ -0,0 +1,266 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_BINITERATOR
+#define TC_BINITERATOR
+//------------------------------------------------------------------------------
+#include "trace/bounds.h"
+#include "trace/int.h"
+#include "trace/objectiterator.h"
+#include "trace/triangleIterator.h"
+//------------------------------------------------------------------------------
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace tc
+{
+class LogContext;
+
+//------------------------------------------------------------------------------
+// Bin_Header
+//------------------------------------------------------------------------------
+/// \brief The start of a binary scene file.
+///
+/// A binary scene file holds the same hierarchy of transforms and poly meshes
+/// as an lsd file, with the vertices and triangles of each mesh stored as the
+/// flat arrays tc::SimplePolyMesh keeps in memory. It is read by mapping it
+/// into memory, so nothing is parsed, and the arrays are copied straight into
+/// the scene. A mesh can also carry the acceleration structure that was built
+/// for it, so the tree doesn't need to be sorted again.
+///
+/// The file is laid out as:
+/// - This header.
+/// - m_nodeCount tc::Bin_Node records, in depth first order.
+/// - The names of the nodes, each null terminated.
+/// - The vertices, triangles and acceleration structure of each mesh, each
+/// array starting on a kAlignment byte boundary.
+///
+/// All offsets are in bytes from the start of the file. Numbers are stored
+/// in the byte order of the machine that wrote the file, and files written by
+/// a machine with a different byte order, or by a different version, are
+/// rejected.
+//------------------------------------------------------------------------------
+class Bin_Header
+{
+public:
+    enum
+    {
+        kVersion = 1,
+        kByteOrder = 0x01020304,
+        kAlignment = 16
+    };
+
+    /// \brief "tcscene" and a null.
+    char m_magic[8];
+    uint32_t m_version;
+    uint32_t m_byteOrder;
+    uint64_t m_fileSize;
+    uint64_t m_nodeCount;
+    uint64_t m_nodeOffset;
+    uint64_t m_nameOffset;
+    uint64_t m_nameSize;
+};
+
+//------------------------------------------------------------------------------
+// Bin_Node
+//------------------------------------------------------------------------------
+/// \brief A transform or poly mesh in a binary scene file. The nodes are
+/// stored depth first, so the children of a node follow it, up to m_end.
+//------------------------------------------------------------------------------
+class Bin_Node
+{
+public:
+    enum
+    {
+        kXform = 0,
+        kPolyMesh = 1,
+        kNoParent = 0xffffffff
+    };
+
+    uint32_t m_type;
+    /// \brief The index of the parent node, or kNoParent.
+    uint32_t m_parent;
+    /// \brief The index after the last node below this one.
+    uint64_t m_end;
+    /// \brief From the start of the names.
+    uint64_t m_nameOffset;
+    /// \brief The bounds of the triangles of a mesh, or of all the meshes
+    /// below a transform.
+    float m_min[3];
+    float m_max[3];
+    uint64_t m_vertexOffset;
+    uint64_t m_vertexCount;
+    uint64_t m_indexOffset;
+    uint64_t m_triangleCount;
+    /// \brief 0 if there is no acceleration structure.
+    uint64_t m_accelerationOffset;
+    uint64_t m_accelerationSize;
+};
+
+//------------------------------------------------------------------------------
+// Bin_Writer
+//------------------------------------------------------------------------------
+/// \brief Writes a binary scene file. See tc::Bin_Header.
+/// \snippet test_biniterator.cpp test_biniterator roundTrip
+//------------------------------------------------------------------------------
+class Bin_Writer
+{
+public:
+    Bin_Writer();
+
+    /// \brief Adds a transform.
+    /// \param parent The index of the parent transform, or
+    /// tc::Bin_Node::kNoParent.
+    /// \return The index of the new node.
+    size_t addXform(const char* name, const size_t parent);
+
+    /// \brief Adds a poly mesh. The arrays of 'mesh' aren't copied, so must
+    /// stay valid until tc::Bin_Writer::write is called.
+    /// \param parent The index of the parent transform, or
+    /// tc::Bin_Node::kNoParent.
+    /// \return The index of the new node.
+    size_t addPolyMesh(const char* name, const size_t parent,
+                       const ObjectIterator_Mesh& mesh);
+
+    /// \brief Writes every node added so far to 'filename'.
+    /// \return false if the file couldn't be written.
+    bool write(const char* filename) const;
+
+private:
+    class Node
+    {
+    public:
+        std::string m_name;
+        size_t m_parent;
+        bool m_isPolyMesh;
+        ObjectIterator_Mesh m_mesh;
+    };
+
+    /// \brief Appends 'node' and the nodes below it to 'order', depth first,
+    /// and sets the end of each in 'ends'.
+    void addDepthFirst(const size_t node,
+                       const std::vector<std::vector<size_t> >& children,
+                       std::vector<size_t>& order,
+                       std::vector<size_t>& ends) const;
+
+    std::vector<Node> m_nodes;
+};
+
+//------------------------------------------------------------------------------
+// Bin_TriangleIterator
+//------------------------------------------------------------------------------
+/// \brief Iterates over the triangles of a poly mesh in a binary scene file.
+//------------------------------------------------------------------------------
+class Bin_TriangleIterator : public TriangleIterator
+{
+public:
+    Bin_TriangleIterator();
+
+    /// \brief Specifies the arrays to iterate over.
+    void setMesh(const ObjectIterator_Mesh& mesh);
+
+    /// \brief Prep the iterator for iteration.
+    virtual void begin();
+
+    /// \brief Move onto the next triangle.
+    virtual bool next();
+
+    /// \brief Dereferencing a tc::TriangleIterator gives us a triangle.
+    virtual Triangle operator*() const;
+
+    /// \return The number of triangles left.
+    virtual size_t sizeHint() const;
+
+    /// \brief Copies the corners of the next triangles from the arrays.
+    virtual size_t nextBatch(Vector3<float>* corners, const size_t capacity);
+
+private:
+    ObjectIterator_Mesh m_mesh;
+    size_t m_next;
+};
+
+//------------------------------------------------------------------------------
+// Bin_ObjectIterator
+//------------------------------------------------------------------------------
+/// \brief Reads a binary scene file from disk. The nodes are visited in the
+/// same way as an lsd file; the children of a transform are only visited if
+/// tc::Bin_ObjectIterator::recurseIntoChildren is called for it.
+//------------------------------------------------------------------------------
+class Bin_ObjectIterator : public ObjectIterator
+{
+public:
+    Bin_ObjectIterator();
+    virtual ~Bin_ObjectIterator();
+
+    /// \brief Specifies the full path of the file to iterate over.
+    void setFilename(const char* filename);
+
+    /// \brief Maps the file into memory. A file that can't be read, or that
+    /// was written by another version, has no nodes.
+    virtual void begin();
+    /// \brief Notify the iterator that we have finished iterating. This
+    /// unmaps the file.
+    virtual void end();
+    /// \brief Move onto the next node.
+    virtual bool next();
+
+    /// \brief By default, we do not recurse down into child objects, this must
+    /// be called each time we want to step down into the children of a node.
+    virtual void recurseIntoChildren(bool yesNo);
+
+    /// \return The bounds of the current node.
+    virtual const BoundsF& getBounds() const;
+
+    /// \return true if the current node is a poly mesh with triangles.
+    virtual bool hasTriangles() const;
+
+    /// \return Returns a TriangleIterator, for looping over all the triangles
+    /// in the current node.
+    virtual TriangleIterator& getTriangles();
+
+    /// \brief Gives the arrays of the current node, straight from the mapped
+    /// file.
+    virtual bool getMesh(ObjectIterator_Mesh& mesh) const;
+
+    /// \brief The index of the current node, which can be given to
+    /// tc::Bin_ObjectIterator::loadMesh.
+    virtual bool getProxy(size_t& proxy) const;
+
+    /// \brief Gives the arrays of any node, straight from the mapped file.
+    virtual bool loadMesh(const size_t proxy, ObjectIterator_Mesh& mesh) const;
+
+    /// \return The name of the current node.
+    const char* getName() const;
+
+private:
+    /// \return The current node.
+    const Bin_Node& getNode() const;
+
+    /// \return true if 'node' is a poly mesh with triangles.
+    static bool hasTriangles(const Bin_Node& node);
+
+    std::string m_filename;
+    void* m_mapped;
+    size_t m_mappedSize;
+    const Bin_Node* m_nodes;
+    size_t m_nodeCount;
+    const char* m_names;
+
+    // The current node, and the one after it. The current node is
+    // m_nodeCount before the first call to next.
+    size_t m_current;
+    size_t m_next;
+    std::vector<BoundsF> m_bounds;
+    Bin_TriangleIterator m_triangleIterator;
+    TriangleIterator m_stubTriangleIterator;
+};
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'biniterator' header file.
+/// \cond
+void biniteratorRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
+}  // namespace tc
+#endif  // TC_BINITERATOR
@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_EMITTER
+#define TC_EMITTER
+//------------------------------------------------------------------------------
+#include "trace/geoid.h"
+#include "trace/vector.h"
+//------------------------------------------------------------------------------
+#include <cstdlib>
+//------------------------------------------------------------------------------
+
+namespace tc
+{
+class LogContext;
+
+//------------------------------------------------------------------------------
+// EmitterSample
+//------------------------------------------------------------------------------
+/// \brief A point chosen on the surface of a tc::Emitter, as seen from a
+/// point in the scene.
+//------------------------------------------------------------------------------
+class EmitterSample
+{
+public:
+    /// \brief The normalized direction from the receiving point to the
+    /// emitter.
+    const Vector3<float> m_direction;
+    /// \brief The distance from the receiving point to the emitter.
+    const float m_distance;
+    /// \brief The probability density of having chosen m_direction, with
+    /// respect to solid angle.
+    const float m_pdf;
+    /// \brief The geometry the chosen point lies on, as it would be reported
+    /// by tc::GeoAPI::geo_trace.
+    const GeoID m_geoId;
+
+    EmitterSample(const Vector3<float>& direction, const float distance,
+                  const float pdf, const GeoID& geoId)
+        : m_direction(direction),
+          m_distance(distance),
+          m_pdf(pdf),
+          m_geoId(geoId)
+    {
+    }
+};
+
+//------------------------------------------------------------------------------
+// Emitter
+//------------------------------------------------------------------------------
+/// \brief An abstract interface for geometry which emits light and can be
+/// sampled directly.
+///
+/// Emitters are registered with the renderer through
+/// tc::ShadeAPI::shade_getEmitter. The integrator uses them to fire shadow
+/// rays straight at light sources, rather than waiting for bounce rays to hit
+/// them by chance. The radiance of an emitter still comes from its surface
+/// tc::Shader.
+//------------------------------------------------------------------------------
+class Emitter
+{
+public:
+    virtual ~Emitter();
+
+    /// \return The solid angle the emitter covers, as seen from 'position'.
+    /// This is 4 pi from inside the emitter.
+    virtual float computeSolidAngle(const Vector3<float>& position) const = 0;
+
+    /// \brief Chooses a point on the emitter.
+    /// \param position The point receiving light.
+    /// \param sample Two values in the range [0, 1) used to pick the point.
+    /// \return The direction, distance and pdf of the chosen point.
+    virtual EmitterSample sample(const Vector3<float>& position,
+                                 const Vector3<float>& sample) const = 0;
+
+    /// \return The probability density, with respect to solid angle, that
+    /// tc::Emitter::sample chooses the point 'distance' along 'direction' from
+    /// 'position'.
+    virtual float pdf(const Vector3<float>& position,
+                      const Vector3<float>& direction,
+                      const float distance) const = 0;
+
+    /// \return true if geoID refers to geometry belonging to this emitter.
+    virtual bool contains(const GeoID& geoID) const = 0;
+};
+
+//------------------------------------------------------------------------------
+// SphereEmitter
+//------------------------------------------------------------------------------
+/// \brief A spherical emitter, sampled uniformly over the cone of directions
+/// in which it can be seen, or over every direction from inside it.
+//------------------------------------------------------------------------------
+class SphereEmitter : public Emitter
+{
+public:
+    /// \brief Initializes a SphereEmitter.
+    /// \param position The centre of the sphere.
+    /// \param radius The radius of the sphere.
+    /// \param objectIndex The GeoID::m_objectIndex the sphere is reported as
+    /// by tc::GeoAPI::geo_trace.
+    SphereEmitter(const Vector3<float>& position, const float radius,
+                  const size_t objectIndex);
+
+    virtual float computeSolidAngle(const Vector3<float>& position) const;
+
+    virtual EmitterSample sample(const Vector3<float>& position,
+                                 const Vector3<float>& sample) const;
+
+    virtual float pdf(const Vector3<float>& position,
+                      const Vector3<float>& direction,
+                      const float distance) const;
+
+    virtual bool contains(const GeoID& geoID) const;
+
+private:
+    /// \return One minus the cosine of the half angle of the cone of
+    /// directions that hit the sphere, from a point 'distance' from its
+    /// centre. This is 2 from inside the sphere.
+    float computeConeSize(const float distance) const;
+
+    /// \return The solid angle pdf of a direction chosen uniformly within a
+    /// cone of the given size.
+    float computePdf(const float coneSize) const;
+
+    const Vector3<float> m_position;
+    const float m_radius;
+    const size_t m_objectIndex;
+};
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'emitter' header file.
+/// \cond
+void emitterRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
+}  // namespace tc
+#endif  // TC_EMITTER
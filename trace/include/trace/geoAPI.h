@@ -4,6 +4,8 @@
 #ifndef TC_GEOAPI
 #define TC_GEOAPI
 //------------------------------------------------------------------------------
+#include "trace/raypacket.h"
+#include "trace/raystream.h"
 #include "trace/traceResult.h"
 //------------------------------------------------------------------------------
 
@@ -53,6 +55,63 @@ public:
                                                              // generic
                                                              // userData.
                                   const Ray& ray) const = 0;
+
+    /// Optional. Finds the nearest intersection for every ray in a packet.
+    /// Scenes can override this to trace coherent rays, such as camera rays,
+    /// together. By default each ray is traced on its own with geo_trace.
+    /// \param searchCache See tc::GeoAPI::geo_trace.
+    /// \param packet The rays to test for intersections. Only the lanes set
+    /// in tc::RayPacket::getMask are traced.
+    /// \return The tc::TraceResult for each lane of the packet.
+    virtual RayPacket_TraceResult geo_tracePacket(
+        SearchCache& searchCache, const RayPacket& packet) const
+    {
+        RayPacket_TraceResult result;
+        for (size_t lane = 0; lane != RayPacket::kSize; ++lane)
+        {
+            if (packet.getMask() & (1 << lane))
+            {
+                result.setTraceResult(
+                    lane, geo_trace(searchCache, packet.getRay(lane)));
+            }
+        }
+        return result;
+    }
+
+    /// Optional. Finds the nearest intersection for every ray in a stream.
+    /// Scenes can override this to trace large numbers of unrelated rays,
+    /// such as bounce rays, together. By default each ray is traced on its own
+    /// with geo_trace.
+    /// \param searchCache See tc::GeoAPI::geo_trace.
+    /// \param stream The rays to test for intersections.
+    /// \param result Reset to hold the tc::TraceResult for every ray in the
+    /// stream.
+    virtual void geo_traceStream(SearchCache& searchCache,
+                                 const RayStream& stream,
+                                 RayStream_TraceResult& result) const
+    {
+        result.reset(stream.size());
+        for (size_t i = 0; i != stream.size(); ++i)
+        {
+            result.setTraceResult(i,
+                                  geo_trace(searchCache, stream.getRay(i)));
+        }
+    }
+
+    /// Optional. Tests whether anything in the scene lies along a ray,
+    /// closer than maxDistance. This is all shadow and occlusion rays need to
+    /// know, so scenes can override it to stop searching at the first hit. By
+    /// default the nearest hit is found with geo_trace.
+    /// \param searchCache See tc::GeoAPI::geo_trace.
+    /// \param ray The ray to test for intersections.
+    /// \param maxDistance Intersections at or beyond this distance along the
+    /// ray are ignored.
+    /// \return true if the ray is blocked.
+    virtual bool geo_occluded(SearchCache& searchCache, const Ray& ray,
+                              const float maxDistance) const
+    {
+        return geo_trace(searchCache, ray).m_distanceAlongRay < maxDistance;
+    }
 };
 
 }  // namespace tc
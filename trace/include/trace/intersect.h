@@ -13,6 +13,7 @@
 namespace tc
 {
 class Ray;
+class RayPacket;
 class Triangle;
 
 //------------------------------------------------------------------------------
@@ -138,6 +139,46 @@ bool intersect_triangle(float& resultDelta, const Ray& ray,
 bool intersect_bounds(const Ray& ray, const BoundsF& bounds,
                       const float epsilon = 0.001f);
 
+//------------------------------------------------------------------------------
+// intersect_segment_bounds
+//------------------------------------------------------------------------------
+/// \brief The same as intersect_bounds, for the part of the ray closer than
+/// maxDistance.
+///
+/// \param ray A ray to intersect with the bounding box.
+/// \param maxDistance How far along the ray the segment reaches.
+/// \param bounds A bounding box to intersect with the given segment.
+///
+/// \return true if the segment intersects the given bounding box, false if
+/// not.
+///
+/// <b>Example</b>
+/// \snippet test_intersect.cpp test_intersect segmentBoundingBox
+//------------------------------------------------------------------------------
+bool intersect_segment_bounds(const Ray& ray, const float maxDistance,
+                              const BoundsF& bounds,
+                              const float epsilon = 0.001f);
+
+//------------------------------------------------------------------------------
+// intersect_bounds
+//------------------------------------------------------------------------------
+/// \brief Computes whether each ray in a packet intersects the given bounding
+/// box. All four rays are tested at once.
+///
+/// \param packet The rays to intersect with the bounding box.
+/// \param bounds A bounding box to intersect with the given rays.
+/// \param mask Only the lanes whose bit is set are tested.
+///
+/// \return A bit for each lane in mask whose ray intersects the bounding box.
+/// The result for each lane is exactly the result the single ray version
+/// gives for that ray.
+///
+/// <b>Example</b>
+/// \snippet test_intersect.cpp test_intersect boundingBoxPacket
+//------------------------------------------------------------------------------
+int intersect_bounds(const RayPacket& packet, const BoundsF& bounds,
+                     const int mask, const float epsilon = 0.001f);
+
 //------------------------------------------------------------------------------
 // Runs all the unit tests for the 'constvector' header file.
 /// \cond
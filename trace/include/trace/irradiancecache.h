@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_IRRADIANCECACHE
+#define TC_IRRADIANCECACHE
+//------------------------------------------------------------------------------
+#include "trace/sampledspectrum.h"
+#include "trace/vector.h"
+//------------------------------------------------------------------------------
+#include <cstdlib>
+
+namespace tc
+{
+class LogContext;
+
+//------------------------------------------------------------------------------
+// IrradianceCache_Record
+//------------------------------------------------------------------------------
+/// \brief A single irradiance estimate, stored in a tc::IrradianceCache.
+//------------------------------------------------------------------------------
+class IrradianceCache_Record
+{
+public:
+    /// \brief Initializes a record with no irradiance.
+    inline IrradianceCache_Record();
+
+    /// The point the estimate was made for.
+    Vector3<float> m_position;
+    /// The surface normal at m_position.
+    Vector3<float> m_normal;
+    /// The harmonic mean of the distances to the points seen from
+    /// m_position. Irradiance changes quickly near other surfaces, so this
+    /// sets how far away the record can be used.
+    float m_radius;
+    /// How many rays deep m_position was. Deeper points are estimated with
+    /// fewer bounces, so records are only used at the depth they were made.
+    size_t m_depth;
+    /// The irradiance at m_position.
+    SampledSpectrum m_irradiance;
+    /// How the irradiance changes as the normal is rotated away from
+    /// m_normal, one gradient for each wavelength.
+    Vector3<float> m_rotationGradient[TC_SAMPLED_SPECTRUM_SAMPLE_COUNT];
+};
+
+//------------------------------------------------------------------------------
+inline IrradianceCache_Record::IrradianceCache_Record()
+    : m_position(0.0f),
+      m_normal(0.0f, 0.0f, 1.0f),
+      m_radius(0.0f),
+      m_depth(0),
+      m_irradiance(0.0f)
+{
+    for (size_t i = 0; i != TC_SAMPLED_SPECTRUM_SAMPLE_COUNT; ++i)
+    {
+        m_rotationGradient[i] = Vector3<float>(0.0f);
+    }
+}
+
+//------------------------------------------------------------------------------
+// IrradianceCache
+//------------------------------------------------------------------------------
+/// \brief Irradiance estimates for diffuse surfaces, shared by every render
+/// thread, following Ward's "A Ray Tracing Solution for Diffuse
+/// Interreflection".
+///
+/// Estimating the irradiance at a point takes a full hemisphere of rays, but
+/// on a flat wall away from other surfaces it barely changes from one point
+/// to the next. Once a point has been estimated it is stored as a
+/// tc::IrradianceCache_Record, and points close enough to it, with a similar
+/// normal, use a weighted average of the stored records instead of firing
+/// their own rays.
+///
+/// The weight of record i for the point P with normal N is
+/// 1 / (|P - Pi| / Ri + sqrt(1 - N.Ni)). Records are only used when their
+/// weight is above 1 / maxError. Each record is corrected for the difference
+/// in normal by its rotation gradient.
+///
+/// Records are kept in a hashed grid whose cells are as big as the largest
+/// area a record can be used over, so a record is in at most eight cells and
+/// a lookup only has to search one. Each cell is a linked list that records
+/// are pushed onto with a compare and swap, so any number of threads can
+/// insert and look up at once without locking. Records are never removed.
+/// Which records a lookup sees depends on how far the other threads have
+/// got, so a render on more than one thread isn't exactly repeatable.
+/// \snippet test_irradiancecache.cpp test_irradiancecache lookup
+//------------------------------------------------------------------------------
+class IrradianceCache
+{
+public:
+    /// \brief Initializes an empty tc::IrradianceCache.
+    /// \param maxError The largest error allowed when interpolating, Ward's
+    /// 'a'. Smaller values mean more records and more rays.
+    /// \param maxRadius The largest record radius. Records which see nothing
+    /// nearby are clamped to this, and it sets the size of the grid cells.
+    /// The smallest radius is a twentieth of this.
+    IrradianceCache(const float maxError, const float maxRadius);
+
+    ~IrradianceCache();
+
+    /// \brief Adds a copy of 'record' to the cache, with its radius clamped.
+    /// This is safe to call from any number of threads at once, and while
+    /// other threads call lookup.
+    void insert(const IrradianceCache_Record& record);
+
+    /// \brief Interpolates the irradiance at 'position' from the records
+    /// made at 'depth'.
+    /// \return false if no record was close enough, in which case the
+    /// irradiance has to be estimated.
+    bool lookup(const Vector3<float>& position, const Vector3<float>& normal,
+                const size_t depth, SampledSpectrum& irradiance) const;
+
+    /// \return The number of records in the cache.
+    size_t size() const;
+
+    /// \return Ward's weight for 'record' at 'position' with 'normal'.
+    static float computeWeight(const IrradianceCache_Record& record,
+                               const Vector3<float>& position,
+                               const Vector3<float>& normal);
+
+private:
+    // Not copyable, the cache owns its records.
+    IrradianceCache(const IrradianceCache&);
+    IrradianceCache& operator=(const IrradianceCache&);
+
+    // A record in the linked list of a cell. A record that covers several
+    // cells has a node in each.
+    class Node
+    {
+    public:
+        const IrradianceCache_Record* m_record;
+        Node* m_next;
+    };
+
+    /// \return The bucket for the cell at the given grid coordinates.
+    size_t computeBucket(const long x, const long y, const long z) const;
+
+    /// \return The grid coordinate of 'value' along one axis.
+    long computeCell(const float value) const;
+
+    /// \brief Pushes 'node' onto the front of 'head', without locking.
+    static void push(Node*& head, Node* node);
+
+    const float m_maxError;
+    const float m_minRadius;
+    const float m_maxRadius;
+    const float m_cellSize;
+
+    Node** m_buckets;
+    // Every record, so they can be deleted without searching the buckets.
+    Node* m_records;
+    size_t m_size;
+};
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'irradiancecache' header file.
+/// \cond
+void irradiancecacheRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
+}  // namespace tc
+#endif  // TC_IRRADIANCECACHE
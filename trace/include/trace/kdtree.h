@@ -7,8 +7,11 @@
 #include "trace/assert.h"
 #include "trace/bounds.h"
 #include "trace/constvector.h"
+#include "trace/raypacket.h"
+#include "trace/raystream.h"
 #include "trace/vector.h"
 //------------------------------------------------------------------------------
+#include <cfloat>
 #include <cstdlib>
 #include <vector>
 
@@ -124,6 +127,56 @@ private:
 };
 /// \endcond
 
+//------------------------------------------------------------------------------
+// KDTree_SearchCache_PacketStackFrame
+//------------------------------------------------------------------------------
+/// \cond
+class KDTree_SearchCache_PacketStackFrame
+{
+    friend class KDTree;
+
+private:
+    const size_t m_nodeIndex;
+    const BoundsF m_bounds;
+    /// The lanes of the packet which intersect m_bounds.
+    const int m_mask;
+
+    KDTree_SearchCache_PacketStackFrame(const size_t nodeIndex,
+                                        const BoundsF& bounds, const int mask)
+        : m_nodeIndex(nodeIndex), m_bounds(bounds), m_mask(mask)
+    {
+        assert(bounds.m_min != bounds.m_max);
+    }
+};
+/// \endcond
+
+//------------------------------------------------------------------------------
+// KDTree_SearchCache_StreamStackFrame
+//------------------------------------------------------------------------------
+/// \cond
+class KDTree_SearchCache_StreamStackFrame
+{
+    friend class KDTree;
+
+private:
+    const size_t m_nodeIndex;
+    const BoundsF m_bounds;
+    /// The rays of the stream which intersect m_bounds are stored in
+    /// KDTree_SearchCache::m_streamRays, from m_begin up to m_end.
+    const size_t m_begin;
+    const size_t m_end;
+
+    KDTree_SearchCache_StreamStackFrame(const size_t nodeIndex,
+                                        const BoundsF& bounds,
+                                        const size_t begin, const size_t end)
+        : m_nodeIndex(nodeIndex), m_bounds(bounds), m_begin(begin), m_end(end)
+    {
+        assert(bounds.m_min != bounds.m_max);
+        assert(begin < end);
+    }
+};
+/// \endcond
+
 //------------------------------------------------------------------------------
 // KDTree_SearchCache
 //------------------------------------------------------------------------------
@@ -142,13 +195,33 @@ private:
 
 private:
     typedef ConstVector<KDTree_SearchCache_StackFrame> Stack;
+    typedef ConstVector<KDTree_SearchCache_PacketStackFrame> PacketStack;
+    typedef ConstVector<KDTree_SearchCache_StreamStackFrame> StreamStack;
     Stack m_stack;
+    PacketStack m_packetStack;
+    StreamStack m_streamStack;
+
+    // The rays of each frame in m_streamStack, stored one after the other in
+    // the same order as the frames.
+    std::vector<size_t> m_streamRays;
+    // Where the rays of the children of a node are sorted, before they are
+    // moved to m_streamRays.
+    std::vector<size_t> m_streamChildRays[3];
+    // Whether each ray of the stream is still looking for an intersection.
+    std::vector<char> m_streamActive;
 };
 
 //------------------------------------------------------------------------------
 void KDTree_SearchCache::clear()
 {
     m_stack.clear();
+    m_packetStack.clear();
+    m_streamStack.clear();
+    m_streamRays.clear();
+    for (size_t i = 0; i != 3; ++i)
+    {
+        m_streamChildRays[i].clear();
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -166,6 +239,40 @@ public:
     }
 };
 
+//------------------------------------------------------------------------------
+class KDTree_PacketTraceResult
+{
+public:
+    /// \brief How far along each ray the element was hit, FLT_MAX for rays
+    /// that didn't hit anything.
+    float m_distanceAlongRay[RayPacket::kSize];
+    /// \brief The element that each ray hit.
+    size_t m_elementIndex[RayPacket::kSize];
+
+    inline KDTree_PacketTraceResult();
+};
+
+//------------------------------------------------------------------------------
+KDTree_PacketTraceResult::KDTree_PacketTraceResult()
+{
+    for (size_t i = 0; i != RayPacket::kSize; ++i)
+    {
+        m_distanceAlongRay[i] = FLT_MAX;
+        m_elementIndex[i] = 0;
+    }
+}
+
+//------------------------------------------------------------------------------
+class KDTree_StreamTraceResult
+{
+public:
+    /// \brief How far along each ray the element was hit, FLT_MAX for rays
+    /// that didn't hit anything.
+    std::vector<float> m_distanceAlongRay;
+    /// \brief The element that each ray hit.
+    std::vector<size_t> m_elementIndex;
+};
+
 //------------------------------------------------------------------------------
 // KDTree_PrimitiveIntersect
 //------------------------------------------------------------------------------
@@ -232,6 +339,61 @@ public:
     KDTree_TraceResult findEntries(
         KDTree_SearchCache& searchCache, const Ray& ray,
         const KDTree_PrimitiveIntersect& primtiveTest) const;
+
+    /// \brief Searches for the nearest intersection of every ray in a packet.
+    ///
+    /// The rays walk the tree together, testing the bounds of each node
+    /// against the whole packet at once. Rays drop out of the packet as they
+    /// find their intersection. If the rays disagree on which child of a node
+    /// to visit first, the rays still searching are traced on their own.
+    /// Either way each ray gets exactly the result tc::KDTree::findEntries
+    /// would give it.
+    /// \param searchCache[out]: Temporary memory needed when searching the
+    /// KDTree.
+    /// \param packet[in]: The rays that will be tested for intersections.
+    /// \param primitiveTest[in]: The actual primitive intersection test.
+    /// \usage This method is thread safe but there must be one
+    /// tc::KDTree_SearchCache instance per thread accessing the KDTree.
+    KDTree_PacketTraceResult findEntries(
+        KDTree_SearchCache& searchCache, const RayPacket& packet,
+        const KDTree_PrimitiveIntersect& primtiveTest) const;
+
+    /// \brief Searches for the nearest intersection of every ray in a stream.
+    ///
+    /// Each node of the tree is visited once for all the rays that reach it,
+    /// rather than once per ray. The rays that reach a node are filtered
+    /// against the bounds of its children four at a time. Every ray still
+    /// visits the nodes in the order tc::KDTree::findEntries would visit them,
+    /// and so gets exactly the same result.
+    /// \param searchCache[out]: Temporary memory needed when searching the
+    /// KDTree.
+    /// \param stream[in]: The rays that will be tested for intersections.
+    /// \param primitiveTest[in]: The actual primitive intersection test.
+    /// \param result[out]: Resized to hold the result for every ray in the
+    /// stream.
+    /// \usage This method is thread safe but there must be one
+    /// tc::KDTree_SearchCache instance per thread accessing the KDTree.
+    void findEntries(KDTree_SearchCache& searchCache, const RayStream& stream,
+                     const KDTree_PrimitiveIntersect& primtiveTest,
+                     KDTree_StreamTraceResult& result) const;
+
+    /// \brief Tests whether any primitive in this tree intersects the given
+    /// ray closer than maxDistance.
+    ///
+    /// Unlike tc::KDTree::findEntries the nearest intersection isn't needed,
+    /// so the search stops at the first primitive that is hit. This is the
+    /// query for shadow and occlusion rays.
+    /// \param searchCache[out]: Temporary memory needed when searching the
+    /// KDTree.
+    /// \param ray[in]: The ray that will be tested for intersections.
+    /// \param maxDistance[in]: Intersections at or beyond this distance along
+    /// the ray are ignored.
+    /// \param primitiveTest[in]: The actual primitive intersection test.
+    /// \usage This method is thread safe but there must be one
+    /// tc::KDTree_SearchCache instance per thread accessing the KDTree.
+    bool findAnyEntry(KDTree_SearchCache& searchCache, const Ray& ray,
+                      const float maxDistance,
+                      const KDTree_PrimitiveIntersect& primtiveTest) const;
     /// \}
 
     /// \name Building the Tree
@@ -248,10 +410,42 @@ public:
     /// \usage This method is not thread safe.
     void addEntry(const BoundsF& bounds, const KDTree_PrimitiveId primitiveId);
 
+    /// \brief Makes room for 'entryCount' entries, so they can be added
+    /// without the entries being copied as they grow.
+    /// \usage This method is not thread safe.
+    void reserve(const size_t entryCount);
+
     /// \brief Organises all primitive entries added with tc::KDTree::addEntry
     /// into a tree structure, for efficient ray intersection testing.
     /// \usage This method is not thread safe.
     void sortTree();
+
+    /// \return true once the tree has been made, by tc::KDTree::sortTree or
+    /// tc::KDTree::deserialize.
+    bool isSorted() const;
+
+    /// \return The number of bytes of memory used by the entries and nodes of
+    /// the tree.
+    size_t getMemorySize() const;
+    /// \}
+
+    /// \name Saving the Tree
+    /// \{
+
+    /// \brief Appends the sorted tree to 'buffer', so that it can be loaded
+    /// by tc::KDTree::deserialize without sorting it again. The nodes and
+    /// entries are copied as they are laid out in memory, so the data can
+    /// only be read by the same build of the library.
+    void serialize(std::vector<char>& buffer) const;
+
+    /// \brief Replaces the contents of this tree with a tree written by
+    /// tc::KDTree::serialize.
+    /// \param primitiveCount The number of primitives the tree was made from.
+    /// \return false, leaving the tree empty, if 'data' doesn't hold exactly
+    /// one tree of this version, or the tree refers to a primitive, entry or
+    /// node that doesn't exist.
+    bool deserialize(const char* data, const size_t size,
+                     const size_t primitiveCount);
     /// \}
 
     /// \brief Converts this tc::KDTree instance into a human readable string,
@@ -268,6 +462,19 @@ public:
 private:
     typedef std::vector<KDTree_Entry> Entries;
 
+    /// \brief Tests a ray against the primitives of a leaf node.
+    /// \return true if the ray hits one of them within the bounds of the
+    /// node, in which case the nearest hit is stored in distanceAlongRay and
+    /// primitiveIndex.
+    bool intersectLeaf(const size_t nodeIndex, const BoundsF& nodeBounds,
+                       const Ray& ray,
+                       const KDTree_PrimitiveIntersect& primitiveTest,
+                       float& distanceAlongRay, size_t& primitiveIndex) const;
+
+    /// \return true if every primitive id is less than 'primitiveCount', and
+    /// every node and entry the nodes refer to exists.
+    bool isValid(const size_t primitiveCount) const;
+
     BoundsBuilderF m_boundsBuilder;
     Entries m_entries;
     KDTree_Nodes m_nodes;
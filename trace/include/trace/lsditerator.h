@@ -8,9 +8,14 @@
 #include "trace/bounds.h"
 #include "trace/objectiterator.h"
 #include "trace/triangleIterator.h"
+//------------------------------------------------------------------------------
+#include <map>
+#include <string>
 
 namespace tc
 {
+class lsdObjectIterator_Mesh;
+class lsdObjectIterator_Stream;
 
 //------------------------------------------------------------------------------
 // lsdTriangleIterator
@@ -24,7 +29,8 @@ public:
 
     /// \brief Prep the iterator for iteration.
     virtual void begin();
-    /// \brief Notify the iterator that we have finished iterating.
+    /// \brief Notify the iterator that we have finished iterating. This frees
+    /// the parsed file.
     virtual void end();
     /// \brief Move onto the next triangle.
     virtual bool next();
@@ -44,12 +50,21 @@ class lsdObjectIterator : public ObjectIterator
 {
 public:
     lsdObjectIterator();
+    virtual ~lsdObjectIterator();
 
     void setFilename(const char* filename);
 
+    /// \brief When streaming, the file is parsed on another thread, and each
+    /// poly mesh is visited as soon as the parser reaches the end of it, and
+    /// freed when the next one is visited. The poly meshes are visited in the
+    /// order they appear in the file, without the transforms above them, so
+    /// tc::lsdObjectIterator::recurseIntoChildren has no effect.
+    void setStreaming(const bool streaming);
+
     /// \brief Prep the iterator for iteration.
     virtual void begin();
-    /// \brief Notify the iterator that we have finished iterating.
+    /// \brief Notify the iterator that we have finished iterating. This frees
+    /// the parsed file.
     virtual void end();
     /// \brief Move onto the next triangle.
     virtual bool next();
@@ -58,8 +73,10 @@ public:
     /// be called each time we want to step down into the children of a node.
     virtual void recurseIntoChildren(bool yesNo);
 
-    /// \return Returns a TriangleIterator, for looping over all the triangles
-    /// in the current object..
+    /// \return The bounds of the current object, and everything below it.
+    /// These are worked out for every object once the file is parsed, so the
+    /// children of an object that can't be seen can be skipped without
+    /// visiting them.
     virtual const BoundsF& getBounds() const;
 
     /// \return true if the current object has triangles. false if not.
@@ -69,9 +86,20 @@ public:
     /// in the current object..
     virtual TriangleIterator& getTriangles();
 
+    /// \return true if tc::lsdObjectIterator::setStreaming is on.
+    virtual bool isStreaming() const;
+
 private:
-    tc::BoundsF m_placeholderBounds;
+    typedef std::map<const lsd::Node*, BoundsF> BoundsMap;
+
+    // Works out the bounds of every node in the stage.
+    void computeBounds();
+
     bool m_currentIsPolyMesh;
+    BoundsMap m_nodeBounds;
+    bool m_streaming;
+    lsdObjectIterator_Stream* m_stream;
+    lsdObjectIterator_Mesh* m_streamedMesh;
 
     std::string m_filename;
     lsd::Stage m_stage;
@@ -79,5 +107,12 @@ private:
     lsdTriangleIterator m_triangleIterator;
     TriangleIterator m_stubTriangleIterator;
 };
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'lsditerator' header file.
+/// \cond
+void lsditeratorRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
 }  // namespace tc
 #endif  // TC_LSDITERATOR
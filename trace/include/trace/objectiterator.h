@@ -5,12 +5,48 @@
 #define TC_OBJECTITERATOR
 //------------------------------------------------------------------------------
 #include "trace/bounds.h"
+#include "trace/int.h"
+//------------------------------------------------------------------------------
+#include <cstdlib>
 
 namespace tc
 {
 class Triangle;
 class TriangleIterator;
 
+//------------------------------------------------------------------------------
+// ObjectIterator_Mesh
+//------------------------------------------------------------------------------
+/// \brief The arrays of an indexed triangle mesh, for iterators that can give
+/// them directly rather than a triangle at a time. See
+/// tc::ObjectIterator::getMesh.
+//------------------------------------------------------------------------------
+class ObjectIterator_Mesh
+{
+public:
+    ObjectIterator_Mesh()
+        : m_vertices(0),
+          m_vertexCount(0),
+          m_indices(0),
+          m_triangleCount(0),
+          m_acceleration(0),
+          m_accelerationSize(0)
+    {
+    }
+
+    /// \brief Four floats for each vertex; x, y, z and an unused w. This is
+    /// how a tc::Vector3<float> is laid out in memory.
+    const float* m_vertices;
+    size_t m_vertexCount;
+    /// \brief Three indices into m_vertices for each triangle.
+    const uint32_t* m_indices;
+    size_t m_triangleCount;
+    /// \brief Optional. An acceleration structure for the triangles, written
+    /// by tc::KDTree::serialize, or null if there isn't one.
+    const char* m_acceleration;
+    size_t m_accelerationSize;
+};
+
 //------------------------------------------------------------------------------
 // ObjectIterator
 //------------------------------------------------------------------------------
@@ -59,6 +95,43 @@ public:
     /// \return Returns a TriangleIterator, for looping over all the triangles
     /// in the current object..
     virtual TriangleIterator& getTriangles() = 0;
+
+    /// \brief Optional. Gives the triangles of the current object as indexed
+    /// arrays, which stay valid until tc::ObjectIterator::next or
+    /// tc::ObjectIterator::end is called.
+    /// \return false if the iterator can't, in which case
+    /// tc::ObjectIterator::getTriangles must be used instead.
+    virtual bool getMesh(ObjectIterator_Mesh& mesh) const
+    {
+        return false;
+    }
+
+    /// \brief Optional. Identifies the current object, so that its mesh can
+    /// be loaded with tc::ObjectIterator::loadMesh after the iterator has
+    /// moved on from it.
+    /// \return false if the iterator can't load meshes later.
+    virtual bool getProxy(size_t& proxy) const
+    {
+        return false;
+    }
+
+    /// \brief Gives the mesh of an object identified by
+    /// tc::ObjectIterator::getProxy, as tc::ObjectIterator::getMesh does. This
+    /// can be called by several threads at once, at any time until
+    /// tc::ObjectIterator::end is called.
+    /// \return false if the mesh couldn't be loaded.
+    virtual bool loadMesh(const size_t proxy, ObjectIterator_Mesh& mesh) const
+    {
+        return false;
+    }
+
+    /// \return true if the file is still being read while the objects are
+    /// visited. Each object should then be processed as soon as it is
+    /// visited, so the work overlaps with reading the rest of the file.
+    virtual bool isStreaming() const
+    {
+        return false;
+    }
 };
 }  // namespace tc
 #endif  // TC_OBJECTITERATOR
@@ -5,24 +5,113 @@
 #define TC_OBJITERATOR
 //------------------------------------------------------------------------------
 #include "trace/bounds.h"
+#include "trace/int.h"
 #include "trace/objectiterator.h"
 #include "trace/triangleIterator.h"
 #include "trace/vector.h"
 //------------------------------------------------------------------------------
 #include <cstdlib>
-#include <fstream>
 #include <string>
 #include <vector>
 
 namespace tc
 {
+class LogContext;
+
 //------------------------------------------------------------------------------
-// Obj_TriangleIterator
+// Obj_Chunk
+//------------------------------------------------------------------------------
+/// \brief The vertices and triangles found in a run of whole lines of an obj
+/// file, by one of the threads of tc::Obj_TriangleIterator::begin.
+//------------------------------------------------------------------------------
+class Obj_Chunk
+{
+public:
+    Obj_Chunk(const char* begin, const char* end);
+
+    /// \brief Parses the lines in [m_begin, m_end).
+    void parse();
+
+    const char* m_begin;
+    const char* m_end;
+
+    /// \brief The vertices, in the order they appear.
+    std::vector<Vector3<float> > m_verts;
+    /// \brief Three zero based vertex indices for each triangle. Polygons
+    /// with more than three vertices are split into a fan of triangles.
+    std::vector<size_t> m_indices;
+    /// \brief The positions in m_indices of the indices that were written
+    /// relative to the last vertex. These count from the first vertex of the
+    /// chunk, wrapping around for vertices in earlier chunks, until the
+    /// number of vertices before the chunk is known.
+    std::vector<size_t> m_relativeIndices;
+    /// \brief The triangles, counting from the first of the chunk, that
+    /// follow an 'o' or 'g' line, and so start a new group.
+    std::vector<size_t> m_groups;
+};
+
 //------------------------------------------------------------------------------
-/// \brief Given a filename, progressively reads an obj from disk.
+// Obj_File
+//------------------------------------------------------------------------------
+/// \brief The vertices, triangles and groups of an obj file.
+///
+/// The file is mapped into memory and split into runs of whole lines, which
+/// are parsed in place by a thread each. Numbers are read straight from the
+/// mapped file, without making a string for each line, and the file is only
+/// read once. Only the vertex positions, faces and groups are used.
 ///
-/// Handles parsing the obj file. This makes it possible to easily iterate over
-/// the triangles in an obj file, without loading everything into memory.
+/// Triangles are numbered in the order they appear in the file. Each 'o' or
+/// 'g' line starts a new group, and groups without any triangles are
+/// dropped.
+//------------------------------------------------------------------------------
+class Obj_File
+{
+public:
+    Obj_File();
+
+    /// \brief Reads 'filename', replacing anything read before. A file that
+    /// can't be read has no triangles.
+    /// \param threadCount The number of threads that parse the file. If this
+    /// is 0 there is one for each processor, as long as the file is large
+    /// enough to be worth splitting.
+    void read(const char* filename, const size_t threadCount);
+
+    /// \brief Frees everything that was read.
+    void clear();
+
+    /// \return The number of triangles, including those of faces that refer
+    /// to vertices that don't exist.
+    size_t getTriangleCount() const;
+
+    /// \return The number of groups.
+    size_t getGroupCount() const;
+
+    /// \return The first triangle of 'group'.
+    size_t getGroupBegin(const size_t group) const;
+
+    /// \return One past the last triangle of 'group'.
+    size_t getGroupEnd(const size_t group) const;
+
+private:
+    // Read the triangles directly.
+    friend class Obj_ObjectIterator;
+    friend class Obj_TriangleIterator;
+
+    // The vertices of every chunk, in file order.
+    std::vector<Vector3<float> > m_verts;
+    std::vector<Obj_Chunk> m_chunks;
+    // The first triangle of each chunk.
+    std::vector<size_t> m_chunkTriangles;
+    // The first triangle of each group.
+    std::vector<size_t> m_groups;
+};
+
+//------------------------------------------------------------------------------
+// Obj_TriangleIterator
+//------------------------------------------------------------------------------
+/// \brief Given a filename, reads the triangles of an obj from disk, using a
+/// tc::Obj_File. Alternatively iterates over a single group of a tc::Obj_File
+/// that has already been read.
 //------------------------------------------------------------------------------
 class Obj_TriangleIterator : public TriangleIterator
 {
@@ -33,7 +122,16 @@ public:
     /// \brief Specifies the full path of the obj file to iterate over.
     void setFilename(const char* filename);
 
-    /// \brief Set/Reset the iterator.
+    /// \brief The number of threads that parse the file. If this is 0, the
+    /// default, there is one for each processor, as long as the file is
+    /// large enough to be worth splitting.
+    void setThreadCount(const size_t threadCount);
+
+    /// \brief Iterates over the triangles of 'group' in 'file', instead of
+    /// reading a file. 'file' must outlive the iteration.
+    void setGroup(const Obj_File& file, const size_t group);
+
+    /// \brief Reads the file, unless a group has been set.
     /// \usage This must be called before using the iterator in a for loop.
     virtual void begin();
     virtual void end() {};
@@ -44,22 +142,36 @@ public:
     /// \brief Dereferences the iterator. This returns a triangle.
     virtual Triangle operator*() const;
 
-private:
-    std::string m_filename;
-    std::ifstream m_infile;
-
-    std::string m_line;
-    std::vector<std::string> m_splitline;
+    /// \return The number of triangles left, including those of faces that
+    /// refer to vertices that don't exist, which are skipped.
+    virtual size_t sizeHint() const;
 
-    std::vector<Vector3<float> > m_verts;
+    /// \brief Copies the corners of the next triangles, skipping those of
+    /// faces that refer to vertices that don't exist.
+    virtual size_t nextBatch(Vector3<float>* corners, const size_t capacity);
 
-    Vector3<float> m_a;
-    Vector3<float> m_b;
-    Vector3<float> m_c;
+private:
+    std::string m_filename;
+    size_t m_threadCount;
+    Obj_File m_ownFile;
+
+    // The file being iterated over, which is m_ownFile unless a group was
+    // set, and the triangles of it to visit.
+    const Obj_File* m_file;
+    size_t m_begin;
+    size_t m_end;
+
+    // The current triangle.
+    size_t m_chunk;
+    size_t m_index;
+    size_t m_triangle;
+    Vector3<float> m_corners[3];
 };
 
 //------------------------------------------------------------------------------
 // Obj_ObjectIterator
+/// \brief Reads an obj from disk, giving an object for each of its groups.
+/// \snippet test_objiterator.cpp test_objiterator groups
 //------------------------------------------------------------------------------
 class Obj_ObjectIterator : public ObjectIterator
 {
@@ -69,19 +181,22 @@ public:
     /// \brief Specifies the full path of the obj file to iterate over.
     void setFilename(const char* filename);
 
+    /// \brief The number of threads that parse the file. See
+    /// tc::Obj_TriangleIterator::setThreadCount.
+    void setThreadCount(const size_t threadCount);
+
     /// \brief Prep the iterator for iteration.
     virtual void begin();
-    /// \brief Notify the iterator that we have finished iterating.
+    /// \brief Notify the iterator that we have finished iterating. This frees
+    /// the file, so the triangles of the groups can't be read after it.
     virtual void end();
-    /// \brief Move onto the next triangle.
+    /// \brief Move onto the next group.
     virtual bool next();
 
-    /// \brief By default, we do not recurse down into child objects, this must
-    /// be called each time we want to step down into the children of a node.
+    /// \brief Groups have no children, so this does nothing.
     virtual void recurseIntoChildren(bool yesNo);
 
-    /// \return A TriangleIterator, for looping over all the triangles
-    /// in the current object..
+    /// \return The bounds of the triangles in the current group.
     virtual const BoundsF& getBounds() const;
 
     /// \return true if the current object has triangles. false if not.
@@ -91,12 +206,40 @@ public:
     /// in the current object..
     virtual TriangleIterator& getTriangles();
 
+    /// \brief Gives the triangles of the current group with the vertex
+    /// indices of the file, so vertices are shared where the file shares
+    /// them. Only the vertices the group uses are given, in the order it
+    /// first uses them, and faces that refer to vertices that don't exist
+    /// are left out.
+    virtual bool getMesh(ObjectIterator_Mesh& mesh) const;
+
 private:
-    BoundsF m_bounds;
-    bool m_currentDone;
-    bool m_done;
+    // Fills m_meshVertices and m_meshIndices with the triangles of 'group'.
+    void readGroupMesh(const size_t group);
+
+    std::string m_filename;
+    size_t m_threadCount;
+    Obj_File m_file;
+    // The bounds of each group, and the group after the current one.
+    std::vector<BoundsF> m_bounds;
+    size_t m_group;
     Obj_TriangleIterator m_triangleIterator;
+
+    // The mesh of the current group.
+    std::vector<Vector3<float> > m_meshVertices;
+    std::vector<uint32_t> m_meshIndices;
+    // The vertices of the file that m_meshVertices are copies of, and where
+    // in m_meshVertices each vertex of the file might be. A vertex is only
+    // there if the two agree, so these don't need clearing between groups.
+    std::vector<size_t> m_meshVertexSources;
+    std::vector<uint32_t> m_meshVertexIndices;
 };
 
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'objiterator' header file.
+/// \cond
+void objiteratorRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
 }  // namespace tc
 #endif  // TC_OBJITERATOR
@@ -0,0 +1,257 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_PLYITERATOR
+#define TC_PLYITERATOR
+//------------------------------------------------------------------------------
+#include "trace/bounds.h"
+#include "trace/int.h"
+#include "trace/objectiterator.h"
+#include "trace/triangleIterator.h"
+#include "trace/vector.h"
+//------------------------------------------------------------------------------
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace tc
+{
+class LogContext;
+
+//------------------------------------------------------------------------------
+// Ply_Property
+//------------------------------------------------------------------------------
+/// \brief A property of an element in the header of a ply file.
+//------------------------------------------------------------------------------
+class Ply_Property
+{
+public:
+    /// \brief The scalar types a property can have.
+    enum Type
+    {
+        kInt8,
+        kUInt8,
+        kInt16,
+        kUInt16,
+        kInt32,
+        kUInt32,
+        kFloat32,
+        kFloat64
+    };
+
+    Ply_Property();
+
+    /// \return The size in bytes of a value of 'type'.
+    static size_t getSize(const Type type);
+
+    std::string m_name;
+    /// \brief The type of the value, or of each item of a list.
+    Type m_type;
+    /// \brief Whether this is a list, which is stored as its length, of type
+    /// m_countType, followed by that many items.
+    bool m_isList;
+    Type m_countType;
+};
+
+//------------------------------------------------------------------------------
+// Ply_Element
+//------------------------------------------------------------------------------
+/// \brief An element in the header of a ply file, such as 'vertex' or 'face'.
+//------------------------------------------------------------------------------
+class Ply_Element
+{
+public:
+    Ply_Element();
+
+    /// \return The index of the property called 'name', or the number of
+    /// properties if there isn't one.
+    size_t findProperty(const char* name) const;
+
+    std::string m_name;
+    size_t m_count;
+    std::vector<Ply_Property> m_properties;
+    /// \brief The size in bytes of each record, or 0 if the element has a
+    /// list property, so the size of each record depends on its lists.
+    size_t m_recordSize;
+};
+
+//------------------------------------------------------------------------------
+// Ply_File
+//------------------------------------------------------------------------------
+/// \brief The vertices and triangles of a binary little endian ply file.
+///
+/// The file is mapped into memory and its records are decoded in place. The
+/// vertices are split into runs which are decoded by a thread each, as are
+/// the faces when they are all triangles, which is checked by the threads
+/// that decode them. Polygons with more vertices are split into fans of
+/// triangles, which needs the faces to be read in order, on one thread.
+///
+/// Only the x, y and z properties of the 'vertex' element and the
+/// 'vertex_indices' (or 'vertex_index') list of the 'face' element are used.
+/// Other elements are skipped, as are faces that refer to vertices that don't
+/// exist. Ascii and big endian files have no triangles.
+//------------------------------------------------------------------------------
+class Ply_File
+{
+public:
+    Ply_File();
+
+    /// \brief Reads 'filename', replacing anything read before. A file that
+    /// can't be read has no triangles.
+    /// \param threadCount The number of threads that decode the file. If
+    /// this is 0 there is one for each processor, as long as the file is
+    /// large enough to be worth splitting.
+    void read(const char* filename, const size_t threadCount);
+
+    /// \brief Frees everything that was read.
+    void clear();
+
+    /// \return The number of triangles.
+    size_t getTriangleCount() const;
+
+    /// \return The bounds of the vertices, including any that no triangle
+    /// uses. A file without vertices has empty bounds at the origin.
+    const BoundsF& getBounds() const;
+
+    /// \brief Gives the vertices and triangles as indexed arrays, which stay
+    /// valid until the file is read again or cleared.
+    void getMesh(ObjectIterator_Mesh& mesh) const;
+
+private:
+    // Reads the triangles directly.
+    friend class Ply_TriangleIterator;
+
+    /// \brief Reads the header of the file at 'data'.
+    /// \return The start of the records, or 0 if the header can't be read.
+    const char* readHeader(const char* data, const char* dataEnd);
+
+    /// \brief Reads the vertices of 'element' at 'p', and their bounds.
+    /// \return false if the vertices can't be read.
+    bool readVertices(const Ply_Element& element, const char* p,
+                      const char* dataEnd, const size_t threadCount);
+
+    /// \brief Reads the faces of 'element' at 'p'.
+    /// \return The end of the faces, or 0 if the file ends before them.
+    const char* readFaces(const Ply_Element& element, const char* p,
+                          const char* dataEnd, const size_t threadCount);
+
+    std::vector<Ply_Element> m_elements;
+    std::vector<Vector3<float> > m_verts;
+    // Three indices into m_verts for each triangle.
+    std::vector<uint32_t> m_indices;
+    // Holds the bounds of the vertices, which can't be assigned.
+    std::vector<BoundsF> m_bounds;
+};
+
+//------------------------------------------------------------------------------
+// Ply_TriangleIterator
+//------------------------------------------------------------------------------
+/// \brief Given a filename, reads the triangles of a ply file from disk,
+/// using a tc::Ply_File. Alternatively iterates over a tc::Ply_File that has
+/// already been read.
+//------------------------------------------------------------------------------
+class Ply_TriangleIterator : public TriangleIterator
+{
+public:
+    Ply_TriangleIterator();
+    virtual ~Ply_TriangleIterator();
+
+    /// \brief Specifies the full path of the ply file to iterate over.
+    void setFilename(const char* filename);
+
+    /// \brief The number of threads that decode the file. If this is 0, the
+    /// default, there is one for each processor, as long as the file is
+    /// large enough to be worth splitting.
+    void setThreadCount(const size_t threadCount);
+
+    /// \brief Iterates over the triangles of 'file', instead of reading a
+    /// file. 'file' must outlive the iteration.
+    void setFile(const Ply_File& file);
+
+    /// \brief Reads the file, unless a file has been set.
+    /// \usage This must be called before using the iterator in a for loop.
+    virtual void begin();
+    virtual void end() {};
+
+    /// \brief Increments the iterator to the next triangle in the ply file.
+    virtual bool next();
+
+    /// \brief Dereferences the iterator. This returns a triangle.
+    virtual Triangle operator*() const;
+
+    /// \return The number of triangles left.
+    virtual size_t sizeHint() const;
+
+    /// \brief Copies the corners of the next triangles from the file.
+    virtual size_t nextBatch(Vector3<float>* corners, const size_t capacity);
+
+private:
+    std::string m_filename;
+    size_t m_threadCount;
+    Ply_File m_ownFile;
+
+    // The file being iterated over, which is m_ownFile unless a file was
+    // set, and the index of the next triangle.
+    const Ply_File* m_file;
+    size_t m_next;
+};
+
+//------------------------------------------------------------------------------
+// Ply_ObjectIterator
+/// \brief Reads a ply file from disk, giving a single object for all of its
+/// triangles.
+/// \snippet test_plyiterator.cpp test_plyiterator read
+//------------------------------------------------------------------------------
+class Ply_ObjectIterator : public ObjectIterator
+{
+public:
+    Ply_ObjectIterator();
+
+    /// \brief Specifies the full path of the ply file to iterate over.
+    void setFilename(const char* filename);
+
+    /// \brief The number of threads that decode the file. See
+    /// tc::Ply_TriangleIterator::setThreadCount.
+    void setThreadCount(const size_t threadCount);
+
+    /// \brief Prep the iterator for iteration.
+    virtual void begin();
+    /// \brief Notify the iterator that we have finished iterating. This frees
+    /// the file, so its triangles can't be read after it.
+    virtual void end();
+    /// \brief Move onto the object, if the file has any triangles.
+    virtual bool next();
+
+    /// \brief The object has no children, so this does nothing.
+    virtual void recurseIntoChildren(bool yesNo);
+
+    /// \return The bounds of the triangles in the file.
+    virtual const BoundsF& getBounds() const;
+
+    /// \return true once the iterator is on the object.
+    virtual bool hasTriangles() const;
+
+    /// \return Returns a TriangleIterator, for looping over all the triangles
+    /// in the file.
+    virtual TriangleIterator& getTriangles();
+
+    /// \brief Gives the arrays the file was decoded into.
+    virtual bool getMesh(ObjectIterator_Mesh& mesh) const;
+
+private:
+    std::string m_filename;
+    size_t m_threadCount;
+    Ply_File m_file;
+    // Whether the iterator is on the object.
+    bool m_visited;
+    Ply_TriangleIterator m_triangleIterator;
+};
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'plyiterator' header file.
+/// \cond
+void plyiteratorRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
+}  // namespace tc
+#endif  // TC_PLYITERATOR
@@ -3,6 +3,9 @@
 //------------------------------------------------------------------------------
 #ifndef TC_RANDOM
 #define TC_RANDOM
+//------------------------------------------------------------------------------
+#include <stdint.h>
+//------------------------------------------------------------------------------
 
 namespace tc
 {
@@ -16,8 +19,115 @@ namespace tc
 /// \code
 /// float x = generateRandomFloat(10.0f, 20.0f); // x is in the range 10 to 20
 /// \endcode
+///
+/// This uses the global libc generator, which is shared between threads. Use
+/// tc::Random for anything on the render path.
 //------------------------------------------------------------------------------
 float generateRandomFloat(const float lowerRange, const float upperRange);
 
+//------------------------------------------------------------------------------
+// Random
+//------------------------------------------------------------------------------
+/// \brief A small, fast PCG32 random number generator.
+///
+/// Each instance holds its own state, so one can be owned per thread without
+/// any locking. The generator is keyed by a 'sequence' and a 'stream', which
+/// lets a renderer reseed it per pixel and per sample so the numbers drawn for
+/// a given sample don't depend on which thread draws them.
+/// \code
+/// tc::Random random;
+/// random.seed(pixelIndex, sampleIndex);
+/// float x = random.nextFloat(10.0f, 20.0f); // x is in the range 10 to 20
+/// \endcode
+//------------------------------------------------------------------------------
+class Random
+{
+public:
+    /// \brief Initializes a Random instance with a fixed default seed.
+    inline Random();
+
+    /// \brief Initializes a Random instance with the given key.
+    inline Random(const uint64_t sequence, const uint64_t stream);
+
+    /// \brief Resets the generator so that it produces the sequence of numbers
+    /// identified by the given key.
+    /// \param sequence Where to start in the stream, i.e. a pixel index.
+    /// \param stream Which of the 2^63 independent streams to draw from, i.e.
+    /// a sample index.
+    inline void seed(const uint64_t sequence, const uint64_t stream);
+
+    /// \return A uniformly distributed 32 bit unsigned integer.
+    inline uint32_t nextUInt();
+
+    /// \return A uniformly distributed float in the range [0, 1).
+    inline float nextFloat();
+
+    /// \return A uniformly distributed float in the range [lower, upper).
+    inline float nextFloat(const float lowerRange, const float upperRange);
+
+    /// \brief Allows a tc::Random to be used as the offset function of
+    /// tc::generateStratifiedDirection.
+    inline float operator()(const float lowerRange, const float upperRange);
+
+private:
+    uint64_t m_state;
+    uint64_t m_increment;
+};
+
+//------------------------------------------------------------------------------
+inline Random::Random() : m_state(0), m_increment(0)
+{
+    seed(0, 0);
+}
+
+//------------------------------------------------------------------------------
+inline Random::Random(const uint64_t sequence, const uint64_t stream)
+    : m_state(0), m_increment(0)
+{
+    seed(sequence, stream);
+}
+
+//------------------------------------------------------------------------------
+inline void Random::seed(const uint64_t sequence, const uint64_t stream)
+{
+    // The increment must be odd.
+    m_state = 0u;
+    m_increment = (stream << 1u) | 1u;
+    nextUInt();
+    m_state += 0x853c49e6748fea9bULL + sequence;
+    nextUInt();
+}
+
+//------------------------------------------------------------------------------
+inline uint32_t Random::nextUInt()
+{
+    const uint64_t oldState = m_state;
+    m_state = oldState * 6364136223846793005ULL + m_increment;
+    const uint32_t xorShifted =
+        static_cast<uint32_t>(((oldState >> 18u) ^ oldState) >> 27u);
+    const uint32_t rotation = static_cast<uint32_t>(oldState >> 59u);
+    return (xorShifted >> rotation) | (xorShifted << ((-rotation) & 31u));
+}
+
+//------------------------------------------------------------------------------
+inline float Random::nextFloat()
+{
+    // Use the top 24 bits, which is all the precision a float mantissa has.
+    // This keeps the result strictly below 1.
+    return static_cast<float>(nextUInt() >> 8u) * (1.0f / 16777216.0f);
+}
+
+//------------------------------------------------------------------------------
+inline float Random::nextFloat(const float lowerRange, const float upperRange)
+{
+    return lowerRange + (nextFloat() * (upperRange - lowerRange));
+}
+
+//------------------------------------------------------------------------------
+inline float Random::operator()(const float lowerRange, const float upperRange)
+{
+    return nextFloat(lowerRange, upperRange);
+}
+
 }  // namespace tc
 #endif  // TC_RANDOM
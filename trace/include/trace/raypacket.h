@@ -0,0 +1,204 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_RAYPACKET
+#define TC_RAYPACKET
+//------------------------------------------------------------------------------
+#include "trace/assert.h"
+#include "trace/geoid.h"
+#include "trace/ray.h"
+#include "trace/traceResult.h"
+#include "trace/vector.h"
+//------------------------------------------------------------------------------
+#include <cfloat>
+#include <cstdlib>
+
+namespace tc
+{
+
+//------------------------------------------------------------------------------
+// RayPacket
+//------------------------------------------------------------------------------
+/// \brief Up to four rays, stored so that one SSE instruction can work on the
+/// same component of every ray at once.
+///
+/// Rays which start close together and point in similar directions, such as
+/// the camera rays of neighbouring pixels, mostly visit the same parts of an
+/// acceleration structure. Tracing them as a packet lets them share that
+/// walk. See tc::intersect_bounds and tc::KDTree::findEntries.
+///
+/// A packet can be partially filled, the lanes without a ray are left out of
+/// the mask returned by tc::RayPacket::getMask.
+/// \code
+/// tc::RayPacket packet;
+/// packet.setRay(0, rayA);
+/// packet.setRay(1, rayB);
+/// const tc::RayPacket_TraceResult result =
+///     geoApi.geo_tracePacket(searchCache, packet);
+/// \endcode
+//------------------------------------------------------------------------------
+class RayPacket
+{
+public:
+    enum
+    {
+        /// The number of rays in a packet.
+        kSize = 4,
+        /// The mask with every lane set.
+        kFullMask = (1 << kSize) - 1
+    };
+
+    /// \brief Initializes an empty tc::RayPacket.
+    inline RayPacket();
+
+    /// \brief Stores 'ray' in the given lane.
+    inline void setRay(const size_t lane, const Ray& ray);
+
+    /// \return The ray stored in the given lane.
+    inline Ray getRay(const size_t lane) const;
+
+    /// \return A bit for each lane that holds a ray.
+    inline int getMask() const;
+
+    /// \return true if every ray in the packet points the same way along
+    /// each axis.
+    inline bool hasCommonDirection() const;
+
+    // The x, y and z components of each ray, one array per component.
+    float m_positionX[kSize] TC_ALIGN16;
+    float m_positionY[kSize] TC_ALIGN16;
+    float m_positionZ[kSize] TC_ALIGN16;
+    float m_directionX[kSize] TC_ALIGN16;
+    float m_directionY[kSize] TC_ALIGN16;
+    float m_directionZ[kSize] TC_ALIGN16;
+
+private:
+    int m_mask;
+};
+
+//------------------------------------------------------------------------------
+inline RayPacket::RayPacket() : m_mask(0)
+{
+    for (size_t i = 0; i != kSize; ++i)
+    {
+        m_positionX[i] = m_positionY[i] = m_positionZ[i] = 0.0f;
+        m_directionX[i] = m_directionY[i] = 0.0f;
+        m_directionZ[i] = 1.0f;
+    }
+}
+
+//------------------------------------------------------------------------------
+inline void RayPacket::setRay(const size_t lane, const Ray& ray)
+{
+    assert(lane < kSize);
+    m_positionX[lane] = ray.m_position.x;
+    m_positionY[lane] = ray.m_position.y;
+    m_positionZ[lane] = ray.m_position.z;
+    m_directionX[lane] = ray.m_direction.x;
+    m_directionY[lane] = ray.m_direction.y;
+    m_directionZ[lane] = ray.m_direction.z;
+    m_mask |= 1 << lane;
+}
+
+//------------------------------------------------------------------------------
+inline Ray RayPacket::getRay(const size_t lane) const
+{
+    assert(lane < kSize);
+    return Ray(Vector3<float>(m_directionX[lane], m_directionY[lane],
+                              m_directionZ[lane]),
+               Vector3<float>(m_positionX[lane], m_positionY[lane],
+                              m_positionZ[lane]));
+}
+
+//------------------------------------------------------------------------------
+inline int RayPacket::getMask() const
+{
+    return m_mask;
+}
+
+//------------------------------------------------------------------------------
+inline bool RayPacket::hasCommonDirection() const
+{
+    int signs[3] = {-1, -1, -1};
+    const float* directions[3] = {m_directionX, m_directionY, m_directionZ};
+    for (size_t lane = 0; lane != kSize; ++lane)
+    {
+        if (!(m_mask & (1 << lane)))
+        {
+            continue;
+        }
+        for (size_t axis = 0; axis != 3; ++axis)
+        {
+            const int sign = directions[axis][lane] >= 0.0f ? 1 : 0;
+            if (signs[axis] == -1)
+            {
+                signs[axis] = sign;
+            }
+            else if (signs[axis] != sign)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// RayPacket_TraceResult
+//------------------------------------------------------------------------------
+/// \brief The tc::TraceResult for each lane of a tc::RayPacket.
+//------------------------------------------------------------------------------
+class RayPacket_TraceResult
+{
+public:
+    /// \brief Initializes the result for every lane to a miss.
+    inline RayPacket_TraceResult();
+
+    /// \brief Stores the result for a lane.
+    inline void setTraceResult(const size_t lane,
+                               const TraceResult& traceResult);
+
+    /// \return The result for a lane.
+    inline TraceResult getTraceResult(const size_t lane) const;
+
+    float m_distanceAlongRay[RayPacket::kSize];
+    size_t m_objectIndex[RayPacket::kSize];
+    size_t m_elementIndex[RayPacket::kSize];
+    Vector3<float> m_normal[RayPacket::kSize];
+};
+
+//------------------------------------------------------------------------------
+inline RayPacket_TraceResult::RayPacket_TraceResult()
+{
+    for (size_t i = 0; i != RayPacket::kSize; ++i)
+    {
+        m_distanceAlongRay[i] = FLT_MAX;
+        m_objectIndex[i] = 0;
+        m_elementIndex[i] = 0;
+        m_normal[i] = Vector3<float>(0.0f);
+    }
+}
+
+//------------------------------------------------------------------------------
+inline void RayPacket_TraceResult::setTraceResult(
+    const size_t lane, const TraceResult& traceResult)
+{
+    assert(lane < RayPacket::kSize);
+    m_distanceAlongRay[lane] = traceResult.m_distanceAlongRay;
+    m_objectIndex[lane] = traceResult.m_geoId.m_objectIndex;
+    m_elementIndex[lane] = traceResult.m_geoId.m_elementIndex;
+    m_normal[lane] = traceResult.m_normal;
+}
+
+//------------------------------------------------------------------------------
+inline TraceResult RayPacket_TraceResult::getTraceResult(
+    const size_t lane) const
+{
+    assert(lane < RayPacket::kSize);
+    return TraceResult(m_distanceAlongRay[lane],
+                       GeoID(m_objectIndex[lane], m_elementIndex[lane]),
+                       m_normal[lane]);
+}
+
+}  // namespace tc
+#endif  // TC_RAYPACKET
@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_RAYSORT
+#define TC_RAYSORT
+//------------------------------------------------------------------------------
+#include "trace/bounds.h"
+#include "trace/ray.h"
+#include "trace/raystream.h"
+//------------------------------------------------------------------------------
+#include <cstdlib>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+//------------------------------------------------------------------------------
+
+namespace tc
+{
+class LogContext;
+
+//------------------------------------------------------------------------------
+// RaySorter
+//------------------------------------------------------------------------------
+/// \brief Reorders a tc::RayStream so that rays which start close together
+/// and point the same way are traced one after the other.
+///
+/// Bounce rays are generated in the order of the surfaces they leave, in
+/// random directions, so consecutive rays touch unrelated parts of the
+/// acceleration structure and triangle arrays. Sorting them by a Morton key
+/// of their quantised origin and direction means neighbouring rays in the
+/// stream mostly need the same nodes and triangles, which are then still in
+/// the cache.
+///
+/// The key is, from the most significant bit down:
+/// - 3 bits for the octant the direction points into, so that rays with the
+/// same traversal order through a tc::KDTree are grouped together.
+/// - 30 bits of interleaved x, y and z origin, quantised to 1024 steps
+/// across the bounds of the origins in the stream.
+/// - 12 bits of interleaved x, y and z direction, quantised to 16 steps.
+///
+/// \snippet test_raysort.cpp test_raysort sort
+//------------------------------------------------------------------------------
+class RaySorter
+{
+public:
+    /// \brief Sorts the rays of 'stream' by their keys.
+    /// \param stream The rays to sort.
+    /// \param tags A value for each ray, moved along with it. Used to scatter
+    /// the results of tracing the sorted stream back to where they came from.
+    void sort(RayStream& stream, std::vector<size_t>& tags);
+
+    /// \return The sort key for 'ray', whose origin lies inside 'bounds'.
+    static uint64_t computeKey(const Ray& ray, const BoundsF& bounds);
+
+private:
+    typedef std::pair<uint64_t, size_t> KeyIndex;
+    std::vector<KeyIndex> m_keys;
+    RayStream m_sortedStream;
+    std::vector<size_t> m_sortedTags;
+};
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'raysort' header file.
+/// \cond
+void raysortRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
+}  // namespace tc
+#endif  // TC_RAYSORT
@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_RAYSTREAM
+#define TC_RAYSTREAM
+//------------------------------------------------------------------------------
+#include "trace/assert.h"
+#include "trace/geoid.h"
+#include "trace/ray.h"
+#include "trace/raypacket.h"
+#include "trace/traceResult.h"
+#include "trace/vector.h"
+//------------------------------------------------------------------------------
+#include <cfloat>
+#include <cstdlib>
+#include <vector>
+
+namespace tc
+{
+
+//------------------------------------------------------------------------------
+// RayStream
+//------------------------------------------------------------------------------
+/// \brief Any number of rays, stored one array per component.
+///
+/// Unlike a tc::RayPacket the rays in a stream don't need to have anything in
+/// common. Bounce rays leave a surface in every direction, so a packet of them
+/// quickly falls apart. A stream of thousands of them still has plenty of rays
+/// that visit any given node of an acceleration structure, which lets the
+/// cost of fetching the node be shared between them. See
+/// tc::KDTree::findEntries and tc::GeoAPI::geo_traceStream.
+/// \code
+/// tc::RayStream stream;
+/// stream.push(rayA);
+/// stream.push(rayB);
+/// tc::RayStream_TraceResult result;
+/// geoApi.geo_traceStream(searchCache, stream, result);
+/// \endcode
+//------------------------------------------------------------------------------
+class RayStream
+{
+public:
+    /// \brief Appends a ray to the end of the stream.
+    inline void push(const Ray& ray);
+
+    /// \brief Removes every ray, keeping the memory for reuse.
+    inline void clear();
+
+    /// \return The number of rays in the stream.
+    inline size_t size() const;
+
+    /// \brief Exchanges the rays of this stream with those of 'other'.
+    inline void swap(RayStream& other);
+
+    /// \return The ray at 'index'.
+    inline Ray getRay(const size_t index) const;
+
+    /// \brief Copies up to tc::RayPacket::kSize rays into a packet, so they
+    /// can be tested together.
+    /// \param indices The rays to copy.
+    /// \param count The number of indices, at most tc::RayPacket::kSize.
+    inline RayPacket gather(const size_t* indices, const size_t count) const;
+
+    // The x, y and z components of each ray, one array per component.
+    std::vector<float> m_positionX;
+    std::vector<float> m_positionY;
+    std::vector<float> m_positionZ;
+    std::vector<float> m_directionX;
+    std::vector<float> m_directionY;
+    std::vector<float> m_directionZ;
+};
+
+//------------------------------------------------------------------------------
+inline void RayStream::push(const Ray& ray)
+{
+    m_positionX.push_back(ray.m_position.x);
+    m_positionY.push_back(ray.m_position.y);
+    m_positionZ.push_back(ray.m_position.z);
+    m_directionX.push_back(ray.m_direction.x);
+    m_directionY.push_back(ray.m_direction.y);
+    m_directionZ.push_back(ray.m_direction.z);
+}
+
+//------------------------------------------------------------------------------
+inline void RayStream::clear()
+{
+    m_positionX.clear();
+    m_positionY.clear();
+    m_positionZ.clear();
+    m_directionX.clear();
+    m_directionY.clear();
+    m_directionZ.clear();
+}
+
+//------------------------------------------------------------------------------
+inline size_t RayStream::size() const
+{
+    return m_positionX.size();
+}
+
+//------------------------------------------------------------------------------
+inline void RayStream::swap(RayStream& other)
+{
+    m_positionX.swap(other.m_positionX);
+    m_positionY.swap(other.m_positionY);
+    m_positionZ.swap(other.m_positionZ);
+    m_directionX.swap(other.m_directionX);
+    m_directionY.swap(other.m_directionY);
+    m_directionZ.swap(other.m_directionZ);
+}
+
+//------------------------------------------------------------------------------
+inline Ray RayStream::getRay(const size_t index) const
+{
+    assert(index < size());
+    return Ray(Vector3<float>(m_directionX[index], m_directionY[index],
+                              m_directionZ[index]),
+               Vector3<float>(m_positionX[index], m_positionY[index],
+                              m_positionZ[index]));
+}
+
+//------------------------------------------------------------------------------
+inline RayPacket RayStream::gather(const size_t* indices,
+                                   const size_t count) const
+{
+    assert(count <= RayPacket::kSize);
+    RayPacket packet;
+    for (size_t lane = 0; lane != count; ++lane)
+    {
+        packet.setRay(lane, getRay(indices[lane]));
+    }
+    return packet;
+}
+
+//------------------------------------------------------------------------------
+// RayStream_TraceResult
+//------------------------------------------------------------------------------
+/// \brief The tc::TraceResult for each ray of a tc::RayStream.
+//------------------------------------------------------------------------------
+class RayStream_TraceResult
+{
+public:
+    /// \brief Sets the result for 'count' rays to a miss.
+    inline void reset(const size_t count);
+
+    /// \brief Stores the result for a ray.
+    inline void setTraceResult(const size_t index,
+                               const TraceResult& traceResult);
+
+    /// \return The result for a ray.
+    inline TraceResult getTraceResult(const size_t index) const;
+
+    std::vector<float> m_distanceAlongRay;
+    std::vector<size_t> m_objectIndex;
+    std::vector<size_t> m_elementIndex;
+    std::vector<Vector3<float> > m_normal;
+};
+
+//------------------------------------------------------------------------------
+inline void RayStream_TraceResult::reset(const size_t count)
+{
+    m_distanceAlongRay.assign(count, FLT_MAX);
+    m_objectIndex.assign(count, 0);
+    m_elementIndex.assign(count, 0);
+    m_normal.assign(count, Vector3<float>(0.0f));
+}
+
+//------------------------------------------------------------------------------
+inline void RayStream_TraceResult::setTraceResult(
+    const size_t index, const TraceResult& traceResult)
+{
+    assert(index < m_distanceAlongRay.size());
+    m_distanceAlongRay[index] = traceResult.m_distanceAlongRay;
+    m_objectIndex[index] = traceResult.m_geoId.m_objectIndex;
+    m_elementIndex[index] = traceResult.m_geoId.m_elementIndex;
+    m_normal[index] = traceResult.m_normal;
+}
+
+//------------------------------------------------------------------------------
+inline TraceResult RayStream_TraceResult::getTraceResult(
+    const size_t index) const
+{
+    assert(index < m_distanceAlongRay.size());
+    return TraceResult(m_distanceAlongRay[index],
+                       GeoID(m_objectIndex[index], m_elementIndex[index]),
+                       m_normal[index]);
+}
+
+}  // namespace tc
+#endif  // TC_RAYSTREAM
@@ -0,0 +1,105 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_RENDERSETTINGS
+#define TC_RENDERSETTINGS
+//------------------------------------------------------------------------------
+#include "trace/sampler.h"
+#include "trace/shade.h"
+//------------------------------------------------------------------------------
+
+namespace tc
+{
+
+//------------------------------------------------------------------------------
+// RenderSettings
+//------------------------------------------------------------------------------
+/// \brief Optional settings which change how an image is rendered.
+///
+/// Every setting has a sensible default, so a default constructed
+/// tc::RenderSettings can always be passed to tc::Renderer.
+/// \code
+/// tc::RenderSettings settings;
+/// settings.m_sampler = tc::kSamplerHalton;
+/// settings.m_integrator = tc::kIntegratorPath;
+/// \endcode
+//------------------------------------------------------------------------------
+class RenderSettings
+{
+public:
+    /// \brief Initializes a RenderSettings instance with the default settings.
+    inline RenderSettings();
+
+    /// \brief The sample generator used for the pixel and bounce dimensions.
+    SamplerType m_sampler;
+
+    /// \brief The light transport algorithm.
+    IntegratorMode m_integrator;
+
+    /// \brief When using kIntegratorPath, the depth at which paths start to
+    /// be terminated with Russian roulette. The maximum ray depth is still a
+    /// hard limit.
+    size_t m_russianRouletteDepth;
+
+    /// \brief Fire shadow rays directly at the emitters provided by
+    /// tc::ShadeAPI::shade_getEmitter, alongside every bounce ray. The two are
+    /// combined with multiple importance sampling, so small emitters are found
+    /// without adding noise where the bounce rays find them well. Emitters
+    /// that cover much of the view from a point, like a sky around the scene,
+    /// are left to the bounce rays.
+    bool m_nextEventEstimation;
+
+    /// \brief Pick bounce directions in proportion to the cosine of their
+    /// angle to the surface normal, rather than uniformly.
+    bool m_cosineWeightedSampling;
+
+    /// \brief When using kIntegratorWavefront, sort the bounce rays by their
+    /// origin and direction before tracing them. See tc::RaySorter. This
+    /// pays off once the scene is too big for the bounce rays of a tile to
+    /// share the cache, so it is off by default.
+    bool m_sortBounceRays;
+
+    /// \brief When the tc::ShadeAPI is a tc::SimpleScene, follow paths with
+    /// code compiled for its concrete shaders rather than through virtual
+    /// calls. See tc::SimpleScene_Shading. The results are the same either
+    /// way.
+    bool m_specialisedShading;
+
+    /// \brief When using kIntegratorStratified, share irradiance estimates
+    /// between nearby diffuse points, see tc::IrradianceCache. This trades
+    /// a small bias for far fewer rays. Threads see each other's estimates
+    /// in whatever order they are made, so images rendered with more than
+    /// one thread can differ slightly from run to run.
+    bool m_irradianceCache;
+
+    /// \brief The largest error allowed when interpolating from the
+    /// irradiance cache.
+    float m_irradianceCacheError;
+
+    /// \brief The largest distance, in scene units, an irradiance cache
+    /// record can be used over is m_irradianceCacheError times this.
+    float m_irradianceCacheRadius;
+
+    /// \brief When using kIntegratorAmbientOcclusion, how far, in scene
+    /// units, geometry can be from a point and still occlude it.
+    float m_ambientOcclusionDistance;
+};
+
+//------------------------------------------------------------------------------
+inline RenderSettings::RenderSettings()
+    : m_sampler(kSamplerSobol),
+      m_integrator(kIntegratorStratified),
+      m_russianRouletteDepth(3),
+      m_nextEventEstimation(true),
+      m_cosineWeightedSampling(true),
+      m_sortBounceRays(false),
+      m_specialisedShading(true),
+      m_irradianceCache(false),
+      m_irradianceCacheError(0.3f),
+      m_irradianceCacheRadius(1.0f),
+      m_ambientOcclusionDistance(1.0f)
+{
+}
+
+}  // namespace tc
+#endif  // TC_RENDERSETTINGS
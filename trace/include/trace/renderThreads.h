@@ -5,16 +5,20 @@
 #define TC_RENDERTHREADS
 //------------------------------------------------------------------------------
 #include "trace/array.h"
+#include "trace/renderSettings.h"
 #include "trace/shadestack.h"
 #include "trace/thread.h"
 #include "trace/vector.h"
 //------------------------------------------------------------------------------
+#include <vector>
+//------------------------------------------------------------------------------
 
 namespace tc
 {
 
 class GeoAPI;
 class Image;
+class IrradianceCache;
 class LogContext;
 class PixelIteratorFactory;
 class ShadeAPI;
@@ -56,19 +60,29 @@ public:
     /// order to obtain a pixel color. This needs to be 16 or above to
     /// obtain smooth antialiasing.
     /// \param threadCount The number of threads to use for rendering.
+    /// \param settings Any additional, optional, render settings.
     ///
     RenderThreads(const Range& range, const GeoAPI& geoApi,
                   const ShadeAPI& shadeApi, Image& image,
                   RWLock& arrayLock, bool& hasNewContent,
                   const tc::LogContext& logContext, const size_t maxRayDepth,
                   const size_t qualityLevel, const size_t samplesPerPixel,
-                  const size_t threadCount);
+                  const size_t threadCount,
+                  const RenderSettings& settings = RenderSettings());
 
     virtual ~RenderThreads();
 
     size_t getBlock();
 
 private:
+    /// \return The number of blocks along the x and y axis of the image.
+    size_t getDivisions() const;
+
+    /// \brief Waits until every pass before 'pass' over 'block' has been
+    /// written to the image.
+    /// \return false if the threads were asked to stop while waiting.
+    bool waitForPass(const size_t block, const size_t pass);
+
     size_t m_blocks;
     const GeoAPI& m_geoApi;
     const ShadeAPI& m_shadeApi;
@@ -79,6 +93,10 @@ private:
     const size_t m_maxRayDepth;
     const size_t m_qualityLevel;
     const size_t m_samplesPerPixel;
+    const RenderSettings m_settings;
+    // Shared by every thread, null unless enabled in m_settings.
+    IrradianceCache* m_irradianceCache;
+    std::vector<size_t> m_blockPasses;
     virtual void run(const size_t threadIndex, const Range& range);
 };
 
@@ -4,6 +4,7 @@
 #ifndef TC_RENDERER
 #define TC_RENDERER
 //------------------------------------------------------------------------------
+#include "trace/renderSettings.h"
 #include "trace/renderThreads.h"
 //------------------------------------------------------------------------------
 #include <cstdlib>
@@ -85,10 +86,12 @@ public:
     /// functions for querying additional geoemtry information such as the
     /// normal and tangents for a particular point.
     /// \param threadCount Gives us the number of threads to use for rendering.
+    /// \param settings Any additional, optional, render settings.
     Renderer(const tc::LogContext& logContext, Image & image,
              const size_t samplesPerPixel, const size_t qualityLevel,
              const size_t maxRayDepth, const GeoAPI& geoApi,
-             const ShadeAPI& shadeApi, const size_t threadCount);
+             const ShadeAPI& shadeApi, const size_t threadCount,
+             const RenderSettings& settings = RenderSettings());
 
     /// \return The total progress of the render as a percentage.
     float computePercentComplete() const;
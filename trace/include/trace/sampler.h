@@ -0,0 +1,213 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#ifndef TC_SAMPLER
+#define TC_SAMPLER
+//------------------------------------------------------------------------------
+#include "trace/random.h"
+#include "trace/vector.h"
+//------------------------------------------------------------------------------
+#include <cstdlib>
+#include <stdint.h>
+//------------------------------------------------------------------------------
+
+namespace tc
+{
+class LogContext;
+
+//------------------------------------------------------------------------------
+// SamplerType
+//------------------------------------------------------------------------------
+/// \brief The sample generators available to the renderer.
+//------------------------------------------------------------------------------
+enum SamplerType
+{
+    kSamplerRandom = 0,
+    kSamplerHalton = 1,
+    kSamplerSobol = 2
+};
+
+//------------------------------------------------------------------------------
+// parseSamplerType
+//------------------------------------------------------------------------------
+/// \brief Converts the name of a sampler ("random", "halton" or "sobol") to a
+/// tc::SamplerType.
+/// \return defaultValue if the name isn't recognised.
+//------------------------------------------------------------------------------
+SamplerType parseSamplerType(const char* name, const SamplerType defaultValue);
+
+//------------------------------------------------------------------------------
+// Sampler
+//------------------------------------------------------------------------------
+/// \brief Provides the sample values used to estimate a single pixel sample.
+///
+/// Each pixel sample consumes a sequence of 'dimensions'. The first two are
+/// used for the position on the image plane, the following pairs are used,
+/// in order, for each bounce direction. A sampler is free to correlate the
+/// values it returns for the same dimension across the samples of a pixel,
+/// which is what makes low discrepancy sequences converge faster than random
+/// numbers.
+///
+/// A sampler has state and must not be shared between threads. The values
+/// returned only depend on the pixel, sample and dimension, so a render is
+/// the same no matter how the work is split between threads.
+///
+/// \code
+/// tc::SobolSampler sampler;
+/// sampler.startPixelSample(pixelIndex, sampleIndex);
+/// const tc::Vector3<float> jitter = sampler.get2D(); // x and y in [0, 1)
+/// \endcode
+//------------------------------------------------------------------------------
+class Sampler
+{
+public:
+    inline Sampler();
+    virtual ~Sampler();
+
+    /// \brief Begin drawing values for the given pixel sample. This resets
+    /// the dimension back to 0.
+    /// \param pixelIndex A unique index for the pixel being rendered.
+    /// \param sampleIndex Which of the samples for this pixel is being
+    /// rendered.
+    virtual void startPixelSample(const size_t pixelIndex,
+                                  const size_t sampleIndex);
+
+    /// \brief Carry on drawing values for a pixel sample, starting from
+    /// 'dimension'. This lets the work for many pixel samples be interleaved
+    /// on the one sampler, as long as each sample remembers where it got to
+    /// with tc::Sampler::getDimension.
+    virtual void resumePixelSample(const size_t pixelIndex,
+                                   const size_t sampleIndex,
+                                   const size_t dimension);
+
+    /// \return The next dimension that will be drawn.
+    inline size_t getDimension() const;
+
+    /// \return A value in the range [0, 1) for the next dimension.
+    virtual float get1D() = 0;
+
+    /// \return A point in the range [0, 1) in x and y for the next two
+    /// dimensions.
+    virtual Vector3<float> get2D() = 0;
+
+    /// \brief Allows a tc::Sampler to be used as the offset function of
+    /// tc::generateStratifiedDirection.
+    inline float operator()(const float lowerRange, const float upperRange);
+
+protected:
+    size_t m_pixelIndex;
+    size_t m_sampleIndex;
+    size_t m_dimension;
+};
+
+//------------------------------------------------------------------------------
+inline Sampler::Sampler() : m_pixelIndex(0), m_sampleIndex(0), m_dimension(0)
+{
+}
+
+//------------------------------------------------------------------------------
+inline size_t Sampler::getDimension() const
+{
+    return m_dimension;
+}
+
+//------------------------------------------------------------------------------
+inline float Sampler::operator()(const float lowerRange,
+                                 const float upperRange)
+{
+    return lowerRange + (get1D() * (upperRange - lowerRange));
+}
+
+//------------------------------------------------------------------------------
+// RandomSampler
+//------------------------------------------------------------------------------
+/// \brief Independent uniform random values, with no stratification between
+/// samples.
+//------------------------------------------------------------------------------
+class RandomSampler : public Sampler
+{
+public:
+    virtual void startPixelSample(const size_t pixelIndex,
+                                  const size_t sampleIndex);
+
+    virtual void resumePixelSample(const size_t pixelIndex,
+                                   const size_t sampleIndex,
+                                   const size_t dimension);
+    virtual float get1D();
+    virtual Vector3<float> get2D();
+
+private:
+    Random m_random;
+};
+
+//------------------------------------------------------------------------------
+// HaltonSampler
+//------------------------------------------------------------------------------
+/// \brief The 2D Halton sequence (bases 2 and 3) indexed by sample number.
+///
+/// Every pair of dimensions draws from the same two bases. To stop the pairs,
+/// and neighbouring pixels, from being correlated, each one is given its own
+/// toroidal (Cranley-Patterson) rotation.
+//------------------------------------------------------------------------------
+class HaltonSampler : public Sampler
+{
+public:
+    virtual float get1D();
+    virtual Vector3<float> get2D();
+};
+
+//------------------------------------------------------------------------------
+// SobolSampler
+//------------------------------------------------------------------------------
+/// \brief The first two dimensions of the Sobol sequence, Owen scrambled.
+///
+/// Each pair of dimensions is given its own scramble and its own shuffle of
+/// the sample order, so the pairs behave as independent (0,2) sequences.
+/// Any power of two number of samples per pixel is perfectly stratified.
+//------------------------------------------------------------------------------
+class SobolSampler : public Sampler
+{
+public:
+    virtual float get1D();
+    virtual Vector3<float> get2D();
+};
+
+//------------------------------------------------------------------------------
+// SampleOffset
+//------------------------------------------------------------------------------
+/// \brief Feeds an already drawn 2D sample to tc::generateStratifiedDirection,
+/// which asks for its offsets one at a time.
+//------------------------------------------------------------------------------
+class SampleOffset
+{
+public:
+    inline SampleOffset(const Vector3<float>& sample);
+    inline float operator()(const float lowerRange, const float upperRange);
+
+private:
+    const Vector3<float> m_sample;
+    size_t m_dimension;
+};
+
+//------------------------------------------------------------------------------
+inline SampleOffset::SampleOffset(const Vector3<float>& sample)
+    : m_sample(sample), m_dimension(0)
+{
+}
+
+//------------------------------------------------------------------------------
+inline float SampleOffset::operator()(const float lowerRange,
+                                      const float upperRange)
+{
+    const float t = m_sample[m_dimension++];
+    return lowerRange + (t * (upperRange - lowerRange));
+}
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'sampler' header file.
+/// \cond
+void samplerRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
+}  // namespace tc
+#endif  // TC_SAMPLER
@@ -4,19 +4,71 @@
 #ifndef TC_SHADE
 #define TC_SHADE
 //------------------------------------------------------------------------------
+#include "trace/raysort.h"
+#include "trace/raystream.h"
+#include "trace/sampledspectrum.h"
+#include "trace/solidangle.h"
+//------------------------------------------------------------------------------
 #include <cstdlib>
+#include <vector>
 //------------------------------------------------------------------------------
 namespace tc
 {
+class Emitter;
 class GeoAPI;
+class IrradianceCache;
 class Ray;
+class RenderSettings;
 class SampledSpectrum;
+class Sampler;
 class SearchCache;
 class ShadeAPI;
+class Shader;
+class SimpleScene;
 class ShadeStack;
 class ShadeStackFrame;
 class TraceResult;
 
+//------------------------------------------------------------------------------
+// IntegratorMode
+//------------------------------------------------------------------------------
+/// \brief The light transport algorithms available to tc::shade::Integrator.
+//------------------------------------------------------------------------------
+enum IntegratorMode
+{
+    /// Fires qualityLevel * (qualityLevel * 4) stratified rays at every hit,
+    /// each with a shadow ray at the emitters, recursing up to the maximum ray
+    /// depth.
+    kIntegratorStratified = 0,
+    /// Fires a single continuation ray at every hit and ends paths with
+    /// Russian roulette. The number of samples per pixel is the only quality
+    /// setting.
+    kIntegratorPath = 1,
+    /// The same estimate as kIntegratorPath, but computed a tile at a time by
+    /// tc::shade::Wavefront. Every ray in the tile goes through each stage of
+    /// the renderer together, rather than one path at a time.
+    kIntegratorWavefront = 2,
+    /// A preview. Fires the same rays as kIntegratorStratified at the first
+    /// hit, but only asks whether anything lies within
+    /// tc::RenderSettings::m_ambientOcclusionDistance along them, lighting
+    /// the point by the fraction that are open. Nothing is recursed into.
+    kIntegratorAmbientOcclusion = 3,
+    /// A preview. Lights the first hit by the emitters alone, with the same
+    /// number of shadow rays as kIntegratorStratified has bounce rays. The
+    /// light that bounces between surfaces is left out.
+    kIntegratorDirect = 4
+};
+
+//------------------------------------------------------------------------------
+// parseIntegratorMode
+//------------------------------------------------------------------------------
+/// \brief Converts the name of an integrator ("stratified", "path",
+/// "wavefront", "ambientOcclusion" or "direct") to a tc::IntegratorMode.
+/// \return defaultValue if the name isn't recognised.
+//------------------------------------------------------------------------------
+IntegratorMode parseIntegratorMode(const char* name,
+                                   const IntegratorMode defaultValue);
+
 namespace shade
 {
 
@@ -36,6 +88,10 @@ public:
     /// \param searchCache: Reusable memory for acceleration structure search
     /// results.
     /// \param shadeStack: For recursive shader evaluation.
+    /// \param sampler: Provides the values used to pick bounce directions.
+    /// The caller is expected to call tc::Sampler::startPixelSample before
+    /// each estimate, so the estimate for a given sample is the same no
+    /// matter which thread computes it.
     /// \param maxRayDepth: The maximum number of times a ray is allowed to
     /// bounce and shatter before path tracing is stopped.
     /// \param qualityLevel A hint for the number of rays to fire per hemisphere
@@ -44,10 +100,16 @@ public:
     /// \param rayPositionOffset: A tiny delta to offset the bounce ray start
     /// position by, in the direction of the ray. This stops bounce rays from
     /// immediately intersecting with the surface they are emitted from.
+    /// \param settings: Selects the integrator mode, see tc::RenderSettings.
+    /// \param irradianceCache: Shared by every integrator of a render, so
+    /// diffuse points can reuse the estimates made for points near them.
+    /// Only used by kIntegratorStratified, may be null.
     Integrator(const GeoAPI& geoApi, const ShadeAPI& shadeApi,
                SearchCache& searchCache, ShadeStack& shadeStack,
-               const size_t maxRayDepth, const size_t qualityLevel,
-               const float rayPositionOffset);
+               Sampler& sampler, const size_t maxRayDepth,
+               const size_t qualityLevel, const float rayPositionOffset,
+               const RenderSettings& settings,
+               IrradianceCache* irradianceCache = 0);
 
     /// \return true if the final radiance value for this integrator has been
     /// computed, false if not.
@@ -69,18 +131,343 @@ public:
     size_t getNumSamples() const;
 
 private:
+    // The wavefront renderer runs the same steps as the path integrator, in a
+    // different order.
+    friend class Wavefront;
+
+    /// \brief Either traces a bounce ray for the frame at the top of the
+    /// shade stack, or shades that frame and pops it.
+    void advance() const;
+
+    /// \brief See tc::shade::Integrator::advance. The private methods that
+    /// take a 'shading' make every scene and shader call through it, see
+    /// tc::ShadeAPI_Shading and tc::SimpleScene_Shading.
+    template <typename Shading>
+    void advance(const Shading& shading) const;
+
+    /// \brief Lights the root frame as the preview integrators do, with
+    /// occlusion queries rather than recursion, and marks it done.
+    template <typename Shading>
+    void estimatePreview(const Shading& shading) const;
+
+    /// \brief Sets the radiance of frame to the cosine weighted fraction of
+    /// its bounce rays that are open for m_ambientOcclusionDistance.
+    template <typename Shading>
+    void estimateAmbientOcclusion(const Shading& shading,
+                                  ShadeStackFrame& frame) const;
+
+    /// \brief Shades the frame at the top of the shade stack and stores the
+    /// result in its parent, or marks it done if it is the root frame.
+    template <typename Shading>
+    void finish(const Shading& shading) const;
+
+    /// \brief Fills in the radiance of frame from the irradiance cache.
+    /// \return false if frame isn't diffuse, or the cache has no record
+    /// close enough, in which case its rays have to be traced.
+    template <typename Shading>
+    bool lookupIrradiance(const Shading& shading,
+                          ShadeStackFrame& frame) const;
+
+    /// \brief Adds what is needed to turn parentFrame into an irradiance
+    /// cache record, once all its rays are in. 'contribution' is the
+    /// radiance bounceFrame added to it.
+    template <typename Shading>
+    void addIrradianceSample(const Shading& shading,
+                             ShadeStackFrame& parentFrame,
+                             const ShadeStackFrame& bounceFrame,
+                             const SampledSpectrum& contribution) const;
+
+    /// \brief Inserts the estimate for frame into the irradiance cache.
+    template <typename Shading>
+    void recordIrradiance(const Shading& shading,
+                          const ShadeStackFrame& frame) const;
+
+    /// \return true if the path should carry on from a point 'depth' rays
+    /// deep, which passes 'throughput' of its light back to the camera. This
+    /// plays Russian roulette once the path is long enough, in which case
+    /// continueWeight is set to the weight surviving paths must be given.
+    bool continuePath(const float throughput, const size_t depth,
+                      float& continueWeight) const;
+
+    /// \brief Next event estimation. Picks a point on one of the scene's
+    /// emitters and, if it is visible, adds its contribution to frame.
+    template <typename Shading>
+    void sampleEmitter(const Shading& shading, ShadeStackFrame& frame) const;
+
+    /// \return true if next event estimation samples 'emitter' from
+    /// 'position'. Emitters that cover much of the view from there are left
+    /// to the bounce rays.
+    bool isEmitterSampled(const Emitter& emitter,
+                          const Vector3<float>& position) const;
+
+    /// \return The multiple importance sampling weight for the radiance
+    /// bounceFrame passes back to frame.
+    template <typename Shading>
+    float computeBounceWeight(const Shading& shading,
+                              const ShadeStackFrame& frame,
+                              const ShadeStackFrame& bounceFrame) const;
+
+    /// \return A bounce ray for the i'th strata of frame. directionWeight is
+    /// set to the factor the radiance it finds must be scaled by.
+    template <typename Shading>
+    const Ray generateBounceRay(const Shading& shading,
+                                const ShadeStackFrame& frame, const size_t i,
+                                float& directionWeight) const;
+
+    /// \return The solid angle pdf of the bounce rays taking a direction
+    /// whose angle to the surface normal has the given cosine.
+    float computeBouncePdf(const float cosTheta) const;
+
     // TODO LT: Order this alphabetically and group const members seperately to
     // non-const members.
+    const IntegratorMode m_mode;
+    const size_t m_russianRouletteDepth;
+    const bool m_nextEventEstimation;
+    const bool m_cosineWeightedSampling;
+    const bool m_sortBounceRays;
     const size_t m_pitchSamples;
     const size_t m_yawSamples;
     const size_t m_numSamples;
+    const CosineDirectionTable m_directionTable;
     const GeoAPI& m_geoAPI;
     const ShadeAPI& m_shadeAPI;
+    // Set when m_shadeAPI is a tc::SimpleScene, in which case the paths are
+    // followed with tc::SimpleScene_Shading.
+    const SimpleScene* m_simpleScene;
     SearchCache& m_searchCache;
     ShadeStack& m_shadeStack;
+    Sampler& m_sampler;
     const size_t m_maxRayDepth;
     const size_t m_qualityLevel;
     const float m_rayPositionOffset;
+    const float m_ambientOcclusionDistance;
+    // Null unless the integrator is stratified and a cache was given.
+    IrradianceCache* const m_irradianceCache;
+};
+
+//------------------------------------------------------------------------------
+// WavefrontQueue
+//------------------------------------------------------------------------------
+/// \brief The rays in flight in a tc::shade::Wavefront, stored as a
+/// structure of arrays so each stage only touches the data it needs.
+///
+/// Each ray knows the point it was fired from, its 'parent', which the shade
+/// stage needs in order to work out how much of the light found by the ray
+/// makes it back to the camera.
+//------------------------------------------------------------------------------
+class WavefrontQueue
+{
+public:
+    /// \brief Appends a ray, and the state of the path it belongs to.
+    void push(const Vector3<float>& direction, const Vector3<float>& position,
+              const Vector3<float>& parentDirection,
+              const Vector3<float>& parentPosition,
+              const TraceResult& parentTraceResult, const size_t slot,
+              const size_t pixelIndex, const size_t sampleIndex,
+              const size_t dimension, const size_t depth,
+              const SampledSpectrum& pathWeight, const float weight,
+              const float throughput);
+
+    /// \brief Removes every ray from the queue. The memory is kept.
+    void clear();
+
+    size_t size() const;
+
+    // The ray.
+    std::vector<Vector3<float> > m_directions;
+    std::vector<Vector3<float> > m_positions;
+
+    // Filled in by the trace stage.
+    std::vector<float> m_distances;
+    std::vector<size_t> m_objectIndices;
+    std::vector<size_t> m_elementIndices;
+    std::vector<Vector3<float> > m_normals;
+
+    // The point the ray was fired from. Camera rays have no parent, which is
+    // marked by an object index of 0.
+    std::vector<Vector3<float> > m_parentDirections;
+    std::vector<Vector3<float> > m_parentPositions;
+    std::vector<float> m_parentDistances;
+    std::vector<size_t> m_parentObjectIndices;
+    std::vector<size_t> m_parentElementIndices;
+    std::vector<Vector3<float> > m_parentNormals;
+
+    // The path.
+    /// Where the radiance of the path is stored.
+    std::vector<size_t> m_slots;
+    std::vector<size_t> m_pixelIndices;
+    std::vector<size_t> m_sampleIndices;
+    /// The next sampler dimension the path will draw.
+    std::vector<size_t> m_dimensions;
+    /// How many rays deep the point the ray finds will be, the camera ray
+    /// finds points at depth 1.
+    std::vector<size_t> m_depths;
+    /// The factor light leaving the parent is scaled by on the way to the
+    /// camera.
+    std::vector<SampledSpectrum> m_pathWeights;
+    /// See tc::ShadeStackFrame::m_weight.
+    std::vector<float> m_weights;
+    /// See tc::ShadeStackFrame::m_throughput.
+    std::vector<float> m_throughputs;
+    /// Set by the shade stage when the point found by the ray needs a bounce
+    /// ray.
+    std::vector<bool> m_bounces;
+};
+
+//------------------------------------------------------------------------------
+// ShaderBuckets
+//------------------------------------------------------------------------------
+/// \brief Groups the hits of a batch by the tc::Shader that shades them.
+///
+/// Running one shader over all of its hits before moving to the next keeps
+/// its code in the instruction cache and its branches predictable, and gives
+/// each shader a list of hits that a batched implementation could shade
+/// together. Within a bucket hits keep the order they were added in, and the
+/// buckets are in the order their shaders were first seen, so the result
+/// doesn't depend on where the shaders are in memory.
+/// \code
+/// tc::shade::ShaderBuckets buckets;
+/// buckets.add(&shaderA, 0);
+/// buckets.add(&shaderB, 1);
+/// buckets.add(&shaderA, 2);
+/// buckets.build();
+/// // 0, 2, 1
+/// for (size_t i = 0; i != buckets.size(); ++i) shadeHit(buckets[i]);
+/// \endcode
+//------------------------------------------------------------------------------
+class ShaderBuckets
+{
+public:
+    /// \brief Removes every hit, keeping the memory for reuse.
+    void clear();
+
+    /// \brief Adds the hit with the given index, shaded by 'shader'.
+    void add(const Shader* shader, const size_t index);
+
+    /// \brief Sorts the hits added since clear into their buckets.
+    void build();
+
+    /// \return The number of hits.
+    size_t size() const;
+
+    /// \return The index of the i'th hit, bucket by bucket.
+    size_t operator[](const size_t i) const;
+
+    /// \return The number of different shaders.
+    size_t getBucketCount() const;
+
+    /// \return The shader of the given bucket.
+    const Shader* getShader(const size_t bucket) const;
+
+    /// \return The range [begin, end) of hits, as positions for operator[],
+    /// that belong to the given bucket.
+    size_t getBucketBegin(const size_t bucket) const;
+    size_t getBucketEnd(const size_t bucket) const;
+
+private:
+    // The shader of each bucket, and the bucket of each hit that was added.
+    std::vector<const Shader*> m_shaders;
+    std::vector<size_t> m_hitBuckets;
+    std::vector<size_t> m_hitIndices;
+
+    // Filled in by build. m_bucketBegins has an extra entry for the end of
+    // the last bucket.
+    std::vector<size_t> m_bucketBegins;
+    std::vector<size_t> m_positions;
+    std::vector<size_t> m_sorted;
+};
+
+//------------------------------------------------------------------------------
+// Wavefront
+//------------------------------------------------------------------------------
+/// \brief Renders the path tracing estimate for many pixel samples at once.
+///
+/// tc::shade::Integrator follows a single path from start to finish,
+/// alternating between traversing the acceleration structure, calling
+/// shaders and drawing samples. This class instead puts every ray of a tile
+/// through one stage at a time:
+/// - camera ray generation, by the caller through addCameraRay.
+/// - trace, finding the closest hit for every ray in the queue. Camera rays
+/// are traced in packets of neighbouring pixels, bounce rays are traced
+/// together as one tc::RayStream, optionally sorted by tc::RaySorter first.
+/// - shade, computing the light each hit sends back to the camera. Hits
+/// are grouped by shader first, see tc::shade::ShaderBuckets.
+/// - bounce ray generation, filling the queue for the next round.
+///
+/// Each stage works through the arrays of a tc::shade::WavefrontQueue in
+/// order, which keeps the caches warm and gives later stages the
+/// opportunity to sort or batch their work.
+///
+/// The result is the same as kIntegratorPath, the sampler is drawn from in
+/// the same order for every path.
+/// \code
+/// tc::shade::Wavefront wavefront(integrator);
+/// wavefront.reset(pixelCount);
+/// wavefront.addCameraRay(ray, slot, pixelIndex, sampleIndex, dimension);
+/// wavefront.render();
+/// const tc::SampledSpectrum& result = wavefront.getRadiance(slot);
+/// \endcode
+//------------------------------------------------------------------------------
+class Wavefront
+{
+public:
+    /// \brief Initializes a Wavefront.
+    /// \param integrator Provides the scene, sampler and settings. Paths are
+    /// terminated, and emitters sampled, exactly as the integrator would.
+    Wavefront(const Integrator& integrator);
+
+    /// \brief Discards the queued rays and makes room for the results of
+    /// 'slotCount' pixel samples.
+    void reset(const size_t slotCount);
+
+    /// \brief Queues a camera ray.
+    /// \param slot Where the radiance found by the ray is stored.
+    /// \param pixelIndex The pixel index passed to tc::Sampler.
+    /// \param sampleIndex The sample index passed to tc::Sampler.
+    /// \param dimension The next dimension of the sampler for this pixel
+    /// sample, after the camera ray was generated.
+    void addCameraRay(const Ray& ray, const size_t slot,
+                      const size_t pixelIndex, const size_t sampleIndex,
+                      const size_t dimension);
+
+    /// \brief Runs the trace, shade and bounce stages until every path has
+    /// finished.
+    void render();
+
+    /// \return The radiance found for the given slot.
+    const SampledSpectrum& getRadiance(const size_t slot) const;
+
+private:
+    void trace();
+    void shade();
+    void generateBounceRays();
+
+    // The stages above, for a given tc::ShadeAPI_Shading or
+    // tc::SimpleScene_Shading.
+    template <typename Shading>
+    void shade(const Shading& shading);
+    template <typename Shading>
+    void generateBounceRays(const Shading& shading);
+
+    // The two halves of the shade stage for the i'th ray in the queue. The
+    // first uses the shader of the point the ray left, the second the
+    // shader of the point it found.
+    template <typename Shading>
+    void weighBounce(const Shading& shading, const size_t i);
+    template <typename Shading>
+    void shadeHit(const Shading& shading, const size_t i);
+
+    const Integrator& m_integrator;
+    WavefrontQueue m_queue;
+    WavefrontQueue m_nextQueue;
+    std::vector<SampledSpectrum> m_radiance;
+
+    // The bounce rays of the queue, and the queue index of each one.
+    RayStream m_stream;
+    RayStream_TraceResult m_streamResult;
+    std::vector<size_t> m_streamQueueIndices;
+    RaySorter m_raySorter;
+    ShaderBuckets m_shaderBuckets;
 };
 
 }  // namespace shade
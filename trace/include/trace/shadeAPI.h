@@ -4,12 +4,20 @@
 #ifndef TC_SHADEAPI
 #define TC_SHADEAPI
 //------------------------------------------------------------------------------
+#include "trace/geoid.h"
+#include "trace/sampledspectrum.h"
+#include "trace/shader.h"
+#include "trace/surfaceframe.h"
+#include "trace/traceResult.h"
+//------------------------------------------------------------------------------
+#include <cstdlib>
+//------------------------------------------------------------------------------
 
 namespace tc
 {
-class GeoID;
-class Shader;
-class SurfaceFrame;
+class Emitter;
+class Radiance;
+class Ray;
 
 //------------------------------------------------------------------------------
 /// \brief An abstract interface for querying the surface shader for a given
@@ -32,8 +40,13 @@ public:
     /// \return A tc::SurfaceFrame instance for the given item of geoemtry.
     /// The tc::SurfaceFrame contains three axis; normal, tangent and
     /// bi-tangent and is used for creating a hemisphere around a given point.
-    virtual const SurfaceFrame& shade_getSurfaceFrame(const GeoID& geoID)
-        const = 0;
+    /// It is returned by value, so it can be derived from a smaller
+    /// representation, such as a normal, rather than stored, and so it stays
+    /// valid after the mesh it came from has been paged out. This used to
+    /// return a const reference; implementations written against that have
+    /// to change their signature, while callers that bind the result to a
+    /// const reference work as before.
+    virtual SurfaceFrame shade_getSurfaceFrame(const GeoID& geoID) const = 0;
 
     /// Concrete implementations of tc::ShadeAPI have to implement this method.
     /// \param geoID A reference to the item of geoemetry being rendered. geoID
@@ -42,7 +55,144 @@ public:
     /// \return A shader object. This is a concrete implementation of the
     /// tc::Shader interface, containing a 'shade' implementation.
     virtual const Shader& shade_getSurfaceShader(const GeoID& geoID) const = 0;
+
+    /// Optional. Scenes with light sources should implement this, so that
+    /// they can be sampled directly.
+    /// \return The number of emitters in the scene.
+    virtual size_t shade_getEmitterCount() const
+    {
+        return 0;
+    }
+
+    /// Optional. See tc::ShadeAPI::shade_getEmitterCount.
+    /// \param index An index less than shade_getEmitterCount.
+    /// \return The emitter for the given index.
+    virtual const Emitter* shade_getEmitter(const size_t index) const
+    {
+        return 0;
+    }
 };
 
+//------------------------------------------------------------------------------
+// ShadeAPI_Shading
+//------------------------------------------------------------------------------
+/// \brief The shading calls tc::shade::Integrator makes, for any
+/// tc::ShadeAPI and any tc::Shader.
+///
+/// The integrator is written against a 'shading' type, which provides the
+/// methods of this class, so it can be compiled for a concrete scene and set
+/// of shaders whose calls can be inlined, see tc::SimpleScene_Shading. This is
+/// the version every scene works with, every call is made through the
+/// virtual interfaces.
+///
+/// The shader methods pick the shader for the tc::GeoID of 'traceResult'.
+//------------------------------------------------------------------------------
+class ShadeAPI_Shading
+{
+public:
+    /// \brief Initializes a tc::ShadeAPI_Shading for 'shadeApi'.
+    inline explicit ShadeAPI_Shading(const ShadeAPI& shadeApi);
+
+    /// \brief See tc::ShadeAPI::shade_getSurfaceFrame, for the tc::GeoID of
+    /// 'traceResult'.
+    inline SurfaceFrame shade_getSurfaceFrame(
+        const TraceResult& traceResult) const;
+
+    /// \brief See tc::ShadeAPI::shade_getSurfaceShader.
+    inline const Shader& shade_getSurfaceShader(const GeoID& geoID) const;
+
+    /// \brief See tc::ShadeAPI::shade_getEmitterCount.
+    inline size_t shade_getEmitterCount() const;
+
+    /// \brief See tc::ShadeAPI::shade_getEmitter.
+    inline const Emitter* shade_getEmitter(const size_t index) const;
+
+    /// \brief See tc::Shader::needsRays.
+    inline bool needsRays(const GeoID& geoID) const;
+
+    /// \brief See tc::Shader::isDiffuse.
+    inline bool isDiffuse(const GeoID& geoID) const;
+
+    /// \brief See tc::Shader::shade.
+    inline SampledSpectrum shade(size_t radianceCount,
+                                 const SampledSpectrum& radianceSum,
+                                 const TraceResult& traceResult,
+                                 const Ray& ray,
+                                 const SampledSpectrum& localColor) const;
+
+    /// \brief See tc::Shader::accumulate.
+    inline void accumulate(const TraceResult& traceResult,
+                           const Radiance& radiance, const Ray& ray,
+                           SampledSpectrum& result) const;
+
+private:
+    const ShadeAPI& m_shadeApi;
+};
+
+//------------------------------------------------------------------------------
+inline ShadeAPI_Shading::ShadeAPI_Shading(const ShadeAPI& shadeApi)
+    : m_shadeApi(shadeApi)
+{
+}
+
+//------------------------------------------------------------------------------
+inline SurfaceFrame ShadeAPI_Shading::shade_getSurfaceFrame(
+    const TraceResult& traceResult) const
+{
+    return m_shadeApi.shade_getSurfaceFrame(traceResult.m_geoId);
+}
+
+//------------------------------------------------------------------------------
+inline const Shader& ShadeAPI_Shading::shade_getSurfaceShader(
+    const GeoID& geoID) const
+{
+    return m_shadeApi.shade_getSurfaceShader(geoID);
+}
+
+//------------------------------------------------------------------------------
+inline size_t ShadeAPI_Shading::shade_getEmitterCount() const
+{
+    return m_shadeApi.shade_getEmitterCount();
+}
+
+//------------------------------------------------------------------------------
+inline const Emitter* ShadeAPI_Shading::shade_getEmitter(
+    const size_t index) const
+{
+    return m_shadeApi.shade_getEmitter(index);
+}
+
+//------------------------------------------------------------------------------
+inline bool ShadeAPI_Shading::needsRays(const GeoID& geoID) const
+{
+    return m_shadeApi.shade_getSurfaceShader(geoID).needsRays();
+}
+
+//------------------------------------------------------------------------------
+inline bool ShadeAPI_Shading::isDiffuse(const GeoID& geoID) const
+{
+    return m_shadeApi.shade_getSurfaceShader(geoID).isDiffuse();
+}
+
+//------------------------------------------------------------------------------
+inline SampledSpectrum ShadeAPI_Shading::shade(
+    const size_t radianceCount, const SampledSpectrum& radianceSum,
+    const TraceResult& traceResult, const Ray& ray,
+    const SampledSpectrum& localColor) const
+{
+    return m_shadeApi.shade_getSurfaceShader(traceResult.m_geoId)
+        .shade(radianceCount, radianceSum, traceResult, ray, localColor);
+}
+
+//------------------------------------------------------------------------------
+inline void ShadeAPI_Shading::accumulate(const TraceResult& traceResult,
+                                         const Radiance& radiance,
+                                         const Ray& ray,
+                                         SampledSpectrum& result) const
+{
+    m_shadeApi.shade_getSurfaceShader(traceResult.m_geoId)
+        .accumulate(traceResult, radiance, ray, m_shadeApi, result);
+}
+
 }  // namespace tc
 #endif  // TC_SHADEAPI
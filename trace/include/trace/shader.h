@@ -78,6 +78,15 @@ public:
     /// \return True if this shader needs to trace rays in order to estimate its
     /// integral. False if no ray tracing is needed.
     virtual bool needsRays() const = 0;
+
+    /// Optional. Diffuse shaders, whose result is the average of the radiance
+    /// they accumulate, can be interpolated between nearby points by
+    /// tc::IrradianceCache.
+    /// \return True if the shader is diffuse.
+    virtual bool isDiffuse() const
+    {
+        return false;
+    }
 };
 }  // namespace tc
 #endif  // TC_SHADER
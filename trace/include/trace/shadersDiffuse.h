@@ -4,7 +4,13 @@
 #ifndef TC_SHADERSDIFFUSE
 #define TC_SHADERSDIFFUSE
 //------------------------------------------------------------------------------
+#include "trace/geoid.h"
+#include "trace/radiance.h"
+#include "trace/ray.h"
+#include "trace/sampledspectrum.h"
 #include "trace/shader.h"
+#include "trace/surfaceframe.h"
+#include "trace/traceResult.h"
 //------------------------------------------------------------------------------
 #include <cstdlib>
 //------------------------------------------------------------------------------
@@ -56,7 +62,89 @@ public:
 
     /// \return True always.
     bool needsRays() const;
+
+    /// \return True always.
+    bool isDiffuse() const
+    {
+        return isDiffuseDirect();
+    }
+
+    /// \brief The same as shade, but not virtual. A caller that knows it has
+    /// a tc::shaders::Diffuse can have this inlined, see
+    /// tc::SimpleScene_Shading.
+    inline SampledSpectrum shadeDirect(size_t radianceCount,
+                                       const SampledSpectrum& radianceSum,
+                                       const TraceResult& traceResult,
+                                       const Ray& ray,
+                                       const SampledSpectrum& localColor) const;
+
+    /// \brief The same as accumulate, but not virtual.
+    /// \param shadeApi Anything with a shade_getSurfaceFrame method taking a
+    /// tc::TraceResult, such as tc::ShadeAPI_Shading, so that it can be a
+    /// concrete type whose surface frames are also found without a virtual
+    /// call.
+    template <typename ShadeAPIType>
+    inline void accumulateDirect(const TraceResult& traceResult,
+                                 const Radiance& radiance, const Ray& ray,
+                                 const ShadeAPIType& shadeApi,
+                                 SampledSpectrum& result) const;
+
+    /// \brief The same as needsRays, but not virtual.
+    inline bool needsRaysDirect() const
+    {
+        return true;
+    }
+
+    /// \brief The same as isDiffuse, but not virtual.
+    inline bool isDiffuseDirect() const
+    {
+        return true;
+    }
 };
+
+//------------------------------------------------------------------------------
+inline SampledSpectrum Diffuse::shadeDirect(
+    const size_t radianceCount, const SampledSpectrum& radianceSum,
+    const TraceResult& traceResult, const Ray& ray,
+    const SampledSpectrum& localColor) const
+{
+    if (radianceCount == 0)
+    {
+        return SampledSpectrum(0.0f);
+    }
+
+    const float radianceCountFloat = static_cast<float>(radianceCount);
+    const SampledSpectrum luminence = radianceSum / radianceCountFloat;
+    const SampledSpectrum coloredSample = (localColor * luminence);
+
+    return coloredSample;
+}
+
+//------------------------------------------------------------------------------
+template <typename ShadeAPIType>
+inline void Diffuse::accumulateDirect(const TraceResult& traceResult,
+                                      const Radiance& radiance,
+                                      const Ray& ray,
+                                      const ShadeAPIType& shadeApi,
+                                      SampledSpectrum& result) const
+{
+    if (radiance.m_traceResult.hasHitSomething())
+    {
+        const SurfaceFrame& surfaceFrame =
+            shadeApi.shade_getSurfaceFrame(traceResult);
+        const float angularFalloff = ray.m_direction.dot(surfaceFrame.m_normal);
+
+        const float distanceFalloff =
+            radiance.m_traceResult.m_distanceAlongRay >= 1.0f
+                ? 1.0f / radiance.m_traceResult.m_distanceAlongRay
+                : 1.0f;
+
+        const SampledSpectrum color =
+            radiance.m_color * (angularFalloff * distanceFalloff);
+        result += color;
+    }
+}
+
 }  // namespace shaders
 }  // namespace tc
 #endif  // TC_SHADERSDIFFUSE
@@ -50,6 +50,39 @@ public:
 
     /// \return False always.
     bool needsRays() const
+    {
+        return needsRaysDirect();
+    }
+
+    /// \brief The same as shade, but not virtual. A caller that knows it has
+    /// a tc::shaders::WhiteLight can have this inlined, see
+    /// tc::SimpleScene_Shading.
+    inline SampledSpectrum shadeDirect(size_t radianceCount,
+                                       const SampledSpectrum& radianceSum,
+                                       const TraceResult& traceResult,
+                                       const Ray& ray,
+                                       const SampledSpectrum& localColor) const
+    {
+        return SampledSpectrum(m_intensity);
+    }
+
+    /// \brief The same as accumulate, but not virtual.
+    template <typename ShadeAPIType>
+    inline void accumulateDirect(const TraceResult& traceResult,
+                                 const Radiance& radiance, const Ray& ray,
+                                 const ShadeAPIType& shadeApi,
+                                 SampledSpectrum& result) const
+    {
+    }
+
+    /// \brief The same as needsRays, but not virtual.
+    inline bool needsRaysDirect() const
+    {
+        return false;
+    }
+
+    /// \brief The same as tc::Shader::isDiffuse, but not virtual.
+    inline bool isDiffuseDirect() const
     {
         return false;
     }
@@ -8,6 +8,7 @@
 #include "trace/ray.h"
 #include "trace/traceResult.h"
 #include "trace/sampledspectrum.h"
+#include "trace/vector.h"
 //------------------------------------------------------------------------------
 
 namespace tc
@@ -36,6 +37,19 @@ public:
     /// The aggregate result of radiance values that contribute to this point's
     /// irradiance.
     SampledSpectrum m_radianceSum;
+    /// The amount the shaded value of this point is scaled by before it is
+    /// passed on to its parent. Used to compensate for paths terminated by
+    /// Russian roulette.
+    float m_weight;
+    /// The fraction of this point's radiance that makes it back to the
+    /// camera.
+    float m_throughput;
+    /// Used by tc::IrradianceCache. The sum of the inverse distances to the
+    /// points found by this point's bounce rays.
+    float m_inverseDistanceSum;
+    /// Used by tc::IrradianceCache. The sum over this point's bounce rays of
+    /// tc::IrradianceCache_Record::m_rotationGradient.
+    Vector3<float> m_rotationGradientSum[TC_SAMPLED_SPECTRUM_SAMPLE_COUNT];
     /// The ray this point is on.
     const Ray m_ray;
     /// The result of the intersection of m_ray with the geometry in the scene.
@@ -68,20 +82,33 @@ public:
     /// \param traceResult The result of the intersection of ray with the
     /// geometry in the scene.
     ShadeStackFrame(const Ray& ray, const TraceResult& traceResult)
-        : m_i(0), m_ray(ray), m_traceResult(traceResult)
+        : m_i(0),
+          m_weight(1.0f),
+          m_throughput(1.0f),
+          m_inverseDistanceSum(0.0f),
+          m_ray(ray),
+          m_traceResult(traceResult)
     {
     }
 
-    ShadeStackFrame(): m_i(0)
+    ShadeStackFrame()
+        : m_i(0), m_weight(1.0f), m_throughput(1.0f), m_inverseDistanceSum(0.0f)
     {
     }
 
     ShadeStackFrame(const ShadeStackFrame& shadeStackFrame)
         : m_i(shadeStackFrame.m_i),
           m_radianceSum(shadeStackFrame.m_radianceSum),
+          m_weight(shadeStackFrame.m_weight),
+          m_throughput(shadeStackFrame.m_throughput),
+          m_inverseDistanceSum(shadeStackFrame.m_inverseDistanceSum),
           m_ray(shadeStackFrame.m_ray),
           m_traceResult(shadeStackFrame.m_traceResult)
     {
+        for (size_t i = 0; i != TC_SAMPLED_SPECTRUM_SAMPLE_COUNT; ++i)
+        {
+            m_rotationGradientSum[i] = shadeStackFrame.m_rotationGradientSum[i];
+        }
     }
 };
 
@@ -4,11 +4,20 @@
 #ifndef TC_SIMPLESCENE
 #define TC_SIMPLESCENE
 //------------------------------------------------------------------------------
+#include "trace/assert.h"
 #include "trace/bounds.h"
-#include "trace/constvector.h"
+#include "trace/emitter.h"
 #include "trace/geoAPI.h"
+#include "trace/geoid.h"
+#include "trace/int.h"
+#include "trace/objectiterator.h"
+#include "trace/radiance.h"
+#include "trace/sampledspectrum.h"
 #include "trace/shadeAPI.h"
+#include "trace/shadersDiffuse.h"
+#include "trace/shadersWhiteLight.h"
 #include "trace/surfaceframe.h"
+#include "trace/thread.h"
 #include "trace/traceResult.h"
 #include "trace/triangle.h"
 #include "trace/triangleCache.h"
@@ -18,7 +27,8 @@
 
 namespace tc
 {
-class ObjectIterator;
+class LogContext;
+class Ray;
 class Shader;
 
 //------------------------------------------------------------------------------
@@ -27,8 +37,10 @@ class Shader;
 /// \brief Provides a barebones polygon mesh implementation.
 /// Contains:
 /// -* Acceleration structure (KDTree)
-/// -* Array of triangles
-/// -* Array of normals, tangents and bi-tangents
+/// -* Array of vertices, each stored once however many triangles share it
+/// -* Array of three 32 bit vertex indices for each triangle
+/// -* Array of normals, from which the tangents and bi-tangents are derived
+/// when they are needed
 //------------------------------------------------------------------------------
 class SimplePolyMesh
 {
@@ -54,29 +66,179 @@ public:
     SimplePolyMesh();
 
     /// \brief Initialise the contents of the poly mesh with triangle
-    /// information.
+    /// information. The mesh can't be traced until tc::SimplePolyMesh::build
+    /// is called. Triangles don't say which corners they share, so corners
+    /// in the same place are found by sorting them, which is only worth it
+    /// for iterators that can't give indexed arrays.
     void init(TriangleIterator& triangleIterator);
 
+    /// \brief Initialise the contents of the poly mesh from indexed arrays,
+    /// which are copied. If 'mesh' has an acceleration structure it is used
+    /// as it is, and tc::SimplePolyMesh::build has nothing to do.
+    void init(const ObjectIterator_Mesh& mesh);
+
+    /// \brief Builds the acceleration structure, if it hasn't already been
+    /// loaded. Different meshes can be built on different threads at the
+    /// same time.
+    void build();
+
+    /// \brief Points 'mesh' at the arrays of this poly mesh, which stay
+    /// valid as long as it does. The acceleration structure is written to
+    /// 'acceleration'.
+    void getMesh(ObjectIterator_Mesh& mesh,
+                 std::vector<char>& acceleration) const;
+
+    /// \return The number of triangles in the poly mesh.
+    size_t getTriangleCount() const;
+
+    /// \return The bounds of every triangle in the poly mesh.
+    BoundsF getBounds() const;
+
+    /// \return The number of bytes of memory used by the arrays and
+    /// acceleration structure of the poly mesh.
+    size_t getMemorySize() const;
+
     /// \brief Perform a ray cast into the poly mesh.
     TraceResult geo_trace(SearchCache& searchCache, const Ray& ray) const;
 
+    /// \brief Perform a ray cast into the poly mesh for every ray in a
+    /// packet.
+    KDTree_PacketTraceResult geo_tracePacket(SearchCache& searchCache,
+                                             const RayPacket& packet) const;
+
+    /// \brief Perform a ray cast into the poly mesh for every ray in a
+    /// stream.
+    void geo_traceStream(SearchCache& searchCache, const RayStream& stream,
+                         KDTree_StreamTraceResult& result) const;
+
+    /// \return true if any element of the poly mesh is hit by the ray closer
+    /// than maxDistance.
+    bool geo_occluded(SearchCache& searchCache, const Ray& ray,
+                      const float maxDistance) const;
+
     /// \return The normal. tangent and bi-tangent vectors for the element
     /// specified by 'elementIndex'.
-    const SurfaceFrame& shade_getSurfaceFrame(const size_t elementIndex) const;
+    inline SurfaceFrame shade_getSurfaceFrame(const size_t elementIndex) const;
 
-private:
-    /// \brief Initialise the contents of the poly mesh with triangle
-    /// information.
-    void addTriangle(const Triangle& triangle, const size_t index);
+    /// \return The normal of the element specified by 'elementIndex'.
+    inline const Vector3<float>& getNormal(const size_t elementIndex) const;
 
-    typedef ConstVector<SurfaceFrame> SurfaceFrames;
+    /// \return The surface frame around 'normal'.
+    inline static SurfaceFrame makeSurfaceFrame(const Vector3<float>& normal);
+
+private:
+    typedef std::vector<Vector3<float> > Vertices;
+    typedef std::vector<uint32_t> Indices;
 
     TriangleCache m_triangleCache;
-    Triangles m_triangles;
-    SurfaceFrames m_surfaceFrames;
+    Vertices m_vertices;
+    Indices m_indices;
+    Vertices m_normals;
     BoundsBuilderF m_boundsBuilder;
 };
 
+//------------------------------------------------------------------------------
+// SimpleScene_Pager
+//------------------------------------------------------------------------------
+/// \brief Loads the meshes of a tc::SimpleScene when they are first needed,
+/// and frees the least recently used meshes that aren't in use when the
+/// memory they take goes over a budget. Meshes that are in use are never
+/// freed, so the budget can be exceeded while every thread is holding a
+/// different mesh.
+///
+/// Acquiring a mesh that is loaded only takes the read lock. The write lock
+/// is taken to mark a mesh as loading, and again to add it once it has
+/// loaded, so meshes are loaded and built outside of the lock. Threads that
+/// need a mesh which another thread is loading wait for it.
+/// \snippet test_simpleScene.cpp test_simpleScene pager
+//------------------------------------------------------------------------------
+class SimpleScene_Pager
+{
+public:
+    /// \param objectIterator Loads the meshes, with
+    /// tc::ObjectIterator::loadMesh. Its iteration is ended when the pager is
+    /// destroyed.
+    /// \param memoryBudget The number of bytes the loaded meshes may take,
+    /// as given by tc::SimplePolyMesh::getMemorySize.
+    SimpleScene_Pager(ObjectIterator& objectIterator, const size_t memoryBudget);
+    ~SimpleScene_Pager();
+
+    /// \brief Adds a mesh, which is loaded from 'proxy'. Meshes can't be
+    /// added once they are being acquired.
+    void addMesh(const size_t proxy);
+
+    /// \return The mesh at 'index', loading it if it isn't already. The mesh
+    /// won't be freed until it is released. This is thread safe.
+    const SimplePolyMesh& acquire(const size_t index);
+
+    /// \brief Allows the mesh at 'index' to be freed again. This is thread
+    /// safe.
+    void release(const size_t index);
+
+    /// \return true if the mesh at 'index' is loaded.
+    bool isLoaded(const size_t index) const;
+
+    /// \return The number of bytes taken by the meshes that are loaded.
+    size_t getMemoryUsed() const;
+
+private:
+    class Page
+    {
+    public:
+        explicit Page(const size_t proxy);
+
+        size_t m_proxy;
+        SimplePolyMesh* m_mesh;
+        size_t m_memorySize;
+        // Changed atomically, as they are written while holding just the
+        // read lock.
+        unsigned int m_users;
+        uint64_t m_lastUse;
+        bool m_loading;
+    };
+
+    SimpleScene_Pager(const SimpleScene_Pager&);
+    SimpleScene_Pager& operator=(const SimpleScene_Pager&);
+
+    /// \brief Loads and builds a mesh. A mesh that can't be loaded is left
+    /// empty.
+    SimplePolyMesh* load(const size_t proxy) const;
+
+    /// \brief Frees the least recently used meshes until the budget is met,
+    /// or there are none left that aren't in use. The write lock must be
+    /// held, so no mesh can be acquired meanwhile.
+    void evict();
+
+    ObjectIterator& m_objectIterator;
+    const size_t m_memoryBudget;
+    std::vector<Page> m_pages;
+    mutable RWLock m_lock;
+    uint64_t m_clock;
+    size_t m_memoryUsed;
+};
+
+//------------------------------------------------------------------------------
+// SimpleScene_Light
+//------------------------------------------------------------------------------
+/// \brief The sphere of white light that lights a tc::SimpleScene.
+///
+/// By default the sphere surrounds the scene, lighting it like a sky. A small
+/// sphere inside the scene lights it like a bulb. Bounce rays only find a
+/// small light by chance, so it is best sampled directly, see
+/// tc::RenderSettings::m_nextEventEstimation.
+//------------------------------------------------------------------------------
+class SimpleScene_Light
+{
+public:
+    /// \brief A sphere with a radius of 20 at the origin, and an intensity of
+    /// 40.
+    SimpleScene_Light();
+
+    Vector3<float> m_position;
+    float m_radius;
+    float m_intensity;
+};
+
 //------------------------------------------------------------------------------
 // SimpleScene
 //------------------------------------------------------------------------------
@@ -94,10 +256,30 @@ private:
 class SimpleScene : public GeoAPI, public ShadeAPI
 {
 public:
-    /// \brief Initializes a tc::SimpleScene.
-    /// \param triangleIterator A concrete tc::TriangleIterator implementation
-    /// which provides the triangles to store in this scene.
-    SimpleScene(ObjectIterator& objectIterator);
+    /// \brief Initializes a tc::SimpleScene, with a tc::SimplePolyMesh for
+    /// each object. Objects are read with tc::ObjectIterator::getMesh when
+    /// the iterator supports it. The acceleration structures of the meshes
+    /// that don't come with one are built on a thread for each processor,
+    /// or one at a time as they arrive from a streaming iterator.
+    /// \param objectIterator A concrete tc::ObjectIterator implementation
+    /// which provides the objects to store in this scene.
+    /// \param memoryBudget If this isn't 0, and 'objectIterator' can load
+    /// meshes later (see tc::ObjectIterator::getProxy), only the bounds of
+    /// each mesh are read up front. A mesh is loaded and built when a ray
+    /// first reaches its bounds, and the least recently used meshes are
+    /// freed to keep the memory used by meshes within this many bytes. The
+    /// scene then ends the iteration when it is destroyed, so
+    /// 'objectIterator' must outlive it.
+    /// \param light The sphere that lights the scene.
+    SimpleScene(ObjectIterator& objectIterator, const size_t memoryBudget = 0,
+                const SimpleScene_Light& light = SimpleScene_Light());
+    ~SimpleScene();
+
+    /// \brief Writes the meshes of this scene, and their acceleration
+    /// structures, to a binary scene file. See tc::Bin_Header.
+    /// \return false if the file couldn't be written, or if the meshes are
+    /// loaded on demand.
+    bool write(const char* filename) const;
 
     /// \brief A fast implementation of tc::GeoAPI::geo_trace.
     ///
@@ -115,6 +297,23 @@ public:
     virtual TraceResult geo_trace(SearchCache& searchCache,
                                   const Ray& ray) const;
 
+    /// \brief A fast implementation of tc::GeoAPI::geo_tracePacket, which
+    /// walks the acceleration structure of each mesh with the whole packet.
+    virtual RayPacket_TraceResult geo_tracePacket(
+        SearchCache& searchCache, const RayPacket& packet) const;
+
+    /// \brief A fast implementation of tc::GeoAPI::geo_traceStream, which
+    /// walks the acceleration structure of each mesh with the whole stream.
+    virtual void geo_traceStream(SearchCache& searchCache,
+                                 const RayStream& stream,
+                                 RayStream_TraceResult& result) const;
+
+    /// \brief A fast implementation of tc::GeoAPI::geo_occluded, which stops
+    /// at the first triangle found in the way. The light sphere counts as
+    /// being in the way too.
+    virtual bool geo_occluded(SearchCache& searchCache, const Ray& ray,
+                              const float maxDistance) const;
+
     /// \brief A fast implementation of tc::ShadeAPI::shade_getSurfaceFrame.
     ///
     /// \param geoID A reference to the item of geoemetry being rendered. geoID
@@ -123,7 +322,7 @@ public:
     /// \return A tc::SurfaceFrame instance for the given item of geoemtry.
     /// The tc::SurfaceFrame contains three axis; normal, tangent and
     /// bi-tangent and is used for creating a hemisphere around a given point.
-    virtual const SurfaceFrame& shade_getSurfaceFrame(const GeoID& geoID) const;
+    virtual SurfaceFrame shade_getSurfaceFrame(const GeoID& geoID) const;
 
     /// \brief A fast implementation of tc::ShadeAPI::shade_getSurfaceShader.
     ///
@@ -134,11 +333,286 @@ public:
     /// tc::Shader interface, containing a 'shade' implementation.
     virtual const Shader& shade_getSurfaceShader(const GeoID& geoID) const;
 
+    /// \return 1, for the light sphere.
+    virtual size_t shade_getEmitterCount() const;
+
+    /// \return The light sphere.
+    virtual const Emitter* shade_getEmitter(const size_t index) const;
+
 private:
+    // Makes the same calls as the methods above, without the virtual calls.
+    friend class SimpleScene_Shading;
+
+    /// \return true if geoID refers to the light sphere.
+    inline bool isLight(const GeoID& geoID) const;
+
+    /// \brief See tc::SimpleScene::shade_getSurfaceFrame.
+    inline SurfaceFrame getSurfaceFrame(const GeoID& geoID) const;
+
+    /// \return The number of meshes, whether they are loaded or not.
+    inline size_t getMeshCount() const;
+
+    /// \return The mesh at 'index', which is loaded if it isn't already.
+    /// Each call must be matched by a call to tc::SimpleScene::releaseMesh,
+    /// until which the mesh won't be freed.
+    inline const SimplePolyMesh& acquireMesh(const size_t index) const;
+
+    /// \brief Allows the mesh at 'index' to be freed again.
+    inline void releaseMesh(const size_t index) const;
+
+    /// \brief See tc::SimpleScene::acquireMesh, when meshes are loaded on
+    /// demand.
+    const SimplePolyMesh& acquirePagedMesh(const size_t index) const;
+
+    /// \brief See tc::SimpleScene::releaseMesh, when meshes are loaded on
+    /// demand.
+    void releasePagedMesh(const size_t index) const;
+
     typedef std::vector<SimplePolyMesh> SimplePolyMeshes;
 
+    // Every mesh, unless they are loaded on demand by m_pager.
     SimplePolyMeshes m_simplePolyMeshes;
+    SimpleScene_Pager* m_pager;
+    // The bounds of each mesh, kept together so rays can skip the meshes
+    // they miss, or that are further away than something already hit.
+    std::vector<BoundsF> m_simplePolyMeshBounds;
+    const SimpleScene_Light m_light;
+    SphereEmitter* m_lightEmitter;
+    const shaders::Diffuse m_diffuseShader;
+    const shaders::WhiteLight m_lightShader;
+};
+
+//------------------------------------------------------------------------------
+// SimpleScene_Shading
+//------------------------------------------------------------------------------
+/// \brief The shading calls of a tc::SimpleScene, made without any virtual
+/// function calls.
+///
+/// tc::shade::Integrator is written against a 'shading' type rather than
+/// against tc::ShadeAPI and tc::Shader directly. tc::ShadeAPI_Shading makes
+/// every call through those interfaces, so a scene from a plugin works with
+/// any shaders. This class instead knows that every item of geometry in a
+/// tc::SimpleScene is either a triangle with a tc::shaders::Diffuse shader, or
+/// the light sphere with a tc::shaders::WhiteLight shader, so all of the
+/// calls made while following a path can be inlined.
+///
+/// Shader selection and shading is by the tc::GeoID of 'traceResult', which
+/// is how tc::ShadeAPI::shade_getSurfaceShader is always used.
+//------------------------------------------------------------------------------
+class SimpleScene_Shading
+{
+public:
+    /// \brief Initializes a tc::SimpleScene_Shading for 'scene'.
+    inline explicit SimpleScene_Shading(const SimpleScene& scene);
+
+    /// \brief See tc::ShadeAPI::shade_getSurfaceFrame. The frame is made
+    /// from the normal the scene stored in 'traceResult', so a mesh that is
+    /// loaded on demand isn't acquired again.
+    inline SurfaceFrame shade_getSurfaceFrame(
+        const TraceResult& traceResult) const;
+
+    /// \brief See tc::ShadeAPI::shade_getSurfaceShader.
+    inline const Shader& shade_getSurfaceShader(const GeoID& geoID) const;
+
+    /// \brief See tc::ShadeAPI::shade_getEmitterCount.
+    inline size_t shade_getEmitterCount() const;
+
+    /// \brief See tc::ShadeAPI::shade_getEmitter.
+    inline const Emitter* shade_getEmitter(const size_t index) const;
+
+    /// \brief See tc::Shader::needsRays.
+    inline bool needsRays(const GeoID& geoID) const;
+
+    /// \brief See tc::Shader::isDiffuse.
+    inline bool isDiffuse(const GeoID& geoID) const;
+
+    /// \brief See tc::Shader::shade.
+    inline SampledSpectrum shade(size_t radianceCount,
+                                 const SampledSpectrum& radianceSum,
+                                 const TraceResult& traceResult,
+                                 const Ray& ray,
+                                 const SampledSpectrum& localColor) const;
+
+    /// \brief See tc::Shader::accumulate.
+    inline void accumulate(const TraceResult& traceResult,
+                           const Radiance& radiance, const Ray& ray,
+                           SampledSpectrum& result) const;
+
+private:
+    const SimpleScene& m_scene;
 };
 
+//------------------------------------------------------------------------------
+// SimplePolyMesh
+//------------------------------------------------------------------------------
+inline SurfaceFrame SimplePolyMesh::shade_getSurfaceFrame(
+    const size_t elementIndex) const
+{
+    return makeSurfaceFrame(getNormal(elementIndex));
+}
+
+//------------------------------------------------------------------------------
+inline const Vector3<float>& SimplePolyMesh::getNormal(
+    const size_t elementIndex) const
+{
+    assert(elementIndex < m_normals.size());
+    return m_normals[elementIndex];
+}
+
+//------------------------------------------------------------------------------
+inline SurfaceFrame SimplePolyMesh::makeSurfaceFrame(
+    const Vector3<float>& normal)
+{
+    Vector3<float> tangent;
+    Vector3<float> bitangent;
+    normal.tangentAndBitangent(tangent, bitangent);
+    return SurfaceFrame(tangent, normal, bitangent);
+}
+
+//------------------------------------------------------------------------------
+// SimpleScene
+//------------------------------------------------------------------------------
+inline bool SimpleScene::isLight(const GeoID& geoID) const
+{
+    return geoID.m_objectIndex == (getMeshCount() + 1);
+}
+
+//------------------------------------------------------------------------------
+inline SurfaceFrame SimpleScene::getSurfaceFrame(const GeoID& geoID) const
+{
+    assert(geoID.m_objectIndex <= getMeshCount());
+    const size_t index = geoID.m_objectIndex - 1;
+    const SurfaceFrame surfaceFrame =
+        acquireMesh(index).shade_getSurfaceFrame(geoID.m_elementIndex);
+    releaseMesh(index);
+    return surfaceFrame;
+}
+
+//------------------------------------------------------------------------------
+inline size_t SimpleScene::getMeshCount() const
+{
+    return m_simplePolyMeshBounds.size();
+}
+
+//------------------------------------------------------------------------------
+inline const SimplePolyMesh& SimpleScene::acquireMesh(const size_t index) const
+{
+    if (m_pager)
+    {
+        return acquirePagedMesh(index);
+    }
+    return m_simplePolyMeshes[index];
+}
+
+//------------------------------------------------------------------------------
+inline void SimpleScene::releaseMesh(const size_t index) const
+{
+    if (m_pager)
+    {
+        releasePagedMesh(index);
+    }
+}
+
+//------------------------------------------------------------------------------
+// SimpleScene_Shading
+//------------------------------------------------------------------------------
+inline SimpleScene_Shading::SimpleScene_Shading(const SimpleScene& scene)
+    : m_scene(scene)
+{
+}
+
+//------------------------------------------------------------------------------
+inline SurfaceFrame SimpleScene_Shading::shade_getSurfaceFrame(
+    const TraceResult& traceResult) const
+{
+    if (traceResult.hasNormal())
+    {
+        return SimplePolyMesh::makeSurfaceFrame(traceResult.m_normal);
+    }
+    return m_scene.getSurfaceFrame(traceResult.m_geoId);
+}
+
+//------------------------------------------------------------------------------
+inline const Shader& SimpleScene_Shading::shade_getSurfaceShader(
+    const GeoID& geoID) const
+{
+    if (m_scene.isLight(geoID))
+    {
+        return m_scene.m_lightShader;
+    }
+    return m_scene.m_diffuseShader;
+}
+
+//------------------------------------------------------------------------------
+inline size_t SimpleScene_Shading::shade_getEmitterCount() const
+{
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+inline const Emitter* SimpleScene_Shading::shade_getEmitter(
+    const size_t index) const
+{
+    assert(index == 0);
+    return m_scene.m_lightEmitter;
+}
+
+//------------------------------------------------------------------------------
+inline bool SimpleScene_Shading::needsRays(const GeoID& geoID) const
+{
+    if (m_scene.isLight(geoID))
+    {
+        return m_scene.m_lightShader.needsRaysDirect();
+    }
+    return m_scene.m_diffuseShader.needsRaysDirect();
+}
+
+//------------------------------------------------------------------------------
+inline bool SimpleScene_Shading::isDiffuse(const GeoID& geoID) const
+{
+    if (m_scene.isLight(geoID))
+    {
+        return m_scene.m_lightShader.isDiffuseDirect();
+    }
+    return m_scene.m_diffuseShader.isDiffuseDirect();
+}
+
+//------------------------------------------------------------------------------
+inline SampledSpectrum SimpleScene_Shading::shade(
+    const size_t radianceCount, const SampledSpectrum& radianceSum,
+    const TraceResult& traceResult, const Ray& ray,
+    const SampledSpectrum& localColor) const
+{
+    if (m_scene.isLight(traceResult.m_geoId))
+    {
+        return m_scene.m_lightShader.shadeDirect(
+            radianceCount, radianceSum, traceResult, ray, localColor);
+    }
+    return m_scene.m_diffuseShader.shadeDirect(radianceCount, radianceSum,
+                                               traceResult, ray, localColor);
+}
+
+//------------------------------------------------------------------------------
+inline void SimpleScene_Shading::accumulate(const TraceResult& traceResult,
+                                            const Radiance& radiance,
+                                            const Ray& ray,
+                                            SampledSpectrum& result) const
+{
+    if (m_scene.isLight(traceResult.m_geoId))
+    {
+        m_scene.m_lightShader.accumulateDirect(traceResult, radiance, ray,
+                                               *this, result);
+        return;
+    }
+    m_scene.m_diffuseShader.accumulateDirect(traceResult, radiance, ray,
+                                             *this, result);
+}
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'simpleScene' header file.
+/// \cond
+void simpleSceneRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
 }  // namespace tc
 #endif  // TC_SIMPLESCENE
@@ -76,6 +76,13 @@ public:
 //------------------------------------------------------------------------------
 size_t getNumProcs();
 
+//------------------------------------------------------------------------------
+// yieldThread
+//------------------------------------------------------------------------------
+/// \brief Gives up the rest of the calling thread's time slice.
+//------------------------------------------------------------------------------
+void yieldThread();
+
 //------------------------------------------------------------------------------
 // ThreadBundle
 //------------------------------------------------------------------------------
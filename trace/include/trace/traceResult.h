@@ -23,41 +23,57 @@ namespace tc
 /// - A 'distance' value for how far along the ray the nearest intersection was
 /// found.
 /// - A GeoId value which identifies the item of geometry that the ray hit.
+/// - Optionally, the normal of the surface that was hit.
 //------------------------------------------------------------------------------
 class TraceResult
 {
 public:
     inline TraceResult();
     inline TraceResult(const TraceResult& src);
-    inline TraceResult(const float distanceAlongRay, const GeoID& geoId);
+    inline TraceResult(const float distanceAlongRay, const GeoID& geoId,
+                       const Vector3<float>& normal = Vector3<float>(0.0f));
 
     /// \brief Returns true if the result of the ray cast is an intersection,
     /// and false if nothing was hit.
     inline bool hasHitSomething() const;
 
+    /// \brief Returns true if the tc::GeoAPI that traced the ray stored the
+    /// normal of the surface it hit.
+    inline bool hasNormal() const;
+
     /// \brief Contains how far along the ray the nearest intersection was
     /// found.
     const float m_distanceAlongRay;
 
     /// \brief Identifies the item of geometry that has been hit.
     GeoID m_geoId;
+
+    /// \brief The normal of the surface that has been hit, or zero if it
+    /// isn't known. A scene whose surfaces are loaded on demand stores it
+    /// while the surface is loaded, so it needn't be loaded again to shade
+    /// the hit.
+    Vector3<float> m_normal;
 };
 
 //------------------------------------------------------------------------------
-inline TraceResult::TraceResult() : m_distanceAlongRay(0.0f), m_geoId(0, 0)
+inline TraceResult::TraceResult()
+    : m_distanceAlongRay(0.0f), m_geoId(0, 0), m_normal(0.0f)
 {
 }
 
 //------------------------------------------------------------------------------
 inline TraceResult::TraceResult(const TraceResult& src)
-    : m_distanceAlongRay(src.m_distanceAlongRay), m_geoId(src.m_geoId)
+    : m_distanceAlongRay(src.m_distanceAlongRay),
+      m_geoId(src.m_geoId),
+      m_normal(src.m_normal)
 {
 }
 
 //------------------------------------------------------------------------------
 inline TraceResult::TraceResult(const float distanceAlongRay,
-                                const GeoID& geoId)
-    : m_distanceAlongRay(distanceAlongRay), m_geoId(geoId)
+                                const GeoID& geoId,
+                                const Vector3<float>& normal)
+    : m_distanceAlongRay(distanceAlongRay), m_geoId(geoId), m_normal(normal)
 {
 }
 
@@ -67,5 +83,11 @@ inline bool TraceResult::hasHitSomething() const
     return m_geoId.m_objectIndex != 0;
 }
 
+//------------------------------------------------------------------------------
+inline bool TraceResult::hasNormal() const
+{
+    return m_normal != Vector3<float>(0.0f);
+}
+
 }  // namespace tc
 #endif  // TC_TRACERESULT
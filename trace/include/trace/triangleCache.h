@@ -20,6 +20,10 @@ class TriangleCache : public KDTree
 /// searches.
 class SearchCache : public KDTree_SearchCache
 {
+public:
+    /// \brief Holds the results for each mesh while a scene traces a
+    /// tc::RayStream, so they don't need to be allocated for every stream.
+    KDTree_StreamTraceResult m_streamTraceResult;
 };
 
 }  // namespace tc
@@ -9,6 +9,8 @@
 
 namespace tc
 {
+class LogContext;
+
 //------------------------------------------------------------------------------
 // Triangleterator
 //------------------------------------------------------------------------------
@@ -30,6 +32,10 @@ namespace tc
 /// }
 /// customTriangleIterator.end();
 /// \endcode
+///
+/// Triangles can also be read in batches, with tc::TriangleIterator::nextBatch,
+/// which sources with the triangles already in memory override to copy them
+/// without a virtual call for each one.
 //------------------------------------------------------------------------------
 class TriangleIterator
 {
@@ -57,6 +63,39 @@ public:
         return Triangle(Vector3<float>(0.0f), Vector3<float>(0.0f),
                         Vector3<float>(0.0f));
     }
+
+    /// \return Once tc::TriangleIterator::begin has been called, the number
+    /// of triangles left, so they can be stored without growing any arrays.
+    /// Some may turn out to be skipped. 0 if it isn't known.
+    virtual size_t sizeHint() const
+    {
+        return 0;
+    }
+
+    /// \brief Moves past up to 'capacity' triangles, writing the three
+    /// corners of each to 'corners'. This moves on from the same triangle
+    /// as tc::TriangleIterator::next, which can't be dereferenced after it.
+    /// \return The number of triangles written, which is 0 once there are
+    /// none left.
+    virtual size_t nextBatch(Vector3<float>* corners, const size_t capacity)
+    {
+        size_t count = 0;
+        for (; count != capacity && next(); ++count)
+        {
+            const Triangle triangle = **this;
+            corners[count * 3] = triangle.m_a;
+            corners[(count * 3) + 1] = triangle.m_b;
+            corners[(count * 3) + 2] = triangle.m_c;
+        }
+        return count;
+    }
 };
+
+//------------------------------------------------------------------------------
+// Runs all the unit tests for the 'triangleIterator' header file.
+/// \cond
+void triangleIteratorRunUnitTests(const tc::LogContext& logContext);
+/// \endcond
+
 }  // namespace tc
 #endif  // TC_TRIANGLEITERATOR
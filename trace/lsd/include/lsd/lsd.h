@@ -3,24 +3,60 @@
 #define LSD
 
 #include <cstdlib>
+#include <new>
 #include <vector>
 
 namespace lsd
 {
 class Node;
+class PolyMesh;
+
+//------------------------------------------------------------------------------
+// Listener
+//------------------------------------------------------------------------------
+// Told about each poly mesh as soon as the parser reaches the end of it. The
+// vertices and triangles of the mesh are freed once polyMesh returns, so a
+// listener that wants to keep them must copy or swap them out. This lets a
+// file be processed a mesh at a time, without the whole of it being held in
+// memory.
+//------------------------------------------------------------------------------
+class Listener
+{
+public:
+    virtual ~Listener() {}
+    virtual void polyMesh(PolyMesh & polyMesh) = 0;
+};
 //------------------------------------------------------------------------------
 // Stage
 //------------------------------------------------------------------------------
+// Owns every node, string and array made while parsing a file. They are
+// bump allocated from large blocks of memory, which are all freed together
+// when the stage is cleared or destroyed, so nothing needs to be freed one
+// at a time, and anything the parser allocates but never uses is freed too.
+//------------------------------------------------------------------------------
 class Stage
 {
 public:
     inline Stage();
+    inline ~Stage();
     template<typename T>
-    T * alloc(); // TODO LT: A placeholder for a smarter memory allocator
+    T * alloc();
     template<typename T, typename Arg0>
-    T * alloc(Arg0 arg0); // TODO LT: A placeholder for a smarter memory allocator
+    T * alloc(Arg0 arg0);
+    // The elements of the array are not destroyed, so T must not need a
+    // destructor.
     template<typename T>
-    T * allocArray(const size_t size); // TODO LT: A placeholder for a smarter memory allocator
+    T * allocArray(const size_t size);
+    // Destroys every object allocated so far, and frees their memory.
+    inline
+    void clear();
+    // Streams poly meshes to 'listener' as they are parsed, or stops
+    // streaming if it is null.
+    inline
+    void setListener(Listener * listener);
+    // The parser calls this with each node once it is complete, so the last
+    // node given is the root of the file. Poly meshes are streamed to the
+    // listener from here.
     inline
     void setRoot(Node * root);
     inline
@@ -29,39 +65,139 @@ public:
     bool empty() const;
 
 private:
+    enum
+    {
+        kBlockSize = 64 * 1024
+    };
+    typedef void (*Destructor)(void * object);
+    struct Object
+    {
+        void * m_object;
+        Destructor m_destructor;
+    };
+
+    Stage(const Stage &);
+    Stage & operator=(const Stage &);
+
+    inline
+    void * allocBytes(const size_t size, const size_t alignment);
+    template<typename T>
+    T * track(T * object);
+    template<typename T>
+    static void destroy(void * object);
+
+    std::vector<char *> m_blocks;
+    char * m_next;
+    char * m_blockEnd;
+    std::vector<Object> m_objects;
+    Listener * m_listener;
     Node * m_root;
 };
 
 //------------------------------------------------------------------------------
 Stage::Stage():
+    m_next(0),
+    m_blockEnd(0),
+    m_listener(0),
     m_root(0)
 {}
 
+//------------------------------------------------------------------------------
+Stage::~Stage()
+{
+    clear();
+}
+
 //------------------------------------------------------------------------------
 template<typename T>
 T * Stage::alloc()
 {
-    return new T;
-};
+    return track(new (allocBytes(sizeof(T), __alignof__(T))) T);
+}
 
 //------------------------------------------------------------------------------
 template<typename T, typename Arg0>
 T * Stage::alloc(Arg0 arg0)
 {
-    return new T(arg0);
-};
+    return track(new (allocBytes(sizeof(T), __alignof__(T))) T(arg0));
+}
 
 //------------------------------------------------------------------------------
 template<typename T>
 T * Stage::allocArray(const size_t size)
 {
-    return new T[size];
-};
+    return new (allocBytes(sizeof(T) * size, __alignof__(T))) T[size];
+}
 
 //------------------------------------------------------------------------------
-void Stage::setRoot(Node * root)
+void Stage::clear()
 {
-    m_root = root;
+    // Objects are destroyed in the reverse order to which they were made.
+    for(size_t i = m_objects.size(); i != 0; --i)
+    {
+        m_objects[i-1].m_destructor(m_objects[i-1].m_object);
+    }
+    for(size_t i = 0; i != m_blocks.size(); ++i)
+    {
+        free(m_blocks[i]);
+    }
+    std::vector<Object>().swap(m_objects);
+    std::vector<char *>().swap(m_blocks);
+    m_next = 0;
+    m_blockEnd = 0;
+    m_root = 0;
+}
+
+//------------------------------------------------------------------------------
+void * Stage::allocBytes(const size_t size, const size_t alignment)
+{
+    // malloc aligns a block for any type.
+    const size_t padding = (alignment - (reinterpret_cast<size_t>(m_next) %
+                                         alignment)) % alignment;
+    if(m_next == 0 || static_cast<size_t>(m_blockEnd - m_next) < size + padding)
+    {
+        // Allocations bigger than a block are given a block of their own, so
+        // the rest of the current block isn't wasted.
+        const size_t blockSize = size > kBlockSize ? size : kBlockSize;
+        char * const block = static_cast<char *>(malloc(blockSize));
+        if(block == 0)
+        {
+            throw std::bad_alloc();
+        }
+        m_blocks.push_back(block);
+        if(size > kBlockSize && m_next != 0)
+        {
+            return block;
+        }
+        m_next = block;
+        m_blockEnd = block + blockSize;
+        return allocBytes(size, alignment);
+    }
+    void * const result = m_next + padding;
+    m_next += padding + size;
+    return result;
+}
+
+//------------------------------------------------------------------------------
+template<typename T>
+T * Stage::track(T * object)
+{
+    const Object tracked = {object, &Stage::destroy<T>};
+    m_objects.push_back(tracked);
+    return object;
+}
+
+//------------------------------------------------------------------------------
+template<typename T>
+void Stage::destroy(void * object)
+{
+    static_cast<T *>(object)->~T();
+}
+
+//------------------------------------------------------------------------------
+void Stage::setListener(Listener * listener)
+{
+    m_listener = listener;
 }
 
 //------------------------------------------------------------------------------
@@ -160,7 +296,29 @@ public:
 };
 
 //------------------------------------------------------------------------------
-// PolyMesh
+void Stage::setRoot(Node * root)
+{
+    m_root = root;
+    if(m_listener == 0 || root == 0 || !root->isPolyMesh())
+    {
+        return;
+    }
+    PolyMesh * const polyMesh = root->as<PolyMesh>();
+    m_listener->polyMesh(*polyMesh);
+
+    // Swapping with empty arrays is the only way to give back their memory.
+    if(polyMesh->m_verticies != 0)
+    {
+        PolyMesh::Verticies().swap(*polyMesh->m_verticies);
+    }
+    if(polyMesh->m_triangles != 0)
+    {
+        PolyMesh::Triangles().swap(*polyMesh->m_triangles);
+    }
+}
+
+//------------------------------------------------------------------------------
+// Variant
 //------------------------------------------------------------------------------
 union Variant
 {
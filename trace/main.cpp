@@ -3,11 +3,13 @@
 //------------------------------------------------------------------------------
 #include "trace/args.h"
 #include "trace/array.h"
+#include "trace/biniterator.h"
 #include "trace/image.h"
 #include "trace/linearPixelIterator.h"
 #include "trace/log.h"
 //#include "trace/lsditerator.h"
 #include "trace/objiterator.h"
+#include "trace/plyiterator.h"
 #include "trace/pngwriter.h"
 #include "trace/recursivePixelIterator.h"
 #include "trace/renderer.h"
@@ -15,6 +17,7 @@
 #include "trace/thread.h"
 #include "trace/time.h"
 //------------------------------------------------------------------------------
+#include <cstring>
 #include <iostream>
 //------------------------------------------------------------------------------
 
@@ -68,6 +71,17 @@ private:
     tc::Array<float,4> m_array;
 };
 
+//------------------------------------------------------------------------------
+// hasExtension
+//------------------------------------------------------------------------------
+bool hasExtension(const char* filename, const char* extension)
+{
+    const size_t length = strlen(filename);
+    const size_t extensionLength = strlen(extension);
+    return length >= extensionLength &&
+           strcmp(filename + length - extensionLength, extension) == 0;
+}
+
 //------------------------------------------------------------------------------
 // main
 //------------------------------------------------------------------------------
@@ -82,7 +96,26 @@ int main(const int argc, const char *argv[])
         tc::runTests(logContext);
     }
 
-    if(args.render)
+    if(*args.convertTo)
+    {
+        // Build the acceleration structures once, and keep them in the file.
+        std::cout << "# Converting scene" << std::endl;
+        tc::Obj_ObjectIterator objIterator;
+        objIterator.setFilename(args.inputFilename);
+        tc::Ply_ObjectIterator plyIterator;
+        plyIterator.setFilename(args.inputFilename);
+        tc::ObjectIterator& objectIterator =
+            hasExtension(args.inputFilename, ".ply")
+                ? static_cast<tc::ObjectIterator&>(plyIterator)
+                : static_cast<tc::ObjectIterator&>(objIterator);
+        const tc::SimpleScene simpleScene(objectIterator);
+        if(!simpleScene.write(args.convertTo))
+        {
+            std::cerr << "Unable to write " << args.convertTo << std::endl;
+            return 1;
+        }
+    }
+    else if(args.render)
     {
         IOImage image(args.width, args.height);
     #if 1
@@ -93,20 +126,56 @@ int main(const int argc, const char *argv[])
     #endif
 
 #if 0
-        // Create an 'lsd' iterator. For piping an lsd file into the scene.
-        tc::lsdObjectIterator objectIterator;
-        objectIterator.setFilename(args.inputFilename);
+        // Create an 'lsd' iterator. For piping an lsd file into the scene,
+        // building each mesh while the rest of the file is parsed.
+        tc::lsdObjectIterator objIterator;
+        objIterator.setFilename(args.inputFilename);
+        objIterator.setStreaming(true);
 #else
         // Create an 'obj' iterator. For piping an obj file into the scene.
-        tc::Obj_ObjectIterator objectIterator;
-        objectIterator.setFilename(args.inputFilename);
+        tc::Obj_ObjectIterator objIterator;
+        objIterator.setFilename(args.inputFilename);
 #endif
+        // Binary scene files are mapped straight into the scene, and ply
+        // files are decoded straight from the mapped file.
+        tc::Bin_ObjectIterator binIterator;
+        binIterator.setFilename(args.inputFilename);
+        tc::Ply_ObjectIterator plyIterator;
+        plyIterator.setFilename(args.inputFilename);
+        tc::ObjectIterator& objectIterator =
+            hasExtension(args.inputFilename, ".tbs")
+                ? static_cast<tc::ObjectIterator&>(binIterator)
+                : hasExtension(args.inputFilename, ".ply")
+                      ? static_cast<tc::ObjectIterator&>(plyIterator)
+                      : static_cast<tc::ObjectIterator&>(objIterator);
 
         tc::Timer timeRender;
 
         // Create our scene, it will be populated by an object iterator.
         std::cout << "# Building scene" << std::endl;
-        tc::SimpleScene simpleScene(objectIterator);
+        tc::SimpleScene_Light light;
+        light.m_position =
+            tc::Vector3<float>(args.lightX, args.lightY, args.lightZ);
+        light.m_radius = args.lightRadius;
+        light.m_intensity = args.lightIntensity;
+        tc::SimpleScene simpleScene(objectIterator,
+                                    args.memoryBudget * 1024 * 1024, light);
+
+        // Optional render settings.
+        tc::RenderSettings settings;
+        settings.m_sampler =
+            tc::parseSamplerType(args.sampler, settings.m_sampler);
+        settings.m_integrator =
+            tc::parseIntegratorMode(args.integrator, settings.m_integrator);
+        settings.m_russianRouletteDepth = args.russianRouletteDepth;
+        settings.m_nextEventEstimation = !args.disableNextEventEstimation;
+        settings.m_cosineWeightedSampling = !args.uniformHemisphereSampling;
+        settings.m_sortBounceRays = args.sortBounceRays;
+        settings.m_specialisedShading = !args.genericShading;
+        settings.m_irradianceCache = args.irradianceCache;
+        settings.m_irradianceCacheError = args.irradianceCacheError;
+        settings.m_irradianceCacheRadius = args.irradianceCacheRadius;
+        settings.m_ambientOcclusionDistance = args.ambientOcclusionDistance;
 
         // Create a renderer instance. This manages the render threads.
         std::cout << "# Rendering" << std::endl;
@@ -117,7 +186,8 @@ int main(const int argc, const char *argv[])
                               args.maxRayDepth,
                               simpleScene, // Geo
                               simpleScene, // Shade
-                              threadCount);
+                              threadCount,
+                              settings);
 
 
         // Kick off our render and monitor its progress.
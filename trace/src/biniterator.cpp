@@ -0,0 +1,569 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/biniterator.h"
+//------------------------------------------------------------------------------
+#include "trace/assert.h"
+#include "trace/triangle.h"
+#include "trace/vector.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tc
+{
+
+namespace
+{
+static const char kMagic[8] = {'t', 'c', 's', 'c', 'e', 'n', 'e', '\0'};
+
+//------------------------------------------------------------------------------
+// Rounds 'offset' up to the next multiple of Bin_Header::kAlignment.
+inline uint64_t align(const uint64_t offset)
+{
+    const uint64_t alignment = Bin_Header::kAlignment;
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+//------------------------------------------------------------------------------
+// Writes 'size' bytes of 'data' at 'offset', padding the file up to it.
+bool writeAt(FILE* file, uint64_t& position, const uint64_t offset,
+             const void* data, const size_t size)
+{
+    static const char padding[Bin_Header::kAlignment] = {0};
+    assert(offset >= position && offset - position <= sizeof(padding));
+    const size_t paddingSize = offset - position;
+    const bool written =
+        fwrite(padding, 1, paddingSize, file) == paddingSize &&
+        (size == 0 || fwrite(data, 1, size, file) == size);
+    position = offset + size;
+    return written;
+}
+
+//------------------------------------------------------------------------------
+// true if [offset, offset + size) lies inside a file of 'fileSize' bytes.
+inline bool isInside(const uint64_t offset, const uint64_t size,
+                     const uint64_t fileSize)
+{
+    return offset <= fileSize && size <= fileSize - offset;
+}
+
+//------------------------------------------------------------------------------
+// true if each of the 'count' indices refers to one of 'vertexCount' vertices.
+bool areIndicesInside(const uint32_t* indices, const uint64_t count,
+                      const uint64_t vertexCount)
+{
+    for (uint64_t i = 0; i != count; ++i)
+    {
+        if (indices[i] >= vertexCount)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// Bin_Writer
+//------------------------------------------------------------------------------
+Bin_Writer::Bin_Writer()
+{
+}
+
+//------------------------------------------------------------------------------
+size_t Bin_Writer::addXform(const char* name, const size_t parent)
+{
+    assert(parent == Bin_Node::kNoParent || parent < m_nodes.size());
+    Node node;
+    node.m_name = name;
+    node.m_parent = parent;
+    node.m_isPolyMesh = false;
+    m_nodes.push_back(node);
+    return m_nodes.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+size_t Bin_Writer::addPolyMesh(const char* name, const size_t parent,
+                               const ObjectIterator_Mesh& mesh)
+{
+    assert(parent == Bin_Node::kNoParent || parent < m_nodes.size());
+    Node node;
+    node.m_name = name;
+    node.m_parent = parent;
+    node.m_isPolyMesh = true;
+    node.m_mesh = mesh;
+    m_nodes.push_back(node);
+    return m_nodes.size() - 1;
+}
+
+//------------------------------------------------------------------------------
+void Bin_Writer::addDepthFirst(
+    const size_t node, const std::vector<std::vector<size_t> >& children,
+    std::vector<size_t>& order, std::vector<size_t>& ends) const
+{
+    order.push_back(node);
+    for (size_t i = 0; i != children[node].size(); ++i)
+    {
+        addDepthFirst(children[node][i], children, order, ends);
+    }
+    ends[node] = order.size();
+}
+
+//------------------------------------------------------------------------------
+bool Bin_Writer::write(const char* filename) const
+{
+    // Put the nodes in depth first order.
+    std::vector<std::vector<size_t> > children(m_nodes.size());
+    for (size_t i = 0; i != m_nodes.size(); ++i)
+    {
+        if (m_nodes[i].m_parent != Bin_Node::kNoParent)
+        {
+            children[m_nodes[i].m_parent].push_back(i);
+        }
+    }
+    std::vector<size_t> order;
+    std::vector<size_t> ends(m_nodes.size());
+    for (size_t i = 0; i != m_nodes.size(); ++i)
+    {
+        if (m_nodes[i].m_parent == Bin_Node::kNoParent)
+        {
+            addDepthFirst(i, children, order, ends);
+        }
+    }
+    std::vector<size_t> newIndex(m_nodes.size());
+    for (size_t i = 0; i != order.size(); ++i)
+    {
+        newIndex[order[i]] = i;
+    }
+
+    // Lay out the names, and then the arrays of each mesh.
+    Bin_Header header;
+    std::memcpy(header.m_magic, kMagic, sizeof(kMagic));
+    header.m_version = Bin_Header::kVersion;
+    header.m_byteOrder = Bin_Header::kByteOrder;
+    header.m_nodeCount = order.size();
+    header.m_nodeOffset = align(sizeof(Bin_Header));
+    header.m_nameOffset =
+        header.m_nodeOffset + (order.size() * sizeof(Bin_Node));
+    header.m_nameSize = 0;
+
+    std::vector<Bin_Node> nodes(order.size());
+    for (size_t i = 0; i != order.size(); ++i)
+    {
+        const Node& source = m_nodes[order[i]];
+        Bin_Node& node = nodes[i];
+        std::memset(&node, 0, sizeof(node));
+        node.m_type = source.m_isPolyMesh ? Bin_Node::kPolyMesh
+                                          : Bin_Node::kXform;
+        node.m_parent = source.m_parent == Bin_Node::kNoParent
+                            ? Bin_Node::kNoParent
+                            : newIndex[source.m_parent];
+        node.m_end = ends[order[i]];
+        node.m_nameOffset = header.m_nameSize;
+        header.m_nameSize += source.m_name.size() + 1;
+        for (size_t axis = 0; axis != 3; ++axis)
+        {
+            node.m_min[axis] = FLT_MAX;
+            node.m_max[axis] = -FLT_MAX;
+        }
+    }
+
+    uint64_t offset = header.m_nameOffset + header.m_nameSize;
+    for (size_t i = 0; i != order.size(); ++i)
+    {
+        const ObjectIterator_Mesh& mesh = m_nodes[order[i]].m_mesh;
+        Bin_Node& node = nodes[i];
+        node.m_vertexOffset = align(offset);
+        node.m_vertexCount = mesh.m_vertexCount;
+        offset = node.m_vertexOffset + (mesh.m_vertexCount * 4 * sizeof(float));
+        node.m_indexOffset = align(offset);
+        node.m_triangleCount = mesh.m_triangleCount;
+        offset = node.m_indexOffset + (mesh.m_triangleCount * 3 *
+                                       sizeof(uint32_t));
+        if (mesh.m_acceleration)
+        {
+            node.m_accelerationOffset = align(offset);
+            node.m_accelerationSize = mesh.m_accelerationSize;
+            offset = node.m_accelerationOffset + mesh.m_accelerationSize;
+        }
+
+        // The bounds of a mesh are grown into each of the transforms above
+        // it.
+        float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+        float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+        for (size_t j = 0; j != mesh.m_vertexCount; ++j)
+        {
+            const float* const vertex = mesh.m_vertices + (j * 4);
+            for (size_t axis = 0; axis != 3; ++axis)
+            {
+                min[axis] = std::min(min[axis], vertex[axis]);
+                max[axis] = std::max(max[axis], vertex[axis]);
+            }
+        }
+        for (size_t parent = i; parent != Bin_Node::kNoParent;
+             parent = nodes[parent].m_parent)
+        {
+            for (size_t axis = 0; axis != 3; ++axis)
+            {
+                nodes[parent].m_min[axis] =
+                    std::min(nodes[parent].m_min[axis], min[axis]);
+                nodes[parent].m_max[axis] =
+                    std::max(nodes[parent].m_max[axis], max[axis]);
+            }
+        }
+    }
+    header.m_fileSize = offset;
+
+    // Nodes without any vertices below them are given empty bounds at the
+    // origin.
+    for (size_t i = 0; i != nodes.size(); ++i)
+    {
+        Bin_Node& node = nodes[i];
+        if (node.m_min[0] > node.m_max[0])
+        {
+            std::fill(node.m_min, node.m_min + 3, 0.0f);
+            std::fill(node.m_max, node.m_max + 3, 0.0f);
+        }
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    uint64_t position = 0;
+    bool written = writeAt(file, position, 0, &header, sizeof(header));
+    written = written && writeAt(file, position, header.m_nodeOffset,
+                                 nodes.empty() ? 0 : &nodes[0],
+                                 nodes.size() * sizeof(Bin_Node));
+    for (size_t i = 0; i != order.size(); ++i)
+    {
+        const std::string& name = m_nodes[order[i]].m_name;
+        written = written && writeAt(file, position, position, name.c_str(),
+                                     name.size() + 1);
+    }
+    for (size_t i = 0; i != order.size(); ++i)
+    {
+        const ObjectIterator_Mesh& mesh = m_nodes[order[i]].m_mesh;
+        const Bin_Node& node = nodes[i];
+        written = written &&
+                  writeAt(file, position, node.m_vertexOffset, mesh.m_vertices,
+                          mesh.m_vertexCount * 4 * sizeof(float));
+        written = written &&
+                  writeAt(file, position, node.m_indexOffset, mesh.m_indices,
+                          mesh.m_triangleCount * 3 * sizeof(uint32_t));
+        if (mesh.m_acceleration)
+        {
+            written = written && writeAt(file, position,
+                                         node.m_accelerationOffset,
+                                         mesh.m_acceleration,
+                                         mesh.m_accelerationSize);
+        }
+    }
+    written = written && position == header.m_fileSize;
+    return fclose(file) == 0 && written;
+}
+
+//------------------------------------------------------------------------------
+// Bin_TriangleIterator
+//------------------------------------------------------------------------------
+Bin_TriangleIterator::Bin_TriangleIterator() : m_next(0)
+{
+}
+
+//------------------------------------------------------------------------------
+void Bin_TriangleIterator::setMesh(const ObjectIterator_Mesh& mesh)
+{
+    m_mesh = mesh;
+    m_next = 0;
+}
+
+//------------------------------------------------------------------------------
+void Bin_TriangleIterator::begin()
+{
+    m_next = 0;
+}
+
+//------------------------------------------------------------------------------
+bool Bin_TriangleIterator::next()
+{
+    if (m_next == m_mesh.m_triangleCount)
+    {
+        return false;
+    }
+    ++m_next;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+Triangle Bin_TriangleIterator::operator*() const
+{
+    assert(m_next != 0);
+    const uint32_t* const indices = m_mesh.m_indices + ((m_next - 1) * 3);
+    Vector3<float> corners[3];
+    for (size_t i = 0; i != 3; ++i)
+    {
+        const float* const vertex = m_mesh.m_vertices + (indices[i] * 4);
+        corners[i] = Vector3<float>(vertex[0], vertex[1], vertex[2]);
+    }
+    return Triangle(corners[0], corners[1], corners[2]);
+}
+
+//------------------------------------------------------------------------------
+size_t Bin_TriangleIterator::sizeHint() const
+{
+    return m_mesh.m_triangleCount - m_next;
+}
+
+//------------------------------------------------------------------------------
+size_t Bin_TriangleIterator::nextBatch(Vector3<float>* corners,
+                                       const size_t capacity)
+{
+    const size_t count = std::min(capacity, m_mesh.m_triangleCount - m_next);
+    const uint32_t* const indices = m_mesh.m_indices + (m_next * 3);
+    for (size_t i = 0; i != count * 3; ++i)
+    {
+        const float* const vertex = m_mesh.m_vertices + (indices[i] * 4);
+        corners[i] = Vector3<float>(vertex[0], vertex[1], vertex[2]);
+    }
+    m_next += count;
+    return count;
+}
+
+//------------------------------------------------------------------------------
+// Bin_ObjectIterator
+//------------------------------------------------------------------------------
+Bin_ObjectIterator::Bin_ObjectIterator()
+    : m_mapped(0),
+      m_mappedSize(0),
+      m_nodes(0),
+      m_nodeCount(0),
+      m_names(0),
+      m_current(0),
+      m_next(0)
+{
+}
+
+//------------------------------------------------------------------------------
+Bin_ObjectIterator::~Bin_ObjectIterator()
+{
+    end();
+}
+
+//------------------------------------------------------------------------------
+void Bin_ObjectIterator::setFilename(const char* filename)
+{
+    m_filename = filename;
+}
+
+//------------------------------------------------------------------------------
+void Bin_ObjectIterator::begin()
+{
+    end();
+
+    // A file that can't be read has no nodes.
+    const int file = open(m_filename.c_str(), O_RDONLY);
+    if (file == -1)
+    {
+        return;
+    }
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 ||
+        static_cast<size_t>(fileStat.st_size) < sizeof(Bin_Header))
+    {
+        close(file);
+        return;
+    }
+    const size_t size = fileStat.st_size;
+    void* const mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED)
+    {
+        return;
+    }
+
+    // Check the file was written by this version, on a machine like this
+    // one, that every node and array lies inside it, and that every index
+    // refers to a vertex of its mesh. The acceleration structures are checked
+    // when they are loaded.
+    const char* const data = static_cast<const char*>(mapped);
+    const Bin_Header& header = *static_cast<const Bin_Header*>(mapped);
+    bool valid = std::memcmp(header.m_magic, kMagic, sizeof(kMagic)) == 0 &&
+                 header.m_version == Bin_Header::kVersion &&
+                 header.m_byteOrder == Bin_Header::kByteOrder &&
+                 header.m_fileSize == size &&
+                 header.m_nodeOffset % Bin_Header::kAlignment == 0 &&
+                 header.m_nodeCount < Bin_Node::kNoParent &&
+                 isInside(header.m_nodeOffset,
+                          header.m_nodeCount * sizeof(Bin_Node), size) &&
+                 isInside(header.m_nameOffset, header.m_nameSize, size) &&
+                 (header.m_nameSize == 0 ||
+                  data[header.m_nameOffset + header.m_nameSize - 1] == '\0');
+    const Bin_Node* const nodes =
+        reinterpret_cast<const Bin_Node*>(data + header.m_nodeOffset);
+    for (size_t i = 0; valid && i != header.m_nodeCount; ++i)
+    {
+        const Bin_Node& node = nodes[i];
+        valid = node.m_end > i && node.m_end <= header.m_nodeCount &&
+                node.m_nameOffset < header.m_nameSize &&
+                node.m_vertexCount <= 0xffffffffu &&
+                node.m_triangleCount <= size &&
+                isInside(node.m_vertexOffset,
+                         node.m_vertexCount * 4 * sizeof(float), size) &&
+                isInside(node.m_indexOffset,
+                         node.m_triangleCount * 3 * sizeof(uint32_t), size) &&
+                isInside(node.m_accelerationOffset, node.m_accelerationSize,
+                         size) &&
+                areIndicesInside(reinterpret_cast<const uint32_t*>(
+                                     data + node.m_indexOffset),
+                                 node.m_triangleCount * 3, node.m_vertexCount);
+    }
+    if (!valid)
+    {
+        munmap(mapped, size);
+        return;
+    }
+
+    m_mapped = mapped;
+    m_mappedSize = size;
+    m_nodes = nodes;
+    m_nodeCount = header.m_nodeCount;
+    m_names = data + header.m_nameOffset;
+    m_current = m_nodeCount;
+    m_next = 0;
+    m_bounds.reserve(m_nodeCount);
+    for (size_t i = 0; i != m_nodeCount; ++i)
+    {
+        const Bin_Node& node = m_nodes[i];
+        m_bounds.push_back(BoundsF(
+            Vector3<float>(node.m_min[0], node.m_min[1], node.m_min[2]),
+            Vector3<float>(node.m_max[0], node.m_max[1], node.m_max[2])));
+    }
+}
+
+//------------------------------------------------------------------------------
+void Bin_ObjectIterator::end()
+{
+    if (m_mapped)
+    {
+        munmap(m_mapped, m_mappedSize);
+    }
+    m_mapped = 0;
+    m_mappedSize = 0;
+    m_nodes = 0;
+    m_nodeCount = 0;
+    m_names = 0;
+    m_current = 0;
+    m_next = 0;
+    m_bounds.clear();
+}
+
+//------------------------------------------------------------------------------
+bool Bin_ObjectIterator::next()
+{
+    if (m_next >= m_nodeCount)
+    {
+        return false;
+    }
+    m_current = m_next;
+    m_next = m_nodes[m_current].m_end;
+    ObjectIterator_Mesh mesh;
+    getMesh(mesh);
+    m_triangleIterator.setMesh(mesh);
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void Bin_ObjectIterator::recurseIntoChildren(bool yesNo)
+{
+    assert(m_current < m_nodeCount);
+    m_next = yesNo ? m_current + 1 : m_nodes[m_current].m_end;
+}
+
+//------------------------------------------------------------------------------
+const BoundsF& Bin_ObjectIterator::getBounds() const
+{
+    assert(m_current < m_nodeCount);
+    return m_bounds[m_current];
+}
+
+//------------------------------------------------------------------------------
+bool Bin_ObjectIterator::hasTriangles() const
+{
+    return hasTriangles(getNode());
+}
+
+//------------------------------------------------------------------------------
+TriangleIterator& Bin_ObjectIterator::getTriangles()
+{
+    if (hasTriangles())
+    {
+        return m_triangleIterator;
+    }
+    return m_stubTriangleIterator;
+}
+
+//------------------------------------------------------------------------------
+bool Bin_ObjectIterator::getMesh(ObjectIterator_Mesh& mesh) const
+{
+    return loadMesh(m_current, mesh);
+}
+
+//------------------------------------------------------------------------------
+bool Bin_ObjectIterator::getProxy(size_t& proxy) const
+{
+    assert(m_current < m_nodeCount);
+    proxy = m_current;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool Bin_ObjectIterator::loadMesh(const size_t proxy,
+                                  ObjectIterator_Mesh& mesh) const
+{
+    if (proxy >= m_nodeCount || !hasTriangles(m_nodes[proxy]))
+    {
+        return false;
+    }
+    const Bin_Node& node = m_nodes[proxy];
+    const char* const data = static_cast<const char*>(m_mapped);
+    mesh.m_vertices =
+        reinterpret_cast<const float*>(data + node.m_vertexOffset);
+    mesh.m_vertexCount = node.m_vertexCount;
+    mesh.m_indices =
+        reinterpret_cast<const uint32_t*>(data + node.m_indexOffset);
+    mesh.m_triangleCount = node.m_triangleCount;
+    mesh.m_acceleration =
+        node.m_accelerationSize ? data + node.m_accelerationOffset : 0;
+    mesh.m_accelerationSize = node.m_accelerationSize;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+const char* Bin_ObjectIterator::getName() const
+{
+    return m_names + getNode().m_nameOffset;
+}
+
+//------------------------------------------------------------------------------
+const Bin_Node& Bin_ObjectIterator::getNode() const
+{
+    assert(m_current < m_nodeCount);
+    return m_nodes[m_current];
+}
+
+//------------------------------------------------------------------------------
+bool Bin_ObjectIterator::hasTriangles(const Bin_Node& node)
+{
+    return node.m_type == Bin_Node::kPolyMesh && node.m_triangleCount != 0;
+}
+
+}  // namespace tc
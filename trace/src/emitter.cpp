@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/emitter.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+//------------------------------------------------------------------------------
+
+namespace tc
+{
+
+//------------------------------------------------------------------------------
+// Emitter
+//------------------------------------------------------------------------------
+Emitter::~Emitter()
+{
+}
+
+//------------------------------------------------------------------------------
+// SphereEmitter
+//------------------------------------------------------------------------------
+SphereEmitter::SphereEmitter(const Vector3<float>& position,
+                             const float radius, const size_t objectIndex)
+    : m_position(position),
+      m_radius(radius),
+      m_objectIndex(objectIndex)
+{
+}
+
+//------------------------------------------------------------------------------
+float SphereEmitter::computeSolidAngle(const Vector3<float>& position) const
+{
+    return 2.0f * M_PI * computeConeSize((m_position - position).mag());
+}
+
+//------------------------------------------------------------------------------
+EmitterSample SphereEmitter::sample(const Vector3<float>& position,
+                                    const Vector3<float>& sample) const
+{
+    // Pick a direction uniformly within the cone of directions that hit the
+    // sphere, so none are wasted on the far side of it. From inside, the
+    // cone is every direction, so its axis doesn't matter.
+    const Vector3<float> offset = m_position - position;
+    const float distance = offset.mag();
+    const bool inside = distance <= m_radius;
+    const Vector3<float> axis = distance == 0.0f
+                                    ? Vector3<float>(0.0f, 0.0f, 1.0f)
+                                    : offset * (1.0f / distance);
+    const float coneSize = computeConeSize(distance);
+    const float cosTheta = 1.0f - (sample.x * coneSize);
+    const float sinThetaSq = std::max(0.0f, 1.0f - (cosTheta * cosTheta));
+    const float sinTheta = sqrt(sinThetaSq);
+    const float phi = 2.0f * M_PI * sample.y;
+    Vector3<float> tangent;
+    Vector3<float> bitangent;
+    axis.tangentAndBitangent(tangent, bitangent);
+    const Vector3<float> direction = (tangent * (sinTheta * cos(phi))) +
+                                     (bitangent * (sinTheta * sin(phi))) +
+                                     (axis * cosTheta);
+
+    // The direction meets the sphere twice. From outside it is the nearer
+    // point that is seen, and from inside the one in front.
+    const float root = sqrt(std::max(
+        0.0f, (m_radius * m_radius) - (distance * distance * sinThetaSq)));
+    const float distanceToSphere =
+        (distance * cosTheta) + (inside ? root : -root);
+    return EmitterSample(direction, distanceToSphere, computePdf(coneSize),
+                         GeoID(m_objectIndex, 0));
+}
+
+//------------------------------------------------------------------------------
+float SphereEmitter::pdf(const Vector3<float>& position,
+                         const Vector3<float>& direction,
+                         const float distance) const
+{
+    return computePdf(computeConeSize((m_position - position).mag()));
+}
+
+//------------------------------------------------------------------------------
+bool SphereEmitter::contains(const GeoID& geoID) const
+{
+    return geoID.m_objectIndex == m_objectIndex;
+}
+
+//------------------------------------------------------------------------------
+float SphereEmitter::computeConeSize(const float distance) const
+{
+    // A point inside the sphere sees it in every direction.
+    if (distance <= m_radius)
+    {
+        return 2.0f;
+    }
+
+    // This is 1 - cos(thetaMax), written so it stays accurate for a small or
+    // distant sphere, where cos(thetaMax) is close to one.
+    const float sinThetaMaxSq = (m_radius * m_radius) / (distance * distance);
+    const float cosThetaMax = sqrt(std::max(0.0f, 1.0f - sinThetaMaxSq));
+    return sinThetaMaxSq / (1.0f + cosThetaMax);
+}
+
+//------------------------------------------------------------------------------
+float SphereEmitter::computePdf(const float coneSize) const
+{
+    return 1.0f / (2.0f * M_PI * coneSize);
+}
+
+}  // namespace tc
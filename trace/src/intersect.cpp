@@ -5,10 +5,12 @@
 //------------------------------------------------------------------------------
 #include "trace/bounds.h"
 #include "trace/ray.h"
+#include "trace/raypacket.h"
 #include "trace/triangle.h"
 //------------------------------------------------------------------------------
 #include <cmath>
 #include <cfloat>
+#include <smmintrin.h>
 //------------------------------------------------------------------------------
 
 namespace tc
@@ -196,8 +198,17 @@ bool intersect_triangle(float& resultDelta, const Ray& ray, const Triangle& tri)
 bool intersect_bounds(const Ray& ray, const BoundsF& bounds,
                       const float epsilon)
 {
-    float tmin = 0.0f;     // The closest
-    float tmax = FLT_MAX;  // set to max distance ray can travel (for segment)
+    return intersect_segment_bounds(ray, FLT_MAX, bounds, epsilon);
+}
+
+//------------------------------------------------------------------------------
+// intersect_segment_bounds
+//------------------------------------------------------------------------------
+bool intersect_segment_bounds(const Ray& ray, const float maxDistance,
+                              const BoundsF& bounds, const float epsilon)
+{
+    float tmin = 0.0f;         // The closest
+    float tmax = maxDistance;  // The max distance the segment can travel
 
     // For all three slabs
     for (int i = 0; i < 3; i++)
@@ -246,4 +257,54 @@ bool intersect_bounds(const Ray& ray, const BoundsF& bounds,
     return true;
 }
 
+//------------------------------------------------------------------------------
+// intersect_bounds
+//------------------------------------------------------------------------------
+int intersect_bounds(const RayPacket& packet, const BoundsF& bounds,
+                     const int mask, const float epsilon)
+{
+    // This follows the single ray version step for step, so that a ray gets
+    // the same answer whether it is traced on its own or in a packet.
+    const float* positions[3] = {packet.m_positionX, packet.m_positionY,
+                                 packet.m_positionZ};
+    const float* directions[3] = {packet.m_directionX, packet.m_directionY,
+                                  packet.m_directionZ};
+
+    const __m128 signMask = _mm_set1_ps(-0.0f);
+    const __m128 epsilon4 = _mm_set1_ps(epsilon);
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    __m128 tmin = _mm_setzero_ps();
+    __m128 tmax = _mm_set1_ps(FLT_MAX);
+    __m128 miss = _mm_setzero_ps();
+
+    for (int i = 0; i < 3; i++)
+    {
+        const __m128 position = _mm_load_ps(positions[i]);
+        const __m128 direction = _mm_load_ps(directions[i]);
+        const __m128 boundsMin = _mm_set1_ps(bounds.m_min[i]);
+        const __m128 boundsMax = _mm_set1_ps(bounds.m_max[i]);
+
+        // Lanes where the ray is parallel to the slab miss if the origin is
+        // not within the slab.
+        const __m128 parallel =
+            _mm_cmplt_ps(_mm_andnot_ps(signMask, direction), epsilon4);
+        const __m128 outside = _mm_or_ps(_mm_cmplt_ps(position, boundsMin),
+                                         _mm_cmpgt_ps(position, boundsMax));
+        miss = _mm_or_ps(miss, _mm_and_ps(parallel, outside));
+
+        // The other lanes narrow down the interval along the ray.
+        const __m128 ood = _mm_div_ps(one, direction);
+        const __m128 t1 = _mm_mul_ps(_mm_sub_ps(boundsMin, position), ood);
+        const __m128 t2 = _mm_mul_ps(_mm_sub_ps(boundsMax, position), ood);
+        const __m128 near = _mm_min_ps(t1, t2);
+        const __m128 far = _mm_max_ps(t1, t2);
+        tmin = _mm_blendv_ps(_mm_max_ps(near, tmin), tmin, parallel);
+        tmax = _mm_blendv_ps(_mm_min_ps(far, tmax), tmax, parallel);
+    }
+
+    miss = _mm_or_ps(miss, _mm_cmpgt_ps(tmin, tmax));
+    return mask & ~_mm_movemask_ps(miss);
+}
+
 }  // namespace tc
@@ -0,0 +1,211 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/irradiancecache.h"
+//------------------------------------------------------------------------------
+#include "trace/assert.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+//------------------------------------------------------------------------------
+
+namespace tc
+{
+
+namespace
+{
+/// The number of buckets in the grid, a power of two.
+static const size_t kBucketCount = 1 << 18;
+
+/// How far, relative to its radius, a record may be in front of a point and
+/// still be used for it.
+static const float kMaxInFront = 0.05f;
+}
+
+//------------------------------------------------------------------------------
+// IrradianceCache
+//------------------------------------------------------------------------------
+IrradianceCache::IrradianceCache(const float maxError, const float maxRadius)
+    : m_maxError(maxError),
+      m_minRadius(maxRadius * 0.05f),
+      m_maxRadius(maxRadius),
+      // A record is used up to maxError * radius away.
+      m_cellSize(maxError * maxRadius),
+      m_buckets(new Node* [kBucketCount]),
+      m_records(0),
+      m_size(0)
+{
+    assert(maxError > 0.0f);
+    assert(maxRadius > 0.0f);
+    std::fill(m_buckets, m_buckets + kBucketCount, static_cast<Node*>(0));
+}
+
+//------------------------------------------------------------------------------
+IrradianceCache::~IrradianceCache()
+{
+    for (size_t i = 0; i != kBucketCount; ++i)
+    {
+        Node* node = m_buckets[i];
+        while (node)
+        {
+            Node* next = node->m_next;
+            delete node;
+            node = next;
+        }
+    }
+    delete[] m_buckets;
+
+    Node* node = m_records;
+    while (node)
+    {
+        Node* next = node->m_next;
+        delete node->m_record;
+        delete node;
+        node = next;
+    }
+}
+
+//------------------------------------------------------------------------------
+void IrradianceCache::insert(const IrradianceCache_Record& record)
+{
+    IrradianceCache_Record* const copy = new IrradianceCache_Record(record);
+    copy->m_radius = std::min(std::max(copy->m_radius, m_minRadius),
+                              m_maxRadius);
+
+    Node* const owner = new Node();
+    owner->m_record = copy;
+    push(m_records, owner);
+
+    // Add the record to every cell it can be used in.
+    const float extent = m_maxError * copy->m_radius;
+    const Vector3<float>& position = copy->m_position;
+    for (long x = computeCell(position.x - extent);
+         x <= computeCell(position.x + extent); ++x)
+    {
+        for (long y = computeCell(position.y - extent);
+             y <= computeCell(position.y + extent); ++y)
+        {
+            for (long z = computeCell(position.z - extent);
+                 z <= computeCell(position.z + extent); ++z)
+            {
+                Node* const node = new Node();
+                node->m_record = copy;
+                push(m_buckets[computeBucket(x, y, z)], node);
+            }
+        }
+    }
+
+    __sync_add_and_fetch(&m_size, 1);
+}
+
+//------------------------------------------------------------------------------
+bool IrradianceCache::lookup(const Vector3<float>& position,
+                             const Vector3<float>& normal, const size_t depth,
+                             SampledSpectrum& irradiance) const
+{
+    const size_t bucket =
+        computeBucket(computeCell(position.x), computeCell(position.y),
+                      computeCell(position.z));
+
+    // Nodes are completely written before the compare and swap that
+    // publishes them. Loading the head with acquire ordering makes those
+    // writes visible here, so following the list without a lock is safe.
+    const float minWeight = 1.0f / m_maxError;
+    float weightSum = 0.0f;
+    SampledSpectrum::Wavelengths irradianceSum(0.0f);
+    for (const Node* node = __atomic_load_n(&m_buckets[bucket],
+                                            __ATOMIC_ACQUIRE);
+         node; node = node->m_next)
+    {
+        const IrradianceCache_Record& record = *node->m_record;
+        if (record.m_depth != depth)
+        {
+            continue;
+        }
+
+        const float weight = computeWeight(record, position, normal);
+        if (weight <= minWeight)
+        {
+            continue;
+        }
+
+        // Records in front of the point see things the point can't.
+        const Vector3<float> offset = position - record.m_position;
+        const float inFront = offset.dot((normal + record.m_normal) * 0.5f);
+        if (inFront < -kMaxInFront * record.m_radius)
+        {
+            continue;
+        }
+
+        const Vector3<float> normalChange = normal - record.m_normal;
+        for (size_t i = 0; i != TC_SAMPLED_SPECTRUM_SAMPLE_COUNT; ++i)
+        {
+            const float value =
+                record.m_irradiance.getWavelength(i) +
+                record.m_rotationGradient[i].dot(normalChange);
+            irradianceSum[i] += weight * std::max(value, 0.0f);
+        }
+        weightSum += weight;
+    }
+
+    if (weightSum == 0.0f)
+    {
+        return false;
+    }
+
+    irradiance = SampledSpectrum(irradianceSum /
+                                 SampledSpectrum::Wavelengths(weightSum));
+    return true;
+}
+
+//------------------------------------------------------------------------------
+size_t IrradianceCache::size() const
+{
+    return m_size;
+}
+
+//------------------------------------------------------------------------------
+float IrradianceCache::computeWeight(const IrradianceCache_Record& record,
+                                     const Vector3<float>& position,
+                                     const Vector3<float>& normal)
+{
+    const float distance = (position - record.m_position).mag();
+    const float cosine = std::min(normal.dot(record.m_normal), 1.0f);
+    const float error =
+        distance / record.m_radius + std::sqrt(1.0f - cosine);
+    if (error <= 0.0f)
+    {
+        return FLT_MAX;
+    }
+    return 1.0f / error;
+}
+
+//------------------------------------------------------------------------------
+size_t IrradianceCache::computeBucket(const long x, const long y,
+                                      const long z) const
+{
+    const size_t hash = (static_cast<size_t>(x) * 73856093) ^
+                        (static_cast<size_t>(y) * 19349663) ^
+                        (static_cast<size_t>(z) * 83492791);
+    return hash & (kBucketCount - 1);
+}
+
+//------------------------------------------------------------------------------
+long IrradianceCache::computeCell(const float value) const
+{
+    return static_cast<long>(std::floor(value / m_cellSize));
+}
+
+//------------------------------------------------------------------------------
+void IrradianceCache::push(Node*& head, Node* node)
+{
+    Node* oldHead;
+    do
+    {
+        oldHead = head;
+        node->m_next = oldHead;
+    } while (!__sync_bool_compare_and_swap(&head, oldHead, node));
+}
+
+}  // namespace tc
@@ -4,11 +4,13 @@
 #include "trace/kdtree.h"
 //------------------------------------------------------------------------------
 #include "trace/constvector.h"
+#include "trace/int.h"
 #include "trace/intersect.h"
 #include "trace/ray.h"
 //------------------------------------------------------------------------------
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <iostream>
 #include <numeric>
 #include <sstream>
@@ -20,6 +22,27 @@ namespace tc
 namespace
 {
 
+//------------------------------------------------------------------------------
+// KDTree_SerializedHeader
+//------------------------------------------------------------------------------
+// Written by KDTree::serialize before the entries and the nodes. The version
+// changes whenever the layout of the entries or the nodes does.
+//------------------------------------------------------------------------------
+struct KDTree_SerializedHeader
+{
+    enum
+    {
+        kVersion = 1
+    };
+
+    uint64_t m_version;
+    uint64_t m_entrySize;
+    uint64_t m_entryCount;
+    uint64_t m_nodesSize;
+    float m_min[3];
+    float m_max[3];
+};
+
 //------------------------------------------------------------------------------
 // KDTree_Record
 //------------------------------------------------------------------------------
@@ -746,6 +769,12 @@ void KDTree::addEntry(const BoundsF& bounds,
     m_entries.push_back(entry);
 }
 
+//------------------------------------------------------------------------------
+void KDTree::reserve(const size_t entryCount)
+{
+    m_entries.reserve(entryCount);
+}
+
 //------------------------------------------------------------------------------
 KDTree_TraceResult KDTree::findEntries(
     KDTree_SearchCache& searchCache, const Ray& ray,
@@ -769,9 +798,6 @@ KDTree_TraceResult KDTree::findEntries(
         favour[axis] = ray.m_direction[axis] >= 0.0f ? kLeft : kRight;
     }
 
-    float bestDistanceAlongRay = FLT_MAX;
-    size_t bestPrimitiveIndex = 0;
-
     searchCache.clear();
 
     BoundsF rootBounds = BoundsF(m_boundsBuilder);
@@ -828,59 +854,493 @@ KDTree_TraceResult KDTree::findEntries(
             }
             else
             {
-                const size_t primitiveCount =
-                    KDTree_Node_Impl::getPrimitiveCount(node);
-                if (primitiveCount != 0)
+                float bestDistanceAlongRay = FLT_MAX;
+                size_t bestPrimitiveIndex = 0;
+                if (intersectLeaf(stackFrame.m_nodeIndex, stackFrame.m_bounds,
+                                  ray, primtiveTest, bestDistanceAlongRay,
+                                  bestPrimitiveIndex))
+                {
+                    return KDTree_TraceResult(bestDistanceAlongRay,
+                                              bestPrimitiveIndex);
+                }
+            }
+        }
+    }
+    return KDTree_TraceResult(FLT_MAX, 0);
+}
+
+//------------------------------------------------------------------------------
+KDTree_PacketTraceResult KDTree::findEntries(
+    KDTree_SearchCache& searchCache, const RayPacket& packet,
+    const KDTree_PrimitiveIntersect& primtiveTest) const
+{
+    KDTree_PacketTraceResult result;
+    if (m_nodes.empty())
+    {
+        return result;
+    }
+
+    // The order children are visited in depends on the direction of the
+    // ray, so the packet can only be traced together if the rays agree.
+    if (!packet.hasCommonDirection())
+    {
+        for (size_t lane = 0; lane != RayPacket::kSize; ++lane)
+        {
+            if (packet.getMask() & (1 << lane))
+            {
+                const KDTree_TraceResult laneResult =
+                    findEntries(searchCache, packet.getRay(lane), primtiveTest);
+                result.m_distanceAlongRay[lane] = laneResult.m_distanceAlongRay;
+                result.m_elementIndex[lane] = laneResult.m_elementIndex;
+            }
+        }
+        return result;
+    }
+
+    // Taken from the first ray, they are the same for all of them.
+    const float* directions[3] = {packet.m_directionX, packet.m_directionY,
+                                  packet.m_directionZ};
+    size_t firstLane = 0;
+    while (!(packet.getMask() & (1 << firstLane)))
+    {
+        ++firstLane;
+    }
+    bool favourLeft[3];
+    for (size_t axis = 0; axis != 3; ++axis)
+    {
+        favourLeft[axis] = directions[axis][firstLane] >= 0.0f;
+    }
+
+    // The rays that are still looking for an intersection.
+    int active = packet.getMask();
+
+    searchCache.clear();
+
+    const BoundsF rootBounds = BoundsF(m_boundsBuilder);
+    const int rootMask = intersect_bounds(packet, rootBounds, active);
+    if (rootMask != 0)
+    {
+        searchCache.m_packetStack.push_back(
+            KDTree_SearchCache_PacketStackFrame(0, rootBounds, rootMask));
+    }
+
+    while (!searchCache.m_packetStack.empty())
+    {
+        const KDTree_SearchCache_PacketStackFrame stackFrame =
+            searchCache.m_packetStack.top();
+        searchCache.m_packetStack.pop_back();
+
+        const int mask = stackFrame.m_mask & active;
+        if (mask == 0)
+        {
+            continue;
+        }
+
+        const KDTree_Node& node =
+            KDTree_Node_Impl::lookupNode(m_nodes, stackFrame.m_nodeIndex);
+
+        if (KDTree_Node_Impl::isBranch(node))
+        {
+            const size_t axis = KDTree_Node_Impl::getAxis(node);
+            const float location = KDTree_Node_Impl::getLocation(node);
+            const Pair<BoundsF> boundsPair =
+                stackFrame.m_bounds.split(axis, location);
+
+            const size_t childIndicies[2] = {
+                KDTree_Node_Impl::getLeft(m_nodes, stackFrame.m_nodeIndex),
+                KDTree_Node_Impl::getRight(m_nodes, stackFrame.m_nodeIndex)};
+
+            // Decide which child gets processed first, exactly as it is for
+            // a single ray.
+            int firstIsLeft = 0;
+            for (size_t lane = 0; lane != RayPacket::kSize; ++lane)
+            {
+                const Vector3<float> position = packet.getRay(lane).m_position;
+                if ((mask & (1 << lane)) &&
+                    (favourLeft[axis] || boundsPair.m_left.contains(position)))
                 {
-                    const size_t nodeIndex = stackFrame.m_nodeIndex;
-                    const size_t* primitiveIndices =
-                        KDTree_Node_Impl::getPrimitives(m_nodes, nodeIndex);
+                    firstIsLeft |= 1 << lane;
+                }
+            }
 
-                    // Add all the entries in this node
-                    for (size_t i = 0; i != primitiveCount; ++i)
+            // The packet has diverged, finish the rays that are left on their
+            // own.
+            if (firstIsLeft != 0 && firstIsLeft != mask)
+            {
+                for (size_t lane = 0; lane != RayPacket::kSize; ++lane)
+                {
+                    if (active & (1 << lane))
                     {
-                        const KDTree_Entry& entry =
-                            m_entries[primitiveIndices[i]];
-                        BoundsF entryBounds(entry.getMin(), entry.getMax());
-                        BoundsF entryBoundsIntersection =
-                            entryBounds.intersection(stackFrame.m_bounds);
-                        if (intersect_bounds(ray, entryBoundsIntersection))
-                        {
-                            float distanceAlongRay = bestDistanceAlongRay;
-                            if (primtiveTest.intersect(distanceAlongRay, ray,
-                                                       entry.getPrimitiveId()))
-                            {
-                                const Vector3<float> intersectionPoint =
-                                    ray.computePointOnRay(distanceAlongRay);
-
-                                // It's possible for the ray to intersect the
-                                // the triangle at a position that is outside of
-                                // the bounds of this part of the triangle,
-                                // because
-                                // triangles can be shared across bounds.
-                                // So we have to reject intersections that are
-                                // outside of the bounds of this triangle's
-                                // kdtree box.
-                                if (entryBoundsIntersection.containsOrTouches(
-                                        intersectionPoint))
-                                {
-                                    bestDistanceAlongRay = distanceAlongRay;
-                                    bestPrimitiveIndex = entry.getPrimitiveId();
-                                }
-                            }
-                        }
+                        const KDTree_TraceResult laneResult = findEntries(
+                            searchCache, packet.getRay(lane), primtiveTest);
+                        result.m_distanceAlongRay[lane] =
+                            laneResult.m_distanceAlongRay;
+                        result.m_elementIndex[lane] = laneResult.m_elementIndex;
                     }
+                }
+                return result;
+            }
+
+            const size_t first = firstIsLeft != 0 ? 0 : 1;
+            const size_t second = (~first) & 1;
+
+            // Push the second to be processed first, only keep the lanes whose
+            // rays intersect the bounds of the child node.
+            const int secondMask =
+                intersect_bounds(packet, boundsPair[second], mask);
+            if (secondMask != 0)
+            {
+                searchCache.m_packetStack.push_back(
+                    KDTree_SearchCache_PacketStackFrame(
+                        childIndicies[second], boundsPair[second], secondMask));
+            }
+            const int firstMask =
+                intersect_bounds(packet, boundsPair[first], mask);
+            if (firstMask != 0)
+            {
+                searchCache.m_packetStack.push_back(
+                    KDTree_SearchCache_PacketStackFrame(
+                        childIndicies[first], boundsPair[first], firstMask));
+            }
+        }
+        else
+        {
+            for (size_t lane = 0; lane != RayPacket::kSize; ++lane)
+            {
+                if (!(mask & (1 << lane)))
+                {
+                    continue;
+                }
+
+                float bestDistanceAlongRay = FLT_MAX;
+                size_t bestPrimitiveIndex = 0;
+                if (intersectLeaf(stackFrame.m_nodeIndex, stackFrame.m_bounds,
+                                  packet.getRay(lane), primtiveTest,
+                                  bestDistanceAlongRay, bestPrimitiveIndex))
+                {
+                    // The nodes are visited front to back, so this is the
+                    // nearest intersection.
+                    result.m_distanceAlongRay[lane] = bestDistanceAlongRay;
+                    result.m_elementIndex[lane] = bestPrimitiveIndex;
+                    active &= ~(1 << lane);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
+void KDTree::findEntries(KDTree_SearchCache& searchCache,
+                         const RayStream& stream,
+                         const KDTree_PrimitiveIntersect& primtiveTest,
+                         KDTree_StreamTraceResult& result) const
+{
+    const size_t rayCount = stream.size();
+    result.m_distanceAlongRay.assign(rayCount, FLT_MAX);
+    result.m_elementIndex.assign(rayCount, 0);
+    if (m_nodes.empty() || rayCount == 0)
+    {
+        return;
+    }
+
+    const std::vector<float>* directions[3] = {
+        &stream.m_directionX, &stream.m_directionY, &stream.m_directionZ};
 
-                    if (bestDistanceAlongRay != FLT_MAX)
+    searchCache.clear();
+    std::vector<size_t>& rays = searchCache.m_streamRays;
+    std::vector<char>& active = searchCache.m_streamActive;
+    active.assign(rayCount, 1);
+
+    // Start with the rays that hit the tree at all.
+    const BoundsF rootBounds = BoundsF(m_boundsBuilder);
+    size_t indices[RayPacket::kSize];
+    for (size_t i = 0; i < rayCount; i += RayPacket::kSize)
+    {
+        const size_t packetSize =
+            std::min(static_cast<size_t>(RayPacket::kSize), rayCount - i);
+        for (size_t lane = 0; lane != packetSize; ++lane)
+        {
+            indices[lane] = i + lane;
+        }
+        const RayPacket packet = stream.gather(indices, packetSize);
+        const int hits = intersect_bounds(packet, rootBounds, packet.getMask());
+        for (size_t lane = 0; lane != packetSize; ++lane)
+        {
+            if (hits & (1 << lane))
+            {
+                rays.push_back(indices[lane]);
+            }
+        }
+    }
+    if (!rays.empty())
+    {
+        searchCache.m_streamStack.push_back(
+            KDTree_SearchCache_StreamStackFrame(0, rootBounds, 0, rays.size()));
+    }
+
+    while (!searchCache.m_streamStack.empty())
+    {
+        const KDTree_SearchCache_StreamStackFrame stackFrame =
+            searchCache.m_streamStack.top();
+        searchCache.m_streamStack.pop_back();
+
+        const KDTree_Node& node =
+            KDTree_Node_Impl::lookupNode(m_nodes, stackFrame.m_nodeIndex);
+
+        if (KDTree_Node_Impl::isBranch(node))
+        {
+            const size_t axis = KDTree_Node_Impl::getAxis(node);
+            const float location = KDTree_Node_Impl::getLocation(node);
+            const Pair<BoundsF> boundsPair =
+                stackFrame.m_bounds.split(axis, location);
+
+            const size_t childIndicies[2] = {
+                KDTree_Node_Impl::getLeft(m_nodes, stackFrame.m_nodeIndex),
+                KDTree_Node_Impl::getRight(m_nodes, stackFrame.m_nodeIndex)};
+
+            // Each ray has to visit the children in the same order it would on
+            // its own. The children are pushed as three frames, the right
+            // child for the rays that visit the left child first, then the
+            // left child for every ray, then the right child for the rays
+            // that visit it first.
+            std::vector<size_t>* childRays = searchCache.m_streamChildRays;
+            const size_t childOfFrame[3] = {1, 0, 1};
+            for (size_t c = 0; c != 3; ++c)
+            {
+                childRays[c].clear();
+            }
+
+            size_t i = stackFrame.m_begin;
+            while (i != stackFrame.m_end)
+            {
+                // Test the next four rays which are still searching.
+                size_t packetSize = 0;
+                while (packetSize != RayPacket::kSize && i != stackFrame.m_end)
+                {
+                    const size_t ray = rays[i++];
+                    if (active[ray])
+                    {
+                        indices[packetSize++] = ray;
+                    }
+                }
+                if (packetSize == 0)
+                {
+                    continue;
+                }
+
+                const RayPacket packet = stream.gather(indices, packetSize);
+                const int mask = packet.getMask();
+                const int leftMask =
+                    intersect_bounds(packet, boundsPair.m_left, mask);
+                const int rightMask =
+                    intersect_bounds(packet, boundsPair.m_right, mask);
+                for (size_t lane = 0; lane != packetSize; ++lane)
+                {
+                    const size_t ray = indices[lane];
+                    if (leftMask & (1 << lane))
                     {
-                        return KDTree_TraceResult(bestDistanceAlongRay,
-                                                  bestPrimitiveIndex);
+                        childRays[1].push_back(ray);
                     }
+                    if (rightMask & (1 << lane))
+                    {
+                        const bool leftIsFirst =
+                            (*directions[axis])[ray] >= 0.0f ||
+                            boundsPair.m_left.contains(
+                                packet.getRay(lane).m_position);
+                        childRays[leftIsFirst ? 0 : 2].push_back(ray);
+                    }
+                }
+            }
+
+            // This frame's rays are at the end of the list, replace them with
+            // the rays of the children.
+            rays.resize(stackFrame.m_begin);
+            for (size_t c = 0; c != 3; ++c)
+            {
+                if (!childRays[c].empty())
+                {
+                    const size_t begin = rays.size();
+                    rays.insert(rays.end(), childRays[c].begin(),
+                                childRays[c].end());
+                    searchCache.m_streamStack.push_back(
+                        KDTree_SearchCache_StreamStackFrame(
+                            childIndicies[childOfFrame[c]],
+                            boundsPair[childOfFrame[c]], begin, rays.size()));
                 }
             }
         }
+        else
+        {
+            for (size_t i = stackFrame.m_begin; i != stackFrame.m_end; ++i)
+            {
+                const size_t ray = rays[i];
+                if (!active[ray])
+                {
+                    continue;
+                }
+
+                float bestDistanceAlongRay = FLT_MAX;
+                size_t bestPrimitiveIndex = 0;
+                if (intersectLeaf(stackFrame.m_nodeIndex, stackFrame.m_bounds,
+                                  stream.getRay(ray), primtiveTest,
+                                  bestDistanceAlongRay, bestPrimitiveIndex))
+                {
+                    // Each ray visits the nodes front to back, so this is
+                    // the nearest intersection.
+                    result.m_distanceAlongRay[ray] = bestDistanceAlongRay;
+                    result.m_elementIndex[ray] = bestPrimitiveIndex;
+                    active[ray] = 0;
+                }
+            }
+            rays.resize(stackFrame.m_begin);
+        }
     }
-    return KDTree_TraceResult(FLT_MAX, 0);
+}
+
+//------------------------------------------------------------------------------
+bool KDTree::findAnyEntry(KDTree_SearchCache& searchCache, const Ray& ray,
+                          const float maxDistance,
+                          const KDTree_PrimitiveIntersect& primtiveTest) const
+{
+    if (m_nodes.empty())
+    {
+        return false;
+    }
+
+    // Nodes are still visited front to back, as nearby primitives are the
+    // most likely to be in the way.
+    bool favourLeft[3];
+    for (size_t axis = 0; axis != 3; ++axis)
+    {
+        favourLeft[axis] = ray.m_direction[axis] >= 0.0f;
+    }
+
+    searchCache.clear();
+
+    const BoundsF rootBounds = BoundsF(m_boundsBuilder);
+    if (!intersect_segment_bounds(ray, maxDistance, rootBounds))
+    {
+        return false;
+    }
+
+    searchCache.m_stack.push_back(
+        KDTree_SearchCache_StackFrame(0, rootBounds));
+    while (!searchCache.m_stack.empty())
+    {
+        const KDTree_SearchCache_StackFrame stackFrame =
+            searchCache.m_stack.top();
+        searchCache.m_stack.pop_back();
+
+        const KDTree_Node& node =
+            KDTree_Node_Impl::lookupNode(m_nodes, stackFrame.m_nodeIndex);
+
+        if (KDTree_Node_Impl::isBranch(node))
+        {
+            const size_t axis = KDTree_Node_Impl::getAxis(node);
+            const float location = KDTree_Node_Impl::getLocation(node);
+            const Pair<BoundsF> boundsPair =
+                stackFrame.m_bounds.split(axis, location);
+
+            const size_t childIndicies[2] = {
+                KDTree_Node_Impl::getLeft(m_nodes, stackFrame.m_nodeIndex),
+                KDTree_Node_Impl::getRight(m_nodes, stackFrame.m_nodeIndex)};
+            const size_t first =
+                favourLeft[axis] || boundsPair.m_left.contains(ray.m_position)
+                    ? 0
+                    : 1;
+            const size_t second = (~first) & 1;
+
+            // Nodes beyond maxDistance can't hold anything in the way.
+            if (intersect_segment_bounds(ray, maxDistance, boundsPair[second]))
+            {
+                searchCache.m_stack.push_back(KDTree_SearchCache_StackFrame(
+                    childIndicies[second], boundsPair[second]));
+            }
+            if (intersect_segment_bounds(ray, maxDistance, boundsPair[first]))
+            {
+                searchCache.m_stack.push_back(KDTree_SearchCache_StackFrame(
+                    childIndicies[first], boundsPair[first]));
+            }
+            continue;
+        }
+
+        const size_t primitiveCount =
+            KDTree_Node_Impl::getPrimitiveCount(node);
+        if (primitiveCount == 0)
+        {
+            continue;
+        }
+        const size_t* primitiveIndices =
+            KDTree_Node_Impl::getPrimitives(m_nodes, stackFrame.m_nodeIndex);
+        for (size_t i = 0; i != primitiveCount; ++i)
+        {
+            // Any hit on the primitive will do, so unlike intersectLeaf the
+            // hit doesn't have to be inside this node.
+            const KDTree_Entry& entry = m_entries[primitiveIndices[i]];
+            const BoundsF entryBounds(entry.getMin(), entry.getMax());
+            float distanceAlongRay = maxDistance;
+            if (intersect_segment_bounds(ray, maxDistance, entryBounds) &&
+                primtiveTest.intersect(distanceAlongRay, ray,
+                                       entry.getPrimitiveId()) &&
+                distanceAlongRay < maxDistance)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+bool KDTree::intersectLeaf(const size_t nodeIndex, const BoundsF& nodeBounds,
+                           const Ray& ray,
+                           const KDTree_PrimitiveIntersect& primtiveTest,
+                           float& bestDistanceAlongRay,
+                           size_t& bestPrimitiveIndex) const
+{
+    const KDTree_Node& node = KDTree_Node_Impl::lookupNode(m_nodes, nodeIndex);
+    const size_t primitiveCount = KDTree_Node_Impl::getPrimitiveCount(node);
+    if (primitiveCount == 0)
+    {
+        return false;
+    }
+
+    const size_t* primitiveIndices =
+        KDTree_Node_Impl::getPrimitives(m_nodes, nodeIndex);
+
+    // Add all the entries in this node
+    bool found = false;
+    for (size_t i = 0; i != primitiveCount; ++i)
+    {
+        const KDTree_Entry& entry = m_entries[primitiveIndices[i]];
+        BoundsF entryBounds(entry.getMin(), entry.getMax());
+        BoundsF entryBoundsIntersection = entryBounds.intersection(nodeBounds);
+        if (intersect_bounds(ray, entryBoundsIntersection))
+        {
+            float distanceAlongRay = bestDistanceAlongRay;
+            if (primtiveTest.intersect(distanceAlongRay, ray,
+                                       entry.getPrimitiveId()))
+            {
+                const Vector3<float> intersectionPoint =
+                    ray.computePointOnRay(distanceAlongRay);
+
+                // It's possible for the ray to intersect the the triangle at a
+                // position that is outside of the bounds of this part of the
+                // triangle, because triangles can be shared across bounds.
+                // So we have to reject intersections that are outside of the
+                // bounds of this triangle's kdtree box.
+                if (entryBoundsIntersection.containsOrTouches(
+                        intersectionPoint))
+                {
+                    bestDistanceAlongRay = distanceAlongRay;
+                    bestPrimitiveIndex = entry.getPrimitiveId();
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
 }
 
 //------------------------------------------------------------------------------
@@ -906,4 +1366,166 @@ void KDTree::sortTree()
     }
 }
 
+//------------------------------------------------------------------------------
+bool KDTree::isSorted() const
+{
+    return !m_nodes.empty();
+}
+
+//------------------------------------------------------------------------------
+size_t KDTree::getMemorySize() const
+{
+    return (m_entries.capacity() * sizeof(KDTree_Entry)) + m_nodes.capacity();
+}
+
+//------------------------------------------------------------------------------
+void KDTree::serialize(std::vector<char>& buffer) const
+{
+    KDTree_SerializedHeader header;
+    header.m_version = KDTree_SerializedHeader::kVersion;
+    header.m_entrySize = sizeof(KDTree_Entry);
+    header.m_entryCount = m_entries.size();
+    header.m_nodesSize = m_nodes.size();
+    const Vector3<float> min =
+        m_entries.empty() ? Vector3<float>(0.0f) : m_boundsBuilder.getMin();
+    const Vector3<float> max =
+        m_entries.empty() ? Vector3<float>(0.0f) : m_boundsBuilder.getMax();
+    for (size_t axis = 0; axis != 3; ++axis)
+    {
+        header.m_min[axis] = min[axis];
+        header.m_max[axis] = max[axis];
+    }
+
+    const char* const headerBytes = reinterpret_cast<const char*>(&header);
+    buffer.insert(buffer.end(), headerBytes, headerBytes + sizeof(header));
+    if (!m_entries.empty())
+    {
+        const char* const entryBytes =
+            reinterpret_cast<const char*>(&m_entries[0]);
+        buffer.insert(buffer.end(), entryBytes,
+                      entryBytes + (m_entries.size() * sizeof(KDTree_Entry)));
+    }
+    buffer.insert(buffer.end(), m_nodes.begin(), m_nodes.end());
+}
+
+//------------------------------------------------------------------------------
+bool KDTree::deserialize(const char* data, const size_t size,
+                         const size_t primitiveCount)
+{
+    m_boundsBuilder = BoundsBuilderF();
+    m_entries.clear();
+    m_nodes.clear();
+
+    KDTree_SerializedHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (header.m_version != KDTree_SerializedHeader::kVersion ||
+        header.m_entrySize != sizeof(KDTree_Entry) ||
+        size != sizeof(header) + (header.m_entryCount * sizeof(KDTree_Entry)) +
+                    header.m_nodesSize)
+    {
+        return false;
+    }
+
+    // The bounds were already grown when the entries were added, so they
+    // are restored exactly.
+    if (header.m_entryCount != 0)
+    {
+        const Vector3<float> min(header.m_min[0], header.m_min[1],
+                                 header.m_min[2]);
+        const Vector3<float> max(header.m_max[0], header.m_max[1],
+                                 header.m_max[2]);
+        m_boundsBuilder.expandBounds(min, 0.0f);
+        m_boundsBuilder.expandBounds(max, 0.0f);
+    }
+
+    const char* p = data + sizeof(header);
+    m_entries.resize(header.m_entryCount, KDTree_Entry(BoundsF(
+        Vector3<float>(0.0f), Vector3<float>(0.0f)), 0));
+    if (!m_entries.empty())
+    {
+        std::memcpy(&m_entries[0], p,
+                    m_entries.size() * sizeof(KDTree_Entry));
+    }
+    p += m_entries.size() * sizeof(KDTree_Entry);
+    m_nodes.assign(p, p + header.m_nodesSize);
+
+    // The entries and nodes are used without checking them again, so a tree
+    // that refers to anything outside of itself is rejected.
+    if (!isValid(primitiveCount))
+    {
+        m_boundsBuilder = BoundsBuilderF();
+        m_entries.clear();
+        m_nodes.clear();
+        return false;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+bool KDTree::isValid(const size_t primitiveCount) const
+{
+    for (size_t i = 0; i != m_entries.size(); ++i)
+    {
+        if (m_entries[i].getPrimitiveId() >= primitiveCount)
+        {
+            return false;
+        }
+    }
+
+    // The nodes are laid out depth first, with the left child of a branch
+    // straight after it, so visiting them in that order must move forward
+    // through the nodes. This also means each node is only visited once.
+    const size_t nodeSize = sizeof(KDTree_Node);
+    std::vector<size_t> stack;
+    if (!m_nodes.empty())
+    {
+        stack.push_back(0);
+    }
+    size_t end = 0;
+    while (!stack.empty())
+    {
+        const size_t nodeIndex = stack.back();
+        stack.pop_back();
+        if (nodeIndex < end || nodeIndex > m_nodes.size() ||
+            nodeSize > m_nodes.size() - nodeIndex)
+        {
+            return false;
+        }
+        end = nodeIndex + nodeSize;
+
+        const KDTree_Node& node =
+            KDTree_Node_Impl::lookupNode(m_nodes, nodeIndex);
+        if (KDTree_Node_Impl::isBranch(node))
+        {
+            stack.push_back(KDTree_Node_Impl::getRight(node));
+            stack.push_back(KDTree_Node_Impl::getLeft(m_nodes, nodeIndex));
+            continue;
+        }
+
+        const size_t leafCount = KDTree_Node_Impl::getPrimitiveCount(node);
+        if (leafCount > (m_nodes.size() - end) / sizeof(size_t))
+        {
+            return false;
+        }
+        if (leafCount != 0)
+        {
+            const size_t* const primitiveIndices =
+                KDTree_Node_Impl::getPrimitives(m_nodes, nodeIndex);
+            for (size_t i = 0; i != leafCount; ++i)
+            {
+                if (primitiveIndices[i] >= m_entries.size())
+                {
+                    return false;
+                }
+            }
+        }
+        end += leafCount * sizeof(size_t);
+    }
+    return true;
+}
+
 }  // namespace tc
@@ -5,12 +5,195 @@
 //------------------------------------------------------------------------------
 #include "lsd/lsdParser.h"
 #include "trace/assert.h"
+#include "trace/thread.h"
 #include "trace/vector.h"
+#include <algorithm>
+#include <cfloat>
 #include <cstring>
+#include <deque>
 
 namespace tc
 {
 
+namespace
+{
+//------------------------------------------------------------------------------
+// The bounds of a node while they are being worked out, and the transform
+// above it, or null for the root.
+struct NodeBounds
+{
+    const lsd::Node* m_parent;
+    float m_min[3];
+    float m_max[3];
+};
+
+//------------------------------------------------------------------------------
+// Grows 'min' and 'max' to hold every vertex of 'polyMesh'.
+void growBounds(const lsd::PolyMesh& polyMesh, float min[3], float max[3])
+{
+    if (polyMesh.m_verticies == 0)
+    {
+        return;
+    }
+    const lsd::PolyMesh::Verticies& verticies = *polyMesh.m_verticies;
+    for (size_t i = 0; i != verticies.size(); ++i)
+    {
+        for (size_t axis = 0; axis != 3; ++axis)
+        {
+            min[axis] = std::min(min[axis], verticies[i].value[axis]);
+            max[axis] = std::max(max[axis], verticies[i].value[axis]);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// A node without any vertices below it is given empty bounds at the origin.
+BoundsF makeBounds(const float min[3], const float max[3])
+{
+    if (min[0] > max[0])
+    {
+        return BoundsF(Vector3<float>(0.0f), Vector3<float>(0.0f));
+    }
+    return BoundsF(Vector3<float>(min[0], min[1], min[2]),
+                   Vector3<float>(max[0], max[1], max[2]));
+}
+
+//------------------------------------------------------------------------------
+BoundsF getPolyMeshBounds(const lsd::PolyMesh& polyMesh)
+{
+    float min[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float max[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    growBounds(polyMesh, min, max);
+    return makeBounds(min, max);
+}
+}  // namespace
+
+//------------------------------------------------------------------------------
+// lsdObjectIterator_Mesh
+//------------------------------------------------------------------------------
+// A poly mesh taken from the parser when streaming. The vertices and
+// triangles are swapped out of the stage, so they aren't copied.
+//------------------------------------------------------------------------------
+class lsdObjectIterator_Mesh
+{
+public:
+    lsdObjectIterator_Mesh(lsd::PolyMesh& polyMesh)
+        : m_name(polyMesh.getName() ? polyMesh.getName() : ""),
+          m_polyMesh(const_cast<char*>(m_name.c_str())),
+          m_bounds(getPolyMeshBounds(polyMesh))
+    {
+        m_verticies.swap(*polyMesh.m_verticies);
+        m_triangles.swap(*polyMesh.m_triangles);
+        m_polyMesh.m_verticies = &m_verticies;
+        m_polyMesh.m_triangles = &m_triangles;
+    }
+
+    const std::string m_name;
+    lsd::PolyMesh::Verticies m_verticies;
+    lsd::PolyMesh::Triangles m_triangles;
+    lsd::PolyMesh m_polyMesh;
+    const BoundsF m_bounds;
+};
+
+//------------------------------------------------------------------------------
+// lsdObjectIterator_Stream
+//------------------------------------------------------------------------------
+// Parses a file on a thread of its own, and queues each poly mesh as soon as
+// the parser reaches the end of it. The parser waits while the queue is
+// full, so no more than a few meshes are held in memory at once.
+//------------------------------------------------------------------------------
+class lsdObjectIterator_Stream : public ThreadBundle, public lsd::Listener
+{
+public:
+    enum
+    {
+        kMaxQueued = 4
+    };
+
+    lsdObjectIterator_Stream(const std::string& filename)
+        : ThreadBundle(Range(0, 1), 1), m_filename(filename), m_finished(0)
+    {
+    }
+
+    ~lsdObjectIterator_Stream()
+    {
+        for (size_t i = 0; i != m_queue.size(); ++i)
+        {
+            delete m_queue[i];
+        }
+    }
+
+    /// \return The next poly mesh, waiting for it to be parsed, or null if
+    /// there are no more. The caller owns the mesh.
+    lsdObjectIterator_Mesh* pop()
+    {
+        for (;;)
+        {
+            // Read the finished flag first, so a mesh queued just before the
+            // parser finishes isn't missed.
+            const bool finished = __sync_fetch_and_add(&m_finished, 0) != 0;
+            {
+                RWLock_Write write(m_lock);
+                if (!m_queue.empty())
+                {
+                    lsdObjectIterator_Mesh* const mesh = m_queue.front();
+                    m_queue.pop_front();
+                    return mesh;
+                }
+            }
+            if (finished)
+            {
+                return 0;
+            }
+            yieldThread();
+        }
+    }
+
+private:
+    virtual void run(const size_t threadIndex, const Range& range)
+    {
+        lsd::Stage stage;
+        stage.setListener(this);
+        lsd::Parser parser(stage, m_filename.c_str());
+        parser.parse();
+        __sync_fetch_and_add(&m_finished, 1);
+    }
+
+    virtual void polyMesh(lsd::PolyMesh& polyMesh)
+    {
+        if (polyMesh.m_verticies == 0 || polyMesh.m_verticies->empty() ||
+            polyMesh.m_triangles == 0 || polyMesh.m_triangles->empty())
+        {
+            return;
+        }
+        lsdObjectIterator_Mesh* const mesh =
+            new lsdObjectIterator_Mesh(polyMesh);
+        for (;;)
+        {
+            // Once iteration has ended, the rest of the file is thrown away.
+            if (shouldStop())
+            {
+                delete mesh;
+                return;
+            }
+            {
+                RWLock_Write write(m_lock);
+                if (m_queue.size() < kMaxQueued)
+                {
+                    m_queue.push_back(mesh);
+                    return;
+                }
+            }
+            yieldThread();
+        }
+    }
+
+    const std::string m_filename;
+    RWLock m_lock;
+    std::deque<lsdObjectIterator_Mesh*> m_queue;
+    unsigned int m_finished;
+};
+
 //------------------------------------------------------------------------------
 // lsdTriangleIterator
 //------------------------------------------------------------------------------
@@ -75,12 +258,26 @@ Triangle lsdTriangleIterator::operator*() const
 // lsdObjectIterator
 //------------------------------------------------------------------------------
 lsdObjectIterator::lsdObjectIterator()
-    : m_placeholderBounds(Vector3<float>(-1.0f), Vector3<float>(1.0f)),
-      m_currentIsPolyMesh(false),
+    : m_currentIsPolyMesh(false),
+      m_streaming(false),
+      m_stream(0),
+      m_streamedMesh(0),
       m_stageIterator(m_stage)
 {
 }
 
+//------------------------------------------------------------------------------
+lsdObjectIterator::~lsdObjectIterator()
+{
+    end();
+}
+
+//------------------------------------------------------------------------------
+void lsdObjectIterator::setStreaming(const bool streaming)
+{
+    m_streaming = streaming;
+}
+
 //------------------------------------------------------------------------------
 void lsdObjectIterator::setFilename(const char* filename)
 {
@@ -90,9 +287,18 @@ void lsdObjectIterator::setFilename(const char* filename)
 //------------------------------------------------------------------------------
 void lsdObjectIterator::begin()
 {
-    // Construct a parser object and parse the given file.
+    // Construct a parser object and parse the given file, replacing anything
+    // left from the last time.
+    end();
+    if (m_streaming)
+    {
+        m_stream = new lsdObjectIterator_Stream(m_filename);
+        m_stream->start();
+        return;
+    }
     lsd::Parser parser(m_stage, m_filename.c_str());
     parser.parse();
+    computeBounds();
     // Initialise the stage iterator to begin iterating.
     m_stageIterator.begin();
 }
@@ -100,12 +306,40 @@ void lsdObjectIterator::begin()
 //------------------------------------------------------------------------------
 void lsdObjectIterator::end()
 {
+    // The parsed file is freed all at once.
+    m_currentIsPolyMesh = false;
+    m_nodeBounds.clear();
+    m_stage.clear();
+    m_stageIterator.begin();
+
+    // Stop a stream part way through.
+    if (m_stream)
+    {
+        m_stream->stop();
+        m_stream->join();
+        delete m_stream;
+        m_stream = 0;
+    }
+    delete m_streamedMesh;
+    m_streamedMesh = 0;
 }
 
 //------------------------------------------------------------------------------
 bool lsdObjectIterator::next()
 {
     m_currentIsPolyMesh = false;
+    if (m_stream)
+    {
+        delete m_streamedMesh;
+        m_streamedMesh = m_stream->pop();
+        if (m_streamedMesh == 0)
+        {
+            return false;
+        }
+        m_currentIsPolyMesh = true;
+        m_triangleIterator.setPolyMesh(m_streamedMesh->m_polyMesh);
+        return true;
+    }
     const bool shouldContinue = m_stageIterator.next();
     if (shouldContinue)
     {
@@ -124,18 +358,32 @@ bool lsdObjectIterator::next()
 //------------------------------------------------------------------------------
 void lsdObjectIterator::recurseIntoChildren(bool yesNo)
 {
-    m_stageIterator.recurseIntoChildren(yesNo);
+    if (!m_stream)
+    {
+        m_stageIterator.recurseIntoChildren(yesNo);
+    }
 }
 
 //------------------------------------------------------------------------------
 const BoundsF& lsdObjectIterator::getBounds() const
 {
-    return m_placeholderBounds;
+    if (m_streamedMesh)
+    {
+        return m_streamedMesh->m_bounds;
+    }
+    const BoundsMap::const_iterator bounds =
+        m_nodeBounds.find(&*m_stageIterator);
+    assert(bounds != m_nodeBounds.end());
+    return bounds->second;
 }
 
 //------------------------------------------------------------------------------
 bool lsdObjectIterator::hasTriangles() const
 {
+    if (m_stream)
+    {
+        return m_currentIsPolyMesh;
+    }
     const lsd::Node& node = *m_stageIterator;
     return node.isPolyMesh();
 }
@@ -154,4 +402,73 @@ TriangleIterator& lsdObjectIterator::getTriangles()
     return m_stubTriangleIterator;
 }
 
+//------------------------------------------------------------------------------
+void lsdObjectIterator::computeBounds()
+{
+    const lsd::Node* const root = m_stage.getRoot();
+    if (root == 0)
+    {
+        return;
+    }
+
+    // Each node is visited before its children, so the transforms above a
+    // poly mesh are already there to grow its bounds into.
+    std::map<const lsd::Node*, NodeBounds> nodes;
+    std::vector<std::pair<const lsd::Node*, const lsd::Node*> > stack;
+    stack.push_back(std::make_pair(root, static_cast<const lsd::Node*>(0)));
+    while (!stack.empty())
+    {
+        const lsd::Node* const node = stack.back().first;
+        NodeBounds& bounds = nodes[node];
+        bounds.m_parent = stack.back().second;
+        stack.pop_back();
+        for (size_t axis = 0; axis != 3; ++axis)
+        {
+            bounds.m_min[axis] = FLT_MAX;
+            bounds.m_max[axis] = -FLT_MAX;
+        }
+
+        if (node->isXform())
+        {
+            const lsd::Xform::Children* const children =
+                node->as<lsd::Xform>()->m_children;
+            for (size_t i = 0; children != 0 && i != children->size(); ++i)
+            {
+                stack.push_back(std::make_pair((*children)[i], node));
+            }
+            continue;
+        }
+
+        // The bounds of a poly mesh are grown into each of the transforms
+        // above it.
+        growBounds(*node->as<lsd::PolyMesh>(), bounds.m_min, bounds.m_max);
+        for (const lsd::Node* parent = bounds.m_parent; parent != 0;
+             parent = nodes[parent].m_parent)
+        {
+            NodeBounds& parentBounds = nodes[parent];
+            for (size_t axis = 0; axis != 3; ++axis)
+            {
+                parentBounds.m_min[axis] =
+                    std::min(parentBounds.m_min[axis], bounds.m_min[axis]);
+                parentBounds.m_max[axis] =
+                    std::max(parentBounds.m_max[axis], bounds.m_max[axis]);
+            }
+        }
+    }
+
+    std::map<const lsd::Node*, NodeBounds>::const_iterator i;
+    for (i = nodes.begin(); i != nodes.end(); ++i)
+    {
+        m_nodeBounds.insert(
+            std::make_pair(i->first, makeBounds(i->second.m_min,
+                                                i->second.m_max)));
+    }
+}
+
+//------------------------------------------------------------------------------
+bool lsdObjectIterator::isStreaming() const
+{
+    return m_streaming;
+}
+
 }  // namespace tc
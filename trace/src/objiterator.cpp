@@ -3,132 +3,671 @@
 //------------------------------------------------------------------------------
 #include "trace/objiterator.h"
 //------------------------------------------------------------------------------
-#include "pystring.h"
+#include "trace/assert.h"
+#include "trace/thread.h"
+#include "trace/triangle.h"
 //------------------------------------------------------------------------------
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace tc
 {
 
+namespace
+{
+/// Files are only split across threads if every thread gets at least this
+/// many bytes.
+static const size_t kMinChunkSize = 1 << 20;
+
+/// Numbers with more digits than this don't fit exactly in a double, and
+/// are left to strtod.
+static const size_t kMaxFastDigits = 15;
+
+/// Exact powers of ten, for numbers with up to kMaxFastDigits digits.
+static const double kPowersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                      1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15};
+
 //------------------------------------------------------------------------------
-// Obj_TriangleIterator
+inline bool isSpace(const char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
 //------------------------------------------------------------------------------
-Obj_TriangleIterator::Obj_TriangleIterator()
+inline bool isDigit(const char c)
 {
+    return c >= '0' && c <= '9';
 }
 
 //------------------------------------------------------------------------------
-Obj_TriangleIterator::~Obj_TriangleIterator()
+inline const char* skipSpaces(const char* p, const char* end)
 {
+    while (p != end && isSpace(*p))
+    {
+        ++p;
+    }
+    return p;
 }
 
 //------------------------------------------------------------------------------
-void Obj_TriangleIterator::setFilename(const char* filename)
+inline const char* skipToken(const char* p, const char* end)
 {
-    m_filename = filename;
+    while (p != end && !isSpace(*p))
+    {
+        ++p;
+    }
+    return p;
 }
 
 //------------------------------------------------------------------------------
-void Obj_TriangleIterator::begin()
+// parseFloat
+//------------------------------------------------------------------------------
+/// \brief Reads the number at p, moving p past it. Plain decimals are read
+/// directly, giving the same result as atof. Anything else, such as an
+/// exponent, is copied out and read by strtod.
+/// \return false if there isn't a number at p.
+//------------------------------------------------------------------------------
+bool parseFloat(const char*& p, const char* end, float& value)
 {
-    m_infile.open(m_filename.c_str());
+    const char* const tokenBegin = p;
+    const char* const tokenEnd = skipToken(p, end);
+
+    const char* c = p;
+    const bool negative = c != tokenEnd && *c == '-';
+    if (c != tokenEnd && (*c == '-' || *c == '+'))
+    {
+        ++c;
+    }
 
-    while (std::getline(m_infile, m_line))
+    unsigned long long mantissa = 0;
+    size_t digits = 0;
+    size_t fractionDigits = 0;
+    bool inFraction = false;
+    for (; c != tokenEnd; ++c)
     {
-        // Load an m_verts
-        pystring::split(m_line, m_splitline);
-        if (m_splitline.size() == 4 && m_splitline[0] == "v")
+        if (isDigit(*c))
+        {
+            mantissa = (mantissa * 10) + (*c - '0');
+            ++digits;
+            fractionDigits += inFraction ? 1 : 0;
+        }
+        else if (*c == '.' && !inFraction)
         {
-            const float x = atof(m_splitline[1].c_str());
-            const float y = atof(m_splitline[2].c_str());
-            const float z = atof(m_splitline[3].c_str());
+            inFraction = true;
+        }
+        else
+        {
+            break;
+        }
+    }
+
+    if (c == tokenEnd && digits != 0 && digits <= kMaxFastDigits)
+    {
+        // Both values are exact, so the division is rounded just once, as
+        // it is by atof.
+        const double magnitude =
+            static_cast<double>(mantissa) / kPowersOfTen[fractionDigits];
+        value = static_cast<float>(negative ? -magnitude : magnitude);
+        p = tokenEnd;
+        return true;
+    }
+
+    // The mapped file isn't null terminated, so the token is copied out.
+    char buffer[64];
+    const size_t length = tokenEnd - tokenBegin;
+    if (length == 0 || length >= sizeof(buffer))
+    {
+        return false;
+    }
+    std::memcpy(buffer, tokenBegin, length);
+    buffer[length] = '\0';
+    char* parsedEnd = 0;
+    const double parsed = strtod(buffer, &parsedEnd);
+    if (parsedEnd != buffer + length)
+    {
+        return false;
+    }
+    value = static_cast<float>(parsed);
+    p = tokenEnd;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// parseIndex
+//------------------------------------------------------------------------------
+/// \brief Reads the vertex index from a face element such as "3", "3/1" or
+/// "-2//4", moving p past the whole element.
+/// \return false if the element doesn't start with a non zero integer.
+//------------------------------------------------------------------------------
+bool parseIndex(const char*& p, const char* end, long& index)
+{
+    const char* c = p;
+    const bool negative = c != end && *c == '-';
+    if (negative)
+    {
+        ++c;
+    }
+
+    long value = 0;
+    const char* const digitsBegin = c;
+    while (c != end && isDigit(*c))
+    {
+        value = (value * 10) + (*c - '0');
+        ++c;
+    }
+
+    p = skipToken(c, end);
+    if (c == digitsBegin || value == 0 || (c != end && !isSpace(*c) &&
+                                           *c != '/'))
+    {
+        return false;
+    }
+    index = negative ? -value : value;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// ObjParseThreads
+//------------------------------------------------------------------------------
+// Parses a chunk of the file on each thread.
+//------------------------------------------------------------------------------
+class ObjParseThreads : public ThreadBundle
+{
+public:
+    explicit ObjParseThreads(std::vector<Obj_Chunk>& chunks)
+        : ThreadBundle(Range(0, chunks.size()), chunks.size()),
+          m_chunks(chunks)
+    {
+    }
 
-            m_verts.push_back(Vector3<float>(x, y, z));
+private:
+    virtual void run(const size_t threadIndex, const Range& range)
+    {
+        for (size_t i = range.m_lower; i != range.m_upper; ++i)
+        {
+            m_chunks[i].parse();
         }
     }
 
-    m_infile.clear();
-    m_infile.seekg(0);
+    std::vector<Obj_Chunk>& m_chunks;
+};
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// Obj_Chunk
+//------------------------------------------------------------------------------
+Obj_Chunk::Obj_Chunk(const char* begin, const char* end)
+    : m_begin(begin), m_end(end)
+{
 }
 
 //------------------------------------------------------------------------------
-bool Obj_TriangleIterator::next()
+void Obj_Chunk::parse()
 {
-    while (std::getline(m_infile, m_line))
+    const char* line = m_begin;
+    while (line != m_end)
     {
-        // Load the m_verts
-        pystring::split(m_line, m_splitline);
-        if (m_splitline.size() == 4 && m_splitline[0] == "f")
+        const char* lineEnd = static_cast<const char*>(
+            std::memchr(line, '\n', m_end - line));
+        lineEnd = lineEnd ? lineEnd : m_end;
+
+        const char* p = skipSpaces(line, lineEnd);
+        const bool isVertex =
+            lineEnd - p > 1 && p[0] == 'v' && isSpace(p[1]);
+        const bool isFace = lineEnd - p > 1 && p[0] == 'f' && isSpace(p[1]);
+        const bool isGroup = p != lineEnd && (p[0] == 'o' || p[0] == 'g') &&
+                             (lineEnd - p == 1 || isSpace(p[1]));
+
+        if (isVertex)
+        {
+            // Any w component is ignored.
+            float xyz[3];
+            bool valid = true;
+            p += 1;
+            for (size_t i = 0; i != 3 && valid; ++i)
+            {
+                p = skipSpaces(p, lineEnd);
+                valid = parseFloat(p, lineEnd, xyz[i]);
+            }
+            if (valid)
+            {
+                m_verts.push_back(Vector3<float>(xyz[0], xyz[1], xyz[2]));
+            }
+        }
+        else if (isFace)
         {
-            size_t va = atoi(m_splitline[1].c_str());
-            size_t vb = atoi(m_splitline[2].c_str());
-            size_t vc = atoi(m_splitline[3].c_str());
+            const size_t faceBegin = m_indices.size();
+            const size_t relativeBegin = m_relativeIndices.size();
+            // The first and previous vertex of the face, and whether their
+            // indices are relative.
+            size_t fan[2] = {0, 0};
+            bool fanRelative[2] = {false, false};
+            size_t count = 0;
+            bool valid = true;
+            p = skipSpaces(p + 1, lineEnd);
+            while (p != lineEnd && valid)
+            {
+                long index = 0;
+                valid = parseIndex(p, lineEnd, index);
+                p = skipSpaces(p, lineEnd);
 
-            m_a = m_verts[va - 1];
-            m_b = m_verts[vb - 1];
-            m_c = m_verts[vc - 1];
+                // Relative indices count back from the last vertex so far.
+                const bool relative = index < 0;
+                const size_t vertex =
+                    relative ? m_verts.size() + index : index - 1;
 
-            return true;
+                // Every vertex after the first two adds a triangle to the fan.
+                if (valid && count >= 2)
+                {
+                    const size_t triangle[3] = {fan[0], fan[1], vertex};
+                    const bool triangleRelative[3] = {fanRelative[0],
+                                                      fanRelative[1], relative};
+                    for (size_t i = 0; i != 3; ++i)
+                    {
+                        if (triangleRelative[i])
+                        {
+                            m_relativeIndices.push_back(m_indices.size());
+                        }
+                        m_indices.push_back(triangle[i]);
+                    }
+                }
+                if (count == 0)
+                {
+                    fan[0] = vertex;
+                    fanRelative[0] = relative;
+                }
+                fan[1] = vertex;
+                fanRelative[1] = relative;
+                ++count;
+            }
+            if (!valid)
+            {
+                m_indices.resize(faceBegin);
+                m_relativeIndices.resize(relativeBegin);
+            }
+        }
+        else if (isGroup)
+        {
+            m_groups.push_back(m_indices.size() / 3);
         }
+
+        line = lineEnd == m_end ? m_end : lineEnd + 1;
     }
-    return false;
+}
+
+//------------------------------------------------------------------------------
+// Obj_File
+//------------------------------------------------------------------------------
+Obj_File::Obj_File()
+{
+}
+
+//------------------------------------------------------------------------------
+void Obj_File::read(const char* filename, const size_t threadCount)
+{
+    clear();
+    // Triangles before the first 'o' or 'g' line are in a group of their own.
+    m_groups.push_back(0);
+
+    // A file that can't be read has no triangles.
+    const int file = open(filename, O_RDONLY);
+    if (file == -1)
+    {
+        return;
+    }
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(file);
+        return;
+    }
+    const size_t size = fileStat.st_size;
+    void* const mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED)
+    {
+        return;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const char* const data = static_cast<const char*>(mapped);
+    const char* const dataEnd = data + size;
+
+    // Split the file into runs of whole lines.
+    const size_t chunkCount =
+        threadCount != 0
+            ? threadCount
+            : std::max(static_cast<size_t>(1),
+                       std::min(getNumProcs(), size / kMinChunkSize));
+    const char* chunkBegin = data;
+    for (size_t i = 1; i <= chunkCount; ++i)
+    {
+        const char* chunkEnd = data + ((size * i) / chunkCount);
+        chunkEnd = std::max(chunkEnd, chunkBegin);
+        if (chunkEnd != dataEnd)
+        {
+            const char* newline = static_cast<const char*>(
+                std::memchr(chunkEnd, '\n', dataEnd - chunkEnd));
+            chunkEnd = newline ? newline + 1 : dataEnd;
+        }
+        m_chunks.push_back(Obj_Chunk(chunkBegin, chunkEnd));
+        chunkBegin = chunkEnd;
+    }
+
+    if (m_chunks.size() == 1)
+    {
+        m_chunks[0].parse();
+    }
+    else
+    {
+        ObjParseThreads threads(m_chunks);
+        threads.start();
+        threads.join();
+    }
+    munmap(mapped, size);
+
+    // Now the number of vertices before each chunk is known, the vertices
+    // can be numbered across the whole file.
+    // The same goes for the triangles, and so the groups.
+    size_t vertexCount = 0;
+    for (size_t i = 0; i != m_chunks.size(); ++i)
+    {
+        vertexCount += m_chunks[i].m_verts.size();
+    }
+    m_verts.reserve(vertexCount);
+    m_chunkTriangles.reserve(m_chunks.size());
+    size_t triangleCount = 0;
+    for (size_t i = 0; i != m_chunks.size(); ++i)
+    {
+        Obj_Chunk& chunk = m_chunks[i];
+        const size_t offset = m_verts.size();
+        for (size_t j = 0; j != chunk.m_relativeIndices.size(); ++j)
+        {
+            chunk.m_indices[chunk.m_relativeIndices[j]] += offset;
+        }
+        m_verts.insert(m_verts.end(), chunk.m_verts.begin(),
+                       chunk.m_verts.end());
+
+        // A group that starts where the last one did has no triangles, so
+        // is dropped.
+        for (size_t j = 0; j != chunk.m_groups.size(); ++j)
+        {
+            const size_t group = triangleCount + chunk.m_groups[j];
+            if (group != m_groups.back())
+            {
+                m_groups.push_back(group);
+            }
+        }
+        m_chunkTriangles.push_back(triangleCount);
+        triangleCount += chunk.m_indices.size() / 3;
+
+        std::vector<Vector3<float> >().swap(chunk.m_verts);
+        std::vector<size_t>().swap(chunk.m_relativeIndices);
+        std::vector<size_t>().swap(chunk.m_groups);
+        chunk.m_begin = 0;
+        chunk.m_end = 0;
+    }
+
+    // So is a group at the end of the file.
+    if (m_groups.back() == triangleCount && m_groups.size() > 1)
+    {
+        m_groups.pop_back();
+    }
+}
+
+//------------------------------------------------------------------------------
+void Obj_File::clear()
+{
+    std::vector<Vector3<float> >().swap(m_verts);
+    std::vector<Obj_Chunk>().swap(m_chunks);
+    std::vector<size_t>().swap(m_chunkTriangles);
+    std::vector<size_t>().swap(m_groups);
+}
+
+//------------------------------------------------------------------------------
+size_t Obj_File::getTriangleCount() const
+{
+    return m_chunks.empty() ? 0
+                            : m_chunkTriangles.back() +
+                                  (m_chunks.back().m_indices.size() / 3);
+}
+
+//------------------------------------------------------------------------------
+size_t Obj_File::getGroupCount() const
+{
+    return getTriangleCount() == 0 ? 0 : m_groups.size();
+}
+
+//------------------------------------------------------------------------------
+size_t Obj_File::getGroupBegin(const size_t group) const
+{
+    assert(group < m_groups.size());
+    return m_groups[group];
+}
+
+//------------------------------------------------------------------------------
+size_t Obj_File::getGroupEnd(const size_t group) const
+{
+    assert(group < m_groups.size());
+    return group + 1 == m_groups.size() ? getTriangleCount()
+                                        : m_groups[group + 1];
+}
+
+//------------------------------------------------------------------------------
+// Obj_TriangleIterator
+//------------------------------------------------------------------------------
+Obj_TriangleIterator::Obj_TriangleIterator()
+    : m_threadCount(0),
+      m_file(0),
+      m_begin(0),
+      m_end(0),
+      m_chunk(0),
+      m_index(0),
+      m_triangle(0)
+{
+}
+
+//------------------------------------------------------------------------------
+Obj_TriangleIterator::~Obj_TriangleIterator()
+{
+}
+
+//------------------------------------------------------------------------------
+void Obj_TriangleIterator::setFilename(const char* filename)
+{
+    m_filename = filename;
+    m_file = 0;
+}
+
+//------------------------------------------------------------------------------
+void Obj_TriangleIterator::setThreadCount(const size_t threadCount)
+{
+    m_threadCount = threadCount;
+}
+
+//------------------------------------------------------------------------------
+void Obj_TriangleIterator::setGroup(const Obj_File& file, const size_t group)
+{
+    m_file = &file;
+    m_begin = file.getGroupBegin(group);
+    m_end = file.getGroupEnd(group);
+}
+
+//------------------------------------------------------------------------------
+void Obj_TriangleIterator::begin()
+{
+    // Read the file, unless a group of another file was set.
+    if (m_file == 0 || m_file == &m_ownFile)
+    {
+        m_ownFile.read(m_filename.c_str(), m_threadCount);
+        m_file = &m_ownFile;
+        m_begin = 0;
+        m_end = m_ownFile.getTriangleCount();
+    }
+
+    // Start from the chunk holding the first triangle.
+    const std::vector<size_t>& chunkTriangles = m_file->m_chunkTriangles;
+    m_chunk = std::upper_bound(chunkTriangles.begin(), chunkTriangles.end(),
+                               m_begin) -
+              chunkTriangles.begin();
+    m_chunk = m_chunk == 0 ? 0 : m_chunk - 1;
+    m_index = m_chunk == chunkTriangles.size()
+                  ? 0
+                  : (m_begin - chunkTriangles[m_chunk]) * 3;
+    m_triangle = m_begin;
+}
+
+//------------------------------------------------------------------------------
+bool Obj_TriangleIterator::next()
+{
+    return nextBatch(m_corners, 1) == 1;
 }
 
 //------------------------------------------------------------------------------
 Triangle Obj_TriangleIterator::operator*() const
 {
-    return Triangle(m_a, m_b, m_c);
+    return Triangle(m_corners[0], m_corners[1], m_corners[2]);
+}
+
+//------------------------------------------------------------------------------
+size_t Obj_TriangleIterator::sizeHint() const
+{
+    return m_end - m_triangle;
+}
+
+//------------------------------------------------------------------------------
+size_t Obj_TriangleIterator::nextBatch(Vector3<float>* corners,
+                                       const size_t capacity)
+{
+    const std::vector<Vector3<float> >& verts = m_file->m_verts;
+    const std::vector<Obj_Chunk>& chunks = m_file->m_chunks;
+    const size_t vertexCount = verts.size();
+    size_t count = 0;
+    for (; m_chunk != chunks.size() && m_triangle != m_end && count != capacity;
+         ++m_chunk, m_index = 0)
+    {
+        const std::vector<size_t>& indices = chunks[m_chunk].m_indices;
+        while (m_index + 3 <= indices.size() && m_triangle != m_end)
+        {
+            const size_t a = indices[m_index];
+            const size_t b = indices[m_index + 1];
+            const size_t c = indices[m_index + 2];
+            m_index += 3;
+            ++m_triangle;
+
+            // Faces that refer to vertices that don't exist are skipped.
+            if (a < vertexCount && b < vertexCount && c < vertexCount)
+            {
+                corners[count * 3] = verts[a];
+                corners[(count * 3) + 1] = verts[b];
+                corners[(count * 3) + 2] = verts[c];
+                if (++count == capacity)
+                {
+                    return count;
+                }
+            }
+        }
+    }
+    return count;
 }
 
 //------------------------------------------------------------------------------
 // Obj_ObjectIterator
 //------------------------------------------------------------------------------
-Obj_ObjectIterator::Obj_ObjectIterator()
-    : m_bounds(Vector3<float>(0.0f), Vector3<float>(0.0f)),
-      m_currentDone(false),
-      m_done(false)
+Obj_ObjectIterator::Obj_ObjectIterator() : m_threadCount(0), m_group(0)
 {
 }
 
 //------------------------------------------------------------------------------
 void Obj_ObjectIterator::setFilename(const char* filename)
 {
-    m_triangleIterator.setFilename(filename);
+    m_filename = filename;
+}
+
+//------------------------------------------------------------------------------
+void Obj_ObjectIterator::setThreadCount(const size_t threadCount)
+{
+    m_threadCount = threadCount;
 }
 
 //------------------------------------------------------------------------------
 void Obj_ObjectIterator::begin()
 {
+    m_file.read(m_filename.c_str(), m_threadCount);
+    m_group = 0;
+
+    // Groups whose faces all refer to vertices that don't exist are given
+    // empty bounds at the origin.
+    m_bounds.clear();
+    m_bounds.reserve(m_file.getGroupCount());
+    for (size_t i = 0; i != m_file.getGroupCount(); ++i)
+    {
+        BoundsBuilderF boundsBuilder;
+        bool empty = true;
+        m_triangleIterator.setGroup(m_file, i);
+        m_triangleIterator.begin();
+        while (m_triangleIterator.next())
+        {
+            const Triangle triangle = *m_triangleIterator;
+            boundsBuilder.expandBounds(triangle.m_a);
+            boundsBuilder.expandBounds(triangle.m_b);
+            boundsBuilder.expandBounds(triangle.m_c);
+            empty = false;
+        }
+        m_triangleIterator.end();
+        if (empty)
+        {
+            boundsBuilder.expandBounds(Vector3<float>(0.0f));
+        }
+        m_bounds.push_back(BoundsF(boundsBuilder));
+    }
 }
 
 //------------------------------------------------------------------------------
 void Obj_ObjectIterator::end()
 {
+    m_file.clear();
+    m_bounds.clear();
+    std::vector<Vector3<float> >().swap(m_meshVertices);
+    std::vector<uint32_t>().swap(m_meshIndices);
+    std::vector<size_t>().swap(m_meshVertexSources);
+    std::vector<uint32_t>().swap(m_meshVertexIndices);
 }
 
 //------------------------------------------------------------------------------
 bool Obj_ObjectIterator::next()
 {
-    m_currentDone = m_done;
-    m_done = true;
-    return !m_currentDone;
+    if (m_group == m_file.getGroupCount())
+    {
+        return false;
+    }
+    m_triangleIterator.setGroup(m_file, m_group);
+    readGroupMesh(m_group);
+    ++m_group;
+    return true;
 }
 
 //------------------------------------------------------------------------------
 void Obj_ObjectIterator::recurseIntoChildren(bool yesNo)
 {
-    // Stub
 }
 
 //------------------------------------------------------------------------------
 const BoundsF& Obj_ObjectIterator::getBounds() const
 {
-    return m_bounds;
+    assert(m_group != 0);
+    return m_bounds[m_group - 1];
 }
 
 //------------------------------------------------------------------------------
 bool Obj_ObjectIterator::hasTriangles() const
 {
-    return !m_currentDone;
+    return m_group != 0;
 }
 
 //------------------------------------------------------------------------------
@@ -137,4 +676,69 @@ TriangleIterator& Obj_ObjectIterator::getTriangles()
     return m_triangleIterator;
 }
 
+//------------------------------------------------------------------------------
+bool Obj_ObjectIterator::getMesh(ObjectIterator_Mesh& mesh) const
+{
+    if (m_group == 0)
+    {
+        return false;
+    }
+    mesh.m_vertices = m_meshVertices.empty()
+                          ? 0
+                          : reinterpret_cast<const float*>(&m_meshVertices[0]);
+    mesh.m_vertexCount = m_meshVertices.size();
+    mesh.m_indices = m_meshIndices.empty() ? 0 : &m_meshIndices[0];
+    mesh.m_triangleCount = m_meshIndices.size() / 3;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void Obj_ObjectIterator::readGroupMesh(const size_t group)
+{
+    const std::vector<Vector3<float> >& verts = m_file.m_verts;
+    const std::vector<Obj_Chunk>& chunks = m_file.m_chunks;
+    const std::vector<size_t>& chunkTriangles = m_file.m_chunkTriangles;
+    const size_t vertexCount = verts.size();
+    assert(vertexCount <= 0xffffffffu);
+    m_meshVertices.clear();
+    m_meshIndices.clear();
+    m_meshVertexSources.clear();
+    m_meshVertexIndices.resize(vertexCount);
+
+    const size_t begin = m_file.getGroupBegin(group);
+    const size_t end = m_file.getGroupEnd(group);
+    size_t chunk = std::upper_bound(chunkTriangles.begin(),
+                                    chunkTriangles.end(), begin) -
+                   chunkTriangles.begin() - 1;
+    for (size_t triangle = begin; triangle != end; ++triangle)
+    {
+        while (chunk + 1 != chunkTriangles.size() &&
+               chunkTriangles[chunk + 1] <= triangle)
+        {
+            ++chunk;
+        }
+        const size_t* const abc =
+            &chunks[chunk].m_indices[(triangle - chunkTriangles[chunk]) * 3];
+
+        // Faces that refer to vertices that don't exist are skipped.
+        if (abc[0] >= vertexCount || abc[1] >= vertexCount ||
+            abc[2] >= vertexCount)
+        {
+            continue;
+        }
+        for (size_t i = 0; i != 3; ++i)
+        {
+            uint32_t& index = m_meshVertexIndices[abc[i]];
+            if (index >= m_meshVertexSources.size() ||
+                m_meshVertexSources[index] != abc[i])
+            {
+                index = static_cast<uint32_t>(m_meshVertices.size());
+                m_meshVertexSources.push_back(abc[i]);
+                m_meshVertices.push_back(verts[abc[i]]);
+            }
+            m_meshIndices.push_back(index);
+        }
+    }
+}
+
 }  // namespace tc
@@ -0,0 +1,929 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/plyiterator.h"
+//------------------------------------------------------------------------------
+#include "trace/assert.h"
+#include "trace/thread.h"
+#include "trace/triangle.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace tc
+{
+
+namespace
+{
+/// Records are only split across threads if every thread gets at least this
+/// many bytes.
+static const size_t kMinChunkSize = 1 << 20;
+
+//------------------------------------------------------------------------------
+// Returns true if numbers are stored little endian on this machine, as they
+// are in the files that can be read.
+bool isLittleEndian()
+{
+    const uint32_t one = 1;
+    unsigned char bytes[sizeof(one)];
+    std::memcpy(bytes, &one, sizeof(one));
+    return bytes[0] == 1;
+}
+
+//------------------------------------------------------------------------------
+// Reads the type called 'name'.
+// Returns false if there is no such type.
+bool parseType(const std::string& name, Ply_Property::Type& type)
+{
+    static const char* const kNames[] = {"char",  "uchar", "short", "ushort",
+                                         "int",   "uint",  "float", "double"};
+    static const char* const kSizedNames[] = {"int8",   "uint8",  "int16",
+                                              "uint16", "int32",  "uint32",
+                                              "float32", "float64"};
+    for (size_t i = 0; i != sizeof(kNames) / sizeof(kNames[0]); ++i)
+    {
+        if (name == kNames[i] || name == kSizedNames[i])
+        {
+            type = static_cast<Ply_Property::Type>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------------
+template <typename T>
+inline double readAs(const char* p)
+{
+    T value;
+    std::memcpy(&value, p, sizeof(value));
+    return static_cast<double>(value);
+}
+
+//------------------------------------------------------------------------------
+// Reads a value of 'type' at p. Every type fits exactly in a double.
+inline double readValue(const char* p, const Ply_Property::Type type)
+{
+    switch (type)
+    {
+    case Ply_Property::kInt8:
+        return readAs<signed char>(p);
+    case Ply_Property::kUInt8:
+        return readAs<unsigned char>(p);
+    case Ply_Property::kInt16:
+        return readAs<short>(p);
+    case Ply_Property::kUInt16:
+        return readAs<unsigned short>(p);
+    case Ply_Property::kInt32:
+        return readAs<int>(p);
+    case Ply_Property::kUInt32:
+        return readAs<uint32_t>(p);
+    case Ply_Property::kFloat32:
+        return readAs<float>(p);
+    case Ply_Property::kFloat64:
+        return readAs<double>(p);
+    }
+    return 0.0;
+}
+
+//------------------------------------------------------------------------------
+// Returns the number of chunks to split 'size' bytes of records into.
+size_t getChunkCount(const size_t size, const size_t threadCount)
+{
+    return threadCount != 0
+               ? threadCount
+               : std::max(static_cast<size_t>(1),
+                          std::min(getNumProcs(), size / kMinChunkSize));
+}
+
+//------------------------------------------------------------------------------
+// PlyVertexChunk
+//------------------------------------------------------------------------------
+// Decodes the positions of a run of vertex records, and finds their bounds.
+//------------------------------------------------------------------------------
+class PlyVertexChunk
+{
+public:
+    PlyVertexChunk(const char* records, const size_t recordSize,
+                   const size_t begin, const size_t end,
+                   Vector3<float>* verts)
+        : m_records(records),
+          m_recordSize(recordSize),
+          m_begin(begin),
+          m_end(end),
+          m_verts(verts)
+    {
+        for (size_t i = 0; i != 3; ++i)
+        {
+            m_offsets[i] = 0;
+            m_types[i] = Ply_Property::kFloat32;
+            m_min[i] = 0.0f;
+            m_max[i] = 0.0f;
+        }
+    }
+
+    void decode()
+    {
+        for (size_t i = m_begin; i != m_end; ++i)
+        {
+            const char* const record = m_records + (i * m_recordSize);
+            float xyz[3];
+            for (size_t j = 0; j != 3; ++j)
+            {
+                xyz[j] = static_cast<float>(
+                    readValue(record + m_offsets[j], m_types[j]));
+                m_min[j] = i == m_begin ? xyz[j] : std::min(m_min[j], xyz[j]);
+                m_max[j] = i == m_begin ? xyz[j] : std::max(m_max[j], xyz[j]);
+            }
+            m_verts[i] = Vector3<float>(xyz[0], xyz[1], xyz[2]);
+        }
+    }
+
+    const char* m_records;
+    size_t m_recordSize;
+    size_t m_offsets[3];
+    Ply_Property::Type m_types[3];
+    size_t m_begin;
+    size_t m_end;
+    Vector3<float>* m_verts;
+    // The bounds of the vertices of the chunk, if it has any.
+    float m_min[3];
+    float m_max[3];
+};
+
+//------------------------------------------------------------------------------
+// PlyTriangleChunk
+//------------------------------------------------------------------------------
+// Decodes a run of face records that are expected to be triangles, so every
+// record has the same size. The triangles are written from the first of the
+// chunk, leaving out those that refer to vertices that don't exist.
+//------------------------------------------------------------------------------
+class PlyTriangleChunk
+{
+public:
+    PlyTriangleChunk(const char* records, const size_t recordSize,
+                     const size_t begin, const size_t end,
+                     uint32_t* indices)
+        : m_records(records),
+          m_recordSize(recordSize),
+          m_countOffset(0),
+          m_countType(Ply_Property::kUInt8),
+          m_indexType(Ply_Property::kInt32),
+          m_vertexCount(0),
+          m_begin(begin),
+          m_end(end),
+          m_indices(indices),
+          m_triangleCount(0),
+          m_allTriangles(true)
+    {
+    }
+
+    void decode()
+    {
+        const size_t indexSize = Ply_Property::getSize(m_indexType);
+        uint32_t* indices = m_indices + (m_begin * 3);
+        for (size_t i = m_begin; i != m_end; ++i)
+        {
+            const char* const record =
+                m_records + (i * m_recordSize) + m_countOffset;
+            if (readValue(record, m_countType) != 3.0)
+            {
+                m_allTriangles = false;
+                return;
+            }
+
+            const char* const items =
+                record + Ply_Property::getSize(m_countType);
+            const double vertexCount = static_cast<double>(m_vertexCount);
+            const double a = readValue(items, m_indexType);
+            const double b = readValue(items + indexSize, m_indexType);
+            const double c = readValue(items + (indexSize * 2), m_indexType);
+            if (a >= 0.0 && a < vertexCount && b >= 0.0 && b < vertexCount &&
+                c >= 0.0 && c < vertexCount)
+            {
+                indices[0] = static_cast<uint32_t>(a);
+                indices[1] = static_cast<uint32_t>(b);
+                indices[2] = static_cast<uint32_t>(c);
+                indices += 3;
+                ++m_triangleCount;
+            }
+        }
+    }
+
+    const char* m_records;
+    size_t m_recordSize;
+    size_t m_countOffset;
+    Ply_Property::Type m_countType;
+    Ply_Property::Type m_indexType;
+    size_t m_vertexCount;
+    size_t m_begin;
+    size_t m_end;
+    uint32_t* m_indices;
+    size_t m_triangleCount;
+    bool m_allTriangles;
+};
+
+//------------------------------------------------------------------------------
+// PlyDecodeThreads
+//------------------------------------------------------------------------------
+// Decodes a chunk of records on each thread.
+//------------------------------------------------------------------------------
+template <typename Chunk>
+class PlyDecodeThreads : public ThreadBundle
+{
+public:
+    explicit PlyDecodeThreads(std::vector<Chunk>& chunks)
+        : ThreadBundle(Range(0, chunks.size()), chunks.size()),
+          m_chunks(chunks)
+    {
+    }
+
+private:
+    virtual void run(const size_t threadIndex, const Range& range)
+    {
+        for (size_t i = range.m_lower; i != range.m_upper; ++i)
+        {
+            m_chunks[i].decode();
+        }
+    }
+
+    std::vector<Chunk>& m_chunks;
+};
+
+//------------------------------------------------------------------------------
+// Decodes every chunk, on a thread each if there is more than one.
+template <typename Chunk>
+void decodeChunks(std::vector<Chunk>& chunks)
+{
+    if (chunks.size() == 1)
+    {
+        chunks[0].decode();
+    }
+    else
+    {
+        PlyDecodeThreads<Chunk> threads(chunks);
+        threads.start();
+        threads.join();
+    }
+}
+
+//------------------------------------------------------------------------------
+// Moves p past the properties [first, last) of the record of 'element' at p.
+// Returns 0 if they don't end before 'end'.
+const char* skipProperties(const Ply_Element& element, const size_t first,
+                           const size_t last, const char* p, const char* end)
+{
+    for (size_t i = first; i != last && p; ++i)
+    {
+        const Ply_Property& property = element.m_properties[i];
+        size_t size = Ply_Property::getSize(property.m_type);
+        if (property.m_isList)
+        {
+            const size_t countSize =
+                Ply_Property::getSize(property.m_countType);
+            if (static_cast<size_t>(end - p) < countSize)
+            {
+                return 0;
+            }
+            const double count = readValue(p, property.m_countType);
+            p += countSize;
+            size = count < 0.0 ? 0 : size * static_cast<size_t>(count);
+        }
+        p = static_cast<size_t>(end - p) < size ? 0 : p + size;
+    }
+    return p;
+}
+
+//------------------------------------------------------------------------------
+// Moves p past the record of 'element' at p.
+// Returns 0 if the record doesn't end before 'end'.
+const char* skipRecord(const Ply_Element& element, const char* p,
+                       const char* end)
+{
+    return skipProperties(element, 0, element.m_properties.size(), p, end);
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// Ply_Property
+//------------------------------------------------------------------------------
+Ply_Property::Ply_Property()
+    : m_type(kFloat32), m_isList(false), m_countType(kUInt8)
+{
+}
+
+//------------------------------------------------------------------------------
+size_t Ply_Property::getSize(const Type type)
+{
+    static const size_t kSizes[] = {1, 1, 2, 2, 4, 4, 4, 8};
+    return kSizes[type];
+}
+
+//------------------------------------------------------------------------------
+// Ply_Element
+//------------------------------------------------------------------------------
+Ply_Element::Ply_Element() : m_count(0), m_recordSize(0)
+{
+}
+
+//------------------------------------------------------------------------------
+size_t Ply_Element::findProperty(const char* name) const
+{
+    size_t i = 0;
+    while (i != m_properties.size() && m_properties[i].m_name != name)
+    {
+        ++i;
+    }
+    return i;
+}
+
+//------------------------------------------------------------------------------
+// Ply_File
+//------------------------------------------------------------------------------
+Ply_File::Ply_File()
+{
+    clear();
+}
+
+//------------------------------------------------------------------------------
+void Ply_File::read(const char* filename, const size_t threadCount)
+{
+    clear();
+
+    // A file that can't be read has no triangles.
+    const int file = open(filename, O_RDONLY);
+    if (file == -1)
+    {
+        return;
+    }
+    struct stat fileStat;
+    if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0)
+    {
+        close(file);
+        return;
+    }
+    const size_t size = fileStat.st_size;
+    void* const mapped = mmap(0, size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (mapped == MAP_FAILED)
+    {
+        return;
+    }
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    const char* const data = static_cast<const char*>(mapped);
+    const char* const dataEnd = data + size;
+
+    // The records of each element follow each other, so those before the
+    // vertices and faces are skipped to find them.
+    const char* p = readHeader(data, dataEnd);
+    bool valid = p != 0;
+    bool hasVertices = false;
+    for (size_t i = 0; valid && i != m_elements.size(); ++i)
+    {
+        const Ply_Element& element = m_elements[i];
+        if (element.m_name == "vertex")
+        {
+            valid = readVertices(element, p, dataEnd, threadCount);
+            p += element.m_count * element.m_recordSize;
+            hasVertices = true;
+        }
+        else if (element.m_name == "face")
+        {
+            p = readFaces(element, p, dataEnd, threadCount);
+            valid = p != 0;
+        }
+        else if (element.m_recordSize != 0)
+        {
+            valid = element.m_count <=
+                    static_cast<size_t>(dataEnd - p) / element.m_recordSize;
+            p += valid ? element.m_count * element.m_recordSize : 0;
+        }
+        else
+        {
+            for (size_t j = 0; p && j != element.m_count; ++j)
+            {
+                p = skipRecord(element, p, dataEnd);
+            }
+            valid = p != 0;
+        }
+    }
+    munmap(mapped, size);
+
+    if (!valid || !hasVertices)
+    {
+        clear();
+    }
+}
+
+//------------------------------------------------------------------------------
+void Ply_File::clear()
+{
+    std::vector<Ply_Element>().swap(m_elements);
+    std::vector<Vector3<float> >().swap(m_verts);
+    std::vector<uint32_t>().swap(m_indices);
+    BoundsBuilderF boundsBuilder;
+    boundsBuilder.expandBounds(Vector3<float>(0.0f));
+    m_bounds.clear();
+    m_bounds.push_back(BoundsF(boundsBuilder));
+}
+
+//------------------------------------------------------------------------------
+size_t Ply_File::getTriangleCount() const
+{
+    return m_indices.size() / 3;
+}
+
+//------------------------------------------------------------------------------
+const BoundsF& Ply_File::getBounds() const
+{
+    return m_bounds[0];
+}
+
+//------------------------------------------------------------------------------
+void Ply_File::getMesh(ObjectIterator_Mesh& mesh) const
+{
+    mesh = ObjectIterator_Mesh();
+    if (!m_indices.empty())
+    {
+        mesh.m_vertices = reinterpret_cast<const float*>(&m_verts[0]);
+        mesh.m_vertexCount = m_verts.size();
+        mesh.m_indices = &m_indices[0];
+        mesh.m_triangleCount = getTriangleCount();
+    }
+}
+
+//------------------------------------------------------------------------------
+const char* Ply_File::readHeader(const char* data, const char* dataEnd)
+{
+    // The header is made of lines of words, ending with 'end_header'.
+    const char* line = data;
+    bool isPly = false;
+    bool isBinaryLittleEndian = false;
+    while (line != dataEnd)
+    {
+        const char* lineEnd = static_cast<const char*>(
+            std::memchr(line, '\n', dataEnd - line));
+        if (lineEnd == 0)
+        {
+            return 0;
+        }
+        std::istringstream words(std::string(line, lineEnd));
+        line = lineEnd + 1;
+        std::string keyword;
+        words >> keyword;
+
+        if (!isPly)
+        {
+            // The first line must say what the file is.
+            if (keyword != "ply")
+            {
+                return 0;
+            }
+            isPly = true;
+        }
+        else if (keyword == "format")
+        {
+            std::string format;
+            words >> format;
+            isBinaryLittleEndian = format == "binary_little_endian";
+        }
+        else if (keyword == "element")
+        {
+            m_elements.push_back(Ply_Element());
+            words >> m_elements.back().m_name >> m_elements.back().m_count;
+            if (words.fail())
+            {
+                return 0;
+            }
+        }
+        else if (keyword == "property")
+        {
+            if (m_elements.empty())
+            {
+                return 0;
+            }
+            Ply_Property property;
+            std::string type;
+            words >> type;
+            property.m_isList = type == "list";
+            if (property.m_isList)
+            {
+                std::string countType;
+                words >> countType >> type;
+                if (!parseType(countType, property.m_countType))
+                {
+                    return 0;
+                }
+            }
+            words >> property.m_name;
+            if (words.fail() || !parseType(type, property.m_type))
+            {
+                return 0;
+            }
+            m_elements.back().m_properties.push_back(property);
+        }
+        else if (keyword == "end_header")
+        {
+            break;
+        }
+    }
+    if (!isBinaryLittleEndian || !isLittleEndian())
+    {
+        return 0;
+    }
+
+    // Elements without lists have records of the same size.
+    for (size_t i = 0; i != m_elements.size(); ++i)
+    {
+        Ply_Element& element = m_elements[i];
+        for (size_t j = 0; j != element.m_properties.size(); ++j)
+        {
+            const Ply_Property& property = element.m_properties[j];
+            if (property.m_isList)
+            {
+                element.m_recordSize = 0;
+                break;
+            }
+            element.m_recordSize += Ply_Property::getSize(property.m_type);
+        }
+    }
+    return line;
+}
+
+//------------------------------------------------------------------------------
+bool Ply_File::readVertices(const Ply_Element& element, const char* p,
+                            const char* dataEnd, const size_t threadCount)
+{
+    // The vertices need a position, and to be small enough in number to be
+    // indexed by a uint32_t.
+    static const char* const kAxes[] = {"x", "y", "z"};
+    size_t axes[3];
+    for (size_t i = 0; i != 3; ++i)
+    {
+        axes[i] = element.findProperty(kAxes[i]);
+        if (axes[i] == element.m_properties.size())
+        {
+            return false;
+        }
+    }
+    const size_t recordSize = element.m_recordSize;
+    const size_t count = element.m_count;
+    if (recordSize == 0 || count > 0xffffffffu ||
+        count > static_cast<size_t>(dataEnd - p) / recordSize)
+    {
+        return false;
+    }
+
+    // Split the vertices into runs.
+    m_verts.resize(count);
+    const size_t chunkCount =
+        std::min(std::max(count, static_cast<size_t>(1)),
+                 getChunkCount(count * recordSize, threadCount));
+    std::vector<PlyVertexChunk> chunks;
+    for (size_t i = 0; i != chunkCount; ++i)
+    {
+        chunks.push_back(PlyVertexChunk(p, recordSize, (count * i) / chunkCount,
+                                        (count * (i + 1)) / chunkCount,
+                                        count == 0 ? 0 : &m_verts[0]));
+        for (size_t j = 0; j != 3; ++j)
+        {
+            size_t offset = 0;
+            for (size_t k = 0; k != axes[j]; ++k)
+            {
+                offset += Ply_Property::getSize(element.m_properties[k].m_type);
+            }
+            chunks.back().m_offsets[j] = offset;
+            chunks.back().m_types[j] = element.m_properties[axes[j]].m_type;
+        }
+    }
+    decodeChunks(chunks);
+
+    // Empty bounds are kept at the origin.
+    BoundsBuilderF boundsBuilder;
+    for (size_t i = 0; i != chunks.size(); ++i)
+    {
+        const PlyVertexChunk& chunk = chunks[i];
+        if (chunk.m_begin != chunk.m_end)
+        {
+            boundsBuilder.expandBounds(
+                Vector3<float>(chunk.m_min[0], chunk.m_min[1], chunk.m_min[2]));
+            boundsBuilder.expandBounds(
+                Vector3<float>(chunk.m_max[0], chunk.m_max[1], chunk.m_max[2]));
+        }
+    }
+    if (count != 0)
+    {
+        m_bounds.clear();
+        m_bounds.push_back(BoundsF(boundsBuilder));
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+const char* Ply_File::readFaces(const Ply_Element& element, const char* p,
+                                const char* dataEnd, const size_t threadCount)
+{
+    // Faces without vertex indices are skipped.
+    size_t list = element.findProperty("vertex_indices");
+    list = list == element.m_properties.size()
+               ? element.findProperty("vertex_index")
+               : list;
+    if (list == element.m_properties.size() ||
+        !element.m_properties[list].m_isList)
+    {
+        for (size_t i = 0; p && i != element.m_count; ++i)
+        {
+            p = skipRecord(element, p, dataEnd);
+        }
+        return p;
+    }
+    const Ply_Property& indexProperty = element.m_properties[list];
+    const size_t countSize = Ply_Property::getSize(indexProperty.m_countType);
+    const size_t indexSize = Ply_Property::getSize(indexProperty.m_type);
+    // The faces may come before the vertices.
+    size_t vertexCount = 0;
+    for (size_t i = 0; i != m_elements.size(); ++i)
+    {
+        vertexCount =
+            m_elements[i].m_name == "vertex" ? m_elements[i].m_count
+                                             : vertexCount;
+    }
+
+    // If the vertex indices are the only list, and every face is a triangle,
+    // the faces are all the same size, so can be split into runs.
+    size_t countOffset = 0;
+    size_t recordSize = countSize + (indexSize * 3);
+    bool sameSize = true;
+    for (size_t i = 0; i != element.m_properties.size(); ++i)
+    {
+        const Ply_Property& property = element.m_properties[i];
+        sameSize = sameSize && (i == list || !property.m_isList);
+        if (i != list)
+        {
+            recordSize += Ply_Property::getSize(property.m_type);
+            countOffset += i < list ? Ply_Property::getSize(property.m_type)
+                                    : 0;
+        }
+    }
+    const size_t count = element.m_count;
+    if (sameSize && count <= static_cast<size_t>(dataEnd - p) / recordSize)
+    {
+        m_indices.resize(count * 3);
+        const size_t chunkCount =
+            std::min(std::max(count, static_cast<size_t>(1)),
+                     getChunkCount(count * recordSize, threadCount));
+        std::vector<PlyTriangleChunk> chunks;
+        for (size_t i = 0; i != chunkCount; ++i)
+        {
+            chunks.push_back(PlyTriangleChunk(
+                p, recordSize, (count * i) / chunkCount,
+                (count * (i + 1)) / chunkCount,
+                count == 0 ? 0 : &m_indices[0]));
+            chunks.back().m_countOffset = countOffset;
+            chunks.back().m_countType = indexProperty.m_countType;
+            chunks.back().m_indexType = indexProperty.m_type;
+            chunks.back().m_vertexCount = vertexCount;
+        }
+        decodeChunks(chunks);
+
+        // Close the gaps left by faces that were skipped.
+        bool allTriangles = true;
+        size_t triangleCount = 0;
+        for (size_t i = 0; i != chunks.size(); ++i)
+        {
+            const PlyTriangleChunk& chunk = chunks[i];
+            allTriangles = allTriangles && chunk.m_allTriangles;
+            if (allTriangles && triangleCount != chunk.m_begin)
+            {
+                std::memmove(&m_indices[triangleCount * 3],
+                             &m_indices[chunk.m_begin * 3],
+                             chunk.m_triangleCount * 3 * sizeof(uint32_t));
+            }
+            triangleCount += chunk.m_triangleCount;
+        }
+        if (allTriangles)
+        {
+            m_indices.resize(triangleCount * 3);
+            return p + (count * recordSize);
+        }
+        m_indices.clear();
+    }
+
+    // Otherwise the faces are read in order, splitting polygons into fans.
+    for (size_t i = 0; p && i != count; ++i)
+    {
+        p = skipProperties(element, 0, list, p, dataEnd);
+        if (p == 0 || static_cast<size_t>(dataEnd - p) < countSize)
+        {
+            return 0;
+        }
+        const double itemCount = readValue(p, indexProperty.m_countType);
+        const size_t items = itemCount < 0.0 ? 0
+                                             : static_cast<size_t>(itemCount);
+        p += countSize;
+        if (items > static_cast<size_t>(dataEnd - p) / indexSize)
+        {
+            return 0;
+        }
+
+        // A face that refers to a vertex that doesn't exist is skipped.
+        bool valid = items >= 3;
+        for (size_t j = 0; j != items && valid; ++j)
+        {
+            const double index = readValue(p + (j * indexSize),
+                                           indexProperty.m_type);
+            valid = index >= 0.0 && index < static_cast<double>(vertexCount);
+        }
+        for (size_t j = 2; j < items && valid; ++j)
+        {
+            m_indices.push_back(
+                static_cast<uint32_t>(readValue(p, indexProperty.m_type)));
+            m_indices.push_back(static_cast<uint32_t>(readValue(
+                p + ((j - 1) * indexSize), indexProperty.m_type)));
+            m_indices.push_back(static_cast<uint32_t>(
+                readValue(p + (j * indexSize), indexProperty.m_type)));
+        }
+        p += items * indexSize;
+
+        p = skipProperties(element, list + 1, element.m_properties.size(),
+                           p, dataEnd);
+    }
+    return p;
+}
+
+//------------------------------------------------------------------------------
+// Ply_TriangleIterator
+//------------------------------------------------------------------------------
+Ply_TriangleIterator::Ply_TriangleIterator()
+    : m_threadCount(0), m_file(0), m_next(0)
+{
+}
+
+//------------------------------------------------------------------------------
+Ply_TriangleIterator::~Ply_TriangleIterator()
+{
+}
+
+//------------------------------------------------------------------------------
+void Ply_TriangleIterator::setFilename(const char* filename)
+{
+    m_filename = filename;
+    m_file = 0;
+}
+
+//------------------------------------------------------------------------------
+void Ply_TriangleIterator::setThreadCount(const size_t threadCount)
+{
+    m_threadCount = threadCount;
+}
+
+//------------------------------------------------------------------------------
+void Ply_TriangleIterator::setFile(const Ply_File& file)
+{
+    m_file = &file;
+}
+
+//------------------------------------------------------------------------------
+void Ply_TriangleIterator::begin()
+{
+    // Read the file, unless another file was set.
+    if (m_file == 0 || m_file == &m_ownFile)
+    {
+        m_ownFile.read(m_filename.c_str(), m_threadCount);
+        m_file = &m_ownFile;
+    }
+    m_next = 0;
+}
+
+//------------------------------------------------------------------------------
+bool Ply_TriangleIterator::next()
+{
+    if (m_next == m_file->getTriangleCount())
+    {
+        return false;
+    }
+    ++m_next;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+Triangle Ply_TriangleIterator::operator*() const
+{
+    assert(m_next != 0);
+    const uint32_t* const indices = &m_file->m_indices[(m_next - 1) * 3];
+    return Triangle(m_file->m_verts[indices[0]], m_file->m_verts[indices[1]],
+                    m_file->m_verts[indices[2]]);
+}
+
+//------------------------------------------------------------------------------
+size_t Ply_TriangleIterator::sizeHint() const
+{
+    return m_file->getTriangleCount() - m_next;
+}
+
+//------------------------------------------------------------------------------
+size_t Ply_TriangleIterator::nextBatch(Vector3<float>* corners,
+                                       const size_t capacity)
+{
+    const size_t count =
+        std::min(capacity, m_file->getTriangleCount() - m_next);
+    if (count == 0)
+    {
+        return 0;
+    }
+    const uint32_t* const indices = &m_file->m_indices[m_next * 3];
+    for (size_t i = 0; i != count * 3; ++i)
+    {
+        corners[i] = m_file->m_verts[indices[i]];
+    }
+    m_next += count;
+    return count;
+}
+
+//------------------------------------------------------------------------------
+// Ply_ObjectIterator
+//------------------------------------------------------------------------------
+Ply_ObjectIterator::Ply_ObjectIterator() : m_threadCount(0), m_visited(false)
+{
+}
+
+//------------------------------------------------------------------------------
+void Ply_ObjectIterator::setFilename(const char* filename)
+{
+    m_filename = filename;
+}
+
+//------------------------------------------------------------------------------
+void Ply_ObjectIterator::setThreadCount(const size_t threadCount)
+{
+    m_threadCount = threadCount;
+}
+
+//------------------------------------------------------------------------------
+void Ply_ObjectIterator::begin()
+{
+    m_file.read(m_filename.c_str(), m_threadCount);
+    m_triangleIterator.setFile(m_file);
+    m_visited = false;
+}
+
+//------------------------------------------------------------------------------
+void Ply_ObjectIterator::end()
+{
+    m_file.clear();
+    m_visited = false;
+}
+
+//------------------------------------------------------------------------------
+bool Ply_ObjectIterator::next()
+{
+    if (m_visited || m_file.getTriangleCount() == 0)
+    {
+        m_visited = false;
+        return false;
+    }
+    m_visited = true;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void Ply_ObjectIterator::recurseIntoChildren(bool yesNo)
+{
+}
+
+//------------------------------------------------------------------------------
+const BoundsF& Ply_ObjectIterator::getBounds() const
+{
+    return m_file.getBounds();
+}
+
+//------------------------------------------------------------------------------
+bool Ply_ObjectIterator::hasTriangles() const
+{
+    return m_visited;
+}
+
+//------------------------------------------------------------------------------
+TriangleIterator& Ply_ObjectIterator::getTriangles()
+{
+    return m_triangleIterator;
+}
+
+//------------------------------------------------------------------------------
+bool Ply_ObjectIterator::getMesh(ObjectIterator_Mesh& mesh) const
+{
+    if (!m_visited)
+    {
+        return false;
+    }
+    m_file.getMesh(mesh);
+    return true;
+}
+
+}  // namespace tc
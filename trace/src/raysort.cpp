@@ -0,0 +1,131 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/raysort.h"
+//------------------------------------------------------------------------------
+#include "trace/assert.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
+//------------------------------------------------------------------------------
+
+namespace tc
+{
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// spreadBits
+//------------------------------------------------------------------------------
+// Moves the lower ten bits of 'value' so there are two zero bits between each
+// of them, ready to be interleaved with two other values.
+//------------------------------------------------------------------------------
+inline uint64_t spreadBits(uint64_t value)
+{
+    value &= 0x3FF;
+    value = (value | (value << 16)) & 0x030000FF;
+    value = (value | (value << 8)) & 0x0300F00F;
+    value = (value | (value << 4)) & 0x030C30C3;
+    value = (value | (value << 2)) & 0x09249249;
+    return value;
+}
+
+//------------------------------------------------------------------------------
+// quantise
+//------------------------------------------------------------------------------
+// Maps 'value' from the range [min, min + 1 / scale] to an integer in the
+// range [0, steps).
+//------------------------------------------------------------------------------
+inline uint64_t quantise(const float value, const float min, const float scale,
+                         const uint64_t steps)
+{
+    const float t = (value - min) * scale * static_cast<float>(steps);
+    if (t <= 0.0f)
+    {
+        return 0;
+    }
+    return std::min(static_cast<uint64_t>(t), steps - 1);
+}
+
+//------------------------------------------------------------------------------
+// computeMortonCode
+//------------------------------------------------------------------------------
+inline uint64_t computeMortonCode(const Vector3<float>& value,
+                                  const Vector3<float>& min,
+                                  const Vector3<float>& scale,
+                                  const uint64_t steps)
+{
+    return (spreadBits(quantise(value.x, min.x, scale.x, steps)) << 2) |
+           (spreadBits(quantise(value.y, min.y, scale.y, steps)) << 1) |
+           spreadBits(quantise(value.z, min.z, scale.z, steps));
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+// RaySorter
+//------------------------------------------------------------------------------
+uint64_t RaySorter::computeKey(const Ray& ray, const BoundsF& bounds)
+{
+    const Vector3<float> extent = bounds.computeDimensions();
+    const Vector3<float> originScale(extent.x > 0.0f ? 1.0f / extent.x : 0.0f,
+                                     extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                                     extent.z > 0.0f ? 1.0f / extent.z : 0.0f);
+
+    // Directions are in the range [-1, 1] along every axis.
+    const Vector3<float> directionMin(-1.0f, -1.0f, -1.0f);
+    const Vector3<float> directionScale(0.5f, 0.5f, 0.5f);
+
+    const uint64_t octant = (ray.m_direction.x < 0.0f ? 4 : 0) |
+                            (ray.m_direction.y < 0.0f ? 2 : 0) |
+                            (ray.m_direction.z < 0.0f ? 1 : 0);
+    const uint64_t origin =
+        computeMortonCode(ray.m_position, bounds.m_min, originScale, 1024);
+    const uint64_t direction =
+        computeMortonCode(ray.m_direction, directionMin, directionScale, 16);
+
+    return (octant << 42) | (origin << 12) | direction;
+}
+
+//------------------------------------------------------------------------------
+void RaySorter::sort(RayStream& stream, std::vector<size_t>& tags)
+{
+    const size_t rayCount = stream.size();
+    assert(tags.size() == rayCount);
+    if (rayCount < 2)
+    {
+        return;
+    }
+
+    BoundsBuilderF boundsBuilder;
+    for (size_t i = 0; i != rayCount; ++i)
+    {
+        boundsBuilder.expandBounds(Vector3<float>(stream.m_positionX[i],
+                                                  stream.m_positionY[i],
+                                                  stream.m_positionZ[i]));
+    }
+    const BoundsF bounds(boundsBuilder);
+
+    // Ties are broken by the original position of the ray, so the order is
+    // the same from run to run.
+    m_keys.resize(rayCount);
+    for (size_t i = 0; i != rayCount; ++i)
+    {
+        m_keys[i] = KeyIndex(computeKey(stream.getRay(i), bounds), i);
+    }
+    std::sort(m_keys.begin(), m_keys.end());
+
+    m_sortedStream.clear();
+    m_sortedTags.resize(rayCount);
+    for (size_t i = 0; i != rayCount; ++i)
+    {
+        const size_t index = m_keys[i].second;
+        m_sortedStream.push(stream.getRay(index));
+        m_sortedTags[i] = tags[index];
+    }
+
+    stream.swap(m_sortedStream);
+    tags.swap(m_sortedTags);
+}
+
+}  // namespace tc
@@ -5,14 +5,18 @@
 //------------------------------------------------------------------------------
 #include "trace/geoAPI.h"
 #include "trace/image.h"
+#include "trace/irradiancecache.h"
 #include "trace/triangleCache.h"
 #include "trace/shadestack.h"
 #include "trace/pixelIterator.h"
 #include "trace/radiance.h"
-#include "trace/random.h"
+#include "trace/raypacket.h"
 #include "trace/sampledspectrum.h"
+#include "trace/sampler.h"
 #include "trace/supersampleiterator.h"
 #include "trace/shade.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
 
 namespace tc
 {
@@ -45,6 +49,34 @@ Vector3<float> sampledSpectrumToRGB(const SampledSpectrum& sampledSpectrum)
     return result;
 }
 
+//------------------------------------------------------------------------------
+Ray generateCameraRay(Sampler& sampler, const Vector3<size_t>& pixel,
+                      const Vector3<size_t>& dimensions,
+                      const Vector3<float>& pixelSize)
+{
+    const Vector3<float> fragment =
+        computePixelLocationInWorldSpace(pixel, dimensions);
+
+    // Generate a point on the image plane that is offset from the
+    // given pixel position, but within the distance dictated by
+    // pixelSize.
+    const Vector3<float> pixelSample = sampler.get2D();
+    const float jitter_x = fragment.x + (pixelSample.x * pixelSize.x);
+    const float jitter_y = fragment.y + (pixelSample.y * pixelSize.y);
+
+    const Vector3<float> offset(jitter_x, jitter_y);
+
+    // Build a ray that starts at the origin 0,0 and intersects the
+    // point defined by jitter_x/y on the image plane. We will fire
+    // this ray into scene and if it hits anything we'll shade the
+    // collision point.
+    const Vector3<float> ray_direction =
+        offset.overwrite(Vector3<float>::kZ, fragment.z).normalized();
+
+    const Vector3<float> sensorCentre(0.0f, 0.0f, 0.0f);
+    return Ray(ray_direction, sensorCentre);
+}
+
 //------------------------------------------------------------------------------
 Bounds<size_t> computeTileBounds(const size_t idx, const Vector3<size_t> step,
                                  const size_t divisions,
@@ -78,7 +110,8 @@ RenderThreads::RenderThreads(const Range& range, const GeoAPI& geoApi,
                              const size_t maxRayDepth,
                              const size_t qualityLevel,
                              const size_t samplesPerPixel,
-                             const size_t threadCount)
+                             const size_t threadCount,
+                             const RenderSettings& settings)
     : ThreadBundle(range, threadCount),
       m_blocks(0),
       m_geoApi(geoApi),
@@ -89,8 +122,34 @@ RenderThreads::RenderThreads(const Range& range, const GeoAPI& geoApi,
       m_logContext(logContext),
       m_maxRayDepth(maxRayDepth),
       m_qualityLevel(qualityLevel),
-      m_samplesPerPixel(samplesPerPixel)
+      m_samplesPerPixel(samplesPerPixel),
+      m_settings(settings),
+      m_irradianceCache(settings.m_irradianceCache
+                            ? new IrradianceCache(
+                                  settings.m_irradianceCacheError,
+                                  settings.m_irradianceCacheRadius)
+                            : 0),
+      m_blockPasses()
 {
+    const size_t divisions = getDivisions();
+    m_blockPasses.resize(divisions * divisions, 0);
+}
+
+//------------------------------------------------------------------------------
+size_t RenderThreads::getDivisions() const
+{
+#if 1
+    const size_t divisions =
+        getThreadCount() * 4;  // The number of divisions in
+                               // the x and y axies, for making
+                               // blocks of pixels to render.
+#else
+    const size_t divisions =
+        getThreadCount();  // The number of divisions in
+                           // the x and y axies, for making
+                           // blocks of pixels to render.
+#endif
+    return divisions;
 }
 
 //------------------------------------------------------------------------------
@@ -99,6 +158,24 @@ size_t RenderThreads::getBlock()
     return __sync_fetch_and_add(&m_blocks, 1);
 }
 
+//------------------------------------------------------------------------------
+bool RenderThreads::waitForPass(const size_t block, const size_t pass)
+{
+    // Each pass over a block blends into the result of the previous pass, so
+    // the passes have to land in order for the running average to come out
+    // the same for every thread count. There are far more blocks than
+    // threads so in practice we almost never wait here.
+    while (__sync_add_and_fetch(&m_blockPasses[block], 0) != pass)
+    {
+        if (shouldStop())
+        {
+            return false;
+        }
+        yieldThread();
+    }
+    return true;
+}
+
 //------------------------------------------------------------------------------
 void RenderThreads::run(const size_t threadIndex, const Range& range)
 {
@@ -111,21 +188,25 @@ void RenderThreads::run(const size_t threadIndex, const Range& range)
     SearchCache searchCache;
     ShadeStack shadeStack;
 
+    // Each thread owns its own sampler.
+    RandomSampler randomSampler;
+    HaltonSampler haltonSampler;
+    SobolSampler sobolSampler;
+    Sampler& sampler =
+        m_settings.m_sampler == kSamplerRandom
+            ? static_cast<Sampler&>(randomSampler)
+            : m_settings.m_sampler == kSamplerHalton
+                  ? static_cast<Sampler&>(haltonSampler)
+                  : static_cast<Sampler&>(sobolSampler);
+
     shade::Integrator integrator(m_geoApi, m_shadeApi, searchCache,
-                                 shadeStack, m_maxRayDepth,
-                                 m_qualityLevel, 0.0001f);  // TODO LT: Expose this as a parameter
+                                 shadeStack, sampler, m_maxRayDepth,
+                                 m_qualityLevel, 0.0001f,  // TODO LT: Expose this as a parameter
+                                 m_settings, m_irradianceCache);
+    shade::Wavefront wavefront(integrator);
+    const bool useWavefront = m_settings.m_integrator == kIntegratorWavefront;
 
-#if 1
-    const size_t divisions =
-        getThreadCount() * 4;  // The number of divisions in
-                               // the x and y axies, for making
-                               // blocks of pixels to render.
-#else
-    const size_t divisions =
-        getThreadCount();  // The number of divisions in
-                           // the x and y axies, for making
-                           // blocks of pixels to render.
-#endif
+    const size_t divisions = getDivisions();
     const Vector3<size_t> step = dimensions / divisions;
     const size_t maxBlocks = (divisions * divisions);
     const size_t iterations = maxBlocks * m_samplesPerPixel;
@@ -143,9 +224,15 @@ void RenderThreads::run(const size_t threadIndex, const Range& range)
     for (size_t idx = getBlock(); idx < iterations; idx = getBlock())
     {
         const size_t superSample = idx / maxBlocks;
+        const size_t block = idx % maxBlocks;
         const Bounds<size_t> tileBounds =
             computeTileBounds(idx, step, divisions, dimensions, maxBlocks);
 
+        if (!waitForPass(block, superSample))
+        {
+            return;
+        }
+
         // Copy our data as it stands from the global array.
         {
             RWLock_Read readFromArray(m_arrayLock);
@@ -170,80 +257,148 @@ void RenderThreads::run(const size_t threadIndex, const Range& range)
             }
         }
 
-        for (size_t x = tileBounds.m_min.x; x != tileBounds.m_max.x; ++x)
+        // In wavefront mode the whole tile is estimated up front, starting
+        // with a camera ray for every pixel.
+        const Vector3<size_t> tileBoundsDimensions =
+            tileBounds.computeDimensions();
+        if (useWavefront)
         {
-            for (size_t y = tileBounds.m_min.y; y != tileBounds.m_max.y; ++y)
+            wavefront.reset(tileBoundsDimensions.area());
+            for (size_t x = tileBounds.m_min.x; x != tileBounds.m_max.x; ++x)
             {
-                if (shouldStop())
+                for (size_t y = tileBounds.m_min.y; y != tileBounds.m_max.y;
+                     ++y)
                 {
-                    return;
+                    const Vector3<size_t> pixel(x, y);
+                    const Vector3<size_t> pixelInTile =
+                        pixel - tileBounds.m_min;
+                    const size_t pixelIndex = (y * dimensions.x) + x;
+                    const size_t slot =
+                        (pixelInTile.y * tileBoundsDimensions.width) +
+                        pixelInTile.x;
+
+                    sampler.startPixelSample(pixelIndex, superSample);
+                    const Ray ray = generateCameraRay(sampler, pixel,
+                                                      dimensions, pixelSize);
+                    wavefront.addCameraRay(ray, slot, pixelIndex, superSample,
+                                           sampler.getDimension());
                 }
+            }
 
-                const Vector3<size_t> pixel(x, y);
-                const Vector3<float> fragment =
-                    computePixelLocationInWorldSpace(pixel, dimensions);
-
-                SampledSpectrum sampledSpectrum;
-
-                //  The coordinates relative to the tile.
-                const Vector3<size_t> pixelInTile = pixel - tileBounds.m_min;
-
-                // Generate a point on the image plane that is randomly offset
-                // from the given pixel position, but within the distance
-                // dictated by pixelSize.
-                const float jitter_x =
-                    generateRandomFloat(fragment.x,
-                                        fragment.x + pixelSize.x);
-                const float jitter_y =
-                    generateRandomFloat(fragment.y,
-                                        fragment.y + pixelSize.y);
-
-                const Vector3<float> offset(jitter_x, jitter_y);
-
-                // Build a ray that starts at the origin 0,0 and intersects the
-                // point defined by jitter_x/y on the image plane. We will fire
-                // this ray into scene and if it hits anything we'll shade the
-                // collision point.
-                const Vector3<float> ray_direction =
-                    offset.overwrite(Vector3<float>::kZ, fragment.z)
-                        .normalized();
-
-                const Vector3<float> sensorCentre(0.0f, 0.0f, 0.0f);
-                const Ray ray(ray_direction, sensorCentre);
-
-                // If we've hit something then there is a value to shade.
-                ShadeStackFrame frame(ray, m_geoApi.geo_trace(searchCache,ray));
+            if (shouldStop())
+            {
+                return;
+            }
+            wavefront.render();
+        }
 
-                // Estimate the result.
-                while(integrator.next(frame))
+        for (size_t x = tileBounds.m_min.x; x != tileBounds.m_max.x; ++x)
+        {
+            for (size_t packetY = tileBounds.m_min.y;
+                 packetY < tileBounds.m_max.y; packetY += RayPacket::kSize)
+            {
+                const size_t packetSize =
+                    std::min(static_cast<size_t>(RayPacket::kSize),
+                             tileBounds.m_max.y - packetY);
+
+                // The camera rays of neighbouring pixels are coherent, so
+                // the first hit for a few pixels at a time is found with a
+                // single walk of the acceleration structure.
+                RayPacket packet;
+                RayPacket_TraceResult primaryHits;
+                if (!useWavefront)
                 {
+                    for (size_t lane = 0; lane != packetSize; ++lane)
+                    {
+                        const Vector3<size_t> pixel(x, packetY + lane);
+
+                        // Key the samples on the pixel and the sample index,
+                        // rather than on the thread, so that every sample
+                        // draws the same values regardless of the thread
+                        // count.
+                        sampler.startPixelSample(
+                            (pixel.y * dimensions.x) + x, superSample);
+                        packet.setRay(lane,
+                                      generateCameraRay(sampler, pixel,
+                                                        dimensions, pixelSize));
+                    }
+                    primaryHits = m_geoApi.geo_tracePacket(searchCache, packet);
                 }
 
-                integrator.computeSampledSpectrum(sampledSpectrum, frame);
+                // Every camera ray uses the same number of dimensions.
+                const size_t cameraDimension = sampler.getDimension();
 
-                const Vector3<float> color =
-                    sampledSpectrumToRGB(sampledSpectrum);
+                for (size_t lane = 0; lane != packetSize; ++lane)
+                {
+                    if (shouldStop())
+                    {
+                        return;
+                    }
 
-                // Get the previous pixel value so that we can merge our
-                // value with the new value.
-                const Vector3<float> originalValue(
-                    tile.getValue(pixelInTile.x, pixelInTile.y, 0),
-                    tile.getValue(pixelInTile.x, pixelInTile.y, 1),
-                    tile.getValue(pixelInTile.x, pixelInTile.y, 2),
-                    tile.getValue(pixelInTile.x, pixelInTile.y, 3));
+                    const Vector3<size_t> pixel(x, packetY + lane);
 
-                const float one_over_n =
-                    1.0f / static_cast<float>(superSample + 1);
+                    SampledSpectrum sampledSpectrum;
 
-                const Vector3<float> finalValue =
-                    originalValue +
-                    ((color * one_over_n) - (originalValue * one_over_n));
+                    //  The coordinates relative to the tile.
+                    const Vector3<size_t> pixelInTile =
+                        pixel - tileBounds.m_min;
 
-                // Write the pixels out to the tile.
-                tile.setValue(pixelInTile.x, pixelInTile.y, 0, finalValue.r);
-                tile.setValue(pixelInTile.x, pixelInTile.y, 1, finalValue.g);
-                tile.setValue(pixelInTile.x, pixelInTile.y, 2, finalValue.b);
-                tile.setValue(pixelInTile.x, pixelInTile.y, 3, finalValue.a);
+                    if (useWavefront)
+                    {
+                        sampledSpectrum = wavefront.getRadiance(
+                            (pixelInTile.y * tileBoundsDimensions.width) +
+                            pixelInTile.x);
+                    }
+                    else
+                    {
+                        // Carry on from where the camera ray left off.
+                        sampler.resumePixelSample(
+                            (pixel.y * dimensions.x) + x, superSample,
+                            cameraDimension);
+
+                        // If we've hit something then there is a value to
+                        // shade.
+                        ShadeStackFrame frame(
+                            packet.getRay(lane),
+                            primaryHits.getTraceResult(lane));
+
+                        // Estimate the result.
+                        while (integrator.next(frame))
+                        {
+                        }
+
+                        integrator.computeSampledSpectrum(sampledSpectrum,
+                                                          frame);
+                    }
+
+                    const Vector3<float> color =
+                        sampledSpectrumToRGB(sampledSpectrum);
+
+                    // Get the previous pixel value so that we can merge our
+                    // value with the new value.
+                    const Vector3<float> originalValue(
+                        tile.getValue(pixelInTile.x, pixelInTile.y, 0),
+                        tile.getValue(pixelInTile.x, pixelInTile.y, 1),
+                        tile.getValue(pixelInTile.x, pixelInTile.y, 2),
+                        tile.getValue(pixelInTile.x, pixelInTile.y, 3));
+
+                    const float one_over_n =
+                        1.0f / static_cast<float>(superSample + 1);
+
+                    const Vector3<float> finalValue =
+                        originalValue +
+                        ((color * one_over_n) - (originalValue * one_over_n));
+
+                    // Write the pixels out to the tile.
+                    tile.setValue(pixelInTile.x, pixelInTile.y, 0,
+                                  finalValue.r);
+                    tile.setValue(pixelInTile.x, pixelInTile.y, 1,
+                                  finalValue.g);
+                    tile.setValue(pixelInTile.x, pixelInTile.y, 2,
+                                  finalValue.b);
+                    tile.setValue(pixelInTile.x, pixelInTile.y, 3,
+                                  finalValue.a);
+                }
             }
         }
 
@@ -278,6 +433,9 @@ void RenderThreads::run(const size_t threadIndex, const Range& range)
                 }
             }
         }
+
+        // Let the next pass over this block begin.
+        __sync_add_and_fetch(&m_blockPasses[block], 1);
     }
 }
 
@@ -286,6 +444,7 @@ RenderThreads::~RenderThreads()
 {
     stop();
     join();
+    delete m_irradianceCache;
 }
 
 }  // namespace tc
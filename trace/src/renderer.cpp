@@ -21,11 +21,12 @@ namespace tc
 Renderer::Renderer(const tc::LogContext& logContext, Image & image,
                    const size_t samplesPerPixel, const size_t qualityLevel,
                    const size_t maxRayDepth, const GeoAPI& geoApi,
-                   const ShadeAPI& shadeApi, const size_t threadCount)
+                   const ShadeAPI& shadeApi, const size_t threadCount,
+                   const RenderSettings& settings)
     : m_hasNewContent(false),
       m_renderThreads(Range(0, image.getHeight()), geoApi, shadeApi, image,
                       m_arrayLock, m_hasNewContent, logContext, maxRayDepth,
-                      qualityLevel, samplesPerPixel, threadCount),
+                      qualityLevel, samplesPerPixel, threadCount, settings),
       m_renderProgress(m_renderThreads,
                        image.getWidth() * image.getHeight() * samplesPerPixel),
       m_state(kStart)
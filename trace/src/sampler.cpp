@@ -0,0 +1,275 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/sampler.h"
+//------------------------------------------------------------------------------
+#include <cmath>
+#include <cstring>
+//------------------------------------------------------------------------------
+
+namespace tc
+{
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// hashUInt
+//------------------------------------------------------------------------------
+// A cheap integer hash with good avalanche behaviour (Chris Wellons'
+// 'lowbias32').
+//------------------------------------------------------------------------------
+inline uint32_t hashUInt(uint32_t x)
+{
+    x ^= x >> 16u;
+    x *= 0x7feb352du;
+    x ^= x >> 15u;
+    x *= 0x846ca68bu;
+    x ^= x >> 16u;
+    return x;
+}
+
+//------------------------------------------------------------------------------
+inline uint32_t hashCombine(const uint32_t seed, const uint32_t value)
+{
+    return hashUInt(seed ^ (value + 0x9e3779b9u + (seed << 6u) + (seed >> 2u)));
+}
+
+//------------------------------------------------------------------------------
+// computeSeed
+//------------------------------------------------------------------------------
+// A seed which is unique to a pixel and a dimension.
+//------------------------------------------------------------------------------
+inline uint32_t computeSeed(const size_t pixelIndex, const size_t dimension)
+{
+    return hashCombine(hashUInt(static_cast<uint32_t>(pixelIndex)),
+                       static_cast<uint32_t>(dimension));
+}
+
+//------------------------------------------------------------------------------
+inline float toUnitFloat(const uint32_t x)
+{
+    // Only 24 bits fit in the mantissa, this keeps the result below 1.
+    return static_cast<float>(x >> 8u) * (1.0f / 16777216.0f);
+}
+
+//------------------------------------------------------------------------------
+inline uint32_t reverseBits(uint32_t x)
+{
+    x = (x << 16u) | (x >> 16u);
+    x = ((x & 0x00ff00ffu) << 8u) | ((x & 0xff00ff00u) >> 8u);
+    x = ((x & 0x0f0f0f0fu) << 4u) | ((x & 0xf0f0f0f0u) >> 4u);
+    x = ((x & 0x33333333u) << 2u) | ((x & 0xccccccccu) >> 2u);
+    x = ((x & 0x55555555u) << 1u) | ((x & 0xaaaaaaaau) >> 1u);
+    return x;
+}
+
+//------------------------------------------------------------------------------
+// nestedUniformScramble
+//------------------------------------------------------------------------------
+// Owen scrambling of a 32 bit fixed point value, using the hash based
+// permutation from "Practical Hash-based Owen Scrambling" (Burley 2020).
+//------------------------------------------------------------------------------
+inline uint32_t nestedUniformScramble(uint32_t x, const uint32_t seed)
+{
+    x = reverseBits(x);
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return reverseBits(x);
+}
+
+//------------------------------------------------------------------------------
+// sobol
+//------------------------------------------------------------------------------
+// The first two dimensions of the Sobol sequence as 32 bit fixed point values.
+// The first is the base 2 radical inverse, the second uses the direction
+// numbers generated by the primitive polynomial x + 1.
+//------------------------------------------------------------------------------
+inline uint32_t sobol0(const uint32_t index)
+{
+    return reverseBits(index);
+}
+
+inline uint32_t sobol1(uint32_t index)
+{
+    uint32_t result = 0u;
+    for (uint32_t v = 1u << 31u; index != 0u; index >>= 1u, v ^= v >> 1u)
+    {
+        if (index & 1u)
+        {
+            result ^= v;
+        }
+    }
+    return result;
+}
+
+//------------------------------------------------------------------------------
+inline float radicalInverse(const uint32_t base, uint32_t index)
+{
+    const float inverseBase = 1.0f / static_cast<float>(base);
+    float inverseBaseN = 1.0f;
+    uint32_t reversed = 0u;
+    while (index != 0u)
+    {
+        const uint32_t next = index / base;
+        const uint32_t digit = index - (next * base);
+        reversed = (reversed * base) + digit;
+        inverseBaseN *= inverseBase;
+        index = next;
+    }
+    // Guard against rounding up to 1.
+    const float result = static_cast<float>(reversed) * inverseBaseN;
+    return result < 1.0f ? result : 0.99999994f;
+}
+
+//------------------------------------------------------------------------------
+// rotate
+//------------------------------------------------------------------------------
+// Adds an offset to a value in [0, 1), wrapping around the unit interval.
+//------------------------------------------------------------------------------
+inline float rotate(const float value, const uint32_t seed)
+{
+    const float result = value + toUnitFloat(seed);
+    return result < 1.0f ? result : result - 1.0f;
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+SamplerType parseSamplerType(const char* name, const SamplerType defaultValue)
+{
+    if (strcmp(name, "random") == 0)
+    {
+        return kSamplerRandom;
+    }
+    if (strcmp(name, "halton") == 0)
+    {
+        return kSamplerHalton;
+    }
+    if (strcmp(name, "sobol") == 0)
+    {
+        return kSamplerSobol;
+    }
+    return defaultValue;
+}
+
+//------------------------------------------------------------------------------
+// Sampler
+//------------------------------------------------------------------------------
+Sampler::~Sampler()
+{
+}
+
+//------------------------------------------------------------------------------
+void Sampler::startPixelSample(const size_t pixelIndex,
+                               const size_t sampleIndex)
+{
+    m_pixelIndex = pixelIndex;
+    m_sampleIndex = sampleIndex;
+    m_dimension = 0;
+}
+
+//------------------------------------------------------------------------------
+void Sampler::resumePixelSample(const size_t pixelIndex,
+                                const size_t sampleIndex,
+                                const size_t dimension)
+{
+    startPixelSample(pixelIndex, sampleIndex);
+    m_dimension = dimension;
+}
+
+//------------------------------------------------------------------------------
+// RandomSampler
+//------------------------------------------------------------------------------
+void RandomSampler::startPixelSample(const size_t pixelIndex,
+                                     const size_t sampleIndex)
+{
+    Sampler::startPixelSample(pixelIndex, sampleIndex);
+    m_random.seed(pixelIndex, sampleIndex);
+}
+
+//------------------------------------------------------------------------------
+void RandomSampler::resumePixelSample(const size_t pixelIndex,
+                                      const size_t sampleIndex,
+                                      const size_t dimension)
+{
+    // Every dimension consumes one value from the stream, so skip over the
+    // ones that have already been drawn.
+    startPixelSample(pixelIndex, sampleIndex);
+    for (; m_dimension != dimension; ++m_dimension)
+    {
+        m_random.nextUInt();
+    }
+}
+
+//------------------------------------------------------------------------------
+float RandomSampler::get1D()
+{
+    ++m_dimension;
+    return m_random.nextFloat();
+}
+
+//------------------------------------------------------------------------------
+Vector3<float> RandomSampler::get2D()
+{
+    m_dimension += 2;
+    const float x = m_random.nextFloat();
+    const float y = m_random.nextFloat();
+    return Vector3<float>(x, y);
+}
+
+//------------------------------------------------------------------------------
+// HaltonSampler
+//------------------------------------------------------------------------------
+float HaltonSampler::get1D()
+{
+    const uint32_t seed = computeSeed(m_pixelIndex, m_dimension++);
+    return rotate(radicalInverse(2, m_sampleIndex), seed);
+}
+
+//------------------------------------------------------------------------------
+Vector3<float> HaltonSampler::get2D()
+{
+    const uint32_t seed = computeSeed(m_pixelIndex, m_dimension);
+    m_dimension += 2;
+
+    const float x = rotate(radicalInverse(2, m_sampleIndex), seed);
+    const float y = rotate(radicalInverse(3, m_sampleIndex), hashUInt(seed));
+    return Vector3<float>(x, y);
+}
+
+//------------------------------------------------------------------------------
+// SobolSampler
+//------------------------------------------------------------------------------
+float SobolSampler::get1D()
+{
+    const uint32_t seed = computeSeed(m_pixelIndex, m_dimension++);
+
+    // Shuffle the order the samples are visited in, then scramble the value.
+    const uint32_t index =
+        nestedUniformScramble(static_cast<uint32_t>(m_sampleIndex), seed);
+    return toUnitFloat(nestedUniformScramble(sobol0(index), hashUInt(seed)));
+}
+
+//------------------------------------------------------------------------------
+Vector3<float> SobolSampler::get2D()
+{
+    const uint32_t seed = computeSeed(m_pixelIndex, m_dimension);
+    m_dimension += 2;
+
+    // Shuffle the order the samples are visited in, then scramble each axis
+    // independently.
+    const uint32_t index =
+        nestedUniformScramble(static_cast<uint32_t>(m_sampleIndex), seed);
+    const uint32_t seedX = hashCombine(seed, 0u);
+    const uint32_t seedY = hashCombine(seed, 1u);
+
+    const float x = toUnitFloat(nestedUniformScramble(sobol0(index), seedX));
+    const float y = toUnitFloat(nestedUniformScramble(sobol1(index), seedY));
+    return Vector3<float>(x, y);
+}
+
+}  // namespace tc
@@ -4,47 +4,100 @@
 #include "trace/shade.h"
 //------------------------------------------------------------------------------
 #include "trace/assert.h"
+#include "trace/emitter.h"
 #include "trace/shadestack.h"
 #include "trace/geoAPI.h"
 #include "trace/geoid.h"
+#include "trace/irradiancecache.h"
 #include "trace/radiance.h"
+#include "trace/raypacket.h"
 #include "trace/matrix.h"
-#include "trace/random.h"
+#include "trace/renderSettings.h"
 #include "trace/sampledspectrum.h"
+#include "trace/sampler.h"
 #include "trace/shadeAPI.h"
 #include "trace/shader.h"
+#include "trace/simpleScene.h"
 #include "trace/supersampleiterator.h"
 #include "trace/surfaceframe.h"
 #include "trace/solidangle.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 
 namespace tc
 {
 
+//------------------------------------------------------------------------------
+IntegratorMode parseIntegratorMode(const char* name,
+                                   const IntegratorMode defaultValue)
+{
+    if (strcmp(name, "stratified") == 0)
+    {
+        return kIntegratorStratified;
+    }
+    if (strcmp(name, "path") == 0)
+    {
+        return kIntegratorPath;
+    }
+    if (strcmp(name, "wavefront") == 0)
+    {
+        return kIntegratorWavefront;
+    }
+    if (strcmp(name, "ambientOcclusion") == 0)
+    {
+        return kIntegratorAmbientOcclusion;
+    }
+    if (strcmp(name, "direct") == 0)
+    {
+        return kIntegratorDirect;
+    }
+    return defaultValue;
+}
+
 namespace shade
 {
 
+/// How far from the surface, in radians, bounce directions are kept.
+static const float kIgnoreRaysCloseToSurface = 0.9f;
+
+/// The fraction of the distance to an emitter that a shadow ray tests for
+/// occluders, so that the emitter doesn't occlude itself.
+static const float kShadowRayLength = 0.999f;
+
+/// Emitters covering more than this solid angle, a quarter of the hemisphere,
+/// are found well enough by the bounce rays, so shadow rays aren't fired at
+/// them. This leaves out a sky around the whole scene.
+static const float kMaxSampledSolidAngle = M_PI * 0.5f;
+
 //------------------------------------------------------------------------------
 // generateRandomDirection
 //------------------------------------------------------------------------------
+template <typename Shading>
 inline const Ray generateRandomDirection(
-    const ShadeAPI& shadeApi, const size_t pitchSamples,
+    const Shading& shading, Sampler& sampler, const size_t pitchSamples,
     const float rayPositionOffset, const size_t yawSamples, const size_t i,
-    const ShadeStackFrame& frame, const float ignoreRaysCloseToSurface = 0.9f)
+    const ShadeStackFrame& frame,
+    const float ignoreRaysCloseToSurface = kIgnoreRaysCloseToSurface)
 {
     const size_t x = i % pitchSamples;  // Pitch iteration
     const size_t y = i / pitchSamples;  // Yaw iteration
 
     const SurfaceFrame& surfaceFrame =
-        shadeApi.shade_getSurfaceFrame(frame.m_traceResult.m_geoId);
+        shading.shade_getSurfaceFrame(frame.m_traceResult);
 
     // Work out the position of the previous intersection point.
     const Vector3<float> previousIntersectionPoint =
         frame.m_ray.computePointOnRay(frame.m_traceResult.m_distanceAlongRay);
 
+    // Each bounce direction consumes the next two sample dimensions.
+    SampleOffset offset(sampler.get2D());
+
     const Vector3<float> rayDirection =
         // Generate a stratified ray direction around our surface normal.
-        generateStratifiedDirection<generateRandomFloat>(
-            ignoreRaysCloseToSurface, yawSamples, pitchSamples, y, x)
+        generateStratifiedDirection(offset, ignoreRaysCloseToSurface,
+                                    yawSamples, pitchSamples, y, x)
             .transform(surfaceFrame.m_tangent, surfaceFrame.m_normal,
                        surfaceFrame.m_bitangent);
 
@@ -61,24 +114,55 @@ inline const Ray generateRandomDirection(
 }
 
 //------------------------------------------------------------------------------
-void storeShadeResult(const ShadeAPI& shadeApi, ShadeStack& shadeStack,
+// generateCosineWeightedDirection
+//------------------------------------------------------------------------------
+template <typename Shading>
+inline const Ray generateCosineWeightedDirection(
+    const Shading& shading, Sampler& sampler,
+    const CosineDirectionTable& directionTable, const size_t pitchSamples,
+    const float rayPositionOffset, const size_t i,
+    const ShadeStackFrame& frame, float& directionWeight)
+{
+    const size_t x = i % pitchSamples;  // Pitch iteration
+    const size_t y = i / pitchSamples;  // Yaw iteration
+
+    const SurfaceFrame& surfaceFrame =
+        shading.shade_getSurfaceFrame(frame.m_traceResult);
+
+    const Vector3<float> previousIntersectionPoint =
+        frame.m_ray.computePointOnRay(frame.m_traceResult.m_distanceAlongRay);
+
+    // Each bounce direction consumes the next two sample dimensions.
+    const Vector3<float> rayDirection =
+        directionTable.generate(y, x, sampler.get2D(), directionWeight)
+            .transform(surfaceFrame.m_tangent, surfaceFrame.m_normal,
+                       surfaceFrame.m_bitangent);
+
+    const Vector3<float> rayPosition =
+        previousIntersectionPoint + (rayDirection * rayPositionOffset);
+
+    return Ray(rayDirection, rayPosition);
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void storeShadeResult(const Shading& shading, ShadeStack& shadeStack,
                       ShadeStackFrame& frame, const SampledSpectrum& color)
 {
     // If we're not at the bottom of the shade stack, then add our
     // shade result to our parent shader. Our only purpose is to
     // contribute to the radiance of our parent shader.
     ShadeStackFrame& parentFrame = shadeStack.top(1);
-    const Shader& parentShader =
-        shadeApi.shade_getSurfaceShader(parentFrame.m_traceResult.m_geoId);
-    const Radiance radiance(frame.m_traceResult, color);
-    parentShader.accumulate(parentFrame.m_traceResult, radiance, frame.m_ray,
-                            shadeApi, parentFrame.m_radianceSum);
+    const Radiance radiance(frame.m_traceResult, color * frame.m_weight);
+    shading.accumulate(parentFrame.m_traceResult, radiance, frame.m_ray,
+                       parentFrame.m_radianceSum);
 }
 
 //------------------------------------------------------------------------------
 // computeColor
 //------------------------------------------------------------------------------
-SampledSpectrum computeColor(const ShadeAPI& shadeApi,
+template <typename Shading>
+SampledSpectrum computeColor(const Shading& shading,
                              const ShadeStackFrame& frame)
 {
     const SampledSpectrum white(1.0f);
@@ -87,11 +171,9 @@ SampledSpectrum computeColor(const ShadeAPI& shadeApi,
     if (frame.m_traceResult.hasHitSomething())
     {
         // Shade the current point and store the result in 'color'.
-        const Shader& shader =
-            shadeApi.shade_getSurfaceShader(frame.m_traceResult.m_geoId);
         const SampledSpectrum color =
-            shader.shade(frame.getI(), frame.m_radianceSum, frame.m_traceResult,
-                         frame.m_ray, white);
+            shading.shade(frame.getI(), frame.m_radianceSum,
+                          frame.m_traceResult, frame.m_ray, white);
         return color;
     }
 
@@ -99,25 +181,100 @@ SampledSpectrum computeColor(const ShadeAPI& shadeApi,
     return SampledSpectrum(0.0f);
 }
 
+//------------------------------------------------------------------------------
+// powerHeuristic
+//------------------------------------------------------------------------------
+/// \brief The multiple importance sampling weight for a sample drawn with
+/// density 'pdf', when 'otherPdf' could also have produced it.
+//------------------------------------------------------------------------------
+inline float powerHeuristic(const float pdf, const float otherPdf)
+{
+    const float pdfSq = pdf * pdf;
+    return pdfSq / (pdfSq + (otherPdf * otherPdf));
+}
+
+//------------------------------------------------------------------------------
+// computeBounceResponse
+//------------------------------------------------------------------------------
+/// \brief The fraction of the radiance arriving along 'ray' that the shader of
+/// 'frame' passes on, for each wavelength. This is measured by shading a
+/// single incoming ray of unit radiance, so it works with any tc::Shader.
+//------------------------------------------------------------------------------
+template <typename Shading>
+SampledSpectrum computeBounceResponse(const Shading& shading,
+                                      const ShadeStackFrame& frame,
+                                      const Ray& ray,
+                                      const TraceResult& traceResult)
+{
+    const SampledSpectrum white(1.0f);
+
+    SampledSpectrum radianceSum(0.0f);
+    shading.accumulate(frame.m_traceResult, Radiance(traceResult, white), ray,
+                       radianceSum);
+    return shading.shade(1, radianceSum, frame.m_traceResult, frame.m_ray,
+                         white);
+}
+
+//------------------------------------------------------------------------------
+// computeBounceThroughput
+//------------------------------------------------------------------------------
+/// \brief As computeBounceResponse, for the first wavelength only.
+//------------------------------------------------------------------------------
+template <typename Shading>
+float computeBounceThroughput(const Shading& shading,
+                              const ShadeStackFrame& frame, const Ray& ray,
+                              const TraceResult& traceResult)
+{
+    return computeBounceResponse(shading, frame, ray, traceResult)
+        .getWavelength(0);
+}
+
 //------------------------------------------------------------------------------
 // Integrator
 //------------------------------------------------------------------------------
 Integrator::Integrator(const GeoAPI& geoApi, const ShadeAPI& shadeApi,
                        SearchCache& searchCache, ShadeStack& shadeStack,
-                       const size_t maxRayDepth, const size_t qualityLevel,
-                       const float rayPositionOffset)
+                       Sampler& sampler, const size_t maxRayDepth,
+                       const size_t qualityLevel, const float rayPositionOffset,
+                       const RenderSettings& settings,
+                       IrradianceCache* irradianceCache)
     :
       // Our starting values.
-      m_pitchSamples(qualityLevel),
-      m_yawSamples(qualityLevel * 4),
+      m_mode(settings.m_integrator),
+      m_russianRouletteDepth(settings.m_russianRouletteDepth),
+      m_nextEventEstimation(settings.m_nextEventEstimation &&
+                            shadeApi.shade_getEmitterCount() != 0),
+      m_cosineWeightedSampling(settings.m_cosineWeightedSampling),
+      m_sortBounceRays(settings.m_sortBounceRays),
+      // A path only ever has one continuation ray. The previews fire as many
+      // rays as the stratified integrator, but only from the first hit.
+      m_pitchSamples(m_mode == kIntegratorPath ||
+                             m_mode == kIntegratorWavefront
+                         ? 1
+                         : qualityLevel),
+      m_yawSamples(m_mode == kIntegratorPath || m_mode == kIntegratorWavefront
+                       ? 1
+                       : qualityLevel * 4),
       m_numSamples(m_pitchSamples * m_yawSamples),
+      m_directionTable(kIgnoreRaysCloseToSurface, m_yawSamples,
+                       m_pitchSamples),
       m_geoAPI(geoApi),
       m_shadeAPI(shadeApi),
+      // Plugins are shaded through the virtual interfaces.
+      m_simpleScene(settings.m_specialisedShading
+                        ? dynamic_cast<const SimpleScene*>(&shadeApi)
+                        : 0),
       m_searchCache(searchCache),
       m_shadeStack(shadeStack),
+      m_sampler(sampler),
       m_maxRayDepth(maxRayDepth),
       m_qualityLevel(qualityLevel),
-      m_rayPositionOffset(rayPositionOffset)
+      m_rayPositionOffset(rayPositionOffset),
+      m_ambientOcclusionDistance(settings.m_ambientOcclusionDistance),
+      // The cache stores full hemisphere estimates, a path only has one ray
+      // per point.
+      m_irradianceCache(m_mode == kIntegratorStratified ? irradianceCache
+                                                         : 0)
 {
     assert(shadeStack.empty());
 }
@@ -156,55 +313,482 @@ bool Integrator::next(ShadeStackFrame & rootFrame) const
     // We have work to do to compute the shade stack.
     do
     {
-        ShadeStackFrame& frame = m_shadeStack.top();
+        advance();
+    } while (m_shadeStack.size() != 1);
+
+    rootFrame.m_i = m_shadeStack.back().m_i;
+    rootFrame.m_radianceSum = m_shadeStack.back().m_radianceSum;
+    m_shadeStack.pop_back();
+
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void Integrator::advance() const
+{
+    if (m_simpleScene)
+    {
+        advance(SimpleScene_Shading(*m_simpleScene));
+    }
+    else
+    {
+        advance(ShadeAPI_Shading(m_shadeAPI));
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Integrator::advance(const Shading& shading) const
+{
+    if (m_mode == kIntegratorAmbientOcclusion || m_mode == kIntegratorDirect)
+    {
+        estimatePreview(shading);
+        return;
+    }
 
-        const bool maxSamplesReached = frame.getI() == m_numSamples;
-        const bool maxRayDepthReached = m_shadeStack.size() == m_maxRayDepth;
-        const bool surfaceWasHit = frame.m_traceResult.hasHitSomething();
+    ShadeStackFrame& frame = m_shadeStack.top();
 
-        // If I need more rays then push another ray onto the stack.
-        //
-        if (surfaceWasHit && !maxRayDepthReached && !maxSamplesReached &&
-            m_shadeAPI.shade_getSurfaceShader(frame.m_traceResult.m_geoId)
-                .needsRays())
+    const bool maxSamplesReached = frame.getI() == m_numSamples;
+    const bool maxRayDepthReached = m_shadeStack.size() == m_maxRayDepth;
+    const bool surfaceWasHit = frame.m_traceResult.hasHitSomething();
+
+    // If I need more rays then push another ray onto the stack.
+    //
+    if (surfaceWasHit && !maxRayDepthReached && !maxSamplesReached &&
+        shading.needsRays(frame.m_traceResult.m_geoId))
+    {
+        // A point near one that has already been estimated doesn't need any
+        // rays of its own.
+        if (frame.getI() == 0 && lookupIrradiance(shading, frame))
         {
-            const Ray randomRay = generateRandomDirection(
-                m_shadeAPI, m_pitchSamples, m_rayPositionOffset, m_yawSamples,
-                frame.getI(), frame);
+            finish(shading);
+            return;
+        }
 
+        if (m_nextEventEstimation)
+        {
+            sampleEmitter(shading, frame);
+        }
+
+        float continueWeight = 1.0f;
+        if (!continuePath(frame.m_throughput, m_shadeStack.size(),
+                          continueWeight))
+        {
+            // The path was terminated, this sample contributes nothing.
             frame.incrI();
+            return;
+        }
+
+        float directionWeight = 1.0f;
+        const Ray randomRay =
+            generateBounceRay(shading, frame, frame.getI(), directionWeight);
+
+        frame.incrI();
 
-            // Trace the ray.
-            const TraceResult traceResult =
-                m_geoAPI.geo_trace(m_searchCache, randomRay);
+        // Trace the ray.
+        const TraceResult traceResult =
+            m_geoAPI.geo_trace(m_searchCache, randomRay);
+
+        // Store the new result on the shade stack.
+        ShadeStackFrame newRay(randomRay, traceResult);
+        newRay.m_weight = directionWeight;
+        if (m_mode != kIntegratorStratified)
+        {
+            newRay.m_weight *=
+                continueWeight * computeBounceWeight(shading, frame, newRay);
+            newRay.m_throughput =
+                frame.m_throughput * continueWeight * directionWeight *
+                computeBounceThroughput(shading, frame, randomRay,
+                                        traceResult);
+        }
+        else
+        {
+            // Each stratum is drawn from the same density as a path's bounce
+            // ray, so it shares an emitter it finds with sampleEmitter in the
+            // same way.
+            newRay.m_weight *= computeBounceWeight(shading, frame, newRay);
+        }
+        m_shadeStack.push_back(newRay);
+    }
 
-            // Store the new result on the shade stack.
-            const ShadeStackFrame newRay(randomRay, traceResult);
-            m_shadeStack.push_back(newRay);
+    // I don't need any more rays, so I can shade myself, store the result
+    // in my parent, and pop the shadeStack.
+    else
+    {
+        if (m_irradianceCache && surfaceWasHit && maxSamplesReached &&
+            shading.isDiffuse(frame.m_traceResult.m_geoId))
+        {
+            recordIrradiance(shading, frame);
         }
+        finish(shading);
+    }
+}
 
-        // I don't need any more rays, so I can shade myself, store the result
-        // in my parent, and pop the shadeStack.
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Integrator::estimatePreview(const Shading& shading) const
+{
+    ShadeStackFrame& frame = m_shadeStack.top();
+    if (frame.m_traceResult.hasHitSomething() &&
+        shading.needsRays(frame.m_traceResult.m_geoId))
+    {
+        if (m_mode == kIntegratorAmbientOcclusion)
+        {
+            estimateAmbientOcclusion(shading, frame);
+        }
         else
         {
-            if (m_shadeStack.size() > 1)
+            // Each shadow ray stands in for one of the bounce rays, so the
+            // shaders average over them as they would over bounce rays.
+            if (shading.shade_getEmitterCount() != 0)
             {
-                const SampledSpectrum color = computeColor(m_shadeAPI, frame);
-                storeShadeResult(m_shadeAPI, m_shadeStack, frame, color);
-                m_shadeStack.pop_back();
-            }
-            else
-            {
-                frame.setDone();
+                for (size_t i = 0; i != m_numSamples; ++i)
+                {
+                    sampleEmitter(shading, frame);
+                }
             }
+            frame.m_i = m_numSamples;
         }
+    }
+    finish(shading);
+}
 
-    } while (m_shadeStack.size() != 1);
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Integrator::estimateAmbientOcclusion(const Shading& shading,
+                                          ShadeStackFrame& frame) const
+{
+    const SurfaceFrame& surfaceFrame =
+        shading.shade_getSurfaceFrame(frame.m_traceResult);
 
-    rootFrame.m_i = m_shadeStack.back().m_i;
-    rootFrame.m_radianceSum = m_shadeStack.back().m_radianceSum;
-    m_shadeStack.pop_back();
+    float openSum = 0.0f;
+    float weightSum = 0.0f;
+    for (size_t i = 0; i != m_numSamples; ++i)
+    {
+        float directionWeight = 1.0f;
+        const Ray ray =
+            generateBounceRay(shading, frame, i, directionWeight);
+        const float weight =
+            directionWeight * ray.m_direction.dot(surfaceFrame.m_normal);
+        if (weight <= 0.0f)
+        {
+            continue;
+        }
+
+        weightSum += weight;
+        if (!m_geoAPI.geo_occluded(m_searchCache, ray,
+                                   m_ambientOcclusionDistance))
+        {
+            openSum += weight;
+        }
+    }
+
+    // Shaded as a single sample, so a diffuse point is lit as if by a white
+    // sky wherever it is open.
+    frame.m_radianceSum =
+        SampledSpectrum(weightSum > 0.0f ? openSum / weightSum : 0.0f);
+    frame.m_i = 1;
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Integrator::finish(const Shading& shading) const
+{
+    ShadeStackFrame& frame = m_shadeStack.top();
+    if (m_shadeStack.size() > 1)
+    {
+        const SampledSpectrum color = computeColor(shading, frame);
+        if (m_irradianceCache)
+        {
+            ShadeStackFrame& parentFrame = m_shadeStack.top(1);
+            const SampledSpectrum radianceSum = parentFrame.m_radianceSum;
+            storeShadeResult(shading, m_shadeStack, frame, color);
+            addIrradianceSample(shading, parentFrame, frame,
+                                parentFrame.m_radianceSum - radianceSum);
+        }
+        else
+        {
+            storeShadeResult(shading, m_shadeStack, frame, color);
+        }
+        m_shadeStack.pop_back();
+    }
+    else
+    {
+        frame.setDone();
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+bool Integrator::lookupIrradiance(const Shading& shading,
+                                  ShadeStackFrame& frame) const
+{
+    const GeoID& geoId = frame.m_traceResult.m_geoId;
+    if (!m_irradianceCache || !shading.isDiffuse(geoId))
+    {
+        return false;
+    }
+
+    const Vector3<float> position = frame.m_ray.computePointOnRay(
+        frame.m_traceResult.m_distanceAlongRay);
+    const SurfaceFrame& surfaceFrame =
+        shading.shade_getSurfaceFrame(frame.m_traceResult);
+    SampledSpectrum irradiance;
+    if (!m_irradianceCache->lookup(position, surfaceFrame.m_normal,
+                                   m_shadeStack.size(), irradiance))
+    {
+        return false;
+    }
+
+    // A diffuse point shades to the average of its samples, so a single
+    // sample of the interpolated irradiance gives the same result.
+    frame.m_radianceSum = irradiance;
+    frame.m_i = 1;
+    return true;
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Integrator::addIrradianceSample(const Shading& shading,
+                                     ShadeStackFrame& parentFrame,
+                                     const ShadeStackFrame& bounceFrame,
+                                     const SampledSpectrum& contribution) const
+{
+    const GeoID& geoId = parentFrame.m_traceResult.m_geoId;
+    if (!shading.isDiffuse(geoId))
+    {
+        return;
+    }
+
+    // Rays that find nothing are infinitely far away.
+    if (bounceFrame.m_traceResult.hasHitSomething())
+    {
+        parentFrame.m_inverseDistanceSum +=
+            1.0f / bounceFrame.m_traceResult.m_distanceAlongRay;
+    }
+
+    // The contribution is proportional to the cosine of the angle between
+    // the ray and the normal. Rotating the normal changes that cosine by the
+    // part of the ray direction that is tangent to the surface.
+    const SurfaceFrame& surfaceFrame =
+        shading.shade_getSurfaceFrame(parentFrame.m_traceResult);
+    const Vector3<float>& direction = bounceFrame.m_ray.m_direction;
+    const float cosTheta = direction.dot(surfaceFrame.m_normal);
+    if (cosTheta <= 0.0f)
+    {
+        return;
+    }
+    const Vector3<float> tangent =
+        direction - surfaceFrame.m_normal * cosTheta;
+    for (size_t i = 0; i != TC_SAMPLED_SPECTRUM_SAMPLE_COUNT; ++i)
+    {
+        parentFrame.m_rotationGradientSum[i] +=
+            tangent * (contribution.getWavelength(i) / cosTheta);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Integrator::recordIrradiance(const Shading& shading,
+                                  const ShadeStackFrame& frame) const
+{
+    const float sampleCount = static_cast<float>(m_numSamples);
+    const SurfaceFrame& surfaceFrame =
+        shading.shade_getSurfaceFrame(frame.m_traceResult);
+
+    IrradianceCache_Record record;
+    record.m_position = frame.m_ray.computePointOnRay(
+        frame.m_traceResult.m_distanceAlongRay);
+    record.m_normal = surfaceFrame.m_normal;
+    // The harmonic mean distance, the cache clamps it to its own range.
+    record.m_radius = frame.m_inverseDistanceSum > 0.0f
+                          ? sampleCount / frame.m_inverseDistanceSum
+                          : FLT_MAX;
+    record.m_depth = m_shadeStack.size();
+    record.m_irradiance = frame.m_radianceSum / sampleCount;
+    for (size_t i = 0; i != TC_SAMPLED_SPECTRUM_SAMPLE_COUNT; ++i)
+    {
+        record.m_rotationGradient[i] =
+            frame.m_rotationGradientSum[i] * (1.0f / sampleCount);
+    }
+    m_irradianceCache->insert(record);
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Integrator::sampleEmitter(const Shading& shading,
+                               ShadeStackFrame& frame) const
+{
+    // Choose one of the emitters at random.
+    const size_t emitterCount = shading.shade_getEmitterCount();
+    size_t emitterIndex = 0;
+    if (emitterCount > 1)
+    {
+        emitterIndex = static_cast<size_t>(m_sampler.get1D() * emitterCount);
+        emitterIndex = emitterIndex < emitterCount ? emitterIndex
+                                                   : emitterCount - 1;
+    }
+    const Emitter& emitter = *shading.shade_getEmitter(emitterIndex);
+
+    const Vector3<float> position =
+        frame.m_ray.computePointOnRay(frame.m_traceResult.m_distanceAlongRay);
+    if (!isEmitterSampled(emitter, position))
+    {
+        return;
+    }
+    const EmitterSample emitterSample =
+        emitter.sample(position, m_sampler.get2D());
+    const float emitterPdf =
+        emitterSample.m_pdf / static_cast<float>(emitterCount);
+    if (emitterPdf == 0.0f)
+    {
+        return;
+    }
+
+    // Directions the bounce rays never take don't contribute.
+    const SurfaceFrame& surfaceFrame =
+        shading.shade_getSurfaceFrame(frame.m_traceResult);
+    const float cosTheta = emitterSample.m_direction.dot(surfaceFrame.m_normal);
+    const float bouncePdf = computeBouncePdf(cosTheta);
+    if (bouncePdf == 0.0f)
+    {
+        return;
+    }
+
+    // Fire a shadow ray, nothing may lie between the point and the emitter.
+    // It stops just short of the emitter, so the emitter itself doesn't
+    // count.
+    const Ray shadowRay(emitterSample.m_direction,
+                        position +
+                            (emitterSample.m_direction * m_rayPositionOffset));
+    const float emitterDistance =
+        emitterSample.m_distance - m_rayPositionOffset;
+    if (m_geoAPI.geo_occluded(m_searchCache, shadowRay,
+                              emitterDistance * kShadowRayLength))
+    {
+        return;
+    }
+    const TraceResult traceResult(emitterDistance, emitterSample.m_geoId);
+
+    // The shaders average over the uniform stratified direction
+    // distribution, so the emitter sample is reweighted from the emitter pdf
+    // to that, whichever distribution the bounce rays are drawn from.
+    const float targetPdf =
+        computeStratifiedDirectionPdf(kIgnoreRaysCloseToSurface, cosTheta);
+    // The direct preview fires no bounce rays, so the emitter sample is the
+    // only estimate and takes all of the weight.
+    const float misWeight = m_mode == kIntegratorDirect
+                                ? 1.0f
+                                : powerHeuristic(emitterPdf, bouncePdf);
+    const float weight = misWeight * (targetPdf / emitterPdf);
+
+    const ShadeStackFrame emitterFrame(shadowRay, traceResult);
+    const SampledSpectrum color = computeColor(shading, emitterFrame);
+    shading.accumulate(frame.m_traceResult,
+                       Radiance(traceResult, color * weight), shadowRay,
+                       frame.m_radianceSum);
+}
+
+//------------------------------------------------------------------------------
+bool Integrator::isEmitterSampled(const Emitter& emitter,
+                                  const Vector3<float>& position) const
+{
+    // The preview has no bounce rays to find the emitter instead.
+    return m_mode == kIntegratorDirect ||
+           emitter.computeSolidAngle(position) <= kMaxSampledSolidAngle;
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+float Integrator::computeBounceWeight(const Shading& shading,
+                                      const ShadeStackFrame& frame,
+                                      const ShadeStackFrame& bounceFrame) const
+{
+    if (!m_nextEventEstimation || !bounceFrame.m_traceResult.hasHitSomething())
+    {
+        return 1.0f;
+    }
+
+    // If the bounce ray found an emitter, it could also have been found by
+    // sampleEmitter, so it only gets its share of the contribution.
+    const size_t emitterCount = shading.shade_getEmitterCount();
+    for (size_t i = 0; i != emitterCount; ++i)
+    {
+        const Emitter& emitter = *shading.shade_getEmitter(i);
+        if (!emitter.contains(bounceFrame.m_traceResult.m_geoId))
+        {
+            continue;
+        }
+
+        const Vector3<float> position = frame.m_ray.computePointOnRay(
+            frame.m_traceResult.m_distanceAlongRay);
+        if (!isEmitterSampled(emitter, position))
+        {
+            return 1.0f;
+        }
+        const float emitterPdf =
+            emitter.pdf(position, bounceFrame.m_ray.m_direction,
+                        bounceFrame.m_traceResult.m_distanceAlongRay) /
+            static_cast<float>(emitterCount);
+
+        const SurfaceFrame& surfaceFrame =
+            shading.shade_getSurfaceFrame(frame.m_traceResult);
+        const float bouncePdf = computeBouncePdf(
+            bounceFrame.m_ray.m_direction.dot(surfaceFrame.m_normal));
+        return powerHeuristic(bouncePdf, emitterPdf);
+    }
+    return 1.0f;
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+const Ray Integrator::generateBounceRay(const Shading& shading,
+                                        const ShadeStackFrame& frame,
+                                        const size_t i,
+                                        float& directionWeight) const
+{
+    if (m_cosineWeightedSampling)
+    {
+        return generateCosineWeightedDirection(
+            shading, m_sampler, m_directionTable, m_pitchSamples,
+            m_rayPositionOffset, i, frame, directionWeight);
+    }
+
+    directionWeight = 1.0f;
+    return generateRandomDirection(shading, m_sampler, m_pitchSamples,
+                                   m_rayPositionOffset, m_yawSamples, i,
+                                   frame);
+}
+
+//------------------------------------------------------------------------------
+float Integrator::computeBouncePdf(const float cosTheta) const
+{
+    if (m_cosineWeightedSampling)
+    {
+        return m_directionTable.computePdf(cosTheta);
+    }
+    return computeStratifiedDirectionPdf(kIgnoreRaysCloseToSurface, cosTheta);
+}
+
+//------------------------------------------------------------------------------
+bool Integrator::continuePath(const float throughput, const size_t depth,
+                              float& continueWeight) const
+{
+    if (m_mode == kIntegratorStratified || depth < m_russianRouletteDepth)
+    {
+        return true;
+    }
+
+    // Paths which carry little light back to the camera are likely to be
+    // terminated. The survivors are scaled up so the estimate stays unbiased.
+    const float survival =
+        throughput < 0.05f ? 0.05f : (throughput > 1.0f ? 1.0f : throughput);
+    if (m_sampler.get1D() >= survival)
+    {
+        return false;
+    }
 
+    continueWeight = 1.0f / survival;
     return true;
 }
 
@@ -222,7 +806,15 @@ const TraceResult& Integrator::getTraceResult() const
 void Integrator::computeSampledSpectrum(SampledSpectrum& sampledSpectrum,
                                         const ShadeStackFrame& frame) const
 {
-    sampledSpectrum = computeColor(m_shadeAPI, frame);
+    if (m_simpleScene)
+    {
+        sampledSpectrum =
+            computeColor(SimpleScene_Shading(*m_simpleScene), frame);
+    }
+    else
+    {
+        sampledSpectrum = computeColor(ShadeAPI_Shading(m_shadeAPI), frame);
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -231,6 +823,475 @@ size_t Integrator::getNumSamples() const
     return m_numSamples;
 }
 
+//------------------------------------------------------------------------------
+// WavefrontQueue
+//------------------------------------------------------------------------------
+void WavefrontQueue::push(
+    const Vector3<float>& direction, const Vector3<float>& position,
+    const Vector3<float>& parentDirection, const Vector3<float>& parentPosition,
+    const TraceResult& parentTraceResult, const size_t slot,
+    const size_t pixelIndex, const size_t sampleIndex, const size_t dimension,
+    const size_t depth, const SampledSpectrum& pathWeight, const float weight,
+    const float throughput)
+{
+    m_directions.push_back(direction);
+    m_positions.push_back(position);
+    m_distances.push_back(0.0f);
+    m_objectIndices.push_back(0);
+    m_elementIndices.push_back(0);
+    m_normals.push_back(Vector3<float>(0.0f));
+    m_parentDirections.push_back(parentDirection);
+    m_parentPositions.push_back(parentPosition);
+    m_parentDistances.push_back(parentTraceResult.m_distanceAlongRay);
+    m_parentObjectIndices.push_back(parentTraceResult.m_geoId.m_objectIndex);
+    m_parentElementIndices.push_back(parentTraceResult.m_geoId.m_elementIndex);
+    m_parentNormals.push_back(parentTraceResult.m_normal);
+    m_slots.push_back(slot);
+    m_pixelIndices.push_back(pixelIndex);
+    m_sampleIndices.push_back(sampleIndex);
+    m_dimensions.push_back(dimension);
+    m_depths.push_back(depth);
+    m_pathWeights.push_back(pathWeight);
+    m_weights.push_back(weight);
+    m_throughputs.push_back(throughput);
+    m_bounces.push_back(false);
+}
+
+//------------------------------------------------------------------------------
+void WavefrontQueue::clear()
+{
+    m_directions.clear();
+    m_positions.clear();
+    m_distances.clear();
+    m_objectIndices.clear();
+    m_elementIndices.clear();
+    m_normals.clear();
+    m_parentDirections.clear();
+    m_parentPositions.clear();
+    m_parentDistances.clear();
+    m_parentObjectIndices.clear();
+    m_parentElementIndices.clear();
+    m_parentNormals.clear();
+    m_slots.clear();
+    m_pixelIndices.clear();
+    m_sampleIndices.clear();
+    m_dimensions.clear();
+    m_depths.clear();
+    m_pathWeights.clear();
+    m_weights.clear();
+    m_throughputs.clear();
+    m_bounces.clear();
+}
+
+//------------------------------------------------------------------------------
+size_t WavefrontQueue::size() const
+{
+    return m_directions.size();
+}
+
+//------------------------------------------------------------------------------
+// ShaderBuckets
+//------------------------------------------------------------------------------
+void ShaderBuckets::clear()
+{
+    m_shaders.clear();
+    m_hitBuckets.clear();
+    m_hitIndices.clear();
+    m_bucketBegins.clear();
+    m_sorted.clear();
+}
+
+//------------------------------------------------------------------------------
+void ShaderBuckets::add(const Shader* shader, const size_t index)
+{
+    // There are only ever a handful of shaders, so a linear search is
+    // quicker than anything cleverer.
+    size_t bucket = 0;
+    while (bucket != m_shaders.size() && m_shaders[bucket] != shader)
+    {
+        ++bucket;
+    }
+    if (bucket == m_shaders.size())
+    {
+        m_shaders.push_back(shader);
+    }
+
+    m_hitBuckets.push_back(bucket);
+    m_hitIndices.push_back(index);
+}
+
+//------------------------------------------------------------------------------
+void ShaderBuckets::build()
+{
+    // A counting sort, which keeps the hits of each bucket in order.
+    const size_t bucketCount = m_shaders.size();
+    m_bucketBegins.assign(bucketCount + 1, 0);
+    for (size_t i = 0; i != m_hitBuckets.size(); ++i)
+    {
+        ++m_bucketBegins[m_hitBuckets[i] + 1];
+    }
+    for (size_t bucket = 0; bucket != bucketCount; ++bucket)
+    {
+        m_bucketBegins[bucket + 1] += m_bucketBegins[bucket];
+    }
+
+    m_sorted.resize(m_hitIndices.size());
+    m_positions.assign(m_bucketBegins.begin(), m_bucketBegins.end() - 1);
+    for (size_t i = 0; i != m_hitBuckets.size(); ++i)
+    {
+        m_sorted[m_positions[m_hitBuckets[i]]++] = m_hitIndices[i];
+    }
+}
+
+//------------------------------------------------------------------------------
+size_t ShaderBuckets::size() const
+{
+    return m_sorted.size();
+}
+
+//------------------------------------------------------------------------------
+size_t ShaderBuckets::operator[](const size_t i) const
+{
+    assert(i < m_sorted.size());
+    return m_sorted[i];
+}
+
+//------------------------------------------------------------------------------
+size_t ShaderBuckets::getBucketCount() const
+{
+    return m_shaders.size();
+}
+
+//------------------------------------------------------------------------------
+const Shader* ShaderBuckets::getShader(const size_t bucket) const
+{
+    assert(bucket < m_shaders.size());
+    return m_shaders[bucket];
+}
+
+//------------------------------------------------------------------------------
+size_t ShaderBuckets::getBucketBegin(const size_t bucket) const
+{
+    assert(bucket < m_shaders.size());
+    return m_bucketBegins[bucket];
+}
+
+//------------------------------------------------------------------------------
+size_t ShaderBuckets::getBucketEnd(const size_t bucket) const
+{
+    assert(bucket < m_shaders.size());
+    return m_bucketBegins[bucket + 1];
+}
+
+//------------------------------------------------------------------------------
+// Wavefront
+//------------------------------------------------------------------------------
+Wavefront::Wavefront(const Integrator& integrator)
+    : m_integrator(integrator), m_queue(), m_nextQueue(), m_radiance()
+{
+}
+
+//------------------------------------------------------------------------------
+void Wavefront::reset(const size_t slotCount)
+{
+    m_queue.clear();
+    m_nextQueue.clear();
+    m_radiance.assign(slotCount, SampledSpectrum(0.0f));
+}
+
+//------------------------------------------------------------------------------
+void Wavefront::addCameraRay(const Ray& ray, const size_t slot,
+                             const size_t pixelIndex, const size_t sampleIndex,
+                             const size_t dimension)
+{
+    assert(slot < m_radiance.size());
+    const Vector3<float> zero(0.0f);
+    m_queue.push(ray.m_direction, ray.m_position, zero, zero, TraceResult(),
+                 slot, pixelIndex, sampleIndex, dimension, 1,
+                 SampledSpectrum(1.0f), 1.0f, 1.0f);
+}
+
+//------------------------------------------------------------------------------
+void Wavefront::render()
+{
+    while (m_queue.size() != 0)
+    {
+        trace();
+        shade();
+        generateBounceRays();
+    }
+}
+
+//------------------------------------------------------------------------------
+const SampledSpectrum& Wavefront::getRadiance(const size_t slot) const
+{
+    assert(slot < m_radiance.size());
+    return m_radiance[slot];
+}
+
+//------------------------------------------------------------------------------
+void Wavefront::trace()
+{
+    const GeoAPI& geoApi = m_integrator.m_geoAPI;
+    SearchCache& searchCache = m_integrator.m_searchCache;
+
+    m_stream.clear();
+    m_streamQueueIndices.clear();
+
+    const size_t count = m_queue.size();
+    for (size_t i = 0; i < count; i += RayPacket::kSize)
+    {
+        const size_t packetSize =
+            std::min(static_cast<size_t>(RayPacket::kSize), count - i);
+
+        // Camera rays are queued in pixel order, so they are coherent enough
+        // to be traced as packets. Bounce rays go in the stream.
+        bool isCoherent = true;
+        RayPacket packet;
+        for (size_t lane = 0; lane != packetSize; ++lane)
+        {
+            isCoherent = isCoherent && m_queue.m_depths[i + lane] == 1;
+            packet.setRay(lane, Ray(m_queue.m_directions[i + lane],
+                                    m_queue.m_positions[i + lane]));
+        }
+
+        if (!isCoherent)
+        {
+            for (size_t lane = 0; lane != packetSize; ++lane)
+            {
+                m_stream.push(packet.getRay(lane));
+                m_streamQueueIndices.push_back(i + lane);
+            }
+            continue;
+        }
+
+        const RayPacket_TraceResult traceResult =
+            geoApi.geo_tracePacket(searchCache, packet);
+
+        for (size_t lane = 0; lane != packetSize; ++lane)
+        {
+            m_queue.m_distances[i + lane] =
+                traceResult.m_distanceAlongRay[lane];
+            m_queue.m_objectIndices[i + lane] = traceResult.m_objectIndex[lane];
+            m_queue.m_elementIndices[i + lane] =
+                traceResult.m_elementIndex[lane];
+            m_queue.m_normals[i + lane] = traceResult.m_normal[lane];
+        }
+    }
+    // Bounce rays head off in every direction, so they are traced all at once
+    // and each node of the acceleration structure is fetched for all of them.
+    if (m_stream.size() != 0)
+    {
+        if (m_integrator.m_sortBounceRays)
+        {
+            m_raySorter.sort(m_stream, m_streamQueueIndices);
+        }
+        geoApi.geo_traceStream(searchCache, m_stream, m_streamResult);
+        for (size_t j = 0; j != m_streamQueueIndices.size(); ++j)
+        {
+            const size_t i = m_streamQueueIndices[j];
+            m_queue.m_distances[i] = m_streamResult.m_distanceAlongRay[j];
+            m_queue.m_objectIndices[i] = m_streamResult.m_objectIndex[j];
+            m_queue.m_elementIndices[i] = m_streamResult.m_elementIndex[j];
+            m_queue.m_normals[i] = m_streamResult.m_normal[j];
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void Wavefront::shade()
+{
+    if (m_integrator.m_simpleScene)
+    {
+        shade(SimpleScene_Shading(*m_integrator.m_simpleScene));
+    }
+    else
+    {
+        shade(ShadeAPI_Shading(m_integrator.m_shadeAPI));
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Wavefront::shade(const Shading& shading)
+{
+    const size_t count = m_queue.size();
+
+    // Weigh the bounce rays by what the point they left passes on, one
+    // shader at a time.
+    m_shaderBuckets.clear();
+    for (size_t i = 0; i != count; ++i)
+    {
+        if (m_queue.m_parentObjectIndices[i] != 0)
+        {
+            const GeoID parentGeoId(m_queue.m_parentObjectIndices[i],
+                                    m_queue.m_parentElementIndices[i]);
+            m_shaderBuckets.add(&shading.shade_getSurfaceShader(parentGeoId),
+                                i);
+        }
+    }
+    m_shaderBuckets.build();
+    for (size_t i = 0; i != m_shaderBuckets.size(); ++i)
+    {
+        weighBounce(shading, m_shaderBuckets[i]);
+    }
+
+    // Then shade the points that were found, again one shader at a time.
+    m_shaderBuckets.clear();
+    for (size_t i = 0; i != count; ++i)
+    {
+        m_queue.m_bounces[i] = false;
+        if (m_queue.m_objectIndices[i] != 0)
+        {
+            const GeoID geoId(m_queue.m_objectIndices[i],
+                              m_queue.m_elementIndices[i]);
+            m_shaderBuckets.add(&shading.shade_getSurfaceShader(geoId), i);
+        }
+    }
+    m_shaderBuckets.build();
+    for (size_t i = 0; i != m_shaderBuckets.size(); ++i)
+    {
+        shadeHit(shading, m_shaderBuckets[i]);
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Wavefront::weighBounce(const Shading& shading, const size_t i)
+{
+    const ShadeStackFrame frame(
+        Ray(m_queue.m_directions[i], m_queue.m_positions[i]),
+        TraceResult(m_queue.m_distances[i],
+                    GeoID(m_queue.m_objectIndices[i],
+                          m_queue.m_elementIndices[i]),
+                    m_queue.m_normals[i]));
+    const ShadeStackFrame parentFrame(
+        Ray(m_queue.m_parentDirections[i], m_queue.m_parentPositions[i]),
+        TraceResult(m_queue.m_parentDistances[i],
+                    GeoID(m_queue.m_parentObjectIndices[i],
+                          m_queue.m_parentElementIndices[i]),
+                    m_queue.m_parentNormals[i]));
+
+    // Work out how much of the light leaving the point this ray found
+    // reaches the camera. The integrator does this on the way back up the
+    // shade stack, but the shaders are linear in the radiance they accumulate
+    // so it can be done on the way down instead.
+    const float weight =
+        m_queue.m_weights[i] *
+        m_integrator.computeBounceWeight(shading, parentFrame, frame);
+    m_queue.m_pathWeights[i] *=
+        computeBounceResponse(shading, parentFrame, frame.m_ray,
+                              frame.m_traceResult) *
+        weight;
+    m_queue.m_throughputs[i] *= computeBounceThroughput(
+        shading, parentFrame, frame.m_ray, frame.m_traceResult);
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Wavefront::shadeHit(const Shading& shading, const size_t i)
+{
+    Sampler& sampler = m_integrator.m_sampler;
+
+    const ShadeStackFrame frame(
+        Ray(m_queue.m_directions[i], m_queue.m_positions[i]),
+        TraceResult(m_queue.m_distances[i],
+                    GeoID(m_queue.m_objectIndices[i],
+                          m_queue.m_elementIndices[i]),
+                    m_queue.m_normals[i]));
+
+    const SampledSpectrum& pathWeight = m_queue.m_pathWeights[i];
+    const size_t slot = m_queue.m_slots[i];
+
+    if (!shading.needsRays(frame.m_traceResult.m_geoId) ||
+        m_queue.m_depths[i] == m_integrator.m_maxRayDepth)
+    {
+        m_radiance[slot] += computeColor(shading, frame) * pathWeight;
+        return;
+    }
+
+    if (m_integrator.m_nextEventEstimation)
+    {
+        sampler.resumePixelSample(m_queue.m_pixelIndices[i],
+                                  m_queue.m_sampleIndices[i],
+                                  m_queue.m_dimensions[i]);
+
+        ShadeStackFrame emitterFrame(frame);
+        m_integrator.sampleEmitter(shading, emitterFrame);
+        emitterFrame.incrI();
+        m_radiance[slot] += computeColor(shading, emitterFrame) * pathWeight;
+
+        m_queue.m_dimensions[i] = sampler.getDimension();
+    }
+
+    m_queue.m_bounces[i] = true;
+}
+
+//------------------------------------------------------------------------------
+void Wavefront::generateBounceRays()
+{
+    if (m_integrator.m_simpleScene)
+    {
+        generateBounceRays(SimpleScene_Shading(*m_integrator.m_simpleScene));
+    }
+    else
+    {
+        generateBounceRays(ShadeAPI_Shading(m_integrator.m_shadeAPI));
+    }
+}
+
+//------------------------------------------------------------------------------
+template <typename Shading>
+void Wavefront::generateBounceRays(const Shading& shading)
+{
+    Sampler& sampler = m_integrator.m_sampler;
+
+    m_nextQueue.clear();
+
+    const size_t count = m_queue.size();
+    for (size_t i = 0; i != count; ++i)
+    {
+        if (!m_queue.m_bounces[i])
+        {
+            continue;
+        }
+
+        sampler.resumePixelSample(m_queue.m_pixelIndices[i],
+                                  m_queue.m_sampleIndices[i],
+                                  m_queue.m_dimensions[i]);
+
+        float continueWeight = 1.0f;
+        if (!m_integrator.continuePath(m_queue.m_throughputs[i],
+                                       m_queue.m_depths[i], continueWeight))
+        {
+            continue;
+        }
+
+        const TraceResult traceResult(
+            m_queue.m_distances[i],
+            GeoID(m_queue.m_objectIndices[i], m_queue.m_elementIndices[i]),
+            m_queue.m_normals[i]);
+        const ShadeStackFrame frame(
+            Ray(m_queue.m_directions[i], m_queue.m_positions[i]), traceResult);
+
+        float directionWeight = 1.0f;
+        const Ray bounceRay =
+            m_integrator.generateBounceRay(shading, frame, 0,
+                                           directionWeight);
+        const float weight = continueWeight * directionWeight;
+
+        m_nextQueue.push(bounceRay.m_direction, bounceRay.m_position,
+                         frame.m_ray.m_direction, frame.m_ray.m_position,
+                         traceResult, m_queue.m_slots[i],
+                         m_queue.m_pixelIndices[i], m_queue.m_sampleIndices[i],
+                         sampler.getDimension(), m_queue.m_depths[i] + 1,
+                         m_queue.m_pathWeights[i], weight,
+                         m_queue.m_throughputs[i] * weight);
+    }
+
+    std::swap(m_queue, m_nextQueue);
+}
+
 }  // namespace shade
 
 }  // namespace tc
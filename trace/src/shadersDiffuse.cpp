@@ -25,28 +25,14 @@ void shaders::Diffuse::accumulate(const TraceResult& traceResult,
                                   const ShadeAPI& shadeApi,
                                   SampledSpectrum& result) const
 {
-
-    if (radiance.m_traceResult.hasHitSomething())
-    {
-        const SurfaceFrame& surfaceFrame =
-            shadeApi.shade_getSurfaceFrame(traceResult.m_geoId);
-        const float angularFalloff = ray.m_direction.dot(surfaceFrame.m_normal);
-
-        const float distanceFalloff =
-            radiance.m_traceResult.m_distanceAlongRay >= 1.0f
-                ? 1.0f / radiance.m_traceResult.m_distanceAlongRay
-                : 1.0f;
-
-        const SampledSpectrum color =
-            radiance.m_color * (angularFalloff * distanceFalloff);
-        result += color;
-    }
+    accumulateDirect(traceResult, radiance, ray, ShadeAPI_Shading(shadeApi),
+                     result);
 }
 
 //------------------------------------------------------------------------------
 bool shaders::Diffuse::needsRays() const
 {
-    return true;
+    return needsRaysDirect();
 }
 
 //------------------------------------------------------------------------------
@@ -56,16 +42,8 @@ SampledSpectrum shaders::Diffuse::shade(const size_t radianceCount,
                                         const Ray& ray,
                                         const SampledSpectrum& localColor) const
 {
-    if (radianceCount == 0)
-    {
-        return SampledSpectrum(0.0f);
-    }
-
-    const float radianceCountFloat = static_cast<float>(radianceCount);
-    const SampledSpectrum luminence = radianceSum / radianceCountFloat;
-    const SampledSpectrum coloredSample = (localColor * luminence);
-
-    return coloredSample;
+    return shadeDirect(radianceCount, radianceSum, traceResult, ray,
+                       localColor);
 }
 
 }  // namespace tc
@@ -15,7 +15,8 @@ SampledSpectrum shaders::WhiteLight::shade(
     const TraceResult& traceResult, const Ray& ray,
     const SampledSpectrum& localColor) const
 {
-    return SampledSpectrum(m_intensity);
+    return shadeDirect(radianceCount, radianceSum, traceResult, ray,
+                       localColor);
 }
 
 }  // namespace tc
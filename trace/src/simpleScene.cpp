@@ -4,19 +4,24 @@
 #include "trace/simpleScene.h"
 //------------------------------------------------------------------------------
 #include "trace/assert.h"
+#include "trace/biniterator.h"
 #include "trace/geoid.h"
 #include "trace/intersect.h"
-#include "trace/objectiterator.h"
+#include "trace/thread.h"
 #include "trace/vector.h"
 //------------------------------------------------------------------------------
-#include "trace/shadersDiffuse.h"
-#include "trace/shadersWhiteLight.h"
-//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <utility>
 
 namespace
 {
-static const tc::shaders::Diffuse shadersDiffuse;
-static const tc::shaders::WhiteLight shadersWhiteLight(40.0f);
+static const float globalLightIntensity = 40.0f;
+static const float globalSphereRadius = 20.0f;
+/// The number of triangles read from a tc::TriangleIterator at a time.
+static const size_t kTriangleBatchSize = 256;
 }
 
 namespace
@@ -26,62 +31,441 @@ namespace
 //------------------------------------------------------------------------------
 class TriangleIntersect : public tc::KDTree_PrimitiveIntersect
 {
-    const tc::Triangles& m_triangles;
+    const std::vector<tc::Vector3<float> >& m_vertices;
+    const std::vector<uint32_t>& m_indices;
 
 public:
-    TriangleIntersect(const tc::Triangles& triangles) : m_triangles(triangles)
+    TriangleIntersect(const std::vector<tc::Vector3<float> >& vertices,
+                      const std::vector<uint32_t>& indices)
+        : m_vertices(vertices), m_indices(indices)
     {
     }
 
     bool intersect(float& resultDelta, const tc::Ray& ray,
                    const size_t primitiveId) const
     {
-        const tc::Triangle& triangle = m_triangles[primitiveId];
+        const uint32_t* const indices = &m_indices[primitiveId * 3];
+        const tc::Triangle triangle(m_vertices[indices[0]],
+                                    m_vertices[indices[1]],
+                                    m_vertices[indices[2]]);
         return tc::intersect_triangle(resultDelta, ray, triangle);
     }
 };
+
+//------------------------------------------------------------------------------
+// CornerLess
+//------------------------------------------------------------------------------
+// Orders the corners of triangles by the bits of their positions, so that
+// corners are only shared when they are exactly the same, down to the sign of
+// zero.
+//------------------------------------------------------------------------------
+class CornerLess
+{
+public:
+    explicit CornerLess(const std::vector<tc::Vector3<float> >& corners)
+        : m_corners(corners)
+    {
+    }
+
+    bool operator()(const uint32_t a, const uint32_t b) const
+    {
+        const tc::Vector3<float>& cornerA = m_corners[a];
+        const tc::Vector3<float>& cornerB = m_corners[b];
+        for (size_t axis = 0; axis != 3; ++axis)
+        {
+            const uint32_t bitsA = toBits(cornerA[axis]);
+            const uint32_t bitsB = toBits(cornerB[axis]);
+            if (bitsA != bitsB)
+            {
+                return bitsA < bitsB;
+            }
+        }
+        return false;
+    }
+
+private:
+    static uint32_t toBits(const float value)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        return bits;
+    }
+
+    const std::vector<tc::Vector3<float> >& m_corners;
+};
+
+//------------------------------------------------------------------------------
+// BuildThreads
+//------------------------------------------------------------------------------
+// Builds the acceleration structures of many meshes. Each thread takes the
+// next mesh from the list until there are none left, so a thread that is
+// given a large mesh doesn't hold up the others.
+//------------------------------------------------------------------------------
+class BuildThreads : public tc::ThreadBundle
+{
+public:
+    BuildThreads(std::vector<tc::SimplePolyMesh>& meshes,
+                 const std::vector<size_t>& order, const size_t threadCount)
+        : ThreadBundle(tc::Range(0, threadCount), threadCount),
+          m_meshes(meshes),
+          m_order(order),
+          m_next(0)
+    {
+    }
+
+private:
+    virtual void run(const size_t threadIndex, const tc::Range& range)
+    {
+        for (;;)
+        {
+            const size_t next = __sync_fetch_and_add(&m_next, 1);
+            if (next >= m_order.size())
+            {
+                return;
+            }
+            m_meshes[m_order[next]].build();
+        }
+    }
+
+    std::vector<tc::SimplePolyMesh>& m_meshes;
+    const std::vector<size_t>& m_order;
+    size_t m_next;
+};
+//------------------------------------------------------------------------------
+// Returns true if any ray in 'stream' reaches 'bounds' before the nearest hit
+// found for it so far.
+bool reachesBounds(const tc::RayStream& stream,
+                   const tc::RayStream_TraceResult& result,
+                   const tc::BoundsF& bounds)
+{
+    for (size_t ray = 0; ray != stream.size(); ++ray)
+    {
+        if (tc::intersect_segment_bounds(stream.getRay(ray),
+                                         result.m_distanceAlongRay[ray],
+                                         bounds))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
 }  // namespace
 
 namespace tc
 {
 
 //------------------------------------------------------------------------------
-// SimplePolyMesh
+// SimpleScene_Pager
 //------------------------------------------------------------------------------
-SimplePolyMesh::SimplePolyMesh()
+SimpleScene_Pager::Page::Page(const size_t proxy)
+    : m_proxy(proxy),
+      m_mesh(0),
+      m_memorySize(0),
+      m_users(0),
+      m_lastUse(0),
+      m_loading(false)
+{
+}
+
+//------------------------------------------------------------------------------
+SimpleScene_Pager::SimpleScene_Pager(ObjectIterator& objectIterator,
+                                     const size_t memoryBudget)
+    : m_objectIterator(objectIterator),
+      m_memoryBudget(memoryBudget),
+      m_clock(0),
+      m_memoryUsed(0)
+{
+}
+
+//------------------------------------------------------------------------------
+SimpleScene_Pager::~SimpleScene_Pager()
+{
+    for (size_t i = 0; i != m_pages.size(); ++i)
+    {
+        delete m_pages[i].m_mesh;
+    }
+    m_objectIterator.end();
+}
+
+//------------------------------------------------------------------------------
+void SimpleScene_Pager::addMesh(const size_t proxy)
+{
+    m_pages.push_back(Page(proxy));
+}
+
+//------------------------------------------------------------------------------
+const SimplePolyMesh& SimpleScene_Pager::acquire(const size_t index)
+{
+    assert(index < m_pages.size());
+    Page& page = m_pages[index];
+    for (;;)
+    {
+        {
+            RWLock_Read read(m_lock);
+            if (page.m_mesh)
+            {
+                // Threads racing here may store their times out of order,
+                // which only makes the page look slightly older.
+                __sync_fetch_and_add(&page.m_users, 1);
+                __sync_lock_test_and_set(&page.m_lastUse,
+                                         __sync_add_and_fetch(&m_clock, 1));
+                return *page.m_mesh;
+            }
+        }
+
+        bool shouldLoad = false;
+        {
+            RWLock_Write write(m_lock);
+            if (!page.m_mesh && !page.m_loading)
+            {
+                page.m_loading = true;
+                shouldLoad = true;
+            }
+        }
+        if (!shouldLoad)
+        {
+            yieldThread();
+            continue;
+        }
+
+        SimplePolyMesh* const mesh = load(page.m_proxy);
+        RWLock_Write write(m_lock);
+        page.m_mesh = mesh;
+        page.m_memorySize = mesh->getMemorySize();
+        page.m_loading = false;
+        page.m_users = 1;
+        page.m_lastUse = __sync_add_and_fetch(&m_clock, 1);
+        m_memoryUsed += page.m_memorySize;
+        evict();
+        return *mesh;
+    }
+}
+
+//------------------------------------------------------------------------------
+void SimpleScene_Pager::release(const size_t index)
 {
+    assert(index < m_pages.size());
+    __sync_fetch_and_sub(&m_pages[index].m_users, 1);
 }
 
 //------------------------------------------------------------------------------
-void SimplePolyMesh::addTriangle(const Triangle& newTriangle, const size_t index)
+bool SimpleScene_Pager::isLoaded(const size_t index) const
 {
-    // Add a new triangle
-    m_triangles.push_back(newTriangle);
-    const Triangle& triangle = m_triangles.back();
+    assert(index < m_pages.size());
+    RWLock_Read read(m_lock);
+    return m_pages[index].m_mesh != 0;
+}
+
+//------------------------------------------------------------------------------
+size_t SimpleScene_Pager::getMemoryUsed() const
+{
+    RWLock_Read read(m_lock);
+    return m_memoryUsed;
+}
 
-    // Add the triangle to the acceleration structure
-    m_triangleCache.addEntry(triangle.computeBounds(), index);
+//------------------------------------------------------------------------------
+SimplePolyMesh* SimpleScene_Pager::load(const size_t proxy) const
+{
+    SimplePolyMesh* const mesh = new SimplePolyMesh;
+    ObjectIterator_Mesh arrays;
+    m_objectIterator.loadMesh(proxy, arrays);
+    mesh->init(arrays);
+    mesh->build();
+    return mesh;
+}
 
-    // Add the triangles normal to our normals array
-    const Vector3<float> normal = triangle.computeNormal();
-    Vector3<float> tangent;
-    Vector3<float> bitangent;
-    normal.tangentAndBitangent(tangent, bitangent);
+//------------------------------------------------------------------------------
+void SimpleScene_Pager::evict()
+{
+    while (m_memoryUsed > m_memoryBudget)
+    {
+        Page* oldest = 0;
+        for (size_t i = 0; i != m_pages.size(); ++i)
+        {
+            Page& page = m_pages[i];
+            if (page.m_mesh && __sync_fetch_and_add(&page.m_users, 0) == 0 &&
+                (oldest == 0 || page.m_lastUse < oldest->m_lastUse))
+            {
+                oldest = &page;
+            }
+        }
+        if (oldest == 0)
+        {
+            return;
+        }
+        delete oldest->m_mesh;
+        oldest->m_mesh = 0;
+        m_memoryUsed -= oldest->m_memorySize;
+        oldest->m_memorySize = 0;
+    }
+}
 
-    m_surfaceFrames.push_back(SurfaceFrame(tangent, normal, bitangent));
+//------------------------------------------------------------------------------
+// SimplePolyMesh
+//------------------------------------------------------------------------------
+SimplePolyMesh::SimplePolyMesh()
+{
 }
 
 //------------------------------------------------------------------------------
 void SimplePolyMesh::init(TriangleIterator& triangleIterator)
 {
+    // Add each triangle to the acceleration structure, and keep its normal
+    // and corners. The triangles are read in batches, and if the iterator
+    // knows how many there are the arrays are only allocated once.
+    Vertices corners;
     triangleIterator.begin();
-    for (size_t i = 0; triangleIterator.next(); ++i)
+    const size_t sizeHint = triangleIterator.sizeHint();
+    corners.reserve(sizeHint * 3);
+    m_normals.reserve(sizeHint);
+    m_triangleCache.reserve(sizeHint);
+    Vector3<float> batch[kTriangleBatchSize * 3];
+    size_t count = 0;
+    while ((count = triangleIterator.nextBatch(batch, kTriangleBatchSize)) != 0)
     {
-        const Triangle tri = *triangleIterator;
-        addTriangle(tri, i);
+        for (size_t i = 0; i != count; ++i)
+        {
+            const Triangle triangle(batch[i * 3], batch[(i * 3) + 1],
+                                    batch[(i * 3) + 2]);
+            m_triangleCache.addEntry(triangle.computeBounds(),
+                                     m_normals.size());
+            m_boundsBuilder.expandBounds(triangle.m_a);
+            m_boundsBuilder.expandBounds(triangle.m_b);
+            m_boundsBuilder.expandBounds(triangle.m_c);
+            m_normals.push_back(triangle.computeNormal());
+        }
+        corners.insert(corners.end(), batch, batch + (count * 3));
     }
     triangleIterator.end();
-    m_triangleCache.sortTree();
+    assert(corners.size() <= 0xffffffffu);
+
+    // Sort the corners so the ones in the same place are next to each other.
+    // The sort is stable, so the first of each run is the first to appear.
+    Indices order(corners.size());
+    for (size_t i = 0; i != order.size(); ++i)
+    {
+        order[i] = static_cast<uint32_t>(i);
+    }
+    std::stable_sort(order.begin(), order.end(), CornerLess(corners));
+    Indices first(corners.size());
+    const CornerLess cornerLess(corners);
+    for (size_t i = 0; i != order.size(); ++i)
+    {
+        const bool shared = i != 0 && !cornerLess(order[i - 1], order[i]);
+        first[order[i]] = shared ? first[order[i - 1]] : order[i];
+    }
+
+    // Store each vertex once, in the order they first appear.
+    m_indices.resize(corners.size());
+    for (size_t i = 0; i != corners.size(); ++i)
+    {
+        if (first[i] == i)
+        {
+            m_indices[i] = static_cast<uint32_t>(m_vertices.size());
+            m_vertices.push_back(corners[i]);
+        }
+        else
+        {
+            m_indices[i] = m_indices[first[i]];
+        }
+    }
+    Vertices(m_vertices).swap(m_vertices);
+    if (m_normals.capacity() != m_normals.size())
+    {
+        Vertices(m_normals).swap(m_normals);
+    }
+
+    // An empty mesh is given empty bounds at the origin.
+    if (m_normals.empty())
+    {
+        m_boundsBuilder.expandBounds(Vector3<float>(0.0f));
+    }
+}
+
+//------------------------------------------------------------------------------
+void SimplePolyMesh::init(const ObjectIterator_Mesh& mesh)
+{
+    m_vertices.reserve(mesh.m_vertexCount);
+    for (size_t i = 0; i != mesh.m_vertexCount; ++i)
+    {
+        const float* const vertex = mesh.m_vertices + (i * 4);
+        m_vertices.push_back(Vector3<float>(vertex[0], vertex[1], vertex[2]));
+        m_boundsBuilder.expandBounds(m_vertices.back());
+    }
+    m_indices.assign(mesh.m_indices,
+                     mesh.m_indices + (mesh.m_triangleCount * 3));
+
+    // Only the acceleration structure needs the bounds of each triangle.
+    const bool loaded =
+        mesh.m_acceleration &&
+        m_triangleCache.deserialize(mesh.m_acceleration,
+                                    mesh.m_accelerationSize,
+                                    mesh.m_triangleCount);
+    m_normals.reserve(mesh.m_triangleCount);
+    for (size_t i = 0; i != mesh.m_triangleCount; ++i)
+    {
+        const uint32_t* const indices = &m_indices[i * 3];
+        const Triangle triangle(m_vertices[indices[0]], m_vertices[indices[1]],
+                                m_vertices[indices[2]]);
+        m_normals.push_back(triangle.computeNormal());
+        if (!loaded)
+        {
+            m_triangleCache.addEntry(triangle.computeBounds(), i);
+        }
+    }
+
+    // An empty mesh is given empty bounds at the origin.
+    if (m_normals.empty())
+    {
+        m_boundsBuilder.expandBounds(Vector3<float>(0.0f));
+    }
+}
+
+//------------------------------------------------------------------------------
+void SimplePolyMesh::build()
+{
+    if (!m_triangleCache.isSorted())
+    {
+        m_triangleCache.sortTree();
+    }
+}
+
+//------------------------------------------------------------------------------
+void SimplePolyMesh::getMesh(ObjectIterator_Mesh& mesh,
+                             std::vector<char>& acceleration) const
+{
+    mesh.m_vertices = m_vertices.empty()
+                          ? 0
+                          : reinterpret_cast<const float*>(&m_vertices[0]);
+    mesh.m_vertexCount = m_vertices.size();
+    mesh.m_indices = m_indices.empty() ? 0 : &m_indices[0];
+    mesh.m_triangleCount = m_normals.size();
+    acceleration.clear();
+    m_triangleCache.serialize(acceleration);
+    mesh.m_acceleration = &acceleration[0];
+    mesh.m_accelerationSize = acceleration.size();
+}
+
+//------------------------------------------------------------------------------
+size_t SimplePolyMesh::getTriangleCount() const
+{
+    return m_normals.size();
+}
+
+//------------------------------------------------------------------------------
+BoundsF SimplePolyMesh::getBounds() const
+{
+    return BoundsF(m_boundsBuilder);
+}
+
+//------------------------------------------------------------------------------
+size_t SimplePolyMesh::getMemorySize() const
+{
+    return sizeof(*this) + m_triangleCache.getMemorySize() +
+           (m_vertices.capacity() * sizeof(Vector3<float>)) +
+           (m_indices.capacity() * sizeof(uint32_t)) +
+           (m_normals.capacity() * sizeof(Vector3<float>));
 }
 
 //------------------------------------------------------------------------------
@@ -90,38 +474,180 @@ SimplePolyMesh::TraceResult SimplePolyMesh::geo_trace(SearchCache& searchCache,
 {
     // Ray Trace Results
     const KDTree_TraceResult result = m_triangleCache.findEntries(
-        searchCache, ray, TriangleIntersect(m_triangles));
+        searchCache, ray, TriangleIntersect(m_vertices, m_indices));
 
     return SimplePolyMesh::TraceResult(result.m_distanceAlongRay,
                                        result.m_elementIndex);
 }
 
 //------------------------------------------------------------------------------
-const SurfaceFrame& SimplePolyMesh::shade_getSurfaceFrame(
-    const size_t elementIndex) const
+KDTree_PacketTraceResult SimplePolyMesh::geo_tracePacket(
+    SearchCache& searchCache, const RayPacket& packet) const
+{
+    return m_triangleCache.findEntries(
+        searchCache, packet, TriangleIntersect(m_vertices, m_indices));
+}
+
+//------------------------------------------------------------------------------
+void SimplePolyMesh::geo_traceStream(SearchCache& searchCache,
+                                     const RayStream& stream,
+                                     KDTree_StreamTraceResult& result) const
+{
+    m_triangleCache.findEntries(searchCache, stream,
+                                TriangleIntersect(m_vertices, m_indices),
+                                result);
+}
+
+//------------------------------------------------------------------------------
+bool SimplePolyMesh::geo_occluded(SearchCache& searchCache, const Ray& ray,
+                                  const float maxDistance) const
+{
+    return m_triangleCache.findAnyEntry(
+        searchCache, ray, maxDistance,
+        TriangleIntersect(m_vertices, m_indices));
+}
+
+//------------------------------------------------------------------------------
+// SimpleScene_Light
+//------------------------------------------------------------------------------
+SimpleScene_Light::SimpleScene_Light()
+    : m_position(0.0f, 0.0f, 0.0f),
+      m_radius(globalSphereRadius),
+      m_intensity(globalLightIntensity)
 {
-    assert(elementIndex < m_surfaceFrames.size());
-    const SurfaceFrame& surfaceFrame = m_surfaceFrames[elementIndex];
-    return surfaceFrame;
 }
 
 //------------------------------------------------------------------------------
 // SimpleScene
 //------------------------------------------------------------------------------
-SimpleScene::SimpleScene(ObjectIterator& objectIterator)
+SimpleScene::SimpleScene(ObjectIterator& objectIterator,
+                         const size_t memoryBudget,
+                         const SimpleScene_Light& light)
+    : m_pager(0),
+      m_light(light),
+      m_lightEmitter(0),
+      m_lightShader(light.m_intensity)
 {
     // Build up a list of polygon meshes
     objectIterator.begin();
     while (objectIterator.next())
     {
         objectIterator.recurseIntoChildren(true);
-        if (objectIterator.hasTriangles())
+        if (!objectIterator.hasTriangles())
+        {
+            continue;
+        }
+
+        // Keep just the bounds of a mesh that can be loaded later. They are
+        // grown by the same amount as the bounds of a loaded mesh, so rays
+        // skip the same meshes either way.
+        size_t proxy = 0;
+        if (memoryBudget != 0 && m_simplePolyMeshes.empty() &&
+            objectIterator.getProxy(proxy))
+        {
+            if (!m_pager)
+            {
+                m_pager = new SimpleScene_Pager(objectIterator, memoryBudget);
+            }
+            m_pager->addMesh(proxy);
+            const BoundsF& bounds = objectIterator.getBounds();
+            BoundsBuilderF boundsBuilder;
+            boundsBuilder.expandBounds(bounds.m_min);
+            boundsBuilder.expandBounds(bounds.m_max);
+            m_simplePolyMeshBounds.push_back(BoundsF(boundsBuilder));
+            continue;
+        }
+        assert(!m_pager);
+
+        m_simplePolyMeshes.resize(m_simplePolyMeshes.size() + 1);
+        ObjectIterator_Mesh mesh;
+        if (objectIterator.getMesh(mesh))
+        {
+            m_simplePolyMeshes.back().init(mesh);
+        }
+        else
         {
-            m_simplePolyMeshes.resize(m_simplePolyMeshes.size() + 1);
             m_simplePolyMeshes.back().init(objectIterator.getTriangles());
         }
+
+        // Build while the next mesh is being read.
+        if (objectIterator.isStreaming())
+        {
+            m_simplePolyMeshes.back().build();
+        }
     }
-    objectIterator.end();
+
+    // Meshes that are loaded on demand are built as they are loaded, and
+    // the iteration is ended when m_pager is destroyed.
+    if (!m_pager)
+    {
+        objectIterator.end();
+
+        // Build the largest meshes first, so the threads finish together.
+        std::vector<std::pair<size_t, size_t> > sizes;
+        for (size_t i = 0; i != m_simplePolyMeshes.size(); ++i)
+        {
+            m_simplePolyMeshBounds.push_back(m_simplePolyMeshes[i].getBounds());
+            sizes.push_back(
+                std::make_pair(m_simplePolyMeshes[i].getTriangleCount(), i));
+        }
+        std::stable_sort(sizes.begin(), sizes.end(),
+                         std::greater<std::pair<size_t, size_t> >());
+        std::vector<size_t> order;
+        for (size_t i = 0; i != sizes.size(); ++i)
+        {
+            order.push_back(sizes[i].second);
+        }
+
+        const size_t threadCount = std::min(getNumProcs(), order.size());
+        if (threadCount <= 1)
+        {
+            for (size_t i = 0; i != order.size(); ++i)
+            {
+                m_simplePolyMeshes[order[i]].build();
+            }
+        }
+        else
+        {
+            BuildThreads threads(m_simplePolyMeshes, order, threadCount);
+            threads.start();
+            threads.join();
+        }
+    }
+
+    // The light sphere is reported as the object after the last mesh.
+    m_lightEmitter = new SphereEmitter(m_light.m_position, m_light.m_radius,
+                                       getMeshCount() + 1);
+}
+
+//------------------------------------------------------------------------------
+SimpleScene::~SimpleScene()
+{
+    delete m_pager;
+    delete m_lightEmitter;
+}
+
+//------------------------------------------------------------------------------
+bool SimpleScene::write(const char* filename) const
+{
+    // The meshes are written below a single transform, as the hierarchy
+    // they came from isn't kept.
+    if (m_pager)
+    {
+        return false;
+    }
+    Bin_Writer writer;
+    const size_t root = writer.addXform("root", Bin_Node::kNoParent);
+    std::vector<std::vector<char> > accelerations(m_simplePolyMeshes.size());
+    for (size_t i = 0; i != m_simplePolyMeshes.size(); ++i)
+    {
+        ObjectIterator_Mesh mesh;
+        m_simplePolyMeshes[i].getMesh(mesh, accelerations[i]);
+        std::ostringstream name;
+        name << "mesh" << i;
+        writer.addPolyMesh(name.str().c_str(), root, mesh);
+    }
+    return writer.write(filename);
 }
 
 //------------------------------------------------------------------------------
@@ -132,49 +658,213 @@ TraceResult SimpleScene::geo_trace(SearchCache& searchCache,
     float resultDistanceAlongRay = FLT_MAX;
     size_t resultObjectIndex = 0;
     size_t resultElementIndex = 0;
+    Vector3<float> resultNormal(0.0f);
 
-    // Test against all the polygon meshes in the scene.
-    // TODO LT: Replace this with accel structure.
-    for (size_t i = 0; i != m_simplePolyMeshes.size(); ++i)
+    // Test against all the polygon meshes in the scene, skipping those that
+    // are missed or are behind the nearest hit so far. The normal of a hit is
+    // kept while its mesh is acquired, so it needn't be acquired to shade it.
+    for (size_t i = 0; i != getMeshCount(); ++i)
     {
+        if (!intersect_segment_bounds(ray, resultDistanceAlongRay,
+                                      m_simplePolyMeshBounds[i]))
+        {
+            continue;
+        }
+        const SimplePolyMesh& mesh = acquireMesh(i);
         SimplePolyMesh::TraceResult traceResult =
-            m_simplePolyMeshes[i].geo_trace(searchCache, ray);
+            mesh.geo_trace(searchCache, ray);
         if (traceResult.m_distanceAlongRay < resultDistanceAlongRay)
         {
             resultDistanceAlongRay = traceResult.m_distanceAlongRay;
             resultObjectIndex = i + 1;
             resultElementIndex = traceResult.m_elementIndex;
+            resultNormal = mesh.getNormal(resultElementIndex);
         }
+        releaseMesh(i);
     }
 
-    // Intersect with a light sphere around our scene.
-    const float globalSphereRadius = 20.0f;
-    if (intersect_sphere(resultDistanceAlongRay, ray, globalSphereRadius))
+    // Intersect with the light sphere.
+    if (intersect_sphere(resultDistanceAlongRay, ray, m_light.m_position,
+                         m_light.m_radius))
     {
-        resultObjectIndex = m_simplePolyMeshes.size() + 1;
+        resultObjectIndex = getMeshCount() + 1;
         resultElementIndex = 0;
+        resultNormal = Vector3<float>(0.0f);
     }
 
     return TraceResult(resultDistanceAlongRay,
-                       GeoID(resultObjectIndex, resultElementIndex));
+                       GeoID(resultObjectIndex, resultElementIndex),
+                       resultNormal);
+}
+
+//------------------------------------------------------------------------------
+RayPacket_TraceResult SimpleScene::geo_tracePacket(
+    SearchCache& searchCache, const RayPacket& packet) const
+{
+    RayPacket_TraceResult result;
+
+    // Test against all the polygon meshes in the scene, keeping the nearest
+    // hit for each ray.
+    for (size_t i = 0; i != getMeshCount(); ++i)
+    {
+        if (intersect_bounds(packet, m_simplePolyMeshBounds[i],
+                             packet.getMask()) == 0)
+        {
+            continue;
+        }
+        const SimplePolyMesh& mesh = acquireMesh(i);
+        const KDTree_PacketTraceResult traceResult =
+            mesh.geo_tracePacket(searchCache, packet);
+        for (size_t lane = 0; lane != RayPacket::kSize; ++lane)
+        {
+            if (traceResult.m_distanceAlongRay[lane] <
+                result.m_distanceAlongRay[lane])
+            {
+                result.m_distanceAlongRay[lane] =
+                    traceResult.m_distanceAlongRay[lane];
+                result.m_objectIndex[lane] = i + 1;
+                result.m_elementIndex[lane] = traceResult.m_elementIndex[lane];
+                result.m_normal[lane] =
+                    mesh.getNormal(traceResult.m_elementIndex[lane]);
+            }
+        }
+        releaseMesh(i);
+    }
+
+    // Intersect with the light sphere.
+    for (size_t lane = 0; lane != RayPacket::kSize; ++lane)
+    {
+        if ((packet.getMask() & (1 << lane)) &&
+            intersect_sphere(result.m_distanceAlongRay[lane],
+                             packet.getRay(lane), m_light.m_position,
+                             m_light.m_radius))
+        {
+            result.m_objectIndex[lane] = getMeshCount() + 1;
+            result.m_elementIndex[lane] = 0;
+            result.m_normal[lane] = Vector3<float>(0.0f);
+        }
+    }
+
+    return result;
+}
+
+//------------------------------------------------------------------------------
+void SimpleScene::geo_traceStream(SearchCache& searchCache,
+                                  const RayStream& stream,
+                                  RayStream_TraceResult& result) const
+{
+    const size_t rayCount = stream.size();
+    result.reset(rayCount);
+
+    // Test against all the polygon meshes in the scene, keeping the nearest
+    // hit for each ray.
+    KDTree_StreamTraceResult& traceResult = searchCache.m_streamTraceResult;
+    for (size_t i = 0; i != getMeshCount(); ++i)
+    {
+        // A mesh that is loaded on demand isn't loaded unless a ray reaches
+        // it.
+        if (m_pager &&
+            !reachesBounds(stream, result, m_simplePolyMeshBounds[i]))
+        {
+            continue;
+        }
+        const SimplePolyMesh& mesh = acquireMesh(i);
+        mesh.geo_traceStream(searchCache, stream, traceResult);
+        for (size_t ray = 0; ray != rayCount; ++ray)
+        {
+            if (traceResult.m_distanceAlongRay[ray] <
+                result.m_distanceAlongRay[ray])
+            {
+                result.m_distanceAlongRay[ray] =
+                    traceResult.m_distanceAlongRay[ray];
+                result.m_objectIndex[ray] = i + 1;
+                result.m_elementIndex[ray] = traceResult.m_elementIndex[ray];
+                result.m_normal[ray] =
+                    mesh.getNormal(traceResult.m_elementIndex[ray]);
+            }
+        }
+        releaseMesh(i);
+    }
+
+    // Intersect with the light sphere.
+    for (size_t ray = 0; ray != rayCount; ++ray)
+    {
+        if (intersect_sphere(result.m_distanceAlongRay[ray],
+                             stream.getRay(ray), m_light.m_position,
+                             m_light.m_radius))
+        {
+            result.m_objectIndex[ray] = getMeshCount() + 1;
+            result.m_elementIndex[ray] = 0;
+            result.m_normal[ray] = Vector3<float>(0.0f);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+bool SimpleScene::geo_occluded(SearchCache& searchCache, const Ray& ray,
+                               const float maxDistance) const
+{
+    for (size_t i = 0; i != getMeshCount(); ++i)
+    {
+        if (!intersect_segment_bounds(ray, maxDistance,
+                                      m_simplePolyMeshBounds[i]))
+        {
+            continue;
+        }
+        const bool occluded =
+            acquireMesh(i).geo_occluded(searchCache, ray, maxDistance);
+        releaseMesh(i);
+        if (occluded)
+        {
+            return true;
+        }
+    }
+
+    float distanceAlongRay = maxDistance;
+    return intersect_sphere(distanceAlongRay, ray, m_light.m_position,
+                            m_light.m_radius) &&
+           distanceAlongRay < maxDistance;
 }
 
 //------------------------------------------------------------------------------
-const SurfaceFrame& SimpleScene::shade_getSurfaceFrame(const GeoID& geoID) const
+const SimplePolyMesh& SimpleScene::acquirePagedMesh(const size_t index) const
 {
-    assert(geoID.m_objectIndex <= m_simplePolyMeshes.size());
-    return m_simplePolyMeshes[geoID.m_objectIndex - 1]
-        .shade_getSurfaceFrame(geoID.m_elementIndex);
+    return m_pager->acquire(index);
+}
+
+//------------------------------------------------------------------------------
+void SimpleScene::releasePagedMesh(const size_t index) const
+{
+    m_pager->release(index);
+}
+
+//------------------------------------------------------------------------------
+SurfaceFrame SimpleScene::shade_getSurfaceFrame(const GeoID& geoID) const
+{
+    return getSurfaceFrame(geoID);
 }
 
 //------------------------------------------------------------------------------
 const Shader& SimpleScene::shade_getSurfaceShader(const GeoID& geoID) const
 {
-    if (geoID.m_objectIndex == (m_simplePolyMeshes.size() + 1))
+    if (isLight(geoID))
     {
-        return shadersWhiteLight;
+        return m_lightShader;
     }
-    return shadersDiffuse;
+    return m_diffuseShader;
+}
+
+//------------------------------------------------------------------------------
+size_t SimpleScene::shade_getEmitterCount() const
+{
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+const Emitter* SimpleScene::shade_getEmitter(const size_t index) const
+{
+    assert(index == 0);
+    return m_lightEmitter;
 }
 
 }  // namespace tc
@@ -5,4 +5,52 @@
 
 namespace tc
 {
+
+//------------------------------------------------------------------------------
+// CosineDirectionTable
+//------------------------------------------------------------------------------
+CosineDirectionTable::CosineDirectionTable(const float pitchAngleRange,
+                                           const size_t yawSamples,
+                                           const size_t pitchSamples)
+    : m_cosPitchLower(cos(1.0f - pitchAngleRange)),
+      m_cosPitchUpper(cos((1.0f - pitchAngleRange) +
+                          (pitchAngleRange * M_PI_2l))),
+      m_sinPitchLower(sin(1.0f - pitchAngleRange)),
+      m_sinPitchUpper(sin((1.0f - pitchAngleRange) +
+                          (pitchAngleRange * M_PI_2l))),
+      m_sinPitchStep((m_sinPitchUpper - m_sinPitchLower) /
+                     static_cast<float>(pitchSamples)),
+      // The ratio of the uniform pitch density to the cosine pitch density.
+      m_weightScale((m_sinPitchUpper - m_sinPitchLower) /
+                    (pitchAngleRange * M_PI_2l)),
+      // Keep every bin within 45 degrees.
+      m_yawSubdivisions((8 + yawSamples - 1) / yawSamples),
+      m_yawBinHalfWidth(M_PI /
+                        static_cast<float>(yawSamples * m_yawSubdivisions)),
+      m_cosYaw(yawSamples * m_yawSubdivisions),
+      m_sinYaw(yawSamples * m_yawSubdivisions)
+{
+    for (size_t i = 0; i != m_cosYaw.size(); ++i)
+    {
+        const float yaw =
+            m_yawBinHalfWidth * static_cast<float>((i * 2) + 1);
+        m_cosYaw[i] = cos(yaw);
+        m_sinYaw[i] = sin(yaw);
+    }
+}
+
+//------------------------------------------------------------------------------
+float CosineDirectionTable::computePdf(const float cosTheta) const
+{
+    // The pitch density is cos(pitch) / (sinPitchUpper - sinPitchLower). The
+    // solid angle density divides this by sin(pitch) and the yaw range.
+    if (cosTheta > m_cosPitchLower || cosTheta < m_cosPitchUpper)
+    {
+        return 0.0f;
+    }
+    const float sinPitch = sqrt(1.0f - (cosTheta * cosTheta));
+    return cosTheta /
+           (2.0f * M_PI * (m_sinPitchUpper - m_sinPitchLower) * sinPitch);
+}
+
 }  // namespace tc
@@ -0,0 +1,362 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/biniterator.h"
+#include "trace/log.h"
+#include "trace/test.h"
+//------------------------------------------------------------------------------
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Returns the name of a new, empty temporary file.
+std::string makeTemporaryFile()
+{
+    char filename[] = "/tmp/test_biniteratorXXXXXX";
+    const int file = mkstemp(filename);
+    if (file == -1)
+    {
+        return std::string();
+    }
+    close(file);
+    return std::string(filename);
+}
+
+//------------------------------------------------------------------------------
+// Counts the triangles of every poly mesh visited by 'iterator', recursing
+// into the children of every node.
+size_t countTriangles(tc::Bin_ObjectIterator& iterator)
+{
+    size_t count = 0;
+    iterator.begin();
+    while (iterator.next())
+    {
+        iterator.recurseIntoChildren(true);
+        tc::TriangleIterator& triangles = iterator.getTriangles();
+        triangles.begin();
+        while (triangles.next())
+        {
+            ++count;
+        }
+        triangles.end();
+    }
+    iterator.end();
+    return count;
+}
+
+//------------------------------------------------------------------------------
+// Reads every triangle of 'iterator' one at a time.
+std::vector<tc::Triangle> readTriangles(tc::TriangleIterator& iterator)
+{
+    std::vector<tc::Triangle> triangles;
+    iterator.begin();
+    while (iterator.next())
+    {
+        triangles.push_back(*iterator);
+    }
+    iterator.end();
+    return triangles;
+}
+
+//------------------------------------------------------------------------------
+// Reads every triangle of 'iterator' with tc::TriangleIterator::nextBatch,
+// 'capacity' at a time. 'sizeHint' is set to the hint given after begin, and
+// 'fits' to whether every batch fitted in 'capacity'.
+std::vector<tc::Triangle> readBatches(tc::TriangleIterator& iterator,
+                                      const size_t capacity, size_t& sizeHint,
+                                      bool& fits)
+{
+    std::vector<tc::Vector3<float> > corners(capacity * 3);
+    std::vector<tc::Triangle> triangles;
+    iterator.begin();
+    sizeHint = iterator.sizeHint();
+    fits = true;
+    size_t count = 0;
+    while ((count = iterator.nextBatch(&corners[0], capacity)) != 0)
+    {
+        fits = fits && count <= capacity;
+        for (size_t i = 0; i != count; ++i)
+        {
+            triangles.push_back(tc::Triangle(corners[i * 3],
+                                             corners[(i * 3) + 1],
+                                             corners[(i * 3) + 2]));
+        }
+    }
+    iterator.end();
+    return triangles;
+}
+
+//------------------------------------------------------------------------------
+bool isSame(const std::vector<tc::Triangle>& a,
+            const std::vector<tc::Triangle>& b)
+{
+    bool matches = a.size() == b.size();
+    for (size_t i = 0; matches && i != a.size(); ++i)
+    {
+        matches = a[i].m_a == b[i].m_a && a[i].m_b == b[i].m_b &&
+                  a[i].m_c == b[i].m_c;
+    }
+    return matches;
+}
+
+//------------------------------------------------------------------------------
+void roundTrip(const tc::LogContext& logContext)
+{
+    /// [test_biniterator roundTrip]
+    // Two triangles sharing an edge, and a single triangle above them.
+    const float square[] = {0, 0, 0, 0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 1, 0, 0};
+    const uint32_t squareIndices[] = {0, 1, 2, 0, 2, 3};
+    const float roof[] = {0, 2, 0, 0, 1, 2, 0, 0, 0, 2, 1, 0};
+    const uint32_t roofIndices[] = {0, 1, 2};
+
+    tc::ObjectIterator_Mesh squareMesh;
+    squareMesh.m_vertices = square;
+    squareMesh.m_vertexCount = 4;
+    squareMesh.m_indices = squareIndices;
+    squareMesh.m_triangleCount = 2;
+    tc::ObjectIterator_Mesh roofMesh;
+    roofMesh.m_vertices = roof;
+    roofMesh.m_vertexCount = 3;
+    roofMesh.m_indices = roofIndices;
+    roofMesh.m_triangleCount = 1;
+
+    // The roof is added before the transform it belongs to is finished, so
+    // the writer has to put the nodes in depth first order.
+    tc::Bin_Writer writer;
+    const size_t house = writer.addXform("house", tc::Bin_Node::kNoParent);
+    const size_t walls = writer.addXform("walls", house);
+    writer.addPolyMesh("roof", house, roofMesh);
+    writer.addPolyMesh("floor", walls, squareMesh);
+    writer.addXform("empty", tc::Bin_Node::kNoParent);
+
+    const std::string filename = makeTemporaryFile();
+    TC_IS(logContext, !filename.empty());
+    TC_IS(logContext, writer.write(filename.c_str()));
+
+    tc::Bin_ObjectIterator iterator;
+    iterator.setFilename(filename.c_str());
+
+    // Every node is visited depth first, and the bounds of a transform hold
+    // all the meshes below it.
+    std::vector<std::string> names;
+    std::vector<float> maxY;
+    iterator.begin();
+    while (iterator.next())
+    {
+        iterator.recurseIntoChildren(true);
+        names.push_back(iterator.getName());
+        maxY.push_back(iterator.getBounds().m_max.y);
+    }
+    iterator.end();
+    TC_IS(logContext, names.size() == 5);
+    if (names.size() == 5)
+    {
+        TC_IS(logContext, names[0] == "house" && maxY[0] == 2.0f);
+        TC_IS(logContext, names[1] == "walls" && maxY[1] == 1.0f);
+        TC_IS(logContext, names[2] == "floor" && maxY[2] == 1.0f);
+        TC_IS(logContext, names[3] == "roof" && maxY[3] == 2.0f);
+        TC_IS(logContext, names[4] == "empty" && maxY[4] == 0.0f);
+    }
+
+    // Without recursing, only the transforms at the top are visited.
+    names.clear();
+    iterator.begin();
+    while (iterator.next())
+    {
+        names.push_back(iterator.getName());
+        TC_IS(logContext, !iterator.hasTriangles());
+    }
+    iterator.end();
+    TC_IS(logContext, names.size() == 2);
+
+    // The triangles and arrays of a mesh come back as they were written.
+    TC_IS(logContext, countTriangles(iterator) == 3);
+    bool matches = false;
+    iterator.begin();
+    while (iterator.next())
+    {
+        iterator.recurseIntoChildren(true);
+        tc::ObjectIterator_Mesh mesh;
+        if (strcmp(iterator.getName(), "floor") == 0 &&
+            iterator.getMesh(mesh))
+        {
+            matches =
+                mesh.m_vertexCount == 4 && mesh.m_triangleCount == 2 &&
+                mesh.m_acceleration == 0 &&
+                std::memcmp(mesh.m_vertices, square, sizeof(square)) == 0 &&
+                std::memcmp(mesh.m_indices, squareIndices,
+                            sizeof(squareIndices)) == 0;
+
+            tc::TriangleIterator& triangles = iterator.getTriangles();
+            triangles.begin();
+            matches = matches && triangles.next() &&
+                      (*triangles).m_c == tc::Vector3<float>(1.0f, 1.0f, 0.0f);
+            triangles.end();
+        }
+    }
+    iterator.end();
+    TC_IS(logContext, matches);
+
+    // A mesh can be loaded again from its proxy, after the iterator has moved
+    // past it, but transforms have no mesh to load.
+    size_t floorProxy = 0;
+    size_t houseProxy = 0;
+    iterator.begin();
+    while (iterator.next())
+    {
+        iterator.recurseIntoChildren(true);
+        if (strcmp(iterator.getName(), "floor") == 0)
+        {
+            TC_IS(logContext, iterator.getProxy(floorProxy));
+        }
+        else if (strcmp(iterator.getName(), "house") == 0)
+        {
+            TC_IS(logContext, iterator.getProxy(houseProxy));
+        }
+    }
+    tc::ObjectIterator_Mesh floorMesh;
+    TC_IS(logContext, iterator.loadMesh(floorProxy, floorMesh) &&
+                          floorMesh.m_triangleCount == 2 &&
+                          std::memcmp(floorMesh.m_indices, squareIndices,
+                                      sizeof(squareIndices)) == 0);
+    tc::ObjectIterator_Mesh houseMesh;
+    TC_IS(logContext, !iterator.loadMesh(houseProxy, houseMesh));
+    TC_IS(logContext, !iterator.loadMesh(99, houseMesh));
+    iterator.end();
+
+    unlink(filename.c_str());
+    /// [test_biniterator roundTrip]
+}
+
+//------------------------------------------------------------------------------
+void reject(const tc::LogContext& logContext)
+{
+    /// [test_biniterator reject]
+    const float vertices[] = {0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0};
+    const uint32_t indices[] = {0, 1, 2};
+    tc::ObjectIterator_Mesh mesh;
+    mesh.m_vertices = vertices;
+    mesh.m_vertexCount = 3;
+    mesh.m_indices = indices;
+    mesh.m_triangleCount = 1;
+    tc::Bin_Writer writer;
+    writer.addPolyMesh("triangle", tc::Bin_Node::kNoParent, mesh);
+
+    const std::string filename = makeTemporaryFile();
+    TC_IS(logContext, writer.write(filename.c_str()));
+    tc::Bin_ObjectIterator iterator;
+    iterator.setFilename(filename.c_str());
+    TC_IS(logContext, countTriangles(iterator) == 1);
+
+    // A file from another version has no nodes.
+    FILE* file = fopen(filename.c_str(), "r+b");
+    TC_IS(logContext, file != 0);
+    if (file)
+    {
+        const uint32_t version = tc::Bin_Header::kVersion + 1;
+        fseek(file, offsetof(tc::Bin_Header, m_version), SEEK_SET);
+        fwrite(&version, sizeof(version), 1, file);
+        fclose(file);
+    }
+    TC_IS(logContext, countTriangles(iterator) == 0);
+
+    // As does a file with an index past the end of the vertices.
+    const uint32_t badIndices[] = {0, 1, 3};
+    mesh.m_indices = badIndices;
+    tc::Bin_Writer badWriter;
+    badWriter.addPolyMesh("triangle", tc::Bin_Node::kNoParent, mesh);
+    TC_IS(logContext, badWriter.write(filename.c_str()));
+    TC_IS(logContext, countTriangles(iterator) == 0);
+
+    // Or that has been cut short, or is missing.
+    TC_IS(logContext, writer.write(filename.c_str()));
+    TC_IS(logContext, truncate(filename.c_str(), 100) == 0);
+    TC_IS(logContext, countTriangles(iterator) == 0);
+    unlink(filename.c_str());
+    TC_IS(logContext, countTriangles(iterator) == 0);
+    /// [test_biniterator reject]
+}
+
+//------------------------------------------------------------------------------
+void batches(const tc::LogContext& logContext)
+{
+    /// [test_biniterator batches]
+    // A fan of triangles around the first vertex, whose corners are told
+    // apart by their x coordinate.
+    const size_t triangleCount = 20;
+    float vertices[(triangleCount + 2) * 4] = {};
+    uint32_t indices[triangleCount * 3];
+    for (size_t i = 0; i != triangleCount + 2; ++i)
+    {
+        vertices[i * 4] = static_cast<float>(i);
+        vertices[(i * 4) + 1] = static_cast<float>(i % 2);
+    }
+    for (size_t i = 0; i != triangleCount; ++i)
+    {
+        indices[i * 3] = 0;
+        indices[(i * 3) + 1] = static_cast<uint32_t>(i + 1);
+        indices[(i * 3) + 2] = static_cast<uint32_t>(i + 2);
+    }
+    tc::ObjectIterator_Mesh mesh;
+    mesh.m_vertices = vertices;
+    mesh.m_vertexCount = triangleCount + 2;
+    mesh.m_indices = indices;
+    mesh.m_triangleCount = triangleCount;
+
+    // Reading in batches gives the same triangles as reading one at a time,
+    // whichever the capacity. The hint is exact.
+    tc::Bin_TriangleIterator iterator;
+    iterator.setMesh(mesh);
+    const std::vector<tc::Triangle> triangles = readTriangles(iterator);
+    TC_IS(logContext, triangles.size() == triangleCount);
+    bool matches = true;
+    bool hintsMatch = true;
+    for (size_t capacity = 1; capacity != 12; ++capacity)
+    {
+        size_t sizeHint = 0;
+        bool fits = false;
+        matches = matches &&
+                  isSame(readBatches(iterator, capacity, sizeHint, fits),
+                         triangles) &&
+                  fits;
+        hintsMatch = hintsMatch && sizeHint == triangleCount;
+    }
+    TC_IS(logContext, matches);
+    TC_IS(logContext, hintsMatch);
+
+    // A batch carries on from the triangle next moved onto, and the last
+    // batch is cut short.
+    iterator.begin();
+    TC_IS(logContext, iterator.next());
+    TC_IS(logContext, (*iterator).m_c == triangles[0].m_c);
+    TC_IS(logContext, iterator.sizeHint() == triangleCount - 1);
+    tc::Vector3<float> corners[triangleCount * 3];
+    TC_IS(logContext, iterator.nextBatch(corners, 3) == 3);
+    TC_IS(logContext, corners[0] == triangles[1].m_a &&
+                          corners[8] == triangles[3].m_c);
+    TC_IS(logContext, iterator.nextBatch(corners, triangleCount) ==
+                          triangleCount - 4);
+    TC_IS(logContext, corners[((triangleCount - 4) * 3) - 1] ==
+                          triangles[triangleCount - 1].m_c);
+    TC_IS(logContext, iterator.sizeHint() == 0);
+    TC_IS(logContext, iterator.nextBatch(corners, triangleCount) == 0);
+    iterator.end();
+    /// [test_biniterator batches]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::biniteratorRunUnitTests(const tc::LogContext& logContext)
+{
+    roundTrip(logContext);
+    reject(logContext);
+    batches(logContext);
+}
@@ -0,0 +1,96 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/emitter.h"
+#include "trace/log.h"
+#include "trace/test.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool isClose(const float a, const float b, const float tolerance)
+{
+    return std::fabs(a - b) <= tolerance * std::max(1.0f, std::fabs(b));
+}
+
+//------------------------------------------------------------------------------
+// Checks that each sample, on a grid, lands on the near side of the sphere as
+// seen from 'position', and has the pdf tc::Emitter::pdf gives for it.
+bool isSampledOnSphere(const tc::SphereEmitter& emitter,
+                       const tc::Vector3<float>& centre, const float radius,
+                       const tc::Vector3<float>& position)
+{
+    const float solidAngle = emitter.computeSolidAngle(position);
+    const size_t steps = 16;
+    for (size_t i = 0; i != steps; ++i)
+    {
+        for (size_t j = 0; j != steps; ++j)
+        {
+            const tc::Vector3<float> sample((i + 0.5f) / steps,
+                                            (j + 0.5f) / steps);
+            const tc::EmitterSample emitterSample =
+                emitter.sample(position, sample);
+            const tc::Vector3<float> pointOnSphere =
+                position +
+                (emitterSample.m_direction * emitterSample.m_distance);
+            const tc::Vector3<float> normal = pointOnSphere - centre;
+            const float pdf =
+                emitter.pdf(position, emitterSample.m_direction,
+                            emitterSample.m_distance);
+            if (emitterSample.m_distance <= 0.0f ||
+                !isClose(normal.mag(), radius, 0.001f) ||
+                normal.dot(emitterSample.m_direction) > 0.0f ||
+                !isClose(emitterSample.m_pdf, 1.0f / solidAngle, 0.001f) ||
+                !isClose(pdf, emitterSample.m_pdf, 0.001f))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void sphere(const tc::LogContext& logContext)
+{
+    /// [test_emitter sphere]
+    const tc::Vector3<float> centre(1.0f, 2.0f, 3.0f);
+    const tc::SphereEmitter emitter(centre, 0.5f, 7);
+    TC_IS(logContext, emitter.contains(tc::GeoID(7, 0)));
+    TC_IS(logContext, !emitter.contains(tc::GeoID(6, 0)));
+
+    // From inside, the sphere is seen in every direction, and the front of it
+    // is sampled.
+    const tc::Vector3<float> inside(1.1f, 2.2f, 3.0f);
+    TC_IS(logContext,
+          isClose(emitter.computeSolidAngle(inside), 4.0f * M_PI, 0.001f));
+    const tc::EmitterSample emitterSample =
+        emitter.sample(inside, tc::Vector3<float>(0.3f, 0.6f));
+    const tc::Vector3<float> pointOnSphere =
+        inside + (emitterSample.m_direction * emitterSample.m_distance);
+    TC_IS(logContext, emitterSample.m_distance > 0.0f &&
+                          isClose((pointOnSphere - centre).mag(), 0.5f,
+                                  0.001f));
+
+    // From outside, only the cone of directions that hit it is sampled. Far
+    // away, it covers about pi * radius^2 / distance^2.
+    const tc::Vector3<float> near(1.0f, 2.0f, 4.0f);
+    const tc::Vector3<float> far(1.0f, 2.0f, 503.0f);
+    TC_IS(logContext, isClose(emitter.computeSolidAngle(far),
+                              M_PI * 0.25f / (500.0f * 500.0f), 0.001f));
+    TC_IS(logContext, isSampledOnSphere(emitter, centre, 0.5f, near));
+    TC_IS(logContext, isSampledOnSphere(emitter, centre, 0.5f, far));
+    /// [test_emitter sphere]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::emitterRunUnitTests(const tc::LogContext& logContext)
+{
+    sphere(logContext);
+}
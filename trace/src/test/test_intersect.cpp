@@ -5,6 +5,7 @@
 #include "trace/intersect.h"
 #include "trace/log.h"
 #include "trace/ray.h"
+#include "trace/raypacket.h"
 #include "trace/test.h"
 #include "trace/triangle.h"
 //------------------------------------------------------------------------------
@@ -116,6 +117,60 @@ void boundingBox(const tc::LogContext& logContext)
     /// [test_intersect boundingBox]
 }
 
+//------------------------------------------------------------------------------
+void segmentBoundingBox(const tc::LogContext& logContext)
+{
+    /// [test_intersect segmentBoundingBox]
+    // The box is between 1 and 3 along the ray.
+    const tc::Ray ray(tc::Vector3<float>(0.0f, 0.0f, 1.0f),
+                      tc::Vector3<float>(0.0f, 0.0f, -2.0f));
+    const tc::Vector3<float> max(1.0f, 1.0f, 1.0f);
+    const tc::Vector3<float> min(-1.0f, -1.0f, -1.0f);
+    const tc::BoundsF bounds(min, max);
+    TC_IS(logContext, tc::intersect_segment_bounds(ray, 2.0f, bounds));
+    TC_IS(logContext, !tc::intersect_segment_bounds(ray, 0.5f, bounds));
+    /// [test_intersect segmentBoundingBox]
+}
+
+//------------------------------------------------------------------------------
+void boundingBoxPacket(const tc::LogContext& logContext)
+{
+    /// [test_intersect boundingBoxPacket]
+    const tc::Vector3<float> max(1.0f, 1.0f, 1.0f);
+    const tc::Vector3<float> min(-1.0f, -1.0f, -1.0f);
+    const tc::BoundsF bounds(min, max);
+
+    tc::RayPacket packet;
+    // Hits.
+    packet.setRay(0, tc::Ray(tc::Vector3<float>(0.0f, 0.0f, 1.0f),
+                             tc::Vector3<float>(0.0f, 0.0f, -2.0f)));
+    // Points away.
+    packet.setRay(1, tc::Ray(tc::Vector3<float>(0.0f, 0.0f, -1.0f),
+                             tc::Vector3<float>(0.0f, 0.0f, -2.0f)));
+    // Parallel to two of the slabs, but outside of one.
+    packet.setRay(2, tc::Ray(tc::Vector3<float>(0.0f, 0.0f, 1.0f),
+                             tc::Vector3<float>(2.0f, 0.0f, -2.0f)));
+    // Diagonal hit.
+    packet.setRay(3, tc::Ray(tc::Vector3<float>(0.6f, 0.0f, 0.8f),
+                             tc::Vector3<float>(-1.5f, 0.0f, -2.0f)));
+
+    TC_IS(logContext, tc::intersect_bounds(packet, bounds, 0xF) == 0x9);
+    // Lanes outside of the mask are never reported.
+    TC_IS(logContext, tc::intersect_bounds(packet, bounds, 0x6) == 0x0);
+
+    // Every lane agrees with the single ray test.
+    bool agrees = true;
+    for (size_t lane = 0; lane != tc::RayPacket::kSize; ++lane)
+    {
+        const bool hit =
+            tc::intersect_bounds(packet, bounds, 0xF) & (1 << lane);
+        agrees = agrees &&
+                 hit == tc::intersect_bounds(packet.getRay(lane), bounds);
+    }
+    TC_IS(logContext, agrees);
+    /// [test_intersect boundingBoxPacket]
+}
+
 }  // namespace
 
 //------------------------------------------------------------------------------
@@ -126,4 +181,6 @@ void tc::intersectRunUnitTests(const tc::LogContext& logContext)
     plane(logContext);
     triangle(logContext);
     boundingBox(logContext);
+    segmentBoundingBox(logContext);
+    boundingBoxPacket(logContext);
 }
@@ -0,0 +1,112 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/irradiancecache.h"
+#include "trace/log.h"
+#include "trace/test.h"
+//------------------------------------------------------------------------------
+#include <cfloat>
+#include <cmath>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+bool isClose(const float a, const float b)
+{
+    return std::fabs(a - b) < 0.0001f;
+}
+
+//------------------------------------------------------------------------------
+void lookup(const tc::LogContext& logContext)
+{
+    /// [test_irradiancecache lookup]
+    const tc::Vector3<float> up(0.0f, 0.0f, 1.0f);
+    const tc::Vector3<float> side(1.0f, 0.0f, 0.0f);
+
+    tc::IrradianceCache cache(0.5f, 1.0f);
+    tc::IrradianceCache_Record record;
+    record.m_position = tc::Vector3<float>(0.0f, 0.0f, 0.0f);
+    record.m_normal = up;
+    record.m_radius = 0.5f;
+    record.m_depth = 1;
+    record.m_irradiance = tc::SampledSpectrum(2.0f);
+    cache.insert(record);
+    TC_IS(logContext, cache.size() == 1);
+
+    // Close by, on either side of a grid cell boundary, the record is used.
+    tc::SampledSpectrum irradiance;
+    TC_IS(logContext, cache.lookup(tc::Vector3<float>(0.1f, 0.0f, 0.0f), up,
+                                   1, irradiance));
+    TC_IS(logContext, isClose(irradiance.getWavelength(0), 2.0f));
+    TC_IS(logContext, cache.lookup(tc::Vector3<float>(-0.1f, 0.0f, 0.0f), up,
+                                   1, irradiance));
+
+    // Too far away, facing another way, or at another depth, it isn't.
+    TC_IS(logContext, !cache.lookup(tc::Vector3<float>(0.4f, 0.0f, 0.0f), up,
+                                    1, irradiance));
+    TC_IS(logContext, !cache.lookup(tc::Vector3<float>(0.1f, 0.0f, 0.0f),
+                                    side, 1, irradiance));
+    TC_IS(logContext, !cache.lookup(tc::Vector3<float>(0.1f, 0.0f, 0.0f), up,
+                                    2, irradiance));
+
+    // Nor is it used behind the record, where it can see things the point
+    // can't.
+    TC_IS(logContext, !cache.lookup(tc::Vector3<float>(0.0f, 0.0f, -0.1f),
+                                    up, 1, irradiance));
+    /// [test_irradiancecache lookup]
+}
+
+//------------------------------------------------------------------------------
+void weight(const tc::LogContext& logContext)
+{
+    /// [test_irradiancecache weight]
+    tc::IrradianceCache_Record record;
+    record.m_radius = 0.5f;
+
+    const tc::Vector3<float> up(0.0f, 0.0f, 1.0f);
+    TC_IS(logContext, tc::IrradianceCache::computeWeight(
+                          record, record.m_position, up) == FLT_MAX);
+    TC_IS(logContext, isClose(tc::IrradianceCache::computeWeight(
+                                  record, tc::Vector3<float>(0.25f, 0.0f, 0.0f),
+                                  up),
+                              2.0f));
+    TC_IS(logContext, isClose(tc::IrradianceCache::computeWeight(
+                                  record, record.m_position,
+                                  tc::Vector3<float>(1.0f, 0.0f, 0.0f)),
+                              1.0f));
+    /// [test_irradiancecache weight]
+}
+
+//------------------------------------------------------------------------------
+void gradient(const tc::LogContext& logContext)
+{
+    /// [test_irradiancecache gradient]
+    tc::IrradianceCache cache(0.5f, 1.0f);
+    tc::IrradianceCache_Record record;
+    record.m_radius = 1.0f;
+    record.m_irradiance = tc::SampledSpectrum(1.0f);
+    for (size_t i = 0; i != tc::TC_SAMPLED_SPECTRUM_SAMPLE_COUNT; ++i)
+    {
+        record.m_rotationGradient[i] = tc::Vector3<float>(1.0f, 0.0f, 0.0f);
+    }
+    cache.insert(record);
+
+    // Tilting the normal towards +x increases the irradiance.
+    const tc::Vector3<float> tilted(0.1f, 0.0f, std::sqrt(0.99f));
+    tc::SampledSpectrum irradiance;
+    TC_IS(logContext,
+          cache.lookup(record.m_position, tilted, 0, irradiance));
+    TC_IS(logContext, isClose(irradiance.getWavelength(0), 1.1f));
+    /// [test_irradiancecache gradient]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::irradiancecacheRunUnitTests(const tc::LogContext& logContext)
+{
+    lookup(logContext);
+    weight(logContext);
+    gradient(logContext);
+}
@@ -5,6 +5,14 @@
 #include "trace/test.h"
 #include "trace/intersect.h"
 #include "trace/kdtree.h"
+#include "trace/raypacket.h"
+#include "trace/raystream.h"
+//------------------------------------------------------------------------------
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
 //------------------------------------------------------------------------------
 
 namespace
@@ -85,6 +93,267 @@ void twoSpheres(const tc::LogContext& logContext)
     /// [test_kdtree two spheres]
 }
 
+//------------------------------------------------------------------------------
+void packet(const tc::LogContext& logContext)
+{
+    /// [test_kdtree packet]
+
+    tc::KDTree kdTree;
+
+    // A wall of points in front of the camera.
+    const float rad = 0.2f;
+    PrimitiveTest::Points points;
+    for (size_t y = 0; y != 8; ++y)
+    {
+        for (size_t x = 0; x != 8; ++x)
+        {
+            points.push_back(tc::Vector3<float>(
+                static_cast<float>(x) - 3.5f, static_cast<float>(y) - 3.5f,
+                4.0f + static_cast<float>((x * 7 + y * 3) % 5)));
+        }
+    }
+    for (size_t i = 0; i != points.size(); ++i)
+    {
+        const tc::Vector3<float>& p = points[i];
+        kdTree.addEntry(tc::BoundsF(p - rad, p + rad), i);
+    }
+    kdTree.sortTree();
+
+    tc::KDTree_SearchCache searchCache;
+    const PrimitiveTest primitiveTest(points, rad);
+
+    // Coherent packets of rays from the origin, and packets that point in
+    // every direction, must find what the rays would find on their own.
+    bool matches = true;
+    size_t hits = 0;
+    for (size_t i = 0; i != 64; ++i)
+    {
+        tc::RayPacket packet;
+        for (size_t lane = 0; lane != tc::RayPacket::kSize; ++lane)
+        {
+            const size_t j = (i * tc::RayPacket::kSize) + lane;
+            const float sx = static_cast<float>(j % 16) / 8.0f - 1.0f;
+            const float sy = static_cast<float>(j / 16) / 8.0f - 1.0f;
+            const float sz = i < 48 ? 1.0f : (lane % 2 ? 1.0f : -1.0f);
+            packet.setRay(lane,
+                          tc::Ray(tc::Vector3<float>(sx, sy, sz).normalized(),
+                                  tc::Vector3<float>(0.0f, 0.0f, 0.0f)));
+        }
+
+        const tc::KDTree_PacketTraceResult result =
+            kdTree.findEntries(searchCache, packet, primitiveTest);
+        for (size_t lane = 0; lane != tc::RayPacket::kSize; ++lane)
+        {
+            const tc::KDTree_TraceResult single = kdTree.findEntries(
+                searchCache, packet.getRay(lane), primitiveTest);
+            matches = matches &&
+                      result.m_distanceAlongRay[lane] ==
+                          single.m_distanceAlongRay &&
+                      result.m_elementIndex[lane] == single.m_elementIndex;
+            hits += single.m_distanceAlongRay != FLT_MAX ? 1 : 0;
+        }
+    }
+    TC_IS(logContext, matches);
+    TC_IS(logContext, hits != 0);
+
+    /// [test_kdtree packet]
+}
+
+//------------------------------------------------------------------------------
+void stream(const tc::LogContext& logContext)
+{
+    /// [test_kdtree stream]
+
+    tc::KDTree kdTree;
+
+    // A box of points around the origin.
+    const float rad = 0.3f;
+    PrimitiveTest::Points points;
+    for (size_t z = 0; z != 5; ++z)
+    {
+        for (size_t y = 0; y != 5; ++y)
+        {
+            for (size_t x = 0; x != 5; ++x)
+            {
+                points.push_back(tc::Vector3<float>(
+                    static_cast<float>(x) - 2.0f, static_cast<float>(y) - 2.0f,
+                    static_cast<float>(z) - 2.0f));
+            }
+        }
+    }
+    for (size_t i = 0; i != points.size(); ++i)
+    {
+        const tc::Vector3<float>& p = points[i];
+        kdTree.addEntry(tc::BoundsF(p - rad, p + rad), i);
+    }
+    kdTree.sortTree();
+
+    tc::KDTree_SearchCache searchCache;
+    const PrimitiveTest primitiveTest(points, rad);
+
+    // Rays leaving points inside the box in every direction, like bounce
+    // rays do.
+    tc::RayStream rays;
+    for (size_t i = 0; i != 500; ++i)
+    {
+        const float a = static_cast<float>(i) * 2.39996f;
+        const float z = 1.0f - (static_cast<float>(i) + 0.5f) / 250.0f;
+        const float r = std::sqrt(std::max(0.0f, 1.0f - (z * z)));
+        const tc::Vector3<float> direction(r * std::cos(a), r * std::sin(a), z);
+        const tc::Vector3<float> position(
+            static_cast<float>(i % 7) * 0.5f - 1.5f,
+            static_cast<float>(i % 5) * 0.5f - 1.0f,
+            static_cast<float>(i % 3) * 0.5f - 0.5f);
+        rays.push(tc::Ray(direction, position));
+    }
+
+    tc::KDTree_StreamTraceResult result;
+    kdTree.findEntries(searchCache, rays, primitiveTest, result);
+
+    // Every ray must find what it would find on its own.
+    bool matches = result.m_distanceAlongRay.size() == rays.size();
+    size_t hits = 0;
+    for (size_t i = 0; matches && i != rays.size(); ++i)
+    {
+        const tc::KDTree_TraceResult single =
+            kdTree.findEntries(searchCache, rays.getRay(i), primitiveTest);
+        matches = result.m_distanceAlongRay[i] == single.m_distanceAlongRay &&
+                  result.m_elementIndex[i] == single.m_elementIndex;
+        hits += single.m_distanceAlongRay != FLT_MAX ? 1 : 0;
+    }
+    TC_IS(logContext, matches);
+    TC_IS(logContext, hits != 0 && hits != rays.size());
+
+    // An empty stream gives an empty result.
+    kdTree.findEntries(searchCache, tc::RayStream(), primitiveTest, result);
+    TC_IS(logContext, result.m_distanceAlongRay.empty());
+
+    /// [test_kdtree stream]
+}
+
+//------------------------------------------------------------------------------
+void anyEntry(const tc::LogContext& logContext)
+{
+    /// [test_kdtree any entry]
+
+    tc::KDTree kdTree;
+
+    // A row of points along the z axis.
+    const float rad = 0.1f;
+    PrimitiveTest::Points points;
+    for (size_t i = 0; i != 16; ++i)
+    {
+        points.push_back(
+            tc::Vector3<float>(0.0f, 0.0f, static_cast<float>(i) + 1.0f));
+    }
+    for (size_t i = 0; i != points.size(); ++i)
+    {
+        const tc::Vector3<float>& p = points[i];
+        kdTree.addEntry(tc::BoundsF(p - rad, p + rad), i);
+    }
+    kdTree.sortTree();
+
+    tc::KDTree_SearchCache searchCache;
+    const PrimitiveTest primitiveTest(points, rad);
+
+    // The first point is 0.9 along the ray, so only a ray that reaches past
+    // it is occluded.
+    const tc::Ray along(tc::Vector3<float>(0.0f, 0.0f, 1.0f),
+                        tc::Vector3<float>(0.0f, 0.0f, 0.0f));
+    TC_IS(logContext,
+          kdTree.findAnyEntry(searchCache, along, 1.0f, primitiveTest));
+    TC_IS(logContext,
+          !kdTree.findAnyEntry(searchCache, along, 0.8f, primitiveTest));
+    TC_IS(logContext,
+          kdTree.findAnyEntry(searchCache, along, FLT_MAX, primitiveTest));
+
+    // A ray which misses every point.
+    const tc::Ray beside(tc::Vector3<float>(0.0f, 0.0f, 1.0f),
+                         tc::Vector3<float>(1.0f, 0.0f, 0.0f));
+    TC_IS(logContext,
+          !kdTree.findAnyEntry(searchCache, beside, FLT_MAX, primitiveTest));
+
+    /// [test_kdtree any entry]
+}
+
+//------------------------------------------------------------------------------
+void serialize(const tc::LogContext& logContext)
+{
+    /// [test_kdtree serialize]
+
+    // A tree of points, which is saved and loaded again.
+    const float rad = 0.1f;
+    PrimitiveTest::Points points;
+    tc::KDTree kdTree;
+    for (size_t i = 0; i != 16; ++i)
+    {
+        points.push_back(tc::Vector3<float>(static_cast<float>(i % 4),
+                                            static_cast<float>(i / 4),
+                                            static_cast<float>(i)));
+        kdTree.addEntry(tc::BoundsF(points[i] - rad, points[i] + rad), i);
+    }
+    kdTree.sortTree();
+
+    std::vector<char> buffer;
+    kdTree.serialize(buffer);
+
+    tc::KDTree loaded;
+    TC_IS(logContext, !loaded.isSorted());
+    TC_IS(logContext,
+          loaded.deserialize(&buffer[0], buffer.size(), points.size()));
+    TC_IS(logContext, loaded.isSorted());
+
+    // Every point is found in the loaded tree, as it is in the original.
+    tc::KDTree_SearchCache searchCache;
+    const PrimitiveTest primitiveTest(points, rad);
+    bool matches = true;
+    for (size_t i = 0; i != points.size(); ++i)
+    {
+        const tc::Ray ray(tc::Vector3<float>(0.0f, 0.0f, 1.0f),
+                          points[i] - tc::Vector3<float>(0.0f, 0.0f, 1.0f));
+        const tc::KDTree_TraceResult original =
+            kdTree.findEntries(searchCache, ray, primitiveTest);
+        const tc::KDTree_TraceResult result =
+            loaded.findEntries(searchCache, ray, primitiveTest);
+        matches = matches && result.m_elementIndex == i &&
+                  result.m_elementIndex == original.m_elementIndex &&
+                  result.m_distanceAlongRay == original.m_distanceAlongRay;
+    }
+    TC_IS(logContext, matches);
+
+    // A buffer that is cut short is rejected.
+    tc::KDTree truncated;
+    TC_IS(logContext, !truncated.deserialize(&buffer[0], buffer.size() - 1,
+                                             points.size()));
+    TC_IS(logContext, !truncated.isSorted());
+
+    // As is a tree made from more primitives than there are.
+    tc::KDTree invalid;
+    TC_IS(logContext, !invalid.deserialize(&buffer[0], buffer.size(),
+                                           points.size() - 1));
+    TC_IS(logContext, !invalid.isSorted());
+
+    // Or one from another version, or with a node outside of the tree. The
+    // header is the whole of an empty tree, and is followed by the entries
+    // and then the root node.
+    std::vector<char> header;
+    tc::KDTree().serialize(header);
+    std::vector<char> corrupt(buffer);
+    ++corrupt[0];
+    TC_IS(logContext, !invalid.deserialize(&corrupt[0], corrupt.size(),
+                                           points.size()));
+    corrupt = buffer;
+    const unsigned int farRight = 0xfffffff0;
+    std::memcpy(&corrupt[header.size() +
+                         (points.size() * sizeof(tc::KDTree_Entry))],
+                &farRight, sizeof(farRight));
+    TC_IS(logContext, !invalid.deserialize(&corrupt[0], corrupt.size(),
+                                           points.size()));
+    TC_IS(logContext, !invalid.isSorted());
+
+    /// [test_kdtree serialize]
+}
+
 #if 0
 //------------------------------------------------------------------------------
 void eightSpheres(const tc::LogContext& logContext)
@@ -145,4 +414,8 @@ void eightSpheres(const tc::LogContext& logContext)
 void tc::kdtreeRunUnitTests(const tc::LogContext& logContext)
 {
     twoSpheres(logContext);
+    packet(logContext);
+    stream(logContext);
+    anyEntry(logContext);
+    serialize(logContext);
 }
@@ -0,0 +1,188 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/log.h"
+#include "trace/lsditerator.h"
+#include "trace/test.h"
+//------------------------------------------------------------------------------
+#include <cstring>
+#include <vector>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Records the order in which it is destroyed.
+class Counted
+{
+public:
+    explicit Counted(std::vector<const Counted*>* destroyed)
+        : m_destroyed(destroyed)
+    {
+    }
+    ~Counted()
+    {
+        m_destroyed->push_back(this);
+    }
+
+private:
+    std::vector<const Counted*>* m_destroyed;
+};
+
+//------------------------------------------------------------------------------
+template <typename T>
+bool isAligned(const T* pointer)
+{
+    return reinterpret_cast<size_t>(pointer) % __alignof__(T) == 0;
+}
+
+//------------------------------------------------------------------------------
+void arena(const tc::LogContext& logContext)
+{
+    /// [test_lsditerator arena]
+    lsd::Stage stage;
+    char* const character = stage.allocArray<char>(1);
+    *character = 'a';
+    double* const number = stage.alloc<double>();
+    *number = 1.0;
+    TC_IS(logContext, isAligned(number));
+
+    // An array bigger than a block, followed by more small allocations,
+    // which mustn't overlap anything before them.
+    const size_t size = 256 * 1024;
+    char* const big = stage.allocArray<char>(size);
+    std::memset(big, 'b', size);
+    double* const numbers = stage.allocArray<double>(3);
+    TC_IS(logContext, isAligned(numbers));
+    numbers[0] = 2.0;
+    numbers[1] = 3.0;
+    numbers[2] = 4.0;
+    std::vector<double*> many;
+    for (size_t i = 0; i != 20000; ++i)
+    {
+        many.push_back(stage.alloc<double>());
+        *many.back() = static_cast<double>(i);
+    }
+
+    bool matches = *character == 'a' && *number == 1.0 && big[0] == 'b' &&
+                   big[size - 1] == 'b' && numbers[0] == 2.0 &&
+                   numbers[2] == 4.0;
+    for (size_t i = 0; matches && i != many.size(); ++i)
+    {
+        matches = isAligned(many[i]) && *many[i] == static_cast<double>(i);
+    }
+    TC_IS(logContext, matches);
+    /// [test_lsditerator arena]
+}
+
+//------------------------------------------------------------------------------
+void lifetime(const tc::LogContext& logContext)
+{
+    /// [test_lsditerator lifetime]
+    std::vector<const Counted*> destroyed;
+    {
+        lsd::Stage stage;
+        const Counted* const a = stage.alloc<Counted>(&destroyed);
+        const Counted* const b = stage.alloc<Counted>(&destroyed);
+        char name[] = "mesh";
+        stage.setRoot(stage.alloc<lsd::PolyMesh>(name));
+        TC_IS(logContext, !stage.empty());
+        TC_IS(logContext, destroyed.empty());
+
+        // Clearing destroys everything, newest first, and forgets the root.
+        stage.clear();
+        TC_IS(logContext, stage.empty() && stage.getRoot() == 0);
+        TC_IS(logContext,
+              destroyed.size() == 2 && destroyed[0] == b && destroyed[1] == a);
+
+        // The stage can be used again, across several blocks, and destroys
+        // the rest when it is destroyed.
+        for (size_t i = 0; i != 10000; ++i)
+        {
+            stage.alloc<Counted>(&destroyed);
+        }
+        TC_IS(logContext, destroyed.size() == 2);
+    }
+    TC_IS(logContext, destroyed.size() == 10002);
+    /// [test_lsditerator lifetime]
+}
+
+//------------------------------------------------------------------------------
+// Takes the vertices of each poly mesh it is told about.
+class TakingListener : public lsd::Listener
+{
+public:
+    virtual void polyMesh(lsd::PolyMesh& polyMesh)
+    {
+        m_verticies.push_back(lsd::PolyMesh::Verticies());
+        m_verticies.back().swap(*polyMesh.m_verticies);
+    }
+
+    std::vector<lsd::PolyMesh::Verticies> m_verticies;
+};
+
+//------------------------------------------------------------------------------
+// Makes a poly mesh with 'count' vertices, as the parser would.
+lsd::PolyMesh* makePolyMesh(lsd::Stage& stage, char* name, const size_t count)
+{
+    lsd::PolyMesh* const polyMesh = stage.alloc<lsd::PolyMesh>(name);
+    polyMesh->m_verticies = stage.alloc<lsd::PolyMesh::Verticies>();
+    polyMesh->m_triangles = stage.alloc<lsd::PolyMesh::Triangles>();
+    lsd::Vertex vertex;
+    vertex.x = vertex.y = vertex.z = 0.0f;
+    polyMesh->m_verticies->resize(count, vertex);
+    lsd::Triangle triangle;
+    triangle.a = triangle.b = triangle.c = 0;
+    polyMesh->m_triangles->push_back(triangle);
+    return polyMesh;
+}
+
+//------------------------------------------------------------------------------
+void listener(const tc::LogContext& logContext)
+{
+    /// [test_lsditerator listener]
+    char name[] = "node";
+    TakingListener listener;
+    lsd::Stage stage;
+
+    // Without a listener, poly meshes are kept.
+    lsd::PolyMesh* const kept = makePolyMesh(stage, name, 2);
+    stage.setRoot(kept);
+    TC_IS(logContext, kept->m_verticies->size() == 2);
+
+    // With one, each poly mesh is given to it as it is finished, and then
+    // freed. Transforms aren't given to it.
+    stage.setListener(&listener);
+    lsd::PolyMesh* const first = makePolyMesh(stage, name, 3);
+    stage.setRoot(first);
+    lsd::PolyMesh* const second = makePolyMesh(stage, name, 4);
+    stage.setRoot(second);
+    lsd::Xform* const xform = stage.alloc<lsd::Xform>(name);
+    xform->m_children = stage.alloc<lsd::Xform::Children>();
+    xform->m_children->push_back(first);
+    xform->m_children->push_back(second);
+    stage.setRoot(xform);
+    TC_IS(logContext, stage.getRoot() == xform);
+    TC_IS(logContext, listener.m_verticies.size() == 2 &&
+                          listener.m_verticies[0].size() == 3 &&
+                          listener.m_verticies[1].size() == 4);
+    TC_IS(logContext, first->m_verticies->empty() &&
+                          first->m_triangles->empty() &&
+                          second->m_triangles->empty());
+
+    // Streaming can be stopped.
+    stage.setListener(0);
+    stage.setRoot(makePolyMesh(stage, name, 5));
+    TC_IS(logContext, listener.m_verticies.size() == 2);
+    /// [test_lsditerator listener]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::lsditeratorRunUnitTests(const tc::LogContext& logContext)
+{
+    arena(logContext);
+    lifetime(logContext);
+    listener(logContext);
+}
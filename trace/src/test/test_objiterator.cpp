@@ -0,0 +1,376 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/log.h"
+#include "trace/objiterator.h"
+#include "trace/test.h"
+//------------------------------------------------------------------------------
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Writes 'contents' to a new temporary file and returns its name.
+std::string writeTemporaryFile(const char* contents)
+{
+    char filename[] = "/tmp/test_objiteratorXXXXXX";
+    const int file = mkstemp(filename);
+    if (file == -1)
+    {
+        return std::string();
+    }
+    const ssize_t length = static_cast<ssize_t>(strlen(contents));
+    const bool written = write(file, contents, length) == length;
+    close(file);
+    return written ? std::string(filename) : std::string();
+}
+
+//------------------------------------------------------------------------------
+// Reads every triangle of the obj file, with the given number of threads.
+std::vector<tc::Triangle> readTriangles(const std::string& filename,
+                                        const size_t threadCount)
+{
+    tc::Obj_TriangleIterator iterator;
+    iterator.setFilename(filename.c_str());
+    iterator.setThreadCount(threadCount);
+
+    std::vector<tc::Triangle> triangles;
+    iterator.begin();
+    while (iterator.next())
+    {
+        triangles.push_back(*iterator);
+    }
+    iterator.end();
+    return triangles;
+}
+
+//------------------------------------------------------------------------------
+// Reads every triangle of 'iterator' with tc::TriangleIterator::nextBatch,
+// 'capacity' at a time. 'sizeHint' is set to the hint given after begin, and
+// 'fits' to whether every batch fitted in 'capacity'.
+std::vector<tc::Triangle> readBatches(tc::TriangleIterator& iterator,
+                                      const size_t capacity, size_t& sizeHint,
+                                      bool& fits)
+{
+    std::vector<tc::Vector3<float> > corners(capacity * 3);
+    std::vector<tc::Triangle> triangles;
+    iterator.begin();
+    sizeHint = iterator.sizeHint();
+    fits = true;
+    size_t count = 0;
+    while ((count = iterator.nextBatch(&corners[0], capacity)) != 0)
+    {
+        fits = fits && count <= capacity;
+        for (size_t i = 0; i != count; ++i)
+        {
+            triangles.push_back(tc::Triangle(corners[i * 3],
+                                             corners[(i * 3) + 1],
+                                             corners[(i * 3) + 2]));
+        }
+    }
+    iterator.end();
+    return triangles;
+}
+
+//------------------------------------------------------------------------------
+bool isSame(const std::vector<tc::Triangle>& a,
+            const std::vector<tc::Triangle>& b)
+{
+    bool matches = a.size() == b.size();
+    for (size_t i = 0; matches && i != a.size(); ++i)
+    {
+        matches = a[i].m_a == b[i].m_a && a[i].m_b == b[i].m_b &&
+                  a[i].m_c == b[i].m_c;
+    }
+    return matches;
+}
+
+//------------------------------------------------------------------------------
+bool isTriangle(const tc::Triangle& triangle, const float a, const float b,
+                const float c)
+{
+    return triangle.m_a.x == a && triangle.m_b.x == b && triangle.m_c.x == c;
+}
+
+//------------------------------------------------------------------------------
+void parse(const tc::LogContext& logContext)
+{
+    /// [test_objiterator parse]
+    // Each vertex is told apart by its x coordinate.
+    const std::string filename = writeTemporaryFile(
+        "# A comment\n"
+        "o object\n"
+        "v 1.0 0.0 0.0\n"
+        "v 2.5 0.0 0.0 1.0\n"
+        "vn 0.0 1.0 0.0\n"
+        "v -3.25 0.0 0.0\r\n"
+        "v 4e0 0 0\n"
+        "f 1 2 3\n"
+        "f 1/1/1 2//1 3/2\n"
+        "f 1 2 3 4\n"
+        "f -4 -3 -2\n"
+        "  f 1 2 99\n"
+        "f 1 x 3\n"
+        "v 5 0 0\n"
+        "f -1 1 2");
+    TC_IS(logContext, !filename.empty());
+
+    // Polygons are split into fans, relative indices count back from the
+    // last vertex, and faces that are broken are skipped.
+    const std::vector<tc::Triangle> triangles = readTriangles(filename, 1);
+    TC_IS(logContext, triangles.size() == 6);
+    if (triangles.size() == 6)
+    {
+        TC_IS(logContext, isTriangle(triangles[0], 1.0f, 2.5f, -3.25f));
+        TC_IS(logContext, isTriangle(triangles[1], 1.0f, 2.5f, -3.25f));
+        TC_IS(logContext, isTriangle(triangles[2], 1.0f, 2.5f, -3.25f));
+        TC_IS(logContext, isTriangle(triangles[3], 1.0f, -3.25f, 4.0f));
+        TC_IS(logContext, isTriangle(triangles[4], 1.0f, 2.5f, -3.25f));
+        TC_IS(logContext, isTriangle(triangles[5], 5.0f, 1.0f, 2.5f));
+    }
+
+    // However many threads read the file, the result is the same.
+    bool matches = true;
+    for (size_t threadCount = 2; threadCount != 8; ++threadCount)
+    {
+        const std::vector<tc::Triangle> split =
+            readTriangles(filename, threadCount);
+        matches = matches && split.size() == triangles.size();
+        for (size_t i = 0; matches && i != split.size(); ++i)
+        {
+            matches = split[i].m_a == triangles[i].m_a &&
+                      split[i].m_b == triangles[i].m_b &&
+                      split[i].m_c == triangles[i].m_c;
+        }
+    }
+    TC_IS(logContext, matches);
+
+    // A file that doesn't exist has no triangles.
+    unlink(filename.c_str());
+    TC_IS(logContext, readTriangles(filename, 0).empty());
+    /// [test_objiterator parse]
+}
+
+//------------------------------------------------------------------------------
+void groups(const tc::LogContext& logContext)
+{
+    /// [test_objiterator groups]
+    // The first group is named by both an 'o' and a 'g' line, and the last
+    // group has no faces.
+    const std::string filename = writeTemporaryFile(
+        "v 1 0 0\n"
+        "v 2 0 0\n"
+        "v 3 0 0\n"
+        "v 4 1 1\n"
+        "o first\n"
+        "g part\n"
+        "f 1 2 3\n"
+        "f 2 3 1\n"
+        "g\n"
+        "f 2 3 4\n"
+        "o empty\n");
+    TC_IS(logContext, !filename.empty());
+
+    // However many threads read the file, it has the same groups.
+    bool matches = true;
+    for (size_t threadCount = 1; threadCount != 8; ++threadCount)
+    {
+        tc::Obj_ObjectIterator iterator;
+        iterator.setFilename(filename.c_str());
+        iterator.setThreadCount(threadCount);
+
+        std::vector<size_t> triangleCounts;
+        std::vector<float> maxY;
+        iterator.begin();
+        while (iterator.next())
+        {
+            matches = matches && iterator.hasTriangles();
+            size_t count = 0;
+            tc::TriangleIterator& triangles = iterator.getTriangles();
+            triangles.begin();
+            while (triangles.next())
+            {
+                ++count;
+            }
+            triangles.end();
+            triangleCounts.push_back(count);
+            maxY.push_back(iterator.getBounds().m_max.y);
+        }
+        iterator.end();
+
+        matches = matches && triangleCounts.size() == 2 &&
+                  triangleCounts[0] == 2 && triangleCounts[1] == 1;
+        matches = matches && maxY.size() == 2 && maxY[0] < 0.5f &&
+                  maxY[1] > 0.5f;
+    }
+    TC_IS(logContext, matches);
+    unlink(filename.c_str());
+    /// [test_objiterator groups]
+}
+
+//------------------------------------------------------------------------------
+// Checks the vertices of 'mesh' by their x coordinate, and its indices.
+bool isMesh(const tc::ObjectIterator_Mesh& mesh, const std::vector<float>& x,
+            const std::vector<uint32_t>& indices)
+{
+    bool matches = mesh.m_vertexCount == x.size() &&
+                   mesh.m_triangleCount * 3 == indices.size();
+    for (size_t i = 0; matches && i != x.size(); ++i)
+    {
+        matches = mesh.m_vertices[i * 4] == x[i];
+    }
+    for (size_t i = 0; matches && i != indices.size(); ++i)
+    {
+        matches = mesh.m_indices[i] == indices[i];
+    }
+    return matches && mesh.m_acceleration == 0;
+}
+
+//------------------------------------------------------------------------------
+void mesh(const tc::LogContext& logContext)
+{
+    /// [test_objiterator mesh]
+    // The second and fourth vertices are in the same place, but the file
+    // doesn't share them, so neither does the mesh. The second face refers
+    // to a vertex that doesn't exist, and the third uses a relative index.
+    const std::string filename = writeTemporaryFile(
+        "v 0 0 0\n"
+        "v 1 0 0\n"
+        "v 2 1 0\n"
+        "v 1 0 0\n"
+        "v 5 5 5\n"
+        "f 1 2 3\n"
+        "f 3 2 9\n"
+        "f -4 4 3\n"
+        "g second\n"
+        "f 5 4 1\n");
+    TC_IS(logContext, !filename.empty());
+
+    // Each group only has the vertices it uses, in the order it uses them.
+    std::vector<float> firstX;
+    firstX.push_back(0.0f);
+    firstX.push_back(1.0f);
+    firstX.push_back(2.0f);
+    firstX.push_back(1.0f);
+    const uint32_t firstIndices[] = {0, 1, 2, 1, 3, 2};
+    std::vector<float> secondX;
+    secondX.push_back(5.0f);
+    secondX.push_back(1.0f);
+    secondX.push_back(0.0f);
+    const uint32_t secondIndices[] = {0, 1, 2};
+
+    bool matches = true;
+    for (size_t threadCount = 1; threadCount != 8; ++threadCount)
+    {
+        tc::Obj_ObjectIterator iterator;
+        iterator.setFilename(filename.c_str());
+        iterator.setThreadCount(threadCount);
+        tc::ObjectIterator_Mesh mesh;
+        iterator.begin();
+        matches = matches && !iterator.getMesh(mesh);
+        matches = matches && iterator.next() && iterator.getMesh(mesh) &&
+                  isMesh(mesh, firstX,
+                         std::vector<uint32_t>(firstIndices, firstIndices + 6));
+        matches = matches && iterator.next() && iterator.getMesh(mesh) &&
+                  isMesh(mesh, secondX, std::vector<uint32_t>(
+                                            secondIndices, secondIndices + 3));
+        matches = matches && !iterator.next();
+        iterator.end();
+    }
+    TC_IS(logContext, matches);
+    unlink(filename.c_str());
+    /// [test_objiterator mesh]
+}
+
+//------------------------------------------------------------------------------
+void batches(const tc::LogContext& logContext)
+{
+    /// [test_objiterator batches]
+    // Enough faces that a file read by a few threads is split into chunks
+    // of several triangles each. Every fifth face refers to a vertex that
+    // doesn't exist.
+    std::string contents;
+    for (size_t i = 0; i != 8; ++i)
+    {
+        char line[64];
+        std::sprintf(line, "v %u 0 0\n", static_cast<unsigned int>(i));
+        contents += line;
+    }
+    for (size_t i = 0; i != 40; ++i)
+    {
+        char line[64];
+        std::sprintf(line, "f %u %u %u\n",
+                     static_cast<unsigned int>((i % 8) + 1),
+                     static_cast<unsigned int>(((i + 1) % 8) + 1),
+                     static_cast<unsigned int>(i % 5 == 4 ? 99 : (i % 3) + 1));
+        contents += line;
+    }
+    const std::string filename = writeTemporaryFile(contents.c_str());
+    TC_IS(logContext, !filename.empty());
+
+    // Reading in batches gives the same triangles as reading one at a time,
+    // whichever the capacity, so batches end part way through a chunk and
+    // cross from one chunk to the next. The hint counts the skipped faces,
+    // so it is larger than the number of triangles.
+    bool matches = true;
+    bool hintsMatch = true;
+    for (size_t threadCount = 1; threadCount != 5; ++threadCount)
+    {
+        const std::vector<tc::Triangle> triangles =
+            readTriangles(filename, threadCount);
+        matches = matches && triangles.size() == 32;
+        for (size_t capacity = 1; capacity != 12; ++capacity)
+        {
+            tc::Obj_TriangleIterator iterator;
+            iterator.setFilename(filename.c_str());
+            iterator.setThreadCount(threadCount);
+            size_t sizeHint = 0;
+            bool fits = false;
+            matches = matches &&
+                      isSame(readBatches(iterator, capacity, sizeHint, fits),
+                             triangles) &&
+                      fits;
+            hintsMatch = hintsMatch && sizeHint == 40;
+        }
+    }
+    TC_IS(logContext, matches);
+    TC_IS(logContext, hintsMatch);
+
+    // A batch carries on from the triangle next moved onto, and the hint
+    // counts down as the faces are read.
+    const std::vector<tc::Triangle> triangles = readTriangles(filename, 3);
+    tc::Obj_TriangleIterator iterator;
+    iterator.setFilename(filename.c_str());
+    iterator.setThreadCount(3);
+    iterator.begin();
+    TC_IS(logContext, iterator.next());
+    const tc::Triangle first = *iterator;
+    TC_IS(logContext, iterator.sizeHint() == 39);
+    tc::Vector3<float> corners[3 * 3];
+    TC_IS(logContext, iterator.nextBatch(corners, 3) == 3);
+    TC_IS(logContext, iterator.sizeHint() == 36);
+    TC_IS(logContext, triangles.size() == 32 &&
+                          first.m_a == triangles[0].m_a &&
+                          corners[0] == triangles[1].m_a &&
+                          corners[8] == triangles[3].m_c);
+    iterator.end();
+
+    unlink(filename.c_str());
+    /// [test_objiterator batches]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::objiteratorRunUnitTests(const tc::LogContext& logContext)
+{
+    parse(logContext);
+    groups(logContext);
+    mesh(logContext);
+    batches(logContext);
+}
@@ -0,0 +1,387 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/log.h"
+#include "trace/plyiterator.h"
+#include "trace/test.h"
+#include "trace/triangle.h"
+//------------------------------------------------------------------------------
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Appends the bytes of 'value' to 'bytes'.
+template <typename T>
+void append(std::string& bytes, const T value)
+{
+    bytes.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+//------------------------------------------------------------------------------
+// Writes 'contents' to a new temporary file and returns its name.
+std::string writeTemporaryFile(const std::string& contents)
+{
+    char filename[] = "/tmp/test_plyiteratorXXXXXX";
+    const int file = mkstemp(filename);
+    if (file == -1)
+    {
+        return std::string();
+    }
+    const ssize_t length = static_cast<ssize_t>(contents.size());
+    const bool written = write(file, contents.data(), length) == length;
+    close(file);
+    return written ? std::string(filename) : std::string();
+}
+
+//------------------------------------------------------------------------------
+// Reads every triangle of the ply file, with the given number of threads.
+std::vector<tc::Triangle> readTriangles(const std::string& filename,
+                                        const size_t threadCount)
+{
+    tc::Ply_TriangleIterator iterator;
+    iterator.setFilename(filename.c_str());
+    iterator.setThreadCount(threadCount);
+
+    std::vector<tc::Triangle> triangles;
+    iterator.begin();
+    while (iterator.next())
+    {
+        triangles.push_back(*iterator);
+    }
+    iterator.end();
+    return triangles;
+}
+
+//------------------------------------------------------------------------------
+// Reads every triangle of 'iterator' with tc::TriangleIterator::nextBatch,
+// 'capacity' at a time. 'sizeHint' is set to the hint given after begin, and
+// 'fits' to whether every batch fitted in 'capacity'.
+std::vector<tc::Triangle> readBatches(tc::TriangleIterator& iterator,
+                                      const size_t capacity, size_t& sizeHint,
+                                      bool& fits)
+{
+    std::vector<tc::Vector3<float> > corners(capacity * 3);
+    std::vector<tc::Triangle> triangles;
+    iterator.begin();
+    sizeHint = iterator.sizeHint();
+    fits = true;
+    size_t count = 0;
+    while ((count = iterator.nextBatch(&corners[0], capacity)) != 0)
+    {
+        fits = fits && count <= capacity;
+        for (size_t i = 0; i != count; ++i)
+        {
+            triangles.push_back(tc::Triangle(corners[i * 3],
+                                             corners[(i * 3) + 1],
+                                             corners[(i * 3) + 2]));
+        }
+    }
+    iterator.end();
+    return triangles;
+}
+
+//------------------------------------------------------------------------------
+bool isSame(const std::vector<tc::Triangle>& a,
+            const std::vector<tc::Triangle>& b)
+{
+    bool matches = a.size() == b.size();
+    for (size_t i = 0; matches && i != a.size(); ++i)
+    {
+        matches = a[i].m_a == b[i].m_a && a[i].m_b == b[i].m_b &&
+                  a[i].m_c == b[i].m_c;
+    }
+    return matches;
+}
+
+//------------------------------------------------------------------------------
+bool isTriangle(const tc::Triangle& triangle, const float a, const float b,
+                const float c)
+{
+    return triangle.m_a.x == a && triangle.m_b.x == b && triangle.m_c.x == c;
+}
+
+//------------------------------------------------------------------------------
+void read(const tc::LogContext& logContext)
+{
+    /// [test_plyiterator read]
+    // Each vertex is told apart by its x coordinate. The vertices have a
+    // colour, and there is an element before them, which are skipped.
+    std::string bytes(
+        "ply\n"
+        "format binary_little_endian 1.0\n"
+        "comment Made by hand\n"
+        "element camera 1\n"
+        "property float fov\n"
+        "element vertex 4\n"
+        "property float x\n"
+        "property uchar red\n"
+        "property float y\n"
+        "property float z\n"
+        "element face 4\n"
+        "property list uchar int vertex_indices\n"
+        "end_header\n");
+    append(bytes, 45.0f);
+    const float xs[] = {1.0f, 2.5f, -3.25f, 4.0f};
+    for (size_t i = 0; i != 4; ++i)
+    {
+        append(bytes, xs[i]);
+        append(bytes, static_cast<unsigned char>(255));
+        append(bytes, static_cast<float>(i));
+        append(bytes, 0.0f);
+    }
+    // The third face refers to a vertex that doesn't exist.
+    const int faces[] = {0, 1, 2, 3, 2, 1, 0, 1, 4, 1, 3, 0};
+    for (size_t i = 0; i != 4; ++i)
+    {
+        append(bytes, static_cast<unsigned char>(3));
+        append(bytes, faces[i * 3]);
+        append(bytes, faces[(i * 3) + 1]);
+        append(bytes, faces[(i * 3) + 2]);
+    }
+    const std::string filename = writeTemporaryFile(bytes);
+    TC_IS(logContext, !filename.empty());
+
+    const std::vector<tc::Triangle> triangles = readTriangles(filename, 1);
+    TC_IS(logContext, triangles.size() == 3);
+    if (triangles.size() == 3)
+    {
+        TC_IS(logContext, isTriangle(triangles[0], 1.0f, 2.5f, -3.25f));
+        TC_IS(logContext, isTriangle(triangles[1], 4.0f, -3.25f, 2.5f));
+        TC_IS(logContext, isTriangle(triangles[2], 2.5f, 4.0f, 1.0f));
+        TC_IS(logContext, triangles[1].m_b.y == 2.0f);
+    }
+
+    // However many threads read the file, the result is the same.
+    bool matches = true;
+    for (size_t threadCount = 2; threadCount != 8; ++threadCount)
+    {
+        const std::vector<tc::Triangle> split =
+            readTriangles(filename, threadCount);
+        matches = matches && split.size() == triangles.size();
+        for (size_t i = 0; matches && i != split.size(); ++i)
+        {
+            matches = split[i].m_a == triangles[i].m_a &&
+                      split[i].m_b == triangles[i].m_b &&
+                      split[i].m_c == triangles[i].m_c;
+        }
+    }
+    TC_IS(logContext, matches);
+
+    // The file is a single object, which gives its arrays directly.
+    tc::Ply_ObjectIterator iterator;
+    iterator.setFilename(filename.c_str());
+    iterator.setThreadCount(3);
+    size_t objectCount = 0;
+    iterator.begin();
+    while (iterator.next())
+    {
+        ++objectCount;
+        TC_IS(logContext, iterator.hasTriangles());
+        TC_IS(logContext, iterator.getBounds().m_max.y > 3.0f);
+        TC_IS(logContext, iterator.getBounds().m_min.x < -3.25f);
+        tc::ObjectIterator_Mesh mesh;
+        TC_IS(logContext, iterator.getMesh(mesh) && mesh.m_vertexCount == 4 &&
+                              mesh.m_triangleCount == 3 &&
+                              mesh.m_indices[3] == 3 &&
+                              mesh.m_vertices[4] == 2.5f);
+    }
+    iterator.end();
+    TC_IS(logContext, objectCount == 1);
+
+    unlink(filename.c_str());
+    /// [test_plyiterator read]
+}
+
+//------------------------------------------------------------------------------
+void polygons(const tc::LogContext& logContext)
+{
+    /// [test_plyiterator polygons]
+    // A quad and a triangle, each with a list of texture coordinates, so the
+    // faces aren't all the same size.
+    std::string bytes(
+        "ply\r\n"
+        "format binary_little_endian 1.0\r\n"
+        "element vertex 4\r\n"
+        "property double x\r\n"
+        "property double y\r\n"
+        "property double z\r\n"
+        "element face 2\r\n"
+        "property list uchar float texcoord\r\n"
+        "property list uint uint vertex_index\r\n"
+        "property short flags\r\n"
+        "end_header\r\n");
+    for (size_t i = 0; i != 4; ++i)
+    {
+        append(bytes, static_cast<double>(i + 1));
+        append(bytes, 0.0);
+        append(bytes, 0.0);
+    }
+    append(bytes, static_cast<unsigned char>(1));
+    append(bytes, 0.5f);
+    append(bytes, 4u);
+    append(bytes, 0u);
+    append(bytes, 1u);
+    append(bytes, 2u);
+    append(bytes, 3u);
+    append(bytes, static_cast<short>(7));
+    append(bytes, static_cast<unsigned char>(0));
+    append(bytes, 3u);
+    append(bytes, 3u);
+    append(bytes, 2u);
+    append(bytes, 1u);
+    append(bytes, static_cast<short>(7));
+    const std::string filename = writeTemporaryFile(bytes);
+    TC_IS(logContext, !filename.empty());
+
+    // The quad is split into a fan.
+    const std::vector<tc::Triangle> triangles = readTriangles(filename, 2);
+    TC_IS(logContext, triangles.size() == 3);
+    if (triangles.size() == 3)
+    {
+        TC_IS(logContext, isTriangle(triangles[0], 1.0f, 2.0f, 3.0f));
+        TC_IS(logContext, isTriangle(triangles[1], 1.0f, 3.0f, 4.0f));
+        TC_IS(logContext, isTriangle(triangles[2], 4.0f, 3.0f, 2.0f));
+    }
+
+    // A file that has been cut short has no triangles.
+    TC_IS(logContext, truncate(filename.c_str(), bytes.size() - 1) == 0);
+    TC_IS(logContext, readTriangles(filename, 2).empty());
+    unlink(filename.c_str());
+    /// [test_plyiterator polygons]
+}
+
+//------------------------------------------------------------------------------
+void reject(const tc::LogContext& logContext)
+{
+    /// [test_plyiterator reject]
+    // Ascii files aren't read.
+    const std::string filename = writeTemporaryFile(
+        "ply\n"
+        "format ascii 1.0\n"
+        "element vertex 3\n"
+        "property float x\n"
+        "property float y\n"
+        "property float z\n"
+        "element face 1\n"
+        "property list uchar int vertex_indices\n"
+        "end_header\n"
+        "0 0 0\n"
+        "1 0 0\n"
+        "0 1 0\n"
+        "3 0 1 2\n");
+    TC_IS(logContext, !filename.empty());
+    TC_IS(logContext, readTriangles(filename, 1).empty());
+
+    // Nor are files that don't exist.
+    unlink(filename.c_str());
+    TC_IS(logContext, readTriangles(filename, 1).empty());
+    tc::Ply_ObjectIterator iterator;
+    iterator.setFilename(filename.c_str());
+    iterator.begin();
+    TC_IS(logContext, !iterator.next());
+    iterator.end();
+    /// [test_plyiterator reject]
+}
+
+//------------------------------------------------------------------------------
+void batches(const tc::LogContext& logContext)
+{
+    /// [test_plyiterator batches]
+    // Enough faces for each thread to decode a run of several. Every fifth
+    // face refers to a vertex that doesn't exist.
+    std::string bytes(
+        "ply\n"
+        "format binary_little_endian 1.0\n"
+        "element vertex 8\n"
+        "property float x\n"
+        "property float y\n"
+        "property float z\n"
+        "element face 40\n"
+        "property list uchar int vertex_indices\n"
+        "end_header\n");
+    for (size_t i = 0; i != 8; ++i)
+    {
+        append(bytes, static_cast<float>(i));
+        append(bytes, 0.0f);
+        append(bytes, 0.0f);
+    }
+    for (size_t i = 0; i != 40; ++i)
+    {
+        append(bytes, static_cast<unsigned char>(3));
+        append(bytes, static_cast<int>(i % 8));
+        append(bytes, static_cast<int>((i + 1) % 8));
+        append(bytes, static_cast<int>(i % 5 == 4 ? 99 : i % 3));
+    }
+    const std::string filename = writeTemporaryFile(bytes);
+    TC_IS(logContext, !filename.empty());
+
+    // Reading in batches gives the same triangles as reading one at a time,
+    // whichever the capacity, so batches end part way through the run a
+    // thread decoded and cross into the next. The skipped faces are dropped
+    // as the file is read, so the hint is exact.
+    bool matches = true;
+    bool hintsMatch = true;
+    for (size_t threadCount = 1; threadCount != 5; ++threadCount)
+    {
+        const std::vector<tc::Triangle> triangles =
+            readTriangles(filename, threadCount);
+        matches = matches && triangles.size() == 32;
+        for (size_t capacity = 1; capacity != 12; ++capacity)
+        {
+            tc::Ply_TriangleIterator iterator;
+            iterator.setFilename(filename.c_str());
+            iterator.setThreadCount(threadCount);
+            size_t sizeHint = 0;
+            bool fits = false;
+            matches = matches &&
+                      isSame(readBatches(iterator, capacity, sizeHint, fits),
+                             triangles) &&
+                      fits;
+            hintsMatch = hintsMatch && sizeHint == 32;
+        }
+    }
+    TC_IS(logContext, matches);
+    TC_IS(logContext, hintsMatch);
+
+    // A batch carries on from the triangle next moved onto, and the last
+    // batch is cut short.
+    const std::vector<tc::Triangle> triangles = readTriangles(filename, 2);
+    tc::Ply_TriangleIterator iterator;
+    iterator.setFilename(filename.c_str());
+    iterator.setThreadCount(2);
+    iterator.begin();
+    TC_IS(logContext, iterator.next());
+    const tc::Triangle first = *iterator;
+    TC_IS(logContext, iterator.sizeHint() == 31);
+    std::vector<tc::Vector3<float> > corners(40 * 3);
+    TC_IS(logContext, iterator.nextBatch(&corners[0], 3) == 3);
+    TC_IS(logContext, triangles.size() == 32 &&
+                          first.m_a == triangles[0].m_a &&
+                          corners[0] == triangles[1].m_a &&
+                          corners[8] == triangles[3].m_c);
+    TC_IS(logContext, iterator.nextBatch(&corners[0], 40) == 28);
+    TC_IS(logContext, corners[(28 * 3) - 1] == triangles[31].m_c);
+    TC_IS(logContext, iterator.sizeHint() == 0);
+    TC_IS(logContext, iterator.nextBatch(&corners[0], 40) == 0);
+    iterator.end();
+
+    unlink(filename.c_str());
+    /// [test_plyiterator batches]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::plyiteratorRunUnitTests(const tc::LogContext& logContext)
+{
+    read(logContext);
+    polygons(logContext);
+    reject(logContext);
+    batches(logContext);
+}
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/log.h"
+#include "trace/raysort.h"
+#include "trace/test.h"
+//------------------------------------------------------------------------------
+#include <vector>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+void key(const tc::LogContext& logContext)
+{
+    /// [test_raysort key]
+    const tc::BoundsF bounds(tc::Vector3<float>(0.0f, 0.0f, 0.0f),
+                             tc::Vector3<float>(1.0f, 1.0f, 1.0f));
+    const tc::Vector3<float> up(0.0f, 1.0f, 0.0f);
+    const tc::Vector3<float> down(0.0f, -1.0f, 0.0f);
+
+    const uint64_t near = tc::RaySorter::computeKey(
+        tc::Ray(up, tc::Vector3<float>(0.1f, 0.1f, 0.1f)), bounds);
+    const uint64_t nearby = tc::RaySorter::computeKey(
+        tc::Ray(up, tc::Vector3<float>(0.11f, 0.1f, 0.1f)), bounds);
+    const uint64_t far = tc::RaySorter::computeKey(
+        tc::Ray(up, tc::Vector3<float>(0.9f, 0.9f, 0.9f)), bounds);
+    const uint64_t opposite = tc::RaySorter::computeKey(
+        tc::Ray(down, tc::Vector3<float>(0.1f, 0.1f, 0.1f)), bounds);
+
+    // Rays close together have close keys.
+    TC_IS(logContext, near < far);
+    TC_IS(logContext, nearby - near < far - near);
+
+    // The direction's octant comes first.
+    TC_IS(logContext, far < opposite);
+
+    // Origins outside of the bounds are clamped to them.
+    TC_IS(logContext,
+          tc::RaySorter::computeKey(
+              tc::Ray(up, tc::Vector3<float>(-5.0f, -5.0f, -5.0f)), bounds) <=
+              near);
+    /// [test_raysort key]
+}
+
+//------------------------------------------------------------------------------
+void sort(const tc::LogContext& logContext)
+{
+    /// [test_raysort sort]
+    const tc::Vector3<float> direction(0.0f, 0.0f, 1.0f);
+
+    // Rays alternating between two ends of a line.
+    tc::RayStream stream;
+    std::vector<size_t> tags;
+    for (size_t i = 0; i != 8; ++i)
+    {
+        const float x = static_cast<float>(i % 2) * 10.0f +
+                        static_cast<float>(i) * 0.1f;
+        stream.push(tc::Ray(direction, tc::Vector3<float>(x, 0.0f, 0.0f)));
+        tags.push_back(i);
+    }
+
+    tc::RaySorter sorter;
+    sorter.sort(stream, tags);
+
+    // The rays at each end end up next to each other, and every ray keeps its
+    // tag.
+    bool keepsTags = tags.size() == stream.size();
+    bool isGrouped = true;
+    for (size_t i = 0; i != stream.size(); ++i)
+    {
+        const float x = static_cast<float>(tags[i] % 2) * 10.0f +
+                        static_cast<float>(tags[i]) * 0.1f;
+        keepsTags = keepsTags && stream.getRay(i).m_position.x == x;
+        isGrouped = isGrouped && (tags[i] % 2) == (i < 4 ? 0 : 1);
+    }
+    TC_IS(logContext, keepsTags);
+    TC_IS(logContext, isGrouped);
+    /// [test_raysort sort]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::raysortRunUnitTests(const tc::LogContext& logContext)
+{
+    key(logContext);
+    sort(logContext);
+}
@@ -0,0 +1,157 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/log.h"
+#include "trace/sampler.h"
+#include "trace/test.h"
+//------------------------------------------------------------------------------
+#include <vector>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Returns true if every sample in the range [0, 1) and 'sampleCount' samples
+// fall into 'sampleCount' different strata along each axis.
+bool isStratified(tc::Sampler& sampler, const size_t pixelIndex,
+                  const size_t dimension, const size_t sampleCount)
+{
+    std::vector<bool> strataX(sampleCount, false);
+    std::vector<bool> strataY(sampleCount, false);
+
+    for (size_t i = 0; i != sampleCount; ++i)
+    {
+        sampler.startPixelSample(pixelIndex, i);
+        for (size_t d = 0; d != dimension; d += 2)
+        {
+            sampler.get2D();
+        }
+        const tc::Vector3<float> sample = sampler.get2D();
+        if (sample.x < 0.0f || sample.x >= 1.0f || sample.y < 0.0f ||
+            sample.y >= 1.0f)
+        {
+            return false;
+        }
+
+        const size_t x = static_cast<size_t>(sample.x * sampleCount);
+        const size_t y = static_cast<size_t>(sample.y * sampleCount);
+        if (strataX[x] || strataY[y])
+        {
+            return false;
+        }
+        strataX[x] = true;
+        strataY[y] = true;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+void sobolstratification(const tc::LogContext& logContext)
+{
+    /// [test_sampler sobolstratification]
+    tc::SobolSampler sampler;
+    TC_IS(logContext, isStratified(sampler, 0, 0, 16));
+    TC_IS(logContext, isStratified(sampler, 7, 0, 64));
+    TC_IS(logContext, isStratified(sampler, 7, 6, 32));
+    /// [test_sampler sobolstratification]
+}
+
+//------------------------------------------------------------------------------
+void haltonrange(const tc::LogContext& logContext)
+{
+    /// [test_sampler haltonrange]
+    tc::HaltonSampler sampler;
+    bool inRange = true;
+    for (size_t i = 0; i != 256; ++i)
+    {
+        sampler.startPixelSample(3, i);
+        for (size_t d = 0; d != 4; ++d)
+        {
+            const tc::Vector3<float> sample = sampler.get2D();
+            inRange = inRange && sample.x >= 0.0f && sample.x < 1.0f &&
+                      sample.y >= 0.0f && sample.y < 1.0f;
+        }
+    }
+    TC_IS(logContext, inRange);
+    /// [test_sampler haltonrange]
+}
+
+//------------------------------------------------------------------------------
+void repeatable(const tc::LogContext& logContext)
+{
+    /// [test_sampler repeatable]
+    // The same pixel sample always gives the same values.
+    tc::SobolSampler sampler;
+    sampler.startPixelSample(12, 5);
+    sampler.get2D();
+    const tc::Vector3<float> a = sampler.get2D();
+
+    sampler.startPixelSample(99, 1);
+    sampler.get2D();
+
+    sampler.startPixelSample(12, 5);
+    sampler.get2D();
+    const tc::Vector3<float> b = sampler.get2D();
+    TC_IS(logContext, a.x == b.x && a.y == b.y);
+    /// [test_sampler repeatable]
+}
+
+//------------------------------------------------------------------------------
+// Returns true if resuming a pixel sample part way through gives the same
+// values as drawing them all in one go.
+bool isResumable(tc::Sampler& sampler)
+{
+    sampler.startPixelSample(21, 3);
+    sampler.get2D();
+    sampler.get1D();
+    const size_t dimension = sampler.getDimension();
+    const tc::Vector3<float> a = sampler.get2D();
+
+    sampler.startPixelSample(4, 0);
+    sampler.get2D();
+
+    sampler.resumePixelSample(21, 3, dimension);
+    const tc::Vector3<float> b = sampler.get2D();
+    return dimension == 3 && a.x == b.x && a.y == b.y;
+}
+
+//------------------------------------------------------------------------------
+void resumable(const tc::LogContext& logContext)
+{
+    /// [test_sampler resumable]
+    tc::RandomSampler randomSampler;
+    tc::HaltonSampler haltonSampler;
+    tc::SobolSampler sobolSampler;
+    TC_IS(logContext, isResumable(randomSampler));
+    TC_IS(logContext, isResumable(haltonSampler));
+    TC_IS(logContext, isResumable(sobolSampler));
+    /// [test_sampler resumable]
+}
+
+//------------------------------------------------------------------------------
+void parsesamplertype(const tc::LogContext& logContext)
+{
+    /// [test_sampler parsesamplertype]
+    TC_IS(logContext,
+          tc::parseSamplerType("halton", tc::kSamplerSobol) ==
+              tc::kSamplerHalton);
+    TC_IS(logContext,
+          tc::parseSamplerType("random", tc::kSamplerSobol) ==
+              tc::kSamplerRandom);
+    TC_IS(logContext,
+          tc::parseSamplerType("unknown", tc::kSamplerSobol) ==
+              tc::kSamplerSobol);
+    /// [test_sampler parsesamplertype]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::samplerRunUnitTests(const tc::LogContext& logContext)
+{
+    sobolstratification(logContext);
+    haltonrange(logContext);
+    repeatable(logContext);
+    resumable(logContext);
+    parsesamplertype(logContext);
+}
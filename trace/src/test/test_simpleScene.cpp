@@ -0,0 +1,453 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/biniterator.h"
+#include "trace/log.h"
+#include "trace/ray.h"
+#include "trace/simpleScene.h"
+#include "trace/test.h"
+#include "trace/thread.h"
+#include "trace/triangleCache.h"
+#include "trace/triangleIterator.h"
+//------------------------------------------------------------------------------
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+const size_t kMeshCount = 4;
+
+//------------------------------------------------------------------------------
+// Writes a .tbs file holding kMeshCount meshes of a single triangle each. Mesh
+// 'i' spans x from 2i to 2i + 1, so it can be told apart by its bounds.
+std::string writeMeshes()
+{
+    char filename[] = "/tmp/test_simpleSceneXXXXXX";
+    const int file = mkstemp(filename);
+    if (file == -1)
+    {
+        return std::string();
+    }
+    close(file);
+
+    // The arrays have to outlive the writer. Each vertex takes four floats.
+    float vertices[kMeshCount * 12] = {};
+    const uint32_t indices[] = {0, 1, 2};
+    tc::Bin_Writer writer;
+    for (size_t i = 0; i != kMeshCount; ++i)
+    {
+        float* const triangle = vertices + (i * 12);
+        triangle[0] = static_cast<float>(i * 2);
+        triangle[4] = triangle[0] + 1.0f;
+        triangle[8] = triangle[0];
+        triangle[9] = 1.0f;
+
+        tc::ObjectIterator_Mesh mesh;
+        mesh.m_vertices = triangle;
+        mesh.m_vertexCount = 3;
+        mesh.m_indices = indices;
+        mesh.m_triangleCount = 1;
+        writer.addPolyMesh("triangle", tc::Bin_Node::kNoParent, mesh);
+    }
+    return writer.write(filename) ? std::string(filename) : std::string();
+}
+
+//------------------------------------------------------------------------------
+// Counts the meshes that are loaded, and waits a little while loading each, so
+// that other threads try to load the same mesh meanwhile.
+class CountingObjectIterator : public tc::Bin_ObjectIterator
+{
+public:
+    CountingObjectIterator() : m_isIterating(false)
+    {
+        for (size_t i = 0; i != kMeshCount; ++i)
+        {
+            m_loadCounts[i] = 0;
+        }
+    }
+
+    // Moving onto an object gives its mesh too, which isn't counted.
+    virtual bool next()
+    {
+        m_isIterating = true;
+        const bool hasNext = tc::Bin_ObjectIterator::next();
+        m_isIterating = false;
+        return hasNext;
+    }
+
+    virtual bool loadMesh(const size_t proxy,
+                          tc::ObjectIterator_Mesh& mesh) const
+    {
+        if (!m_isIterating)
+        {
+            __sync_fetch_and_add(&m_loadCounts[proxy % kMeshCount], 1);
+            usleep(1000);
+        }
+        return tc::Bin_ObjectIterator::loadMesh(proxy, mesh);
+    }
+
+    mutable unsigned int m_loadCounts[kMeshCount];
+
+private:
+    bool m_isIterating;
+};
+
+//------------------------------------------------------------------------------
+// Adds every mesh of 'iterator' to 'pager'.
+void addMeshes(tc::ObjectIterator& iterator, tc::SimpleScene_Pager& pager)
+{
+    iterator.begin();
+    while (iterator.next())
+    {
+        size_t proxy = 0;
+        if (iterator.hasTriangles() && iterator.getProxy(proxy))
+        {
+            pager.addMesh(proxy);
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+// The bounds of a mesh are grown a little, so they are only compared with the
+// middle of the triangle.
+bool isMesh(const tc::SimplePolyMesh& mesh, const size_t index)
+{
+    const float middle = static_cast<float>(index * 2) + 0.5f;
+    const tc::BoundsF bounds = mesh.getBounds();
+    return bounds.m_min.x > middle - 1.0f && bounds.m_min.x < middle &&
+           bounds.m_max.x > middle && bounds.m_max.x < middle + 1.0f;
+}
+
+//------------------------------------------------------------------------------
+size_t countLoads(const CountingObjectIterator& iterator)
+{
+    size_t count = 0;
+    for (size_t i = 0; i != kMeshCount; ++i)
+    {
+        count += iterator.m_loadCounts[i];
+    }
+    return count;
+}
+
+//------------------------------------------------------------------------------
+// Acquires every mesh from a thread each, starting from a different mesh on
+// each thread, and counts the meshes that weren't the ones asked for.
+class AcquireThreads : public tc::ThreadBundle
+{
+public:
+    AcquireThreads(tc::SimpleScene_Pager& pager, const size_t threadCount,
+                   const size_t repeatCount)
+        : tc::ThreadBundle(tc::Range(0, threadCount), threadCount),
+          m_pager(pager),
+          m_repeatCount(repeatCount),
+          m_wrongCount(0)
+    {
+    }
+
+    tc::SimpleScene_Pager& m_pager;
+    const size_t m_repeatCount;
+    unsigned int m_wrongCount;
+
+private:
+    virtual void run(const size_t threadIndex, const tc::Range&)
+    {
+        for (size_t repeat = 0; repeat != m_repeatCount; ++repeat)
+        {
+            for (size_t i = 0; i != kMeshCount; ++i)
+            {
+                const size_t index = (threadIndex + i) % kMeshCount;
+                const tc::SimplePolyMesh& mesh = m_pager.acquire(index);
+                tc::yieldThread();
+                if (!isMesh(mesh, index))
+                {
+                    __sync_fetch_and_add(&m_wrongCount, 1);
+                }
+                m_pager.release(index);
+            }
+        }
+    }
+};
+
+//------------------------------------------------------------------------------
+// Iterates over the triangles of an array.
+class ArrayTriangleIterator : public tc::TriangleIterator
+{
+public:
+    ArrayTriangleIterator(const tc::Vector3<float>* corners,
+                          const size_t triangleCount)
+        : m_corners(corners), m_triangleCount(triangleCount), m_next(0)
+    {
+    }
+
+    virtual void begin()
+    {
+        m_next = 0;
+    }
+
+    virtual bool next()
+    {
+        if (m_next == m_triangleCount)
+        {
+            return false;
+        }
+        ++m_next;
+        return true;
+    }
+
+    virtual tc::Triangle operator*() const
+    {
+        const tc::Vector3<float>* const corners =
+            m_corners + ((m_next - 1) * 3);
+        return tc::Triangle(corners[0], corners[1], corners[2]);
+    }
+
+private:
+    const tc::Vector3<float>* m_corners;
+    const size_t m_triangleCount;
+    size_t m_next;
+};
+
+//------------------------------------------------------------------------------
+// Whether the position of vertex 'index' of 'mesh' has the same bits as
+// 'corner'.
+bool isVertex(const tc::ObjectIterator_Mesh& mesh, const size_t index,
+              const tc::Vector3<float>& corner)
+{
+    const float position[] = {corner.x, corner.y, corner.z};
+    return index < mesh.m_vertexCount &&
+           std::memcmp(mesh.m_vertices + (index * 4), position,
+                       sizeof(position)) == 0;
+}
+
+//------------------------------------------------------------------------------
+void sharedCorners(const tc::LogContext& logContext)
+{
+    /// [test_simpleScene sharedCorners]
+    // Corners are only shared when their positions have the same bits. The
+    // positive and negative zero compare equal, but aren't shared, and
+    // neither are 1 and the float just above it.
+    const tc::Vector3<float> a(0.0f, 0.0f, 0.0f);
+    const tc::Vector3<float> negativeA(-0.0f, 0.0f, 0.0f);
+    const tc::Vector3<float> b(1.0f, 0.0f, 0.0f);
+    const tc::Vector3<float> aboveB(1.00000012f, 0.0f, 0.0f);
+    const tc::Vector3<float> c(0.0f, 1.0f, 0.0f);
+    const tc::Vector3<float> d(1.0f, 1.0f, 0.0f);
+    const tc::Vector3<float> e(2.0f, 0.0f, 0.0f);
+    const tc::Vector3<float> corners[] = {a,         b, c,
+                                          b,         d, c,
+                                          negativeA, b, e,
+                                          a,         d, e,
+                                          aboveB,    c, d};
+    const size_t triangleCount = (sizeof(corners) / sizeof(corners[0])) / 3;
+
+    ArrayTriangleIterator iterator(corners, triangleCount);
+    tc::SimplePolyMesh polyMesh;
+    polyMesh.init(iterator);
+    polyMesh.build();
+    tc::ObjectIterator_Mesh mesh;
+    std::vector<char> acceleration;
+    polyMesh.getMesh(mesh, acceleration);
+
+    // Each vertex is stored once, in the order it first appears, rather than
+    // the order the corners are sorted in.
+    TC_IS(logContext, mesh.m_triangleCount == triangleCount);
+    TC_IS(logContext, mesh.m_vertexCount == 7);
+    const tc::Vector3<float> vertices[] = {a, b, c, d, negativeA, e, aboveB};
+    bool verticesMatch = true;
+    for (size_t i = 0; i != 7; ++i)
+    {
+        verticesMatch = verticesMatch && isVertex(mesh, i, vertices[i]);
+    }
+    TC_IS(logContext, verticesMatch);
+
+    const uint32_t indices[] = {0, 1, 2, 1, 3, 2, 4, 1, 5, 0, 3, 5, 6, 2, 3};
+    TC_IS(logContext, std::memcmp(mesh.m_indices, indices,
+                                  sizeof(indices)) == 0);
+
+    // Every triangle is rebuilt from the shared vertices exactly.
+    bool rebuilt = true;
+    for (size_t i = 0; i != triangleCount * 3; ++i)
+    {
+        rebuilt = rebuilt && isVertex(mesh, mesh.m_indices[i], corners[i]);
+    }
+    TC_IS(logContext, rebuilt);
+    /// [test_simpleScene sharedCorners]
+}
+
+//------------------------------------------------------------------------------
+void pager(const tc::LogContext& logContext)
+{
+    /// [test_simpleScene pager]
+    const std::string filename = writeMeshes();
+    TC_IS(logContext, !filename.empty());
+
+    // Every mesh is the same size. Holding a mesh keeps it loaded, even when
+    // the budget is less than the size of a single mesh.
+    size_t meshSize = 0;
+    {
+        CountingObjectIterator iterator;
+        iterator.setFilename(filename.c_str());
+        tc::SimpleScene_Pager pager(iterator, 1);
+        addMeshes(iterator, pager);
+        TC_IS(logContext, isMesh(pager.acquire(0), 0));
+        meshSize = pager.getMemoryUsed();
+        TC_IS(logContext, meshSize != 0 && pager.isLoaded(0));
+        pager.release(0);
+    }
+
+    // With room for two meshes, the least recently used mesh is freed.
+    {
+        CountingObjectIterator iterator;
+        iterator.setFilename(filename.c_str());
+        tc::SimpleScene_Pager pager(iterator, meshSize * 2);
+        addMeshes(iterator, pager);
+        pager.acquire(0);
+        pager.release(0);
+        pager.acquire(1);
+        pager.release(1);
+        pager.acquire(0);
+        pager.release(0);
+        TC_IS(logContext, isMesh(pager.acquire(2), 2));
+        pager.release(2);
+        TC_IS(logContext, pager.isLoaded(0));
+        TC_IS(logContext, !pager.isLoaded(1));
+        TC_IS(logContext, pager.isLoaded(2));
+        TC_IS(logContext, !pager.isLoaded(3));
+        TC_IS(logContext, pager.getMemoryUsed() == meshSize * 2);
+        TC_IS(logContext, countLoads(iterator) == 3);
+    }
+
+    // Meshes that are in use are never freed, so the budget is exceeded.
+    {
+        CountingObjectIterator iterator;
+        iterator.setFilename(filename.c_str());
+        tc::SimpleScene_Pager pager(iterator, 1);
+        addMeshes(iterator, pager);
+        pager.acquire(0);
+        const tc::SimplePolyMesh& held = pager.acquire(1);
+        TC_IS(logContext, pager.getMemoryUsed() == meshSize * 2);
+        pager.release(0);
+        pager.acquire(2);
+        TC_IS(logContext, !pager.isLoaded(0));
+        TC_IS(logContext, pager.isLoaded(1) && isMesh(held, 1));
+        TC_IS(logContext, pager.isLoaded(2));
+        pager.release(1);
+        pager.release(2);
+    }
+
+    // Threads that need a mesh that is being loaded wait for it, rather than
+    // loading it again.
+    {
+        CountingObjectIterator iterator;
+        iterator.setFilename(filename.c_str());
+        tc::SimpleScene_Pager pager(iterator, meshSize * kMeshCount);
+        addMeshes(iterator, pager);
+        AcquireThreads threads(pager, 8, 1);
+        threads.start();
+        threads.join();
+        TC_IS(logContext, threads.m_wrongCount == 0);
+        bool loadedOnce = true;
+        for (size_t i = 0; i != kMeshCount; ++i)
+        {
+            loadedOnce = loadedOnce && iterator.m_loadCounts[i] == 1;
+        }
+        TC_IS(logContext, loadedOnce);
+        TC_IS(logContext, pager.getMemoryUsed() == meshSize * kMeshCount);
+    }
+
+    // With a tiny budget, meshes may be freed and loaded again as the threads
+    // move between them, but never while a thread is using them.
+    {
+        CountingObjectIterator iterator;
+        iterator.setFilename(filename.c_str());
+        tc::SimpleScene_Pager pager(iterator, 1);
+        addMeshes(iterator, pager);
+        AcquireThreads threads(pager, 8, 4);
+        threads.start();
+        threads.join();
+        TC_IS(logContext, threads.m_wrongCount == 0);
+        TC_IS(logContext, countLoads(iterator) >= kMeshCount);
+    }
+
+    unlink(filename.c_str());
+    /// [test_simpleScene pager]
+}
+
+//------------------------------------------------------------------------------
+void pagedScene(const tc::LogContext& logContext)
+{
+    /// [test_simpleScene pagedScene]
+    const std::string filename = writeMeshes();
+    TC_IS(logContext, !filename.empty());
+
+    // A scene that pages its meshes hits the same triangles as one that loads
+    // them all up front.
+    tc::Bin_ObjectIterator iterator;
+    iterator.setFilename(filename.c_str());
+    const tc::SimpleScene scene(iterator);
+    CountingObjectIterator pagedIterator;
+    pagedIterator.setFilename(filename.c_str());
+    const tc::SimpleScene pagedScene(pagedIterator, 1);
+
+    tc::SearchCache searchCache;
+    std::vector<tc::TraceResult> hits;
+    bool matches = true;
+    for (size_t i = 0; i != kMeshCount * 4; ++i)
+    {
+        const float x = (static_cast<float>(i) * 0.5f) + 0.1f;
+        const tc::Ray ray(tc::Vector3<float>(0.0f, 0.0f, -1.0f),
+                          tc::Vector3<float>(x, 0.2f, 1.0f));
+        const tc::TraceResult result = scene.geo_trace(searchCache, ray);
+        const tc::TraceResult pagedResult =
+            pagedScene.geo_trace(searchCache, ray);
+        matches = matches &&
+                  result.m_distanceAlongRay == pagedResult.m_distanceAlongRay &&
+                  result.m_geoId.m_objectIndex ==
+                      pagedResult.m_geoId.m_objectIndex &&
+                  result.m_geoId.m_elementIndex ==
+                      pagedResult.m_geoId.m_elementIndex &&
+                  result.m_normal == pagedResult.m_normal;
+        // The rays that miss the triangles hit the light around them.
+        if (pagedResult.m_geoId.m_objectIndex <= kMeshCount)
+        {
+            hits.push_back(pagedResult);
+        }
+    }
+    TC_IS(logContext, matches);
+    TC_IS(logContext, hits.size() == kMeshCount * 2);
+
+    // Each hit keeps the normal of its triangle, so the hits can be shaded
+    // without loading the meshes again, although the budget only leaves
+    // room for one.
+    const tc::SimpleScene_Shading shading(pagedScene);
+    const size_t loads = countLoads(pagedIterator);
+    bool framesMatch = true;
+    for (size_t i = 0; i != hits.size(); ++i)
+    {
+        const tc::SurfaceFrame frame = shading.shade_getSurfaceFrame(hits[i]);
+        framesMatch = framesMatch && hits[i].hasNormal() &&
+                      frame.m_normal ==
+                          scene.shade_getSurfaceFrame(hits[i].m_geoId)
+                              .m_normal;
+    }
+    TC_IS(logContext, framesMatch);
+    TC_IS(logContext, countLoads(pagedIterator) == loads);
+
+    unlink(filename.c_str());
+    /// [test_simpleScene pagedScene]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::simpleSceneRunUnitTests(const tc::LogContext& logContext)
+{
+    sharedCorners(logContext);
+    pager(logContext);
+    pagedScene(logContext);
+}
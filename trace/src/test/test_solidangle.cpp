@@ -71,6 +71,72 @@ void stratifiedsampling(const tc::LogContext& logContext)
     /// [test_solidangle stratifiedsampling]
 }
 
+//------------------------------------------------------------------------------
+void cosinedirectiontable(const tc::LogContext& logContext)
+{
+    /// [test_solidangle cosinedirectiontable]
+    const float pitchAngleRange = 0.9f;
+    const size_t pitchSamples = 2;
+    const size_t yawSamples = pitchSamples * 4;
+    const tc::CosineDirectionTable table(pitchAngleRange, yawSamples,
+                                         pitchSamples);
+
+    const float pitchLower = 1.0f - pitchAngleRange;
+    const float pitchUpper = pitchLower + (pitchAngleRange * M_PI_2);
+
+    bool isNormalized = true;
+    bool isInRange = true;
+    bool isInStrata = true;
+    bool weightMatchesPdf = true;
+    for (size_t yaw = 0; yaw != yawSamples; ++yaw)
+    {
+        for (size_t pitch = 0; pitch != pitchSamples; ++pitch)
+        {
+            for (size_t i = 0; i != 16; ++i)
+            {
+                const tc::Vector3<float> sample(
+                    0.01f + (static_cast<float>(i % 4) * 0.32f),
+                    0.01f + (static_cast<float>(i / 4) * 0.32f));
+                float weight = 0.0f;
+                const tc::Vector3<float> direction =
+                    table.generate(yaw, pitch, sample, weight);
+
+                isNormalized =
+                    isNormalized && fabs(direction.dot(direction) - 1.0f) <
+                                        0.0001f;
+
+                const float theta = acos(direction.y);
+                isInRange = isInRange && theta >= pitchLower - 0.0001f &&
+                            theta <= pitchUpper + 0.0001f;
+
+                // The yaw must stay inside its own strata.
+                float phi = atan2(direction.x, direction.z);
+                phi = phi < 0.0f ? phi + (2.0f * M_PI) : phi;
+                const float yawStep = (2.0f * M_PI) / yawSamples;
+                isInStrata = isInStrata && phi >= (yaw * yawStep) - 0.0001f &&
+                             phi <= ((yaw + 1) * yawStep) + 0.0001f;
+
+                // The weight converts from the cosine distribution to the
+                // uniform one.
+                const float uniformPdf = tc::computeStratifiedDirectionPdf(
+                    pitchAngleRange, direction.y);
+                weightMatchesPdf =
+                    weightMatchesPdf &&
+                    fabs((weight * table.computePdf(direction.y)) -
+                         uniformPdf) < uniformPdf * 0.001f;
+            }
+        }
+    }
+    TC_IS(logContext, isNormalized);
+    TC_IS(logContext, isInRange);
+    TC_IS(logContext, isInStrata);
+    TC_IS(logContext, weightMatchesPdf);
+
+    // Straight up is outside of the range the table covers.
+    TC_IS(logContext, table.computePdf(1.0f) == 0.0f);
+    /// [test_solidangle cosinedirectiontable]
+}
+
 //------------------------------------------------------------------------------
 class LightCurve
 {
@@ -317,6 +383,7 @@ void tc::solidangleRunUnitTests(const tc::LogContext& logContext)
     sphericaltocartesian(logContext);
     halfwaypoint(logContext);
     stratifiedsampling(logContext);
+    cosinedirectiontable(logContext);
     importance_sampling_experiment(logContext);
     importance_sampling_weighted_curve(logContext);
 }
@@ -0,0 +1,116 @@
+//------------------------------------------------------------------------------
+// Copywrite Luke Titley 2015
+//------------------------------------------------------------------------------
+#include "trace/log.h"
+#include "trace/test.h"
+#include "trace/triangleIterator.h"
+//------------------------------------------------------------------------------
+#include <vector>
+
+namespace
+{
+
+//------------------------------------------------------------------------------
+// Counts up through 'triangleCount' triangles, whose corners are told apart
+// by their x coordinate. Only next and operator* are implemented, so batches
+// are read with the default tc::TriangleIterator::nextBatch.
+class CountingTriangleIterator : public tc::TriangleIterator
+{
+public:
+    explicit CountingTriangleIterator(const size_t triangleCount)
+        : m_triangleCount(triangleCount), m_next(0)
+    {
+    }
+
+    virtual void begin()
+    {
+        m_next = 0;
+    }
+
+    virtual bool next()
+    {
+        if (m_next == m_triangleCount)
+        {
+            return false;
+        }
+        ++m_next;
+        return true;
+    }
+
+    virtual tc::Triangle operator*() const
+    {
+        const float x = static_cast<float>((m_next - 1) * 3);
+        return tc::Triangle(tc::Vector3<float>(x, 0.0f, 0.0f),
+                            tc::Vector3<float>(x + 1.0f, 0.0f, 0.0f),
+                            tc::Vector3<float>(x + 2.0f, 1.0f, 0.0f));
+    }
+
+private:
+    const size_t m_triangleCount;
+    size_t m_next;
+};
+
+//------------------------------------------------------------------------------
+void nextBatch(const tc::LogContext& logContext)
+{
+    /// [test_triangleIterator nextBatch]
+    const size_t triangleCount = 10;
+    CountingTriangleIterator iterator(triangleCount);
+
+    std::vector<tc::Triangle> triangles;
+    iterator.begin();
+    while (iterator.next())
+    {
+        triangles.push_back(*iterator);
+    }
+    iterator.end();
+    TC_IS(logContext, triangles.size() == triangleCount);
+
+    // Whichever the capacity, the batches hold the same triangles as
+    // next and operator* give, and only the last batch is cut short.
+    bool matches = true;
+    for (size_t capacity = 1; capacity != triangleCount + 2; ++capacity)
+    {
+        std::vector<tc::Vector3<float> > corners(capacity * 3);
+        size_t read = 0;
+        size_t count = 0;
+        iterator.begin();
+        while ((count = iterator.nextBatch(&corners[0], capacity)) != 0)
+        {
+            matches = matches && count <= capacity &&
+                      (count == capacity || read + count == triangleCount);
+            for (size_t i = 0; matches && i != count; ++i)
+            {
+                const tc::Triangle& triangle = triangles[read + i];
+                matches = corners[i * 3] == triangle.m_a &&
+                          corners[(i * 3) + 1] == triangle.m_b &&
+                          corners[(i * 3) + 2] == triangle.m_c;
+            }
+            read += count;
+        }
+        iterator.end();
+        matches = matches && read == triangleCount;
+    }
+    TC_IS(logContext, matches);
+
+    // A batch carries on from the triangle next moved onto.
+    iterator.begin();
+    TC_IS(logContext, iterator.next());
+    tc::Vector3<float> corners[2 * 3];
+    TC_IS(logContext, iterator.nextBatch(corners, 2) == 2);
+    TC_IS(logContext, corners[0] == triangles[1].m_a &&
+                          corners[5] == triangles[2].m_c);
+    iterator.end();
+
+    // The size of the iteration isn't known.
+    TC_IS(logContext, iterator.sizeHint() == 0);
+    /// [test_triangleIterator nextBatch]
+}
+
+}  // namespace
+
+//------------------------------------------------------------------------------
+void tc::triangleIteratorRunUnitTests(const tc::LogContext& logContext)
+{
+    nextBatch(logContext);
+}
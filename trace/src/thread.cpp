@@ -5,6 +5,7 @@
 //------------------------------------------------------------------------------
 #include "trace/assert.h"
 #include <pthread.h>
+#include <sched.h>
 #include <unistd.h>
 #include <vector>
 
@@ -18,6 +19,12 @@ size_t getNumProcs()
     return sysconf(_SC_NPROCESSORS_CONF);
 }
 
+//------------------------------------------------------------------------------
+void yieldThread()
+{
+    sched_yield();
+}
+
 //------------------------------------------------------------------------------
 // Thread
 //------------------------------------------------------------------------------